@@ -24,6 +24,7 @@
 
 /* for uint64_t, but not in swig */
 #ifndef SWIGIMPORTED
+# include <stddef.h>
 /* with autotools you get better int types, esp. on 64bit */
 # ifdef HAVE_STDINT_H
 #  include <stdint.h>
@@ -316,7 +317,9 @@ typedef struct _dwg_color /* CmColor: R15 and earlier */
 {
   unsigned int index;
   long unsigned int rgb;
-  unsigned char flag;    /* 1: name follows, 2: book name follows */
+  unsigned char flag;    /* 1: name follows, 2: book name follows.
+                            Entities since R2004: 0x80 rgb, 0x40 color
+                            book handle, 0x20 transparency follow */
   char* name;
   char* book_name;
   unsigned char transparency_type; /* 0 BYLAYER, 1 BYBLOCK, 3 alpha in the last byte */
@@ -333,7 +336,9 @@ struct _dwg_binary_chunk
 };
 
 /**
- Struct for result buffers
+ Struct for result buffers.
+ The xdata of an XRECORD is a list chained by next. A decoded one is
+ also an array of num_eed resbufs.
  */
 typedef struct _dwg_resbuf
 {
@@ -1350,7 +1355,7 @@ typedef struct _dwg_entity_3DSOLID
   BITCODE_BS version;
   BITCODE_BL num_blocks;
   BITCODE_BL* block_size;
-  BITCODE_RC** sat_data;
+  BITCODE_RC** sat_data;  /* the obfuscated blocks, in one buffer */
   BITCODE_RC* acis_data;
   BITCODE_B wireframe_data_present;
   BITCODE_B point_present;
@@ -1366,7 +1371,7 @@ typedef struct _dwg_entity_3DSOLID
   BITCODE_BL unknown_2007;
   BITCODE_H history_id;
   BITCODE_B ACIS_empty_bit;
-  unsigned char* raw_sat_data;
+  unsigned char* raw_sat_data; /* NULL until dwg_decode_sat_data */
 } Dwg_Entity_3DSOLID;
 
 /**
@@ -2329,7 +2334,7 @@ typedef struct _dwg_object_XRECORD
 {
   BITCODE_BL num_databytes;
   BITCODE_BS cloning_flags;
-  unsigned int num_eed;
+  unsigned int num_eed; /* number of xdata items */
   Dwg_Resbuf* xdata;
   BITCODE_H parenthandle;
   BITCODE_H* reactors;
@@ -3806,10 +3811,12 @@ typedef struct _dwg_object_object
   } tio;
 
   BITCODE_RL bitsize;
-  long unsigned int datpos; /* the data stream offset */
   /* Dwg_Handle handle; */
+  /* num_eed and eed at the same offset as in Dwg_Object_Entity, for the
+     shared EED code. datpos was before them until 0.0x, an ABI change. */
   unsigned int num_eed;
   Dwg_Eed *eed;
+  long unsigned int datpos; /* the data stream offset */
 
   /* TODO: should these be removed? */
   BITCODE_BL num_reactors;      /* r13-r14 */
@@ -3833,6 +3840,9 @@ typedef struct _dwg_object
   BITCODE_B  has_strings;       /* r2007+ */
   BITCODE_RL stringstream_size; /* r2007+ in bits, unused */
   BITCODE_MC handlestream_size; /* r2010+ in bits */
+  BITCODE_B  handles_deferred;  /* r2007+ see dwg_decode_handles */
+  BITCODE_B  strings_deferred;  /* r2007+ see dwg_decode_strings */
+  BITCODE_B  eed_deferred;      /* see dwg_decode_eed_data */
 
   Dwg_Object_Supertype supertype;
   union
@@ -3849,6 +3859,18 @@ typedef struct _dwg_object
   struct _dwg_struct *parent;
 } Dwg_Object;
 
+/**
+ The fields of a Dwg_Object which scans need, see dwg_object_index().
+ 16 bytes instead of the whole object.
+ */
+typedef struct _dwg_object_index
+{
+  long unsigned int handle; /* absolute */
+  unsigned int index;       /* into dwg->object */
+  unsigned short type;
+  unsigned char supertype;  /* Dwg_Object_Supertype */
+} Dwg_Object_Index;
+
 /**
  Struct for classes
  */
@@ -3928,6 +3950,15 @@ typedef enum DWG_SECTION_TYPE_R11 /* tables */
   SECTION_VP_ENT_HDR = 11,
 } Dwg_Section_Type_r11;
 
+/* Codes of the preview images in the AcDb:Preview directory */
+typedef enum DWG_PREVIEW_TYPE
+{
+  DWG_PREVIEW_NONE = 0,
+  DWG_PREVIEW_BMP = 2,
+  DWG_PREVIEW_WMF = 3,
+  DWG_PREVIEW_PNG = 6,
+} Dwg_Preview_Type;
+
 typedef struct _dwg_section
 {
   long number; /* preR13: count of entries */
@@ -3976,6 +4007,137 @@ typedef struct
   Dwg_Section **sections;
 } Dwg_Section_Info;
 
+/**
+ Streaming decode, see dwg_stream()
+ */
+typedef enum DWG_STREAM_ACTION
+{
+  DWG_STREAM_FREE = 0, /* release the object after the callback */
+  DWG_STREAM_KEEP = 1  /* keep it in dwg->object until dwg_free */
+} Dwg_Stream_Action;
+
+typedef struct _dwg_stream_callbacks
+{
+  /* Called right after each object is decoded, returns a
+     Dwg_Stream_Action. Handle references are not resolved yet, use
+     their absolute_ref. Table objects are always kept. */
+  int (*object) (Dwg_Object *obj, void *userdata);
+} Dwg_Stream_Callbacks;
+
+/**
+ Decode statistics, see Dwg_Data.stats
+ */
+typedef enum DWG_STATS_PHASE
+{
+  DWG_PHASE_READ = 0,   /* opening, mapping or reading the input */
+  DWG_PHASE_SECTIONS,   /* file header, section and object maps */
+  DWG_PHASE_DECOMPRESS, /* R2004+ section pages */
+  DWG_PHASE_CLASSES,
+  DWG_PHASE_HEADER,     /* header variables */
+  DWG_PHASE_OBJECTS,
+  DWG_PHASE_HANDLES,    /* resolving the handle references */
+  DWG_PHASE_FREE,
+  DWG_NUM_PHASES
+} Dwg_Stats_Phase;
+
+typedef struct _dwg_stats_time
+{
+  double wall; /* seconds */
+  double cpu;  /* seconds of the decoding thread */
+} Dwg_Stats_Time;
+
+typedef struct _dwg_stats_count
+{
+  long unsigned int count;
+  long unsigned int bytes;
+  Dwg_Stats_Time time;
+} Dwg_Stats_Count;
+
+#define DWG_STATS_SECTIONS 32  /* by Dwg_Section_Type */
+#define DWG_STATS_TYPES 1024   /* by object type, the last one for all above */
+
+/* Set Dwg_Data.stats to a zeroed Dwg_Stats, and DWG_OPTS_STATS, before
+   dwg_read_file() and the like. The times of the phases exclude each
+   other. All counts add up over several drawings. */
+typedef struct _dwg_stats
+{
+  Dwg_Stats_Time phase[DWG_NUM_PHASES];
+  Dwg_Stats_Count section[DWG_STATS_SECTIONS]; /* pages decompressed */
+  Dwg_Stats_Count type[DWG_STATS_TYPES];       /* objects decoded */
+  long unsigned int refs;        /* handle references created */
+  long unsigned int allocations; /* of decoded data */
+  /* internal */
+  int running; /* the current phase + 1, or 0 */
+  Dwg_Stats_Time since;
+} Dwg_Stats;
+
+/**
+ Log sink, see dwg_set_log_sink(). Receives whole lines of one thread,
+ msg is NUL-terminated. level is the most severe DWG_LOGLEVEL_* of them.
+ */
+typedef void (*Dwg_Log_Sink) (int level, const char *msg, size_t len,
+                              void *userdata);
+
+/**
+ Deduplicated strings, see DWG_OPTS_INTERN and dwg_intern_new().
+ */
+typedef struct _dwg_intern Dwg_Intern;
+
+/**
+ State of dwg_first_owned() and dwg_next_owned(), owned by the caller.
+ */
+typedef struct _dwg_owned_iterator
+{
+  const Dwg_Object *owner;
+  const Dwg_Object *current;
+} Dwg_Owned_Iterator;
+
+/**
+ A rectangle in the XY plane of the WCS, see dwg_spatial_query().
+ */
+typedef struct _dwg_bbox
+{
+  double xmin;
+  double ymin;
+  double xmax;
+  double ymax;
+} Dwg_BBox;
+
+/**
+ Bits in Dwg_Data.opts
+ */
+#define DWG_OPTS_LOGLEVEL   0xf
+/* Read the whole object map first, and decode the objects in ascending
+   file offset. dwg->object stays in handle order. R2004+ objects are
+   decompressed page by page then, not as a whole section. */
+#define DWG_OPTS_SEQUENTIAL 0x10
+/* R2007+: skip the handle stream of each object but the tables. Its
+   handle fields stay NULL until dwg_decode_handles() reads them. */
+#define DWG_OPTS_LAZY_HANDLES 0x20
+/* R2007+: skip the strings of each object but the tables. Its text
+   fields stay NULL until dwg_decode_strings() reads them. */
+#define DWG_OPTS_LAZY_STRINGS 0x40
+/* Keep the EED of each object as raw blocks only. Its items are parsed
+   by dwg_decode_eed_data(), which dwg_ent_get_eed() calls. */
+#define DWG_OPTS_LAZY_EED   0x80
+/* The input of dwg_read_memory() outlives the drawing. Byte-aligned
+   binary data (the preview, pictures, OLE data, unknown objects) of
+   uncompressed sections then points into it, instead of being copied.
+   See dwg_detach(). */
+#define DWG_OPTS_ZERO_COPY  0x100
+/* Collect decode statistics into Dwg_Data.stats, which is kept by
+   dwg_read_file() and the like only with this bit. */
+#define DWG_OPTS_STATS      0x200
+/* Store each distinct text field up to 256 bytes and class DXF name
+   once, in Dwg_Data.intern, so equal names are the same pointer. Set
+   intern to a table of dwg_intern_new() to share it by a batch of
+   drawings, else one is created and freed with the drawing. Interned
+   strings must not be changed or freed. */
+#define DWG_OPTS_INTERN     0x400
+/* Build the spatial index of each BLOCK_HEADER after decoding, see
+   dwg_spatial_query(). Else its first query builds it. */
+#define DWG_OPTS_SPATIAL    0x800
+
 /**
  Main DWG struct
  */
@@ -4121,7 +4283,25 @@ typedef struct _dwg_struct
 
   long unsigned int measurement;
   unsigned int layout_number;
-  unsigned int opts; /* 0xf: loglevel, ... */
+  unsigned int opts; /* DWG_OPTS_*, 0xf: loglevel */
+  void *arena; /* decoded objects, strings and vectors, see dwg_alloc */
+  Dwg_Stream_Callbacks *callbacks; /* dwg_stream only */
+  void *userdata;
+  unsigned char *objects_section; /* kept for DWG_OPTS_LAZY_* */
+  long unsigned int objects_section_size;
+  const unsigned char *input; /* caller-owned, with DWG_OPTS_ZERO_COPY */
+  long unsigned int input_size;
+  Dwg_Stats *stats; /* caller-owned, with DWG_OPTS_STATS */
+  long unsigned int num_alloced_objects; /* of object, grown in chunks */
+  Dwg_Object_Index *object_index; /* see dwg_object_index */
+  long unsigned int num_indexed_objects;
+  Dwg_Intern *intern; /* with DWG_OPTS_INTERN */
+  int intern_owned;   /* created by the decoder, freed by dwg_free */
+  void *owner_index;  /* see dwg_owner_index */
+  void *type_index;   /* see dwg_objects_of_type */
+  void *layer_index;  /* see dwg_find_layer */
+  void *spatial_index; /* see dwg_spatial_query */
+  void *index_lock;    /* builds the indices above on first use */
 } Dwg_Data;
 
 /*--------------------------------------------------
@@ -4131,6 +4311,93 @@ typedef struct _dwg_struct
 int
 dwg_read_file(char *filename, Dwg_Data * dwg);
 
+int
+dwg_read_memory(const void *buf, size_t size, Dwg_Data * dwg);
+
+int
+dwg_read_fd(int fd, Dwg_Data * dwg);
+
+int
+dwg_stream(char *filename, Dwg_Stream_Callbacks *callbacks, void *userdata);
+
+int
+dwg_detach(Dwg_Data *dwg);
+
+void
+dwg_set_log_sink(Dwg_Log_Sink sink, void *userdata);
+
+void
+dwg_log_flush(void);
+
+const char *
+dwg_type_name(const Dwg_Data *dwg, unsigned int type);
+
+const Dwg_Object_Index *
+dwg_object_index(Dwg_Data *dwg);
+
+Dwg_Intern *
+dwg_intern_new(void);
+
+void
+dwg_intern_free(Dwg_Intern *intern);
+
+const char *
+dwg_intern(Dwg_Intern *intern, const char *str);
+
+int
+dwg_owner_index(Dwg_Data *dwg);
+
+Dwg_Object *
+dwg_first_owned(const Dwg_Object *owner, Dwg_Owned_Iterator *iter);
+
+Dwg_Object *
+dwg_next_owned(Dwg_Owned_Iterator *iter);
+
+const unsigned int *
+dwg_objects_of_type(Dwg_Data *dwg, unsigned int type, unsigned int *num);
+
+const unsigned int *
+dwg_block_objects_of_type(Dwg_Object *block, unsigned int type,
+                          unsigned int *num);
+
+Dwg_Object *
+dwg_find_layer(Dwg_Data *dwg, const char *name);
+
+const unsigned int *
+dwg_layer_entities(Dwg_Object *layer, unsigned int *num);
+
+const unsigned int *
+dwg_block_layer_entities(Dwg_Object *block, Dwg_Object *layer,
+                         unsigned int *num);
+
+int
+dwg_entity_bbox(Dwg_Object *obj, Dwg_BBox *bbox);
+
+int
+dwg_spatial_index(Dwg_Data *dwg);
+
+long unsigned int
+dwg_spatial_query(Dwg_Object *block, const Dwg_BBox *window,
+                  unsigned int *objects, long unsigned int max);
+
+int
+dwg_spatial_write(Dwg_Data *dwg, const char *filename);
+
+int
+dwg_spatial_read(Dwg_Data *dwg, const char *filename);
+
+int
+dwg_decode_handles(Dwg_Object *obj);
+
+int
+dwg_decode_strings(Dwg_Object *obj);
+
+int
+dwg_decode_eed_data(Dwg_Object *obj);
+
+int
+dwg_decode_sat_data(Dwg_Entity_3DSOLID *_obj);
+
 #ifdef USE_WRITE
 int
 dwg_write_file(char *filename, Dwg_Data * dwg_data);
@@ -4139,6 +4406,14 @@ dwg_write_file(char *filename, Dwg_Data * dwg_data);
 unsigned char*
 dwg_bmp(Dwg_Data *, BITCODE_RL *);
 
+unsigned char*
+dwg_read_preview(char *filename, unsigned int opts, Dwg_Preview_Type *type,
+                 BITCODE_RL *size);
+
+unsigned char*
+dwg_read_preview_buffer(unsigned char *buf, long unsigned int bufsize,
+                        unsigned int opts, Dwg_Preview_Type *type, BITCODE_RL *size);
+
 double
 dwg_model_x_min(Dwg_Data *);
 double
@@ -4190,6 +4465,9 @@ dwg_next_object(Dwg_Object* obj);
 Dwg_Object*
 dwg_ref_get_object(Dwg_Object_Ref* ref);
 
+int
+dwg_text_utf8(Dwg_Object *obj, char **text, char *buf, size_t size);
+
 Dwg_Object*
 get_first_owned_object(Dwg_Object* hdr_obj, Dwg_Object_BLOCK_HEADER* hdr);
 
@@ -4202,6 +4480,15 @@ dwg_section_type(DWGCHAR *wname);
 void
 dwg_free(Dwg_Data * dwg);
 
+/* Memory owned by the drawing, zeroed. Use it for data set into decoded
+   objects, as decoded fields must not be passed to free() or realloc().
+   It is released by dwg_free. */
+void *
+dwg_alloc(Dwg_Data *dwg, size_t size);
+
+void *
+dwg_realloc(Dwg_Data *dwg, void *ptr, size_t oldsize, size_t size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -56,32 +56,26 @@ typedef struct dwg_lwpline_widths
 #define GET_DWG_ENTITY_DECL(token) \
 Dwg_Entity_##token **dwg_get_##token (Dwg_Object_Ref * ref);
 
+/* one allocation from the type index, NULL-terminated */
 #define GET_DWG_ENTITY(token) \
 Dwg_Entity_##token **dwg_get_##token (Dwg_Object_Ref * ref) \
 { \
-  int x=0, counts=0; \
+  unsigned int x, n = 0, counts; \
   Dwg_Entity_##token ** ret_##token; \
-  Dwg_Object_BLOCK_HEADER *hdr = ref->obj->tio.object->tio.BLOCK_HEADER; \
-  Dwg_Object * obj = get_first_owned_object(ref->obj, hdr); \
-  while (obj) \
-    { \
-      if (obj->type == DWG_TYPE_##token) \
-        counts++; \
-      obj = get_next_owned_object(ref->obj, obj, hdr); \
-    } \
+  const unsigned int *objects = dwg_block_objects_of_type(ref->obj, \
+      DWG_TYPE_##token, &counts); \
   if (!counts) \
     return NULL; \
-  ret_##token = (Dwg_Entity_##token **)malloc (counts * sizeof(Dwg_Entity_##token *));\
-  obj = get_first_owned_object(ref->obj, hdr); \
-  while (obj) \
+  ret_##token = (Dwg_Entity_##token **)malloc ((counts + 1) * sizeof(Dwg_Entity_##token *));\
+  if (!ret_##token) \
+    return NULL; \
+  for (x = 0; x < counts; x++) \
     { \
-      if(obj->type == DWG_TYPE_##token) \
-        { \
-          ret_##token[x] = obj->tio.entity->tio.token; \
-          x++; \
-        } \
-        obj = get_next_owned_object(ref->obj, obj, hdr); \
+      Dwg_Object *obj = &ref->obj->parent->object[objects[x]]; \
+      if (obj->supertype == DWG_SUPERTYPE_ENTITY && obj->tio.entity) \
+        ret_##token[n++] = obj->tio.entity->tio.token; \
     } \
+  ret_##token[n] = NULL; \
   return ret_##token; \
 }
 
@@ -3081,6 +3075,9 @@ dwg_ent_3dsolid_get_block_size(dwg_ent_3dsolid *_3dsolid, int *error);
 char *
 dwg_ent_3dsolid_get_acis_data(dwg_ent_3dsolid *_3dsolid, int *error);
 
+char *
+dwg_ent_3dsolid_get_raw_sat_data(dwg_ent_3dsolid *_3dsolid, int *error);
+
 void
 dwg_ent_3dsolid_set_acis_data(dwg_ent_3dsolid *_3dsolid, char *data,
                               int *error);
@@ -3174,6 +3171,9 @@ dwg_ent_region_get_block_size(dwg_ent_region *region, int *error);
 char *
 dwg_ent_region_get_acis_data(dwg_ent_region *region, int *error);
 
+char *
+dwg_ent_region_get_raw_sat_data(dwg_ent_region *region, int *error);
+
 void
 dwg_ent_region_set_acis_data(dwg_ent_region *region, char *data, int *error);
 
@@ -3263,6 +3263,9 @@ dwg_ent_body_get_block_size(dwg_ent_body *body, int *error);
 char *
 dwg_ent_body_get_acis_data(dwg_ent_body *body, int *error);
 
+char *
+dwg_ent_body_get_raw_sat_data(dwg_ent_body *body, int *error);
+
 void
 dwg_ent_body_set_acis_data(dwg_ent_body *body, char *data, int *error);
 
@@ -3944,6 +3947,10 @@ dwg_ent_get_eed(dwg_obj_ent *ent, unsigned int index, int *error);
 dwg_entity_eed_data *
 dwg_ent_get_eed_data(dwg_obj_ent *ent, unsigned int index, int *error);
 
+dwg_entity_eed *
+dwg_ent_get_eed_appid(dwg_obj_ent *ent, dwg_object *appid,
+                      unsigned int *index, int *error);
+
 BITCODE_B
 dwg_ent_get_picture_exists(dwg_obj_ent *ent, int *error);
 
@@ -4074,6 +4081,10 @@ dwg_obj_get_eed(dwg_obj_obj *obj, int index, int *error);
 dwg_entity_eed_data *
 dwg_obj_get_eed_data(dwg_obj_obj *obj, int index, int *error);
 
+dwg_entity_eed *
+dwg_obj_get_eed_appid(dwg_obj_obj *obj, dwg_object *appid,
+                      unsigned int *index, int *error);
+
 BITCODE_B
 dwg_obj_get_picture_exists(dwg_object *obj, int *error);
 
@@ -101,21 +101,20 @@ create_postscript(Dwg_Data *dwg, char *output)
   PS_lineto(ps, H, 0);
   PS_stroke(ps);
 
-  /* Iterate all entities
+  /* Iterate all entities, over the compact index
    */
   Dwg_Object *obj;
-  for (i = 0; i < dwg->num_objects; i++)
+  const Dwg_Object_Index *index = dwg_object_index(dwg);
+  for (i = 0; index && i < dwg->num_objects; i++)
     {
-      obj = &dwg->object[i];
-      if (obj->supertype == DWG_SUPERTYPE_UNKNOWN) // unknown
-        continue;
-      if (obj->type == DWG_SUPERTYPE_OBJECT) // not entity
+      if (index[i].supertype != DWG_SUPERTYPE_ENTITY)
         continue;
       //if (obj->tio.entity->entity_mode == 0) // belongs to block
       //  continue;
-      if (obj->type == DWG_TYPE_LINE)
+      if (index[i].type == DWG_TYPE_LINE)
         {
           Dwg_Entity_LINE* line;
+          obj = &dwg->object[index[i].index];
           line = obj->tio.entity->tio.LINE;
           PS_moveto(ps, line->start.x, line->start.y);
           PS_lineto(ps, line->end.x, line->end.y);
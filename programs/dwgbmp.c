@@ -40,8 +40,9 @@ static int opt_version(void) {
 }
 static int help(void) {
   printf("\nUsage: dwgbmp [OPTION]... DWGFILE [BMPFILE]\n");
-  printf("Extract the DWG preview image as BMP.\n");
-  printf("Default BMPFILE: DWGFILE with .bmp extension.\n"
+  printf("Extract the DWG preview image as BMP, or as PNG or WMF if the DWG\n"
+         "has no BMP preview. The drawing itself is not decoded.\n");
+  printf("Default BMPFILE: DWGFILE with .bmp, .png or .wmf extension.\n"
          "\n");
   printf("  -v[0-9], --verbose [0-9]  verbosity\n");
   printf("           --help           display this help and exit\n");
@@ -51,78 +52,93 @@ static int help(void) {
   return 0;
 }
 
+static void
+write_le32(unsigned char *p, unsigned long v)
+{
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  p[2] = (v >> 16) & 0xff;
+  p[3] = (v >> 24) & 0xff;
+}
+
 static int
 get_bmp(char *dwgfile, char *bmpfile, unsigned int opts)
 {
   unsigned char *data;
-  int success;
+  Dwg_Preview_Type type;
   BITCODE_RL size;
   size_t retval;
   FILE *fh;
-  Dwg_Data dwg;
-  struct _BITMAP_HEADER
-  {
-    char magic[2];
-    long file_size;
-    long reserved;
-    long offset;
-  } bmp_h;
-
-  dwg.opts = opts;
-  /* Read dwg data */
-  success = dwg_read_file(dwgfile, &dwg);
-  if (success != 0) {
-    fprintf(stderr, "Unable to read file %s\n", dwgfile);
-    return success;
-  }
-
-  /* Get DIB bitmap data */
-  data = dwg_bmp(&dwg, &size);
+  /* BITMAPFILEHEADER: magic, file size, reserved, offset to the bits */
+  unsigned char bmp_h[14];
 
+  /* Read only the preview, not the drawing */
+  data = dwg_read_preview(dwgfile, opts, &type, &size);
   if (!data) {
     fprintf(stderr, "No thumb in dwg file\n");
+    free (bmpfile);
     return 0;
   }
+  if (!bmpfile) /* name non-BMP previews by their format */
+    bmpfile = suffix (dwgfile, type == DWG_PREVIEW_PNG ? "png"
+                               : type == DWG_PREVIEW_WMF ? "wmf" : "bmp");
   if (size < 1) {
     fprintf(stderr, "Empty thumb data in dwg file\n");
+    free (data);
+    free (bmpfile);
     return -3;
   }
 
-  fh = fopen (bmpfile, "w");
+  fh = fopen (bmpfile, "wb");
   if (!fh) {
     fprintf(stderr, "Unable to write BMP file '%s'\n", bmpfile);
+    free (data);
     free (bmpfile);
     return -4;
   }
 
-  /* Write bmp file header */
-  bmp_h.magic[0] = 'B';
-  bmp_h.magic[1] = 'M';
-  bmp_h.file_size = 14 + size; // file header + DIB data
-  bmp_h.reserved = 0;
-  bmp_h.offset = 14 + 40 + 4 * 256; // file header + DIB header + color table
-  retval = fwrite(&bmp_h.magic[0], 2, sizeof(char), fh);
-  if (!retval) {
-    perror("writing BMP magic"); return 1;
-  }
-  retval = fwrite(&bmp_h.file_size, 3, sizeof(long), fh);
-  if (!retval) {
-    free (bmpfile);
-    perror("writing BMP file_size"); return 1;
-  }
+  if (type == DWG_PREVIEW_BMP && size >= 40)
+    {
+      /* The DIB has no file header. The bits follow the DIB header
+         and the color table. */
+      unsigned long colors = data[32] | (data[33] << 8)
+        | (data[34] << 16) | ((unsigned long)data[35] << 24);
+      unsigned bitcount = data[14] | (data[15] << 8);
+      unsigned long dib_size = data[0] | (data[1] << 8)
+        | (data[2] << 16) | ((unsigned long)data[3] << 24);
+
+      if (!colors && bitcount <= 8)
+        colors = 1UL << bitcount;
+      bmp_h[0] = 'B';
+      bmp_h[1] = 'M';
+      write_le32(&bmp_h[2], 14 + size); // file header + DIB data
+      write_le32(&bmp_h[6], 0);
+      write_le32(&bmp_h[10], 14 + dib_size + 4 * colors);
+      retval = fwrite(bmp_h, 1, sizeof(bmp_h), fh);
+      if (retval != sizeof(bmp_h)) {
+        perror("writing BMP file header");
+        fclose(fh);
+        free (data);
+        free (bmpfile);
+        return 1;
+      }
+    }
 
-  /* Write data (DIB header + bitmap) */
+  /* Write data (DIB header + bitmap, or the WMF or PNG as is) */
   retval = fwrite(data, 1, size, fh);
-  if (!retval) {
+  if (retval != size) {
+    perror("writing preview data");
+    fclose(fh);
+    free (data);
     free (bmpfile);
-    perror("writing BMP header"); return 1;
+    return 1;
   }
   fclose(fh);
 
   printf ("Success. Written preview image to '%s'\n", bmpfile);
+  free (data);
   free (bmpfile);
-  dwg_free(&dwg);
-  return success;
+  return 0;
 }
 
 int
@@ -152,7 +168,7 @@ main (int argc, char *argv[])
   REQUIRE_INPUT_FILE_ARG (argc);
 
   dwgfile = argv[i];
-  bmpfile = suffix (dwgfile, "bmp");
+  bmpfile = argc > 2 ? strdup (argv[i + 1]) : NULL;
   return get_bmp (dwgfile, bmpfile, opts);
 }
 
@@ -20,6 +20,8 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "../src/config.h"
 
 #include <dwg.h>
@@ -29,9 +31,10 @@ int verbosity(int argc, char **argv, int i, unsigned int *opts);
 #include "common.inc"
 static char *fmt = NULL;
 static char *outfile = NULL;
+static int stats = 0;
 
 static int usage(void) {
-  printf("\nUsage: dwgread [-v[0-9]] [-O FMT] [-o OUTFILE] DWGFILE\n");
+  printf("\nUsage: dwgread [-v[0-9]] [-O FMT] [-o OUTFILE] [--stats] DWGFILE\n");
   return 1;
 }
 static int opt_version(void) {
@@ -45,6 +48,7 @@ static int help(void) {
   printf("  -v[0-9], --verbose [0-9]  verbosity\n");
   printf("  -O fmt,  --format fmt     fmt: JSON, YAML, XML, DXF, DXFB\n");
   printf("  -o outfile                \n");
+  printf("           --stats          print decode times and counts as JSON\n");
   printf("           --help           display this help and exit\n");
   printf("           --version        output version information and exit\n"
          "\n");
@@ -52,13 +56,62 @@ static int help(void) {
   return 0;
 }
 
+static const char *phase_names[DWG_NUM_PHASES] = {
+  "read", "sections", "decompress", "classes",
+  "header", "objects", "handles", "free"
+};
+
+static void
+print_count(const Dwg_Stats_Count *count)
+{
+  printf("\"count\": %lu, \"bytes\": %lu, \"wall\": %.6f, \"cpu\": %.6f }",
+         count->count, count->bytes, count->time.wall, count->time.cpu);
+}
+
+/* names are the object type names, kept before dwg_free */
+static void
+print_stats(const Dwg_Stats *s, char **names)
+{
+  const char *sep = "";
+  int i;
+
+  printf("{\n  \"phases\": {");
+  for (i = 0; i < DWG_NUM_PHASES; i++)
+    printf("%s\n    \"%s\": { \"wall\": %.6f, \"cpu\": %.6f }",
+           i ? "," : "", phase_names[i], s->phase[i].wall, s->phase[i].cpu);
+  printf("\n  },\n  \"sections\": [");
+  for (i = 0; i < DWG_STATS_SECTIONS; i++)
+    {
+      if (!s->section[i].count)
+        continue;
+      printf("%s\n    { \"type\": %d, ", sep, i);
+      print_count(&s->section[i]);
+      sep = ",";
+    }
+  printf("\n  ],\n  \"types\": [");
+  sep = "";
+  for (i = 0; i < DWG_STATS_TYPES; i++)
+    {
+      if (!s->type[i].count)
+        continue;
+      printf("%s\n    { \"type\": %d, \"name\": \"%s\", ", sep, i,
+             names[i] ? names[i] : "");
+      print_count(&s->type[i]);
+      sep = ",";
+    }
+  printf("\n  ],\n  \"refs\": %lu,\n  \"allocations\": %lu\n}\n",
+         s->refs, s->allocations);
+}
+
 int
 main(int argc, char *argv[])
 {
   unsigned int opts = 1; //loglevel 1
-  int i = 1;
+  int i = 1, j;
   int error;
   Dwg_Data dwg;
+  Dwg_Stats dwg_stats;
+  char **names = NULL;
 
   if (argc < 2)
     {
@@ -93,6 +146,12 @@ main(int argc, char *argv[])
       argc -= num_args;
       i += num_args;
     }
+  if (argc > 2 && !strcmp(argv[i], "--stats"))
+    {
+      stats = 1;
+      argc--;
+      i++;
+    }
   if (argc > 1 && !strcmp(argv[i], "--help"))
     return help();
   if (argc > 1 && !strcmp(argv[i], "--version"))
@@ -100,15 +159,39 @@ main(int argc, char *argv[])
 
   REQUIRE_INPUT_FILE_ARG (argc);
   dwg.opts = opts;
+  if (stats)
+    {
+      memset(&dwg_stats, 0, sizeof(Dwg_Stats));
+      dwg.opts |= DWG_OPTS_STATS;
+      dwg.stats = &dwg_stats;
+    }
   error = dwg_read_file(argv[i], &dwg);
-  if (!fmt)
+  if (!fmt && !stats)
     {
       if (error)
         printf("\nERROR\n");
       else
         printf("\nSUCCESS\n");
     }
+  if (stats)
+    {
+      /* the class names are freed with dwg */
+      names = (char **)calloc(DWG_STATS_TYPES, sizeof(char *));
+      for (j = 0; names && j < DWG_STATS_TYPES; j++)
+        {
+          const char *name = dwg_type_name(&dwg, j);
+          if (dwg_stats.type[j].count && name)
+            names[j] = strdup(name);
+        }
+    }
   dwg_free(&dwg);
+  if (stats && names)
+    {
+      print_stats(&dwg_stats, names);
+      for (j = 0; j < DWG_STATS_TYPES; j++)
+        free(names[j]);
+      free(names);
+    }
 
   return error;
 }
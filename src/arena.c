@@ -0,0 +1,400 @@
+/*****************************************************************************/
+/*  LibreDWG - free implementation of the DWG file format                    */
+/*                                                                           */
+/*  Copyright (C) 2018 Free Software Foundation, Inc.                        */
+/*                                                                           */
+/*  This library is free software, licensed under the terms of the GNU       */
+/*  General Public License as published by the Free Software Foundation,     */
+/*  either version 3 of the License, or (at your option) any later version.  */
+/*  You should have received a copy of the GNU General Public License        */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.    */
+/*****************************************************************************/
+
+/*
+ * arena.c: per-drawing bump allocator for decoded data.
+ *
+ * All entities, objects, strings, vectors and refs of a decoded drawing
+ * live in a few large zeroed blocks, which dwg_free releases at once.
+ * The typed payloads of the entities and objects are grouped into slabs
+ * per type within these blocks.
+ * Arena memory must not be passed to free() or realloc(); use
+ * dwg_realloc() to resize it.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "intern.h"
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#define ARENA_ALIGN 16
+#define ARENA_MIN_BLOCK (64 * 1024)
+#define SLAB_MIN 8
+#define SLAB_MAX_CHUNK (256 * 1024)
+#define ALIGNED(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define BLOCK_DATA(b) ((char *)(b) + ALIGNED(sizeof(Dwg_Arena_Block)))
+
+/* the arenas of the decoded drawings, for dwg_arena_adopt */
+static Dwg_Arena *decoded_arenas;
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t decoded_lock = PTHREAD_MUTEX_INITIALIZER;
+#define DECODED_LOCK pthread_mutex_lock(&decoded_lock)
+#define DECODED_UNLOCK pthread_mutex_unlock(&decoded_lock)
+#else
+#define DECODED_LOCK
+#define DECODED_UNLOCK
+#endif
+
+static Dwg_Arena_Block *
+arena_new_block(Dwg_Arena *arena, size_t size)
+{
+  Dwg_Arena_Block *block;
+  size_t bsize = arena->total > ARENA_MIN_BLOCK ? arena->total
+                                                : ARENA_MIN_BLOCK;
+
+  if (bsize < size)
+    bsize = ALIGNED(size);
+  /* calloc: large blocks come zeroed from the kernel, untouched pages
+     cost nothing */
+  block = (Dwg_Arena_Block *)calloc(1, ALIGNED(sizeof(Dwg_Arena_Block))
+                                    + bsize);
+  if (!block)
+    return NULL;
+  block->size = bsize;
+  block->next = arena->head;
+  arena->head = block;
+  arena->total += bsize;
+  return block;
+}
+
+static Dwg_Arena *
+arena_new(Dwg_Data *dwg)
+{
+  Dwg_Arena *arena = (Dwg_Arena *)calloc(1, sizeof(Dwg_Arena));
+
+  if (arena)
+    arena->dwg = dwg;
+  dwg->arena = arena;
+  return arena;
+}
+
+/* zeroed memory, owned by the drawing */
+void *
+dwg_arena_calloc(Dwg_Data *dwg, size_t nmemb, size_t size)
+{
+  Dwg_Arena *arena = (Dwg_Arena *)dwg->arena;
+  Dwg_Arena_Block *block;
+  size_t n = nmemb * size;
+  void *ptr;
+
+  if (size && n / size != nmemb)
+    return NULL;
+  if (!arena && !(arena = arena_new(dwg)))
+    return NULL;
+  n = ALIGNED(n ? n : 1);
+  block = arena->head;
+  if (!block || block->used + n > block->size)
+    {
+      block = arena_new_block(arena, n);
+      if (!block)
+        return NULL;
+    }
+  ptr = BLOCK_DATA(block) + block->used;
+  block->used += n;
+  if (dwg->stats)
+    dwg->stats->allocations++;
+  return ptr;
+}
+
+/* A zeroed payload of an object type, next to the previous one of the
+   same type. Falls back to dwg_arena_calloc for a streamed drawing,
+   whose payloads are released after each object, and for a type decoded
+   with another size. */
+void *
+dwg_arena_slab_calloc(Dwg_Data *dwg, unsigned int type, size_t size)
+{
+  Dwg_Arena *arena = (Dwg_Arena *)dwg->arena;
+  Dwg_Arena_Slab *slab;
+  void *ptr;
+
+  if (dwg->callbacks || !size)
+    return dwg_arena_calloc(dwg, 1, size);
+  if (!arena && !(arena = arena_new(dwg)))
+    return NULL;
+  if (type >= arena->num_slabs)
+    {
+      unsigned int num = type + 64;
+      Dwg_Arena_Slab *slabs = (Dwg_Arena_Slab *)realloc(
+          arena->slabs, num * sizeof(Dwg_Arena_Slab));
+      if (!slabs)
+        return dwg_arena_calloc(dwg, 1, size);
+      memset(&slabs[arena->num_slabs], 0,
+             (num - arena->num_slabs) * sizeof(Dwg_Arena_Slab));
+      arena->slabs = slabs;
+      arena->num_slabs = num;
+    }
+  slab = &arena->slabs[type];
+  if (slab->size && slab->size != size)
+    return dwg_arena_calloc(dwg, 1, size);
+  if (!slab->chunk || slab->used == slab->num)
+    {
+      unsigned int num = slab->num ? slab->num * 2 : SLAB_MIN;
+      char *chunk;
+
+      if ((size_t)num * size > SLAB_MAX_CHUNK)
+        num = SLAB_MAX_CHUNK / size ? SLAB_MAX_CHUNK / size : 1;
+      chunk = (char *)dwg_arena_calloc(dwg, num, size);
+      if (!chunk)
+        return NULL;
+      slab->chunk = chunk;
+      slab->size = size;
+      slab->used = 0;
+      slab->num = num;
+    }
+  ptr = slab->chunk + slab->used * size;
+  slab->used++;
+  return ptr;
+}
+
+/* Grows in place if ptr was the last allocation, else copies.
+   Heap memory (not owned by the arena or the input) is realloc'ed. */
+void *
+dwg_arena_realloc(Dwg_Data *dwg, void *ptr, size_t oldsize, size_t size)
+{
+  Dwg_Arena *arena = (Dwg_Arena *)dwg->arena;
+  Dwg_Arena_Block *block;
+  void *new_ptr;
+
+  if (!ptr)
+    return dwg_arena_calloc(dwg, 1, size);
+  if (!dwg_arena_owns(dwg, ptr) && !dwg_input_owns(dwg, ptr)
+      && !dwg_intern_owns(dwg, ptr))
+    return realloc(ptr, size);
+  block = arena ? arena->head : NULL;
+  if (block
+      && (char *)ptr + ALIGNED(oldsize) == BLOCK_DATA(block) + block->used
+      && (char *)ptr >= BLOCK_DATA(block))
+    {
+      size_t used = (char *)ptr - BLOCK_DATA(block);
+      if (used + ALIGNED(size) <= block->size)
+        {
+          if (size < oldsize)
+            memset((char *)ptr + size, 0, oldsize - size);
+          block->used = used + ALIGNED(size ? size : 1);
+          return ptr;
+        }
+    }
+  if (size <= oldsize)
+    return ptr;
+  new_ptr = dwg_arena_calloc(dwg, 1, size);
+  if (new_ptr)
+    memcpy(new_ptr, ptr, oldsize);
+  return new_ptr;
+}
+
+static int
+arena_owns(const Dwg_Arena *arena, const void *ptr)
+{
+  const Dwg_Arena_Block *block;
+
+  for (block = arena->head; block; block = block->next)
+    {
+      if ((const char *)ptr >= BLOCK_DATA(block)
+          && (const char *)ptr < BLOCK_DATA(block) + block->size)
+        return 1;
+    }
+  return 0;
+}
+
+int
+dwg_arena_owns(const Dwg_Data *dwg, const void *ptr)
+{
+  const Dwg_Arena *arena = (const Dwg_Arena *)dwg->arena;
+
+  if (!arena || !ptr)
+    return 0;
+  return arena_owns(arena, ptr);
+}
+
+/* a slice of the input kept for DWG_OPTS_ZERO_COPY */
+int
+dwg_input_owns(const Dwg_Data *dwg, const void *ptr)
+{
+  return dwg->input && (const unsigned char *)ptr >= dwg->input
+         && (const unsigned char *)ptr < dwg->input + dwg->input_size;
+}
+
+/* free() heap memory, leave arena memory to dwg_arena_destroy, input
+   slices to dwg_free and interned strings to their table */
+void
+dwg_arena_free(Dwg_Data *dwg, void *ptr)
+{
+  if (ptr && !(dwg && (dwg_arena_owns(dwg, ptr)
+                       || dwg_input_owns(dwg, ptr)
+                       || dwg_intern_owns(dwg, ptr))))
+    free(ptr);
+}
+
+/* All decoded object memory is allocated from now on, so that dwg_free
+   need not walk the objects. Heap memory set into them later is adopted
+   by the arena instead. */
+void
+dwg_arena_decoded(Dwg_Data *dwg)
+{
+  Dwg_Arena *arena = (Dwg_Arena *)dwg->arena;
+
+  if (!arena || arena->decoded)
+    return;
+  arena->decoded = 1;
+  DECODED_LOCK;
+  arena->next = decoded_arenas;
+  if (decoded_arenas)
+    decoded_arenas->prev = arena;
+  decoded_arenas = arena;
+  DECODED_UNLOCK;
+}
+
+/* Called by the setters with the payload a field is in, its old and its
+   new value. If the payload is in the arena of a decoded drawing, the
+   heap memory in ptr is freed with the arena, and old is handed back to
+   the caller. Memory of any arena, the input or the intern table is not
+   adopted. */
+void
+dwg_arena_adopt(const void *payload, void *old, void *ptr)
+{
+  Dwg_Arena *arena, *owner = NULL;
+  unsigned int i;
+
+  if (!payload || old == ptr)
+    return;
+  DECODED_LOCK;
+  for (arena = decoded_arenas; arena; arena = arena->next)
+    {
+      if (!owner && arena_owns(arena, payload))
+        owner = arena;
+      if (ptr && arena_owns(arena, ptr))
+        ptr = NULL;
+    }
+  if (owner && ptr
+      && (dwg_input_owns(owner->dwg, ptr)
+          || dwg_intern_owns(owner->dwg, ptr)))
+    ptr = NULL;
+  if (!owner)
+    {
+      DECODED_UNLOCK;
+      return;
+    }
+  /* a decoded old value is in the arena, only a replaced one is searched */
+  if (old && !arena_owns(owner, old))
+    for (i = owner->num_adopted; i-- > 0;)
+      {
+        if (owner->adopted[i] == old)
+          {
+            owner->adopted[i] = owner->adopted[--owner->num_adopted];
+            break;
+          }
+      }
+  if (ptr && owner->num_adopted == owner->max_adopted)
+    {
+      unsigned int max = owner->max_adopted ? owner->max_adopted * 2 : 16;
+      void **adopted = (void **)realloc(owner->adopted,
+                                        max * sizeof(void *));
+      if (adopted)
+        {
+          owner->adopted = adopted;
+          owner->max_adopted = max;
+        }
+    }
+  if (ptr && owner->num_adopted < owner->max_adopted)
+    owner->adopted[owner->num_adopted++] = ptr;
+  DECODED_UNLOCK;
+}
+
+void
+dwg_arena_destroy(Dwg_Data *dwg)
+{
+  Dwg_Arena *arena = (Dwg_Arena *)dwg->arena;
+  Dwg_Arena_Block *block, *next;
+  unsigned int i;
+
+  if (!arena)
+    return;
+  if (arena->decoded)
+    {
+      DECODED_LOCK;
+      if (arena->prev)
+        arena->prev->next = arena->next;
+      else
+        decoded_arenas = arena->next;
+      if (arena->next)
+        arena->next->prev = arena->prev;
+      DECODED_UNLOCK;
+    }
+  for (i = 0; i < arena->num_adopted; i++)
+    free(arena->adopted[i]);
+  free(arena->adopted);
+  for (block = arena->head; block; block = next)
+    {
+      next = block->next;
+      free(block);
+    }
+  free(arena->slabs);
+  free(arena);
+  dwg->arena = NULL;
+}
+
+void
+dwg_arena_mark(const Dwg_Data *dwg, Dwg_Arena_Mark *mark)
+{
+  const Dwg_Arena *arena = (const Dwg_Arena *)dwg->arena;
+
+  mark->block = arena ? arena->head : NULL;
+  mark->used = mark->block ? mark->block->used : 0;
+}
+
+/* Drops everything allocated since the mark, zeroed again for reuse.
+   The newest block is kept as spare, so that releasing after every
+   object does not allocate and free a block each time. */
+void
+dwg_arena_release(Dwg_Data *dwg, const Dwg_Arena_Mark *mark)
+{
+  Dwg_Arena *arena = (Dwg_Arena *)dwg->arena;
+  Dwg_Arena_Block *block, *next, *spare = NULL;
+
+  if (!arena)
+    return;
+  /* the chunks may be gone, start new ones */
+  if (arena->slabs)
+    memset(arena->slabs, 0, arena->num_slabs * sizeof(Dwg_Arena_Slab));
+  for (block = arena->head; block && block != mark->block; block = next)
+    {
+      next = block->next;
+      if (!spare)
+        {
+          memset(BLOCK_DATA(block), 0, block->used);
+          block->used = 0;
+          spare = block;
+        }
+      else
+        {
+          arena->total -= block->size;
+          free(block);
+        }
+    }
+  if (mark->block)
+    {
+      memset(BLOCK_DATA(mark->block) + mark->used, 0,
+             mark->block->used - mark->used);
+      mark->block->used = mark->used;
+    }
+  if (spare)
+    {
+      spare->next = mark->block;
+      arena->head = spare;
+    }
+}
@@ -0,0 +1,100 @@
+/*****************************************************************************/
+/*  LibreDWG - free implementation of the DWG file format                    */
+/*                                                                           */
+/*  Copyright (C) 2018 Free Software Foundation, Inc.                        */
+/*                                                                           */
+/*  This library is free software, licensed under the terms of the GNU       */
+/*  General Public License as published by the Free Software Foundation,     */
+/*  either version 3 of the License, or (at your option) any later version.  */
+/*  You should have received a copy of the GNU General Public License        */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.    */
+/*****************************************************************************/
+
+/*
+ * arena.h: per-drawing bump allocator for decoded data
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include "dwg.h"
+
+/* Blocks are chained newest first. Each block is at least as large as
+   all previous blocks together, so there are only a few of them. */
+typedef struct _dwg_arena_block
+{
+  struct _dwg_arena_block *next;
+  size_t size;
+  size_t used;
+} Dwg_Arena_Block;
+
+/* The payloads of one object type in decode order, so that a pass over
+   all LINEs reads them one after another. The chunks come from the arena
+   and double in size. */
+typedef struct _dwg_arena_slab
+{
+  char *chunk;
+  size_t size;       /* of one payload */
+  unsigned int used; /* payloads in chunk */
+  unsigned int num;  /* payloads chunk can hold */
+} Dwg_Arena_Slab;
+
+typedef struct _dwg_arena
+{
+  Dwg_Arena_Block *head;
+  size_t total;
+  Dwg_Arena_Slab *slabs; /* by object type, on the heap */
+  unsigned int num_slabs;
+  /* all decoded object memory was allocated here, so dwg_free need not
+     walk the objects */
+  int decoded;
+  /* heap memory set into decoded objects, freed with the arena */
+  void **adopted;
+  unsigned int num_adopted;
+  unsigned int max_adopted;
+  Dwg_Data *dwg;
+  struct _dwg_arena *prev, *next; /* the other decoded arenas */
+} Dwg_Arena;
+
+/* a position to release the arena back to */
+typedef struct _dwg_arena_mark
+{
+  Dwg_Arena_Block *block;
+  size_t used;
+} Dwg_Arena_Mark;
+
+void *
+dwg_arena_calloc(Dwg_Data *dwg, size_t nmemb, size_t size);
+
+void *
+dwg_arena_slab_calloc(Dwg_Data *dwg, unsigned int type, size_t size);
+
+void *
+dwg_arena_realloc(Dwg_Data *dwg, void *ptr, size_t oldsize, size_t size);
+
+int
+dwg_arena_owns(const Dwg_Data *dwg, const void *ptr);
+
+int
+dwg_input_owns(const Dwg_Data *dwg, const void *ptr);
+
+void
+dwg_arena_free(Dwg_Data *dwg, void *ptr);
+
+void
+dwg_arena_decoded(Dwg_Data *dwg);
+
+void
+dwg_arena_adopt(const void *payload, void *old, void *ptr);
+
+void
+dwg_arena_destroy(Dwg_Data *dwg);
+
+void
+dwg_arena_mark(const Dwg_Data *dwg, Dwg_Arena_Mark *mark);
+
+void
+dwg_arena_release(Dwg_Data *dwg, const Dwg_Arena_Mark *mark);
+
+#endif
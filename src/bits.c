@@ -31,6 +31,8 @@
 #endif
 // else we roll our own, Latin-1 only.
 
+/* the reads here are not counted, see bits.h */
+#define IS_BITS
 #include "logging.h"
 #include "bits.h"
 
@@ -714,6 +716,28 @@ bit_read_MC(Bit_Chain * dat)
   return 0; /* error... */
 }
 
+/** Read 1 unsigned modular char (max 8 bytes), without a sign bit,
+ * as the handle offsets of the object map.
+ */
+long unsigned int
+bit_read_UMC(Bit_Chain * dat)
+{
+  int i, j;
+  unsigned char byte;
+  long unsigned int result = 0;
+
+  for (i = 0, j = 0; i < 8; i++, j += 7)
+    {
+      byte = bit_read_RC(dat);
+      result |= ((long unsigned int)(byte & 0x7f)) << j;
+      if (!(byte & 0x80))
+        return result;
+    }
+
+  LOG_ERROR("bit_read_UMC: error parsing modular char.\n")
+  return 0; /* error... */
+}
+
 /** Write 1 modular char (max 4 bytes).
  */
 void
@@ -163,6 +163,9 @@ bit_write_BD(Bit_Chain * dat, BITCODE_BD value);
 BITCODE_MC
 bit_read_MC(Bit_Chain * dat);
 
+long unsigned int
+bit_read_UMC(Bit_Chain * dat);
+
 void
 bit_write_MC(Bit_Chain * dat, BITCODE_MC value);
 
@@ -270,4 +273,32 @@ bit_explore_chain(Bit_Chain * dat, long unsigned int size);
 BITCODE_BD
 bit_nan(void);
 
+#if defined(LIBREDWG_STATS) && !defined(IS_BITS)
+/* Count the reads of the decoder, but not the nested ones in bits.c.
+   (bit_read_BS)(dat) is not counted either. */
+#include "stats.h"
+#define bit_read_B(dat) (DWG_STATS_PRIM(B, dat), bit_read_B(dat))
+#define bit_read_BB(dat) (DWG_STATS_PRIM(BB, dat), bit_read_BB(dat))
+#define bit_read_3B(dat) (DWG_STATS_PRIM(3B, dat), bit_read_3B(dat))
+#define bit_read_BS(dat) (DWG_STATS_PRIM(BS, dat), bit_read_BS(dat))
+#define bit_read_BL(dat) (DWG_STATS_PRIM(BL, dat), bit_read_BL(dat))
+#define bit_read_BLL(dat) (DWG_STATS_PRIM(BLL, dat), bit_read_BLL(dat))
+#define bit_read_BD(dat) (DWG_STATS_PRIM(BD, dat), bit_read_BD(dat))
+#define bit_read_DD(dat, d) (DWG_STATS_PRIM(DD, dat), bit_read_DD(dat, d))
+#define bit_read_BT(dat) (DWG_STATS_PRIM(BT, dat), bit_read_BT(dat))
+#define bit_read_BE(dat, x, y, z) \
+  (DWG_STATS_PRIM(BE, dat), bit_read_BE(dat, x, y, z))
+#define bit_read_RC(dat) (DWG_STATS_PRIM(RC, dat), bit_read_RC(dat))
+#define bit_read_RS(dat) (DWG_STATS_PRIM(RS, dat), bit_read_RS(dat))
+#define bit_read_RL(dat) (DWG_STATS_PRIM(RL, dat), bit_read_RL(dat))
+#define bit_read_RLL(dat) (DWG_STATS_PRIM(RLL, dat), bit_read_RLL(dat))
+#define bit_read_RD(dat) (DWG_STATS_PRIM(RD, dat), bit_read_RD(dat))
+#define bit_read_MC(dat) (DWG_STATS_PRIM(MC, dat), bit_read_MC(dat))
+#define bit_read_UMC(dat) (DWG_STATS_PRIM(MC, dat), bit_read_UMC(dat))
+#define bit_read_MS(dat) (DWG_STATS_PRIM(MS, dat), bit_read_MS(dat))
+#define bit_read_H(dat, h) (DWG_STATS_PRIM(H, dat), bit_read_H(dat, h))
+#define bit_read_TV(dat) (DWG_STATS_PRIM(TV, dat), bit_read_TV(dat))
+#define bit_read_TU(dat) (DWG_STATS_PRIM(TU, dat), bit_read_TU(dat))
+#endif
+
 #endif
@@ -20,8 +20,15 @@
 
 #include "config.h"
 #include "common.h"
-//#include <stdio.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include "dwg.h"
+#include "logging.h"
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 unsigned char *
 dwg_sentinel(Dwg_Sentinel s)
@@ -127,3 +134,182 @@ Dwg_Version_Type dwg_version_as(const char *version)
   else
     return R_INVALID;
 }
+
+#ifdef USE_TRACING
+/* LIBREDWG_TRACE, or -1 if unset. Read only once, by any thread. */
+static int env_loglevel = -1;
+#ifdef HAVE_PTHREAD_H
+static pthread_once_t env_once = PTHREAD_ONCE_INIT;
+#else
+static int env_var_checked_p;
+#endif
+
+static void
+read_env_loglevel(void)
+{
+  char *probe = getenv ("LIBREDWG_TRACE");
+  if (probe)
+    env_loglevel = atoi (probe);
+}
+#endif  /* USE_TRACING */
+
+/* The logging level of the current decode/encode/free call:
+   the level in opts, overridden by LIBREDWG_TRACE. */
+unsigned int
+dwg_loglevel(unsigned int opts)
+{
+#ifdef USE_TRACING
+#ifdef HAVE_PTHREAD_H
+  pthread_once (&env_once, read_env_loglevel);
+#else
+  if (! env_var_checked_p)
+    {
+      read_env_loglevel ();
+      env_var_checked_p = 1;
+    }
+#endif
+  if (env_loglevel >= 0)
+    return (unsigned int)env_loglevel;
+#endif  /* USE_TRACING */
+  return opts & 0xf;
+}
+
+/* The log sink of all threads, stderr if NULL. The function and its
+   userdata are published together, and a sink once set is kept, as
+   another thread may still be calling it. */
+struct log_sink
+{
+  Dwg_Log_Sink func;
+  void *userdata;
+  struct log_sink *next; /* all sinks set so far */
+};
+static struct log_sink *log_sink;
+static struct log_sink *log_sinks;
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t log_sink_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+#ifdef __GNUC__
+# define LOG_SINK_LOAD() __atomic_load_n(&log_sink, __ATOMIC_ACQUIRE)
+# define LOG_SINK_STORE(sink) \
+  __atomic_store_n(&log_sink, (sink), __ATOMIC_RELEASE)
+#else
+# define LOG_SINK_LOAD() (log_sink)
+# define LOG_SINK_STORE(sink) (log_sink = (sink))
+#endif
+
+/* The unsent log of the current thread: at most one partial line, or
+   a longer message cut at the buffer size. */
+#define LOG_BUFSIZE 1024
+static THREAD_LOCAL struct
+{
+  char buf[LOG_BUFSIZE];
+  size_t size;
+  int level; /* the most severe level of buf */
+} thread_log;
+
+static void
+log_send(size_t len)
+{
+  char c = thread_log.buf[len];
+  const struct log_sink *sink = LOG_SINK_LOAD();
+
+  thread_log.buf[len] = '\0';
+  if (sink)
+    sink->func(thread_log.level, thread_log.buf, len, sink->userdata);
+  else
+    fwrite(thread_log.buf, 1, len, stderr);
+  thread_log.buf[len] = c;
+  thread_log.size -= len;
+  if (thread_log.size)
+    memmove(thread_log.buf, &thread_log.buf[len], thread_log.size);
+}
+
+void
+dwg_log(int level, const char *fmt, ...)
+{
+  va_list ap;
+  size_t size = thread_log.size;
+  size_t room = LOG_BUFSIZE - size;
+  int len;
+
+  va_start(ap, fmt);
+  len = vsnprintf(&thread_log.buf[size], room, fmt, ap);
+  va_end(ap);
+  if (len < 0)
+    return;
+  if ((size_t)len >= room && size)
+    {
+      /* send the pending part first, and append again */
+      thread_log.size = size;
+      log_send(size);
+      room = LOG_BUFSIZE;
+      va_start(ap, fmt);
+      len = vsnprintf(thread_log.buf, room, fmt, ap);
+      va_end(ap);
+      if (len < 0)
+        return;
+      size = 0;
+    }
+  if (!size || level < thread_log.level)
+    thread_log.level = level;
+  if ((size_t)len >= room)
+    {
+      /* too long for the buffer, send it cut */
+      thread_log.size = LOG_BUFSIZE - 1;
+      log_send(thread_log.size);
+      return;
+    }
+  thread_log.size = size + len;
+  /* send all complete lines at once */
+  for (size = thread_log.size; size > 0; size--)
+    if (thread_log.buf[size - 1] == '\n')
+      {
+        log_send(size);
+        /* the rest is of this message only */
+        thread_log.level = level;
+        break;
+      }
+}
+
+/** dwg_log_flush
+ * Sends the last partial line of the current thread to the log sink.
+ */
+void
+dwg_log_flush(void)
+{
+  if (thread_log.size)
+    log_send(thread_log.size);
+}
+
+/** dwg_set_log_sink
+ * Sets the function which receives the log of all threads, line by line.
+ * NULL writes to stderr. Threads which are logging switch to the new
+ * sink with their next line.
+ */
+void
+dwg_set_log_sink(Dwg_Log_Sink func, void *userdata)
+{
+  struct log_sink *sink = NULL;
+
+  dwg_log_flush();
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&log_sink_lock);
+#endif
+  if (func)
+    {
+      for (sink = log_sinks; sink; sink = sink->next)
+        if (sink->func == func && sink->userdata == userdata)
+          break;
+      if (!sink && (sink = (struct log_sink *)calloc(1, sizeof(*sink))))
+        {
+          sink->func = func;
+          sink->userdata = userdata;
+          sink->next = log_sinks;
+          log_sinks = sink;
+        }
+    }
+  LOG_SINK_STORE(sink);
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&log_sink_lock);
+#endif
+}
@@ -72,6 +72,8 @@ extern char version_codes[DWG_VERSIONS][7];
 
 Dwg_Version_Type dwg_version_as(const char *);
 
+unsigned int dwg_loglevel(unsigned int opts);
+
 /**
  Data types (including compressed forms) used through the project
 */
@@ -38,11 +38,12 @@
     }
 
   SINCE(R_2004)
-    { // color book handle
-      FIELD_HANDLE(color_handle, 5, 0);
+    { // color book handle, of an AcDbColor reference
+      if (FIELD_VALUE(color.flag) & 0x40)
+        FIELD_HANDLE(color_handle, 5, 0);
     }
 
-  VERSION(R_2000)
+  SINCE(R_2000)
     {
       FIELD_HANDLE(layer, 5, 8);
       if (FIELD_VALUE(linetype_flags) == 3)
@@ -43,9 +43,18 @@
 #define FIELD_VALUE(name) _obj->name
 
 #define ANYCODE -1
+/* DWG_OPTS_LAZY_HANDLES: skip the handle stream, but not handles in the
+   data stream before it. */
+#define HANDLE_DEFERRED \
+  (obj && obj->handles_deferred && obj->hdlpos && \
+   bit_position(hdl_dat) >= obj->hdlpos)
 #define FIELD_HANDLE(name, handle_code, dxf) \
   { \
-    if (handle_code >= 0) \
+    if (HANDLE_DEFERRED) \
+      {\
+        _obj->name = NULL;\
+      }\
+    else if (handle_code >= 0) \
       {\
         _obj->name = dwg_decode_handleref_with_code(hdl_dat, obj, dwg, handle_code);\
       }\
@@ -64,7 +73,11 @@
   }
 #define FIELD_HANDLE_N(name, vcount, handle_code, dxf)  \
   {\
-    if (handle_code>=0) \
+    if (HANDLE_DEFERRED) \
+      {\
+        _obj->name = NULL;\
+      }\
+    else if (handle_code>=0) \
       {\
         _obj->name = dwg_decode_handleref_with_code(hdl_dat, obj, dwg, handle_code);\
       }\
@@ -107,17 +120,31 @@
 #define FIELD_MC(name,dxf) FIELDG(name, MC, dxf)
 #define FIELD_MS(name,dxf) FIELDG(name, MS, dxf)
 #define FIELD_TF(name,len,dxf) \
-  { _obj->name = bit_read_TF(dat,(int)len); \
+  { _obj->name = dwg_decode_TF(dwg, dat, (long)len); \
+    FIELD_G_TRACE(name, TF, dxf);\
+    LOG_INSANE_TF(FIELD_VALUE(name), (int)len); }
+/* binary data, see dwg_decode_raw */
+#define FIELD_BINARY(name,len,dxf) \
+  { _obj->name = dwg_decode_raw(dwg, dat, (long)len); \
     FIELD_G_TRACE(name, TF, dxf);\
     LOG_INSANE_TF(FIELD_VALUE(name), (int)len); }
 #define FIELD_TFF(name,len,dxf) \
   { bit_read_fixed(dat,_obj->name,(int)len); \
     FIELD_G_TRACE(name, TF, dxf);\
     LOG_INSANE_TF(FIELD_VALUE(name), (int)len); }
-#define FIELD_TV(name,dxf) FIELDG(name, TV, dxf)
+#define FIELD_TV(name,dxf) \
+  { _obj->name = dwg_decode_TV(dwg, dat); \
+    FIELD_G_TRACE(name, TV, dxf); }
+/* DWG_OPTS_LAZY_STRINGS: skip over it, see dwg_decode_strings */
 #define FIELD_TU(name,dxf) \
-  { _obj->name = (char*)bit_read_TU(str_dat); \
-    LOG_TRACE_TU(#name, (BITCODE_TU)FIELD_VALUE(name), dxf); }
+  { if (obj && obj->strings_deferred) { \
+      _obj->name = NULL; \
+      bit_advance_position(str_dat, (long)bit_read_BS(str_dat) * 16); \
+    } else { \
+      _obj->name = (char*)dwg_decode_TU(dwg, str_dat); \
+      LOG_TRACE_TU(#name, (BITCODE_TU)FIELD_VALUE(name), dxf); \
+    } \
+  }
 #define FIELD_T(name,dxf) \
   { if (dat->version < R_2007) { \
       FIELD_TV(name,dxf) \
@@ -153,12 +180,12 @@
   { _obj->name = bit_read_TIMEBLL(dat);                                  \
     LOG_TRACE(#name ": " FORMAT_BL "." FORMAT_BL "\n", _obj->name.days, _obj->name.ms); }
 #define FIELD_CMC(name,dxf) \
-  { bit_read_CMC(dat, &_obj->name); \
+  { dwg_decode_CMC(dwg, dat, &_obj->name); \
     LOG_TRACE(#name ": index %d\n", _obj->name.index); }
 
 #undef DEBUG_HERE
 #define DEBUG_HERE()\
-  if (DWG_LOGLEVEL >= DWG_LOGLEVEL_TRACE) { \
+  if (LOG_ENABLED(TRACE)) { \
     Bit_Chain here = *dat; \
     char *tmp; BITCODE_BB bb; BITCODE_RS rs; BITCODE_RL rl;\
     LOG_TRACE("DEBUG_HERE @%u.%u / 0x%x\n  24RC: ", (unsigned int)dat->byte, dat->bit, \
@@ -202,7 +229,7 @@
 #define FIELD_VECTOR_N(name, type, size, dxf) \
   if (size > 0) \
     { \
-      _obj->name = (BITCODE_##type*) malloc(size * sizeof(BITCODE_##type));\
+      _obj->name = (BITCODE_##type*) dwg_arena_calloc(dwg, size, sizeof(BITCODE_##type));\
       for (vcount=0; vcount<(long)size; vcount++) \
         {\
           _obj->name[vcount] = bit_read_##type(dat); \
@@ -213,15 +240,15 @@
 #define FIELD_VECTOR_T(name, size, dxf) \
   if (_obj->size > 0) \
     { \
-      _obj->name = (char**) malloc(_obj->size * sizeof(char*)); \
+      _obj->name = (char**) dwg_arena_calloc(dwg, _obj->size, sizeof(char*)); \
       for (vcount=0; vcount<(long)_obj->size; vcount++) \
         {\
           PRE (R_2007) { \
-            _obj->name[vcount] = bit_read_TV(dat); \
+            _obj->name[vcount] = dwg_decode_TV(dwg, dat); \
             LOG_INSANE(#name "[%ld]: %s\n", \
                        (long)vcount, _obj->name[vcount]) \
           } LATER_VERSIONS { \
-            _obj->name[vcount] = (char*)bit_read_TU(dat); \
+            _obj->name[vcount] = (char*)dwg_decode_TU(dwg, dat); \
             LOG_TRACE_TU_I(#name, vcount, _obj->name[vcount], dxf) \
           } \
         } \
@@ -230,14 +257,14 @@
 #define FIELD_VECTOR(name, type, size, dxf) FIELD_VECTOR_N(name, type, _obj->size, dxf)
 
 #define FIELD_2RD_VECTOR(name, size, dxf)                                   \
-  _obj->name = (BITCODE_2RD *) malloc(_obj->size * sizeof(BITCODE_2RD));\
+  _obj->name = (BITCODE_2RD *) dwg_arena_calloc(dwg, _obj->size, sizeof(BITCODE_2RD));\
   for (vcount=0; vcount< (long)_obj->size; vcount++)\
     {\
       FIELD_2RD(name[vcount], dxf); \
     }
 
 #define FIELD_2DD_VECTOR(name, size, dxf)                                   \
-  _obj->name = (BITCODE_2RD *) malloc(_obj->size * sizeof(BITCODE_2RD));\
+  _obj->name = (BITCODE_2RD *) dwg_arena_calloc(dwg, _obj->size, sizeof(BITCODE_2RD));\
   FIELD_2RD(name[0], dxf);                                                  \
   for (vcount = 1; vcount < (long)_obj->size; vcount++)\
     {\
@@ -245,14 +272,14 @@
     }
 
 #define FIELD_3DPOINT_VECTOR(name, size, dxf)                               \
-  _obj->name = (BITCODE_3DPOINT *) malloc(_obj->size * sizeof(BITCODE_3DPOINT));\
+  _obj->name = (BITCODE_3DPOINT *) dwg_arena_calloc(dwg, _obj->size, sizeof(BITCODE_3DPOINT));\
   for (vcount=0; vcount < (long)_obj->size; vcount++) \
     {\
       FIELD_3DPOINT(name[vcount], dxf); \
     }
 
 #define HANDLE_VECTOR_N(name, size, code, dxf) \
-  FIELD_VALUE(name) = (BITCODE_H*) malloc(sizeof(BITCODE_H) * size);\
+  FIELD_VALUE(name) = (BITCODE_H*) dwg_arena_calloc(dwg, size, sizeof(BITCODE_H));\
   for (vcount=0; vcount < (long)size; vcount++) \
     {\
       FIELD_HANDLE_N(name[vcount], vcount, code, dxf);  \
@@ -271,17 +298,17 @@
       FIELD_G_TRACE(insert_count, type, dxf)
 
 #define FIELD_XDATA(name, size)\
-  _obj->name = dwg_decode_xdata(dat, _obj, _obj->size)
+  _obj->name = dwg_decode_xdata(dwg, dat, _obj, _obj->size)
 
 #define REACTORS(code)\
-  FIELD_VALUE(reactors) = (BITCODE_H*) malloc(sizeof(BITCODE_H) * obj->tio.object->num_reactors);\
+  FIELD_VALUE(reactors) = (BITCODE_H*) dwg_arena_calloc(dwg, obj->tio.object->num_reactors, sizeof(BITCODE_H));\
   for (vcount=0; vcount < (long)obj->tio.object->num_reactors; vcount++) \
     {\
       FIELD_HANDLE_N(reactors[vcount], vcount, code, -5);  \
     }
 
 #define ENT_REACTORS(code)\
-  FIELD_VALUE(reactors) = (BITCODE_H*) malloc(sizeof(BITCODE_H) * obj->tio.entity->num_reactors);\
+  FIELD_VALUE(reactors) = (BITCODE_H*) dwg_arena_calloc(dwg, obj->tio.entity->num_reactors, sizeof(BITCODE_H));\
   for (vcount=0; vcount < obj->tio.entity->num_reactors; vcount++)\
     {\
       FIELD_HANDLE_N(reactors[vcount], vcount, code, -5);  \
@@ -334,23 +361,23 @@
 
 //TODO unify REPEAT macros
 #define REPEAT_N(times, name, type) \
-  if (times) _obj->name = (type *) calloc(times, sizeof(type)); \
+  if (times) _obj->name = (type *) dwg_arena_calloc(dwg, times, sizeof(type)); \
   for (rcount=0; rcount<(long)times; rcount++)
 
 #define REPEAT(times, name, type) \
-  if (_obj->times) _obj->name = (type *) calloc(_obj->times, sizeof(type)); \
+  if (_obj->times) _obj->name = (type *) dwg_arena_calloc(dwg, _obj->times, sizeof(type)); \
   for (rcount=0; rcount<(long)_obj->times; rcount++)
 
 #define REPEAT2(times, name, type) \
-  if (_obj->times) _obj->name = (type *) calloc(_obj->times, sizeof(type)); \
+  if (_obj->times) _obj->name = (type *) dwg_arena_calloc(dwg, _obj->times, sizeof(type)); \
   for (rcount2=0; rcount2<(long)_obj->times; rcount2++)
 
 #define REPEAT3(times, name, type) \
-  if (_obj->times) _obj->name = (type *) calloc(_obj->times, sizeof(type)); \
+  if (_obj->times) _obj->name = (type *) dwg_arena_calloc(dwg, _obj->times, sizeof(type)); \
   for (rcount3=0; rcount3<(long)_obj->times; rcount3++)
 
 #define REPEAT4(times, name, type) \
-  if (_obj->times) _obj->name = (type *) calloc(_obj->times, sizeof(type)); \
+  if (_obj->times) _obj->name = (type *) dwg_arena_calloc(dwg, _obj->times, sizeof(type)); \
   for (rcount4=0; rcount4<(long)_obj->times; rcount4++)
 
 #define COMMON_ENTITY_HANDLE_DATA \
@@ -359,25 +386,59 @@
     dwg_decode_common_entity_handle_data(dat, hdl_dat, obj); \
   }
 
-#define DWG_ENTITY(token) static void \
-dwg_decode_##token (Bit_Chain* dat, Dwg_Object* obj)\
+#ifdef LIBREDWG_STATS
+/* dwg_decode_<token> counts its calls, bits and ticks, and the body
+   of the spec goes into dwg_decode_<token>_body */
+# define DWG_DECODE_FUNC(token) \
+static void \
+dwg_decode_##token##_body (Bit_Chain* dat, Dwg_Object* obj); \
+static void \
+dwg_decode_##token (Bit_Chain* dat, Dwg_Object* obj) \
+{ \
+  static Dwg_Stats_Func func = { #token }; \
+  unsigned long long ticks = dwg_stats_ticks(); \
+  long pos = (long)bit_position(dat); \
+  dwg_decode_##token##_body(dat, obj); \
+  dwg_stats_func(&func, (long)bit_position(dat) - pos, \
+                 dwg_stats_ticks() - ticks); \
+} \
+static void \
+dwg_decode_##token##_body
+#else
+# define DWG_DECODE_FUNC(token) static void dwg_decode_##token
+#endif
+
+#define DWG_ENTITY(token) DWG_DECODE_FUNC(token) \
+(Bit_Chain* dat, Dwg_Object* obj)\
 {\
   long vcount, rcount, rcount2, rcount3, rcount4;\
   Dwg_Entity_##token *ent, *_obj;\
   Dwg_Object_Entity *_ent;\
   Dwg_Data* dwg = obj->parent;\
   Bit_Chain* hdl_dat = dat; \
-  Bit_Chain* str_dat; \
+  Bit_Chain str_chain; \
+  Bit_Chain* str_dat = dat; \
   if (dat->version >= R_2007) { \
-    str_dat = malloc(sizeof(Bit_Chain)); /* seperate string buffer */ \
-    *str_dat = *dat; \
-  } else \
-    str_dat = dat; \
+    str_chain = *dat; /* seperate string buffer */ \
+    str_dat = &str_chain; \
+  } \
   LOG_INFO("Entity " #token "\n")\
-  dwg->num_entities++;\
   obj->supertype = DWG_SUPERTYPE_ENTITY;\
-  _ent = obj->tio.entity = (Dwg_Object_Entity*)calloc(1, sizeof(Dwg_Object_Entity));\
-  obj->tio.entity->tio.token = (Dwg_Entity_##token *)calloc(1, sizeof (Dwg_Entity_##token));\
+  if (obj == decode_in_place) /* again, see decode_again */ \
+    {\
+      decode_in_place = NULL;\
+      ent = obj->tio.entity->tio.token;\
+      memset(obj->tio.entity, 0, sizeof(Dwg_Object_Entity));\
+      memset(ent, 0, sizeof(Dwg_Entity_##token));\
+      obj->tio.entity->tio.token = ent;\
+    }\
+  else\
+    {\
+      dwg->num_entities++;\
+      obj->tio.entity = (Dwg_Object_Entity*)dwg_arena_calloc(dwg, 1, sizeof(Dwg_Object_Entity));\
+      obj->tio.entity->tio.token = (Dwg_Entity_##token *)dwg_arena_slab_calloc(dwg, obj->type, sizeof (Dwg_Entity_##token));\
+    }\
+  _ent = obj->tio.entity;\
   ent = obj->tio.entity->tio.token;\
   _obj = ent;\
   _ent->object = obj;\
@@ -385,22 +446,34 @@ dwg_decode_##token (Bit_Chain* dat, Dwg_Object* obj)\
 
 #define DWG_ENTITY_END }
 
-#define DWG_OBJECT(token) static void \
-dwg_decode_ ## token (Bit_Chain* dat, Dwg_Object* obj) \
+#define DWG_OBJECT(token) DWG_DECODE_FUNC(token) \
+(Bit_Chain* dat, Dwg_Object* obj) \
 { \
   long vcount, rcount, rcount2, rcount3, rcount4; \
   Dwg_Object_##token *_obj;\
   Dwg_Data* dwg = obj->parent;\
   Bit_Chain* hdl_dat = dat; /* handle stream initially the same */ \
-  Bit_Chain* str_dat; \
+  Bit_Chain str_chain; \
+  Bit_Chain* str_dat = dat; \
   if (dat->version >= R_2007) { \
-    str_dat = calloc(1, sizeof(Bit_Chain)); /* seperate string buffer */ \
-  } else \
-    str_dat = dat; \
+    memset(&str_chain, 0, sizeof(Bit_Chain)); /* seperate string buffer */ \
+    str_dat = &str_chain; \
+  } \
   LOG_INFO("Object " #token "\n")\
   obj->supertype = DWG_SUPERTYPE_OBJECT;\
-  obj->tio.object = (Dwg_Object_Object*)calloc (1, sizeof(Dwg_Object_Object)); \
-  obj->tio.object->tio.token = (Dwg_Object_##token *)calloc (1, sizeof(Dwg_Object_##token)); \
+  if (obj == decode_in_place) /* again, see decode_again */ \
+    {\
+      decode_in_place = NULL;\
+      _obj = obj->tio.object->tio.token;\
+      memset(obj->tio.object, 0, sizeof(Dwg_Object_Object));\
+      memset(_obj, 0, sizeof(Dwg_Object_##token));\
+      obj->tio.object->tio.token = _obj;\
+    }\
+  else\
+    {\
+      obj->tio.object = (Dwg_Object_Object*)dwg_arena_calloc(dwg, 1, sizeof(Dwg_Object_Object)); \
+      obj->tio.object->tio.token = (Dwg_Object_##token *)dwg_arena_slab_calloc(dwg, obj->type, sizeof(Dwg_Object_##token)); \
+    }\
   obj->tio.object->object = obj;\
   if (dwg_decode_object(dat, hdl_dat, str_dat, obj->tio.object)) return; \
   _obj = obj->tio.object->tio.token;
@@ -21,6 +21,7 @@
 
 #include "config.h"
 #include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
@@ -34,17 +35,17 @@
 #include "dwg.h"
 #include "decode.h"
 #include "print.h"
+#include "arena.h"
+#include "intern.h"
+#include "index.h"
+#include "stats.h"
 
-/* The logging level for the read (decode) path.  */
-static unsigned int loglevel;
+/* The logging level for the read (decode) path, per thread.  */
+static THREAD_LOCAL unsigned int loglevel;
 /* the current version per spec block */
-static unsigned int cur_ver = 0;
-
-#ifdef USE_TRACING
-/* This flag means we have checked the environment variable
-   LIBREDWG_TRACE and set `loglevel' appropriately.  */
-static bool env_var_checked_p;
-#endif  /* USE_TRACING */
+static THREAD_LOCAL unsigned int cur_ver = 0;
+/* decode_again: the object to decode again into its own structs */
+static THREAD_LOCAL Dwg_Object *decode_in_place = NULL;
 #define DWG_LOGLEVEL loglevel
 
 #include "logging.h"
@@ -69,10 +70,15 @@ dwg_decode_header_variables(Bit_Chain* dat, Bit_Chain* hdl_dat,
 void
 dwg_decode_add_object(Dwg_Data* dwg, Bit_Chain* dat, Bit_Chain* hdl_dat,
                       long unsigned int address);
-/* reused with free */
-void
-dwg_free_xdata_resbuf(Dwg_Resbuf *rbuf);
-
+static void
+decode_object_at(Dwg_Data* dwg, Bit_Chain* dat, Bit_Chain* hdl_dat,
+                 long unsigned int address, long unsigned int num,
+                 long unsigned int base);
+static void
+decode_object(Dwg_Data* dwg, Bit_Chain* dat, Bit_Chain* hdl_dat,
+              Dwg_Object* obj, long unsigned int address);
+static int
+reserve_object_map(Dwg_Data *dwg, Dwg_Object_Map *map);
 extern void
 read_r2007_init(Dwg_Data *dwg);
 extern int
@@ -86,8 +92,8 @@ section_string_stream(Bit_Chain *dat, BITCODE_RL bitsize, Bit_Chain *str);
  * Private functions
  */
 
-static Dwg_Object *
-dwg_resolve_handle(Dwg_Data* dwg, unsigned long int handle);
+static int
+reserve_objects(Dwg_Data *dwg, long unsigned int num);
 
 static int
 dwg_resolve_handleref(Dwg_Object_Ref *ref, Dwg_Object * obj);
@@ -95,6 +101,9 @@ dwg_resolve_handleref(Dwg_Object_Ref *ref, Dwg_Object * obj);
 static int
 resolve_objectref_vector(Bit_Chain* dat, Dwg_Data * dwg);
 
+static void
+update_back_pointers(Dwg_Data * dwg);
+
 static void
 decode_preR13_section_ptr(const char* name, Dwg_Section_Type_r11 id,
                           Bit_Chain* dat, Dwg_Data * dwg);
@@ -114,14 +123,20 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg);
 static int
 decode_R2004(Bit_Chain* dat, Dwg_Data * dwg);
 static int
+decode_dwg(Bit_Chain * dat, Dwg_Data * dwg);
+static int
 decode_R2007(Bit_Chain* dat, Dwg_Data * dwg);
 
 static Dwg_Resbuf*
-dwg_decode_xdata(Bit_Chain * dat, Dwg_Object_XRECORD * obj, int size);
+dwg_decode_xdata(Dwg_Data *dwg, Bit_Chain * dat, Dwg_Object_XRECORD * obj,
+                 int size);
 
 static int
 dwg_decode_eed(Bit_Chain * dat, Dwg_Object_Object * obj);
 
+static int
+decode_eed_data(Dwg_Data *dwg, Dwg_Object_Object *obj);
+
 static int
 dwg_decode_object(Bit_Chain* dat, Bit_Chain* hdl_dat, Bit_Chain* str_dat,
                   Dwg_Object_Object * obj);
@@ -147,6 +162,29 @@ dwg_decode_entity(Bit_Chain* dat, Bit_Chain* hdl_dat, Bit_Chain* str_dat,
  */
 int
 dwg_decode(Bit_Chain * dat, Dwg_Data * dwg)
+{
+  Dwg_Stats_Mark mark;
+  int error;
+
+#ifdef LIBREDWG_STATS
+  dwg_stats_atexit();
+#endif
+  dwg_stats_begin(dwg, DWG_PHASE_SECTIONS, &mark);
+  error = decode_dwg(dat, dwg);
+  dwg_object_index(dwg);
+  /* no other thread has dwg yet */
+  dwg_owner_index_locked(dwg);
+  if (dwg->opts & DWG_OPTS_SPATIAL)
+    dwg_spatial_index(dwg);
+  if (dwg->stats)
+    dwg->stats->refs += dwg->num_object_refs;
+  dwg_stats_end(dwg, &mark, NULL, 0);
+  return error;
+}
+
+/* dwg_decode without its stats */
+static int
+decode_dwg(Bit_Chain * dat, Dwg_Data * dwg)
 {
   int i;
   char version[7];
@@ -164,24 +202,43 @@ dwg_decode(Bit_Chain * dat, Dwg_Data * dwg)
   dwg->dwg_class = NULL;
   dwg->object_ref = NULL;
   dwg->object = NULL;
+  dwg->num_alloced_objects = 0;
+  dwg->object_index = NULL;
+  dwg->num_indexed_objects = 0;
+  dwg->owner_index = NULL;
+  dwg->type_index = NULL;
+  dwg->layer_index = NULL;
+  dwg->spatial_index = NULL;
+  dwg_index_lock_new(dwg);
+  /* all objects, strings, vectors and refs go into the arena */
+  dwg->arena = NULL;
+  if (!dwg_arena_calloc(dwg, 1, 1))
+    {
+      LOG_ERROR("Out of memory\n");
+      return -1;
+    }
+  dwg_arena_decoded(dwg);
+  /* DWG_OPTS_INTERN: a table of the caller, or one for this drawing */
+  if (!(dwg->opts & DWG_OPTS_INTERN))
+    dwg->intern = NULL;
+  dwg->intern_owned = 0;
+  if (dwg->opts & DWG_OPTS_INTERN && !dwg->intern)
+    {
+      dwg->intern = dwg_intern_new();
+      if (!dwg->intern)
+        {
+          LOG_ERROR("Out of memory\n");
+          return -1;
+        }
+      dwg->intern_owned = 1;
+    }
 
   memset(&dwg->header_vars, 0, sizeof(Dwg_Header_Variables));
   memset(&dwg->r2004_header.file_ID_string[0], 0, sizeof(dwg->r2004_header));
   memset(&dwg->auxheader.aux_intro[0], 0, sizeof(dwg->auxheader));
   memset(&dwg->second_header.size, 0, sizeof(dwg->second_header));
 
-  if (dwg->opts)
-    loglevel = dwg->opts & 0xf;
-#ifdef USE_TRACING
-  /* Before starting, set the logging level, but only do so once.  */
-  if (! env_var_checked_p)
-    {
-      char *probe = getenv ("LIBREDWG_TRACE");
-      if (probe)
-        loglevel = atoi (probe);
-      env_var_checked_p = true;
-    }
-#endif  /* USE_TRACING */
+  loglevel = dwg_loglevel(dwg->opts);
 
   /* Version */
   dat->byte = 0;
@@ -299,7 +356,6 @@ decode_preR13_section(Dwg_Section_Type_r11 id, Bit_Chain* dat, Dwg_Data * dwg)
   Dwg_Section *tbl = &dwg->header.section[id];
   int i; long vcount;
   long unsigned int num = dwg->num_objects;
-  long unsigned int old_size = num * sizeof(Dwg_Object);
   long unsigned int size = tbl->number * sizeof(Dwg_Object);
   long unsigned int pos;
 
@@ -307,16 +363,21 @@ decode_preR13_section(Dwg_Section_Type_r11 id, Bit_Chain* dat, Dwg_Data * dwg)
             tbl->name, id, tbl->size, tbl->number, tbl->address,
             (long)(tbl->address + tbl->number * tbl->size))
   dat->byte = tbl->address;
-  dwg->object = realloc(dwg->object, old_size + size);
+  if (reserve_objects(dwg, num + tbl->number))
+    return;
+  /* the entries set only some fields of their object */
+  memset(&dwg->object[num], 0, size);
 
   // TODO: move to a spec dwg_r11.spec, and dwg_decode_r11_NAME
 #define PREP_TABLE(name)\
   Dwg_Object *obj = &dwg->object[num + i];                              \
-  Dwg_Object_##name *_obj = calloc (1, sizeof(Dwg_Object_##name));      \
-  obj->tio.object = calloc (1, sizeof(Dwg_Object_Object));              \
+  Dwg_Object_##name *_obj = dwg_arena_calloc(dwg, 1, sizeof(Dwg_Object_##name)); \
+  obj->tio.object = dwg_arena_calloc(dwg, 1, sizeof(Dwg_Object_Object)); \
   obj->tio.object->tio.name = _obj;                                     \
   obj->tio.object->object = obj;                                        \
   obj->parent = dwg;                                                    \
+  obj->index = num + i;                                                 \
+  obj->supertype = DWG_SUPERTYPE_OBJECT;                                \
   LOG_TRACE("\n-- table entry " #name " [%d]:\n", i)
 
 #define CHK_ENDPOS \
@@ -782,7 +843,10 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
   long unsigned int object_end;
   long unsigned int pvz;
   unsigned int j, k;
+  Dwg_Object_Map map;
+  Dwg_Stats_Mark phase;
 
+  memset(&map, 0, sizeof(Dwg_Object_Map));
   {
     int i;
     struct Dwg_Header *_obj = &dwg->header;
@@ -884,14 +948,15 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
           LOG_TRACE("         PICTURE (end): %8X\n",
                 (unsigned int) dat->byte)
           dwg->picture.size = (dat->byte - 16) - start_address;
-          dwg->picture.chain = (unsigned char *) calloc(1, dwg->picture.size);
+          // byte-aligned, a slice of the input with DWG_OPTS_ZERO_COPY
+          dat->byte = start_address;
+          dwg->picture.chain = (unsigned char *)dwg_decode_raw(dwg, dat,
+                                                      dwg->picture.size);
           if (!dwg->picture.chain)
             {
               LOG_ERROR("Out of memory");
               return -2;
             }
-          memcpy(dwg->picture.chain, &dat->chain[start_address],
-              dwg->picture.size);
         }
     }
 
@@ -909,7 +974,9 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
   LOG_TRACE("         Length: " FORMAT_RL "\n", dwg->header_vars.size)
   dat->bit = 0;
 
+  dwg_stats_begin(dwg, DWG_PHASE_HEADER, &phase);
   dwg_decode_header_variables(dat, dat, dat, dwg);
+  dwg_stats_end(dwg, &phase, NULL, 0);
 
   // Check CRC-on
   dat->bit = 0;
@@ -938,6 +1005,7 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
   dat->byte = dwg->header.section[SECTION_CLASSES_R13].address + 16;
   dat->bit = 0;
 
+  dwg_stats_begin(dwg, DWG_PHASE_CLASSES, &phase);
   size = bit_read_RL(dat);
   lasta = dat->byte + size;
   LOG_TRACE("         Length: %lu\n", size);
@@ -970,6 +1038,7 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
       klass->appname = bit_read_TV(dat);
       klass->cppname = bit_read_TV(dat);
       klass->dxfname = bit_read_TV(dat);
+      dwg_intern_class(dwg, klass);
       klass->wasazombie = bit_read_B(dat);
       // 1f2 for entities, 1f3 for objects
       klass->item_class_id = bit_read_BS(dat);
@@ -1020,6 +1089,7 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
   pvz = bit_read_RL(dat); // Unknown bitlong inter class and object
   LOG_TRACE("@ %lu RL: 0x%lx\n", dat->byte - 4, pvz)
   LOG_INFO("Number of classes read: %u\n", dwg->num_classes)
+  dwg_stats_end(dwg, &phase, NULL, 0);
 
   /*-------------------------------------------------------------------------
    * Object-map, section 2
@@ -1037,7 +1107,7 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
   do
     {
       long unsigned int last_offset;
-      //long unsigned int last_handle;
+      long unsigned int last_handle;
       long unsigned int oldpos = 0;
       startpos = dat->byte;
 
@@ -1046,21 +1116,23 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
       if (section_size > 2035)
         {
           LOG_ERROR("Object-map section size greater than 2035!")
+          free(map.entries);
           return -1;
         }
 
-      //last_handle = 0;
+      last_handle = 0;
       last_offset = 0;
       while (dat->byte - startpos < section_size)
         {
-          long handle, offset;
+          long unsigned int handle;
+          long offset;
           oldpos = dat->byte;
-          handle = bit_read_MC(dat);
+          handle = bit_read_UMC(dat);
           offset = bit_read_MC(dat);
-          //last_handle += handle;
+          last_handle += handle;
           last_offset += offset;
           LOG_TRACE("\nNext object: %lu\t", dwg->num_objects)
-          LOG_TRACE("Handle: %li\tOffset: %ld @%lu\n", handle, offset, last_offset)
+          LOG_TRACE("Handle: %lu\tOffset: %ld @%lu\n", handle, offset, last_offset)
 
           if (dat->byte == oldpos)
             break;
@@ -1070,7 +1142,16 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
           if (object_begin > last_offset)
             object_begin = last_offset;
 
-          dwg_decode_add_object(dwg, dat, dat, last_offset);
+          if (dwg->opts & DWG_OPTS_SEQUENTIAL)
+            {
+              if (dwg_object_map_add(&map, last_handle, last_offset))
+                {
+                  free(map.entries);
+                  return -1;
+                }
+            }
+          else
+            dwg_decode_add_object(dwg, dat, dat, last_offset);
 #if 0
           kobj = dwg->num_objects;
           if (dwg->num_objects > kobj)
@@ -1102,6 +1183,8 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
         break;
     }
   while (section_size > 2);
+  if (dwg_decode_object_map(dwg, dat, dat, &map))
+    return -1;
 
   LOG_INFO("Num objects: %lu\n", dwg->num_objects)
   LOG_INFO("\n"
@@ -1202,7 +1285,7 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
             FIELD_BL(section[i].address, 0);
             FIELD_BL(section[i].size, 0);
           }
-        if (DWG_LOGLEVEL >= DWG_LOGLEVEL_HANDLE)
+        if (LOG_ENABLED(HANDLE))
           {
             LOG_HANDLE("1st header was:\n");
             for (i = 0; i < (int)dwg->header.num_sections; i++)
@@ -1267,11 +1350,37 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
   return resolve_objectref_vector(dat, dwg);
 }
 
+/* dwg->object moved while it grew, see reserve_objects: point the
+   structs of the objects back at it. An unknown class is an UNKNOWN_OBJ
+   or _ENT, else only raw bytes. */
+static void
+update_back_pointers(Dwg_Data * dwg)
+{
+  long unsigned int i;
+
+  for (i = 0; i < dwg->num_objects; i++)
+    {
+      Dwg_Object *obj = &dwg->object[i];
+      if (!obj->tio.unknown)
+        continue;
+      if (obj->supertype == DWG_SUPERTYPE_ENTITY)
+        obj->tio.entity->object = obj;
+      else if (obj->supertype == DWG_SUPERTYPE_OBJECT
+               || (obj->type >= 500
+                   && obj->type - 500 <= dwg->num_classes))
+        obj->tio.object->object = obj;
+    }
+}
+
 static int
 resolve_objectref_vector(Bit_Chain* dat, Dwg_Data * dwg)
 {
   long unsigned int i;
   Dwg_Object * obj;
+  Dwg_Stats_Mark mark;
+
+  dwg_stats_begin(dwg, DWG_PHASE_HANDLES, &mark);
+  update_back_pointers(dwg);
 
   for (i = 0; i < dwg->num_object_refs; i++)
     {
@@ -1296,14 +1405,17 @@ resolve_objectref_vector(Bit_Chain* dat, Dwg_Data * dwg)
       //assign found pointer to objectref vector
       dwg->object_ref[i]->obj = obj;
 
-      if (DWG_LOGLEVEL >= DWG_LOGLEVEL_TRACE)
+      if (LOG_ENABLED(TRACE))
         {
-          if (obj)
+          if (!obj)
+            {
+              LOG_WARN("Null object pointer: object_ref[%lu]", i)
+            }
+          else if (obj->tio.unknown) /* not released by dwg_stream */
             dwg_print_object(dat, obj);
-          else
-            LOG_WARN("Null object pointer: object_ref[%lu]", i)
         }
     }
+  dwg_stats_end(dwg, &mark, NULL, 0);
   return dwg->num_object_refs ? 0 : 1;
 }
 
@@ -1461,17 +1573,25 @@ decompress_R2004_section(Bit_Chain* dat, char *decomp,
   return 0;  // Success
 }
 
+/* The section map pages by number, for find_section */
+typedef struct _section_index
+{
+  Dwg_Section **by_number;
+  long unsigned int size;
+} Section_Index;
+
 /* Read R2004, 2010+ Section Map
  * The Section Map is a vector of number, size, and address triples used
  * to locate the sections in the file.
  */
 static void
-read_R2004_section_map(Bit_Chain* dat, Dwg_Data * dwg)
+read_R2004_section_map(Bit_Chain* dat, Dwg_Data * dwg, Section_Index *index)
 {
   char *decomp, *ptr;
   int i;
   int section_address;
   int bytes_remaining;
+  long unsigned int num = 0, max_number = 0;
   uint32_t comp_data_size   = dwg->r2004_header.comp_data_size;
   uint32_t decomp_data_size = dwg->r2004_header.decomp_data_size;
 
@@ -1490,25 +1610,39 @@ read_R2004_section_map(Bit_Chain* dat, Dwg_Data * dwg)
 
   LOG_TRACE("\n#### Read 2004 Section Page Map ####\n")
 
+  /* Count the pages first, gaps have 16 more bytes */
+  bytes_remaining = decomp_data_size;
+  ptr = decomp;
+  while (bytes_remaining >= 8)
+    {
+      int32_t number = *((int32_t*)ptr);
+      if (number > 0 && (long unsigned int)number > max_number)
+        max_number = number;
+      num++;
+      bytes_remaining -= number < 0 ? 24 : 8;
+      ptr += number < 0 ? 24 : 8;
+    }
+  if (!num)
+    {
+      free(decomp);
+      return;
+    }
+  dwg->header.section = (Dwg_Section*) calloc(num, sizeof(Dwg_Section));
+  if (!dwg->header.section)
+    {
+      LOG_ERROR("Out of memory\n");
+      free(decomp);
+      return;
+    }
+
   section_address = 0x100;  // starting address
   i = 0;
   bytes_remaining = decomp_data_size;
   ptr = decomp;
   dwg->header.num_sections = 0;
 
-  while (bytes_remaining)
+  while (dwg->header.num_sections < num)
     {
-      if (dwg->header.num_sections==0)
-        dwg->header.section = (Dwg_Section*) calloc(1, sizeof(Dwg_Section));
-      else
-        dwg->header.section = (Dwg_Section*) realloc(dwg->header.section,
-                       sizeof(Dwg_Section) * (dwg->header.num_sections+1));
-      if (!dwg->header.section)
-        {
-          LOG_ERROR("Out of memory");
-          return;
-        }
-
       dwg->header.section[i].number  = *((int32_t*)ptr);
       dwg->header.section[i].size    = *((uint32_t*)ptr+1);
       dwg->header.section[i].address = section_address;
@@ -1520,7 +1654,8 @@ read_R2004_section_map(Bit_Chain* dat, Dwg_Data * dwg)
       LOG_TRACE(" size=0x%04x", dwg->header.section[i].size)
       LOG_TRACE(" addr=0x%04x\n", dwg->header.section[i].address)
 
-      if (dwg->header.section[i].number < 0) // negative: gap/unused data
+      if (dwg->header.section[i].number < 0 // negative: gap/unused data
+          && bytes_remaining >= 16)
         {
           dwg->header.section[i].parent  = *((int32_t*)ptr);
           dwg->header.section[i].left    = *((int32_t*)ptr+1);
@@ -1539,17 +1674,35 @@ read_R2004_section_map(Bit_Chain* dat, Dwg_Data * dwg)
       i++;
     }
   free(decomp);
+
+  /* Index the pages by number, unless the numbers are too sparse */
+  if (max_number <= 2 * num + 1024)
+    {
+      index->by_number = (Dwg_Section **)
+        calloc(max_number + 1, sizeof(Dwg_Section *));
+      if (index->by_number)
+        {
+          index->size = max_number + 1;
+          for (i = num - 1; i >= 0; i--) // the first one wins
+            if (dwg->header.section[i].number > 0)
+              index->by_number[dwg->header.section[i].number]
+                = &dwg->header.section[i];
+        }
+    }
 }
 
 static Dwg_Section*
-find_section(Dwg_Data *dwg, unsigned long int index)
+find_section(Dwg_Data *dwg, const Section_Index *index,
+             unsigned long int number)
 {
   long unsigned int i;
-  if (dwg->header.section == 0 || index == 0)
+  if (dwg->header.section == 0 || number == 0)
     return 0;
+  if (index->by_number)
+    return number < index->size ? index->by_number[number] : 0;
   for (i = 0; i < dwg->header.num_sections; ++i)
     {
-      if ((unsigned long int)dwg->header.section[i].number == index)
+      if ((unsigned long int)dwg->header.section[i].number == number)
         return &dwg->header.section[i];
     }
   return 0;
@@ -1559,6 +1712,7 @@ find_section(Dwg_Data *dwg, unsigned long int index)
  */
 static void
 read_R2004_section_info(Bit_Chain* dat, Dwg_Data *dwg,
+                        const Section_Index *index,
                         unsigned long int comp_data_size,
                         unsigned long int decomp_data_size)
 {
@@ -1644,7 +1798,7 @@ read_R2004_section_info(Bit_Chain* dat, Dwg_Data *dwg,
               start_offset  += *((uint32_t*)ptr + 3);
 	      ptr += 16;
 
-	      info->sections[j] = find_section(dwg, section_number);
+	      info->sections[j] = find_section(dwg, index, section_number);
 
 	      LOG_TRACE("Section Number: %d\n", section_number)
               LOG_TRACE("Data size:      %d\n", data_size) //compressed
@@ -1679,16 +1833,11 @@ typedef union _encrypted_section_header
   } fields;
 } encrypted_section_header;
 
-static int
-read_2004_compressed_section(Bit_Chain* dat, Dwg_Data *dwg,
-                            Bit_Chain* sec_dat, BITCODE_RL section_type)
+static Dwg_Section_Info *
+find_section_info(Dwg_Data *dwg, BITCODE_RL section_type)
 {
-  long unsigned int address, sec_mask;
-  long unsigned int max_decomp_size;
   Dwg_Section_Info *info = NULL;
-  encrypted_section_header es;
-  char *decomp;
-  unsigned int i, j;
+  unsigned int i;
 
   for (i=0; i < dwg->header.num_infos && !info; ++i)
     {
@@ -1701,13 +1850,68 @@ read_2004_compressed_section(Bit_Chain* dat, Dwg_Data *dwg,
   if (!info)
     {
       LOG_WARN("Failed to find section %d", (int)section_type);
-      return 1;
     }
   else
     {
       LOG_TRACE("\nFound section %s %d with %d sections\n",
                 info->name, (int)section_type, info->num_sections);
     }
+  return info;
+}
+
+/* Decompresses page i of the section into decomp,
+   which has info->max_decomp_size zeroed bytes */
+static void
+read_2004_section_page(Bit_Chain* dat, Dwg_Section_Info *info,
+                       unsigned int i, char *decomp)
+{
+  long unsigned int address, sec_mask;
+  encrypted_section_header es;
+  unsigned int j;
+
+  address = info->sections[i]->address;
+  dat->byte = address;
+  bit_read_fixed(dat, (char*)es.char_data, 32);
+
+  sec_mask = 0x4164536b ^ address;
+  for (j = 0; j < 8; ++j)
+    es.long_data[j] ^= sec_mask;
+
+  LOG_INFO("\n=== Section (Class) ===\n")
+  LOG_INFO("Section Tag:      0x%x (should be 0x4163043b)\n",
+          (unsigned int) es.fields.tag)
+  LOG_INFO("Section Type:     0x%x\n",
+          (unsigned int) es.fields.section_type)
+  // this is the number of bytes that is read in decompress_R2004_section (+ 2bytes)
+  LOG_INFO("Data size:        0x%x\n",
+          (unsigned int) es.fields.data_size)
+  LOG_INFO("Comp data size:   0x%x\n",
+          (unsigned int) es.fields.section_size)
+  LOG_TRACE("StartOffset:      0x%x\n",
+          (unsigned int) es.fields.start_offset)
+  LOG_HANDLE("Unknown:          0x%x\n",
+          (unsigned int) es.fields.unknown);
+  LOG_HANDLE("Checksum1:        0x%x\n",
+        (unsigned int) es.fields.checksum_1)
+  LOG_HANDLE("Checksum2:        0x%x\n\n",
+        (unsigned int) es.fields.checksum_2)
+
+  decompress_R2004_section(dat, decomp, es.fields.data_size);
+}
+
+static int
+read_2004_compressed_section(Bit_Chain* dat, Dwg_Data *dwg,
+                            Bit_Chain* sec_dat, BITCODE_RL section_type)
+{
+  long unsigned int max_decomp_size;
+  Dwg_Section_Info *info;
+  char *decomp;
+  unsigned int i;
+  Dwg_Stats_Mark mark;
+
+  info = find_section_info(dwg, section_type);
+  if (!info)
+    return 1;
 
   max_decomp_size = info->num_sections * info->max_decomp_size;
   decomp = (char *)calloc(max_decomp_size, sizeof(char));
@@ -1717,38 +1921,12 @@ read_2004_compressed_section(Bit_Chain* dat, Dwg_Data *dwg,
       return 2;
     }
 
+  dwg_stats_begin(dwg, DWG_PHASE_DECOMPRESS, &mark);
   for (i=0; i < info->num_sections; ++i)
-    {
-      address = info->sections[i]->address;
-      dat->byte = address;
-      bit_read_fixed(dat, (char*)es.char_data, 32);
-
-      sec_mask = 0x4164536b ^ address;
-      for (j = 0; j < 8; ++j)
-        es.long_data[j] ^= sec_mask;
-
-      LOG_INFO("\n=== Section (Class) ===\n")
-      LOG_INFO("Section Tag:      0x%x (should be 0x4163043b)\n",
-              (unsigned int) es.fields.tag)
-      LOG_INFO("Section Type:     0x%x\n",
-              (unsigned int) es.fields.section_type)
-      // this is the number of bytes that is read in decompress_R2004_section (+ 2bytes)
-      LOG_INFO("Data size:        0x%x\n",
-              (unsigned int) es.fields.data_size)
-      LOG_INFO("Comp data size:   0x%x\n",
-              (unsigned int) es.fields.section_size)
-      LOG_TRACE("StartOffset:      0x%x\n",
-              (unsigned int) es.fields.start_offset)
-      LOG_HANDLE("Unknown:          0x%x\n",
-              (unsigned int) es.fields.unknown);
-      LOG_HANDLE("Checksum1:        0x%x\n",
-            (unsigned int) es.fields.checksum_1)
-      LOG_HANDLE("Checksum2:        0x%x\n\n",
-            (unsigned int) es.fields.checksum_2)
-
-      decompress_R2004_section(dat, &decomp[i * info->max_decomp_size],
-        es.fields.data_size);
-    }
+    read_2004_section_page(dat, info, i,
+                           &decomp[i * info->max_decomp_size]);
+  dwg_stats_end(dwg, &mark, DWG_STATS_SECTION(dwg, info->type),
+                max_decomp_size);
 
   sec_dat->bit     = 0;
   sec_dat->byte    = 0;
@@ -1760,6 +1938,101 @@ read_2004_compressed_section(Bit_Chain* dat, Dwg_Data *dwg,
   return 0;
 }
 
+/* With DWG_OPTS_SEQUENTIAL the objects are decoded in file offset order,
+   and only the pages of AcDb:AcDbObjects with the current object are
+   decompressed, into a window which slides forward.
+ */
+typedef struct _section_window
+{
+  Dwg_Data *dwg;
+  Bit_Chain *dat;           /* the file */
+  Dwg_Section_Info *info;
+  Bit_Chain chain;          /* the pages first .. first + num - 1 */
+  long unsigned int first;
+  long unsigned int num;
+  long unsigned int alloced;
+} Section_Window;
+
+/* Makes sure that the pages first .. last are in the window.
+ */
+static int
+window_load(Section_Window *w, long unsigned int first,
+            long unsigned int last)
+{
+  long unsigned int psize = w->info->max_decomp_size;
+  long unsigned int i, num, keep = 0;
+  Dwg_Stats_Mark mark;
+
+  if (last >= w->info->num_sections)
+    last = w->info->num_sections - 1;
+  if (first > last)
+    {
+      LOG_ERROR("Object outside of section %s\n", w->info->name);
+      return 1;
+    }
+  if (w->num && first >= w->first && last < w->first + w->num)
+    return 0;
+
+  num = last - first + 1;
+  if (num > w->alloced)
+    {
+      unsigned char *chain = (unsigned char *)
+        realloc(w->chain.chain, num * psize);
+      if (!chain)
+        {
+          LOG_ERROR("Out of memory\n");
+          return 2;
+        }
+      w->chain.chain = chain;
+      w->alloced = num;
+    }
+  /* keep the pages of a previous object spanning into this one */
+  if (w->num && first >= w->first && first < w->first + w->num)
+    {
+      keep = w->first + w->num - first;
+      memmove(w->chain.chain, &w->chain.chain[(first - w->first) * psize],
+              keep * psize);
+    }
+  dwg_stats_begin(w->dwg, DWG_PHASE_DECOMPRESS, &mark);
+  for (i = keep; i < num; i++)
+    {
+      memset(&w->chain.chain[i * psize], 0, psize);
+      read_2004_section_page(w->dat, w->info, first + i,
+                             (char *)&w->chain.chain[i * psize]);
+    }
+  dwg_stats_end(w->dwg, &mark, DWG_STATS_SECTION(w->dwg, w->info->type),
+                (num - keep) * psize);
+  w->first = first;
+  w->num = num;
+  w->chain.size = num * psize;
+  return 0;
+}
+
+/* Decodes the object at address of the section into dwg->object[num]
+ */
+static void
+window_decode_object(Dwg_Data *dwg, Section_Window *w,
+                     long unsigned int address, long unsigned int num)
+{
+  long unsigned int psize = w->info->max_decomp_size;
+  long unsigned int page = address / psize;
+  long unsigned int base, end;
+  BITCODE_MS size;
+
+  /* the size may already cross into the next page */
+  if (window_load(w, page, page + 1))
+    return;
+  base = w->first * psize;
+  w->chain.byte = address - base;
+  w->chain.bit = 0;
+  size = bit_read_MS(&w->chain);
+  end = base + w->chain.byte + size + 2; /* with the CRC */
+  if (window_load(w, page, (end - 1) / psize))
+    return;
+  base = w->first * psize;
+  decode_object_at(dwg, &w->chain, &w->chain, address - base, num, base);
+}
+
 /* R2004, 2010+ Class Section
  */
 static int
@@ -1856,6 +2129,7 @@ read_2004_section_classes(Bit_Chain* dat, Dwg_Data *dwg)
               LOG_TRACE("C++ class name:   %s\n", dwg->dwg_class[idc].cppname)
               LOG_TRACE("DXF record name:  %s\n", dwg->dwg_class[idc].dxfname)
             }
+          dwg_intern_class(dwg, &dwg->dwg_class[idc]);
           dwg->dwg_class[idc].wasazombie    = bit_read_B(&sec_dat);
           dwg->dwg_class[idc].item_class_id = bit_read_BS(&sec_dat);
           LOG_TRACE("Class ID:         0x%x "
@@ -1937,13 +2211,32 @@ static int
 read_2004_section_handles(Bit_Chain* dat, Dwg_Data *dwg)
 {
   Bit_Chain obj_dat, hdl_dat;
+  Dwg_Object_Map map;
+  Section_Window window;
   BITCODE_RS section_size = 0;
   long unsigned int endpos;
   int error;
 
-  error = read_2004_compressed_section(dat, dwg, &obj_dat, SECTION_OBJECTS);
-  if (error)
-    return error;
+  memset(&map, 0, sizeof(Dwg_Object_Map));
+  memset(&window, 0, sizeof(Section_Window));
+  memset(&obj_dat, 0, sizeof(Bit_Chain));
+  if (dwg->opts & DWG_OPTS_SEQUENTIAL)
+    {
+      window.dwg = dwg;
+      window.dat = dat;
+      window.info = find_section_info(dwg, SECTION_OBJECTS);
+      if (!window.info || !window.info->max_decomp_size)
+        return 1;
+      window.chain.version = dat->version;
+      window.chain.from_version = dat->from_version;
+    }
+  else
+    {
+      error = read_2004_compressed_section(dat, dwg, &obj_dat,
+                                           SECTION_OBJECTS);
+      if (error)
+        return error;
+    }
 
   error = read_2004_compressed_section(dat, dwg, &hdl_dat, SECTION_HANDLES);
   if (error)
@@ -1958,7 +2251,7 @@ read_2004_section_handles(Bit_Chain* dat, Dwg_Data *dwg)
   do
     {
       long unsigned int last_offset;
-      //long unsigned int last_handle;
+      long unsigned int last_handle;
       long unsigned int oldpos = 0;
       long unsigned int startpos = hdl_dat.byte;
 
@@ -1967,24 +2260,34 @@ read_2004_section_handles(Bit_Chain* dat, Dwg_Data *dwg)
       if (section_size > 2034)
         {
           LOG_ERROR("Object-map section size greater than 2034!");
+          free(map.entries);
           free(obj_dat.chain);
           return 1;
         }
 
-      //last_handle = 0;
+      last_handle = 0;
       last_offset = 0;
       while (hdl_dat.byte - startpos < section_size)
         {
-          long handle, offset;
+          long unsigned int handle;
+          long offset;
           oldpos = dat->byte;
-          handle = bit_read_MC(&hdl_dat);
+          handle = bit_read_UMC(&hdl_dat);
           offset = bit_read_MC(&hdl_dat);
-          //last_handle += handle;
+          last_handle += handle;
           last_offset += offset;
           LOG_TRACE("\nNext object: %lu\t", dwg->num_objects)
-          LOG_HANDLE("Handle: %li\tOffset: %ld @%lu\n", handle, offset, last_offset)
+          LOG_HANDLE("Handle: %lu\tOffset: %ld @%lu\n", handle, offset, last_offset)
 
-          dwg_decode_add_object(dwg, &obj_dat, &obj_dat, last_offset);
+          if (!(dwg->opts & DWG_OPTS_SEQUENTIAL))
+            dwg_decode_add_object(dwg, &obj_dat, &obj_dat, last_offset);
+          else if (dwg_object_map_add(&map, last_handle, last_offset))
+            {
+              free(map.entries);
+              free(hdl_dat.chain);
+              free(obj_dat.chain);
+              return 1;
+            }
         }
 
       if (hdl_dat.byte == oldpos)
@@ -1995,11 +2298,31 @@ read_2004_section_handles(Bit_Chain* dat, Dwg_Data *dwg)
         break;
     }
   while (section_size > 2);
+  if (map.num && reserve_object_map(dwg, &map))
+    {
+      free(map.entries);
+      free(hdl_dat.chain);
+      free(obj_dat.chain);
+      return 1;
+    }
+  if (map.num)
+    {
+      long unsigned int base = dwg->num_objects - map.num;
+      long unsigned int i;
+
+      for (i = 0; i < map.num; i++)
+        window_decode_object(dwg, &window, map.entries[i].address,
+                             base + map.entries[i].index);
+      LOG_TRACE("\n%s: %lu pages decompressed at most\n",
+                window.info->name, window.alloced);
+    }
+  free(map.entries);
 
   LOG_TRACE("\nNum objects: %lu\n", dwg->num_objects);
 
   free(hdl_dat.chain);
   free(obj_dat.chain);
+  free(window.chain.chain);
   return 0;
 }
 
@@ -2009,7 +2332,10 @@ decode_R2004(Bit_Chain* dat, Dwg_Data * dwg)
 {
   int j, error = 0;
   Dwg_Section *section;
+  Section_Index index;
+  Dwg_Stats_Mark phase;
 
+  memset(&index, 0, sizeof(Section_Index));
   {
     struct Dwg_Header* _obj = &dwg->header;
     Dwg_Object *obj = NULL;
@@ -2027,29 +2353,33 @@ decode_R2004(Bit_Chain* dat, Dwg_Data * dwg)
     struct Dwg_R2004_Header* _obj = &dwg->r2004_header;
     Bit_Chain* hdl_dat = dat;
     const unsigned size = sizeof(struct Dwg_R2004_Header);
-    char encrypted_data[size];
+    unsigned char decrypted_data[size];
     unsigned int rseed = 1;
     unsigned i;
 
     dat->byte = 0x80;
-    /* Decrypt */
+    /* Decrypt into a separate buffer, the input may be read-only */
     for (i = 0; i < size; i++)
       {
         rseed *= 0x343fd;
         rseed += 0x269ec3;
-        encrypted_data[i] = bit_read_RC(dat) ^ (rseed >> 0x10);
+        decrypted_data[i] = bit_read_RC(dat) ^ (rseed >> 0x10);
       }
 
     LOG_TRACE("\n#### 2004 File Header ####\n");
-    dat->byte = 0x80;
-    if (dat->byte+0x80 >= dat->size - 1) {
-      dat->size = dat->byte + 0x80;
-      bit_chain_alloc(dat);
-    }
-    memcpy(&dat->chain[0x80], encrypted_data, size);
-    LOG_HANDLE("@0x%lx\n", dat->byte);
+    LOG_HANDLE("@0x%lx\n", 0x80UL);
+    {
+      Bit_Chain file_dat = *dat;
+
+      dat->chain = decrypted_data;
+      dat->size = size;
+      dat->byte = 0;
+      dat->bit = 0;
 
-    #include "r2004_file_header.spec"
+      #include "r2004_file_header.spec"
+
+      *dat = file_dat;
+    }
 
     /*-------------------------------------------------------------------------
      * Section Page Map
@@ -2070,7 +2400,7 @@ decode_R2004(Bit_Chain* dat, Dwg_Data * dwg)
 
   }
 
-  read_R2004_section_map(dat, dwg);
+  read_R2004_section_map(dat, dwg, &index);
 
   if (!dwg->header.section)
     {
@@ -2081,7 +2411,7 @@ decode_R2004(Bit_Chain* dat, Dwg_Data * dwg)
   /*-------------------------------------------------------------------------
    * Section Info
    */
-  section = find_section(dwg, dwg->r2004_header.section_info_id);
+  section = find_section(dwg, &index, dwg->r2004_header.section_info_id);
   if (section)
     {
       Dwg_Object *obj = NULL;
@@ -2102,12 +2432,17 @@ decode_R2004(Bit_Chain* dat, Dwg_Data * dwg)
       FIELD_RL(checksum, 0);
 
       // Data section map, par 4.5
-      read_R2004_section_info(dat, dwg,
+      read_R2004_section_info(dat, dwg, &index,
          _obj->comp_data_size, _obj->decomp_data_size);
     }
+  free(index.by_number);
 
+  dwg_stats_begin(dwg, DWG_PHASE_CLASSES, &phase);
   error += read_2004_section_classes(dat, dwg);
+  dwg_stats_end(dwg, &phase, NULL, 0);
+  dwg_stats_begin(dwg, DWG_PHASE_HEADER, &phase);
   error += read_2004_section_header(dat, dwg);
+  dwg_stats_end(dwg, &phase, NULL, 0);
   error += read_2004_section_handles(dat, dwg);
 
   /* Clean up. XXX? Need this to write the sections, at least the name and type */
@@ -2161,112 +2496,250 @@ decode_R2007(Bit_Chain* dat, Dwg_Data * dwg)
  * Private functions
  */
 
-/* for objects and entities */
+/* Entities are passed as Dwg_Object_Object, so both have to keep their
+   EED at the same offsets. Fails to compile otherwise. */
+typedef char eed_offsets_check
+  [offsetof(Dwg_Object_Object, num_eed) == offsetof(Dwg_Object_Entity, num_eed)
+   && offsetof(Dwg_Object_Object, eed) == offsetof(Dwg_Object_Entity, eed)
+   ? 1 : -1];
+
+/* for objects and entities: only the blocks of EED, of an APPID handle
+   and size raw bytes each. Their items are parsed by decode_eed_data,
+   at once or with DWG_OPTS_LAZY_EED on first use. */
 static int
 dwg_decode_eed(Bit_Chain * dat, Dwg_Object_Object * obj)
 {
+  Dwg_Data *dwg = obj->object->parent;
+  Bit_Chain start = *dat;
+  Dwg_Handle handle;
   BITCODE_BS size;
-  unsigned int idx = 0;
+  unsigned int idx, num = 0;
   int error = 0;
 
   obj->num_eed = 0;
+  obj->eed = NULL;
+  obj->object->eed_deferred = 0;
+  /* count the blocks first, to allocate them at once */
   while ((size = bit_read_BS(dat)))
     {
-      int i;
-      BITCODE_BS j;
-      BITCODE_RC code = 0;
-      long unsigned int end, offset;
-      long unsigned int sav_byte;
-
-      LOG_TRACE("EED[%u] size: " FORMAT_BS "\n", idx, size);
       if (size > 1024)
         {
           LOG_ERROR("dwg_decode_eed: Absurd extended object data size: %lu ignored."
                     " Object: %lu (handle)",
                     (long unsigned int) size, obj->object->handle.value)
           obj->bitsize = 0;
-          obj->num_eed = 0;
-          obj->num_handles = 0;
-          obj->num_reactors = 0;
+          if (obj->object->supertype == DWG_SUPERTYPE_OBJECT)
+            {
+              obj->num_handles = 0;
+              obj->num_reactors = 0;
+            }
           return -1; //XXX
         }
+      error = bit_read_H(dat, &handle);
+      if (error)
+        {
+          LOG_ERROR("No EED[%d].handle\n", num);
+          return error;
+        }
+      dat->byte += size;
+      num++;
+    }
+  if (!num)
+    return 0;
 
-      if (idx) {
-        obj->eed = (Dwg_Eed*)realloc(obj->eed, (idx+1) * sizeof(Dwg_Eed));
-        memset(&obj->eed[idx], 0, sizeof(Dwg_Eed));
-      } else {
-        obj->eed = (Dwg_Eed*)calloc(1, sizeof(Dwg_Eed));
-      }
-      obj->eed[idx].size = size;
-      error = bit_read_H(dat, &obj->eed[idx].handle);
-      if (error) {
-        LOG_ERROR("No EED[%d].handle", idx);
-        obj->num_eed = 0;
-        free(obj->eed);
-        return error;
-      } else {
-        end = dat->byte + size;
-        LOG_TRACE("EED[%u] handle: %d.%d.%lu\n", idx,
-                  obj->eed[idx].handle.code, obj->eed[idx].handle.size,
-                  obj->eed[idx].handle.value);
-        if (obj->object->supertype == DWG_SUPERTYPE_OBJECT &&
-            obj->object->dxfname &&
-            !strcmp(obj->object->dxfname, "MLEADERSTYLE"))
-          { // check for is_new_format: has extended data for APPID “ACAD_MLEADERVER”
-            Dwg_Object_Ref ref;
-            ref.obj = NULL;
-            ref.handleref = obj->eed[idx].handle;
-            ref.absolute_ref = 0L;
-            if (dwg_resolve_handleref(&ref, obj->object))
-              {
-                Dwg_Data *dwg = obj->object->parent;
-                Dwg_Object_APPID_CONTROL *appid = dwg->appid_control;
-                if (appid)
-                  {
-                    // search absref in APPID_CONTROL apps[]
-                    for (j=0; j < appid->num_entries; j++)
-                      {
-                        if ( appid->apps[j]->absolute_ref == ref.absolute_ref )
-                          {
-                            Dwg_Object_MLEADERSTYLE *this = obj->tio.MLEADERSTYLE;
-                            this->is_new_format = 1;
-                            LOG_TRACE("EED found ACAD_MLEADERVER %lu: new format\n",
-                                      ref.absolute_ref);
-                          }
-                      }
-                  }
-              }
-          }
-      }
+  *dat = start;
+  obj->eed = (Dwg_Eed*)dwg_arena_calloc(dwg, num, sizeof(Dwg_Eed));
+  if (!obj->eed)
+    {
+      LOG_ERROR("Out of memory\n");
+      return -1;
+    }
+  for (idx = 0; idx < num; idx++)
+    {
+      BITCODE_BS j;
 
-      sav_byte = dat->byte;
-      obj->eed[idx].raw = bit_read_TF(dat, size);
+      size = obj->eed[idx].size = bit_read_BS(dat);
+      LOG_TRACE("EED[%u] size: " FORMAT_BS "\n", idx, size);
+      bit_read_H(dat, &obj->eed[idx].handle);
+      LOG_TRACE("EED[%u] handle: %d.%d.%lu\n", idx,
+                obj->eed[idx].handle.code, obj->eed[idx].handle.size,
+                obj->eed[idx].handle.value);
+      if (obj->object->supertype == DWG_SUPERTYPE_OBJECT &&
+          obj->object->dxfname &&
+          !strcmp(obj->object->dxfname, "MLEADERSTYLE"))
+        { // check for is_new_format: has extended data for APPID “ACAD_MLEADERVER”
+          Dwg_Object_Ref ref;
+          ref.obj = NULL;
+          ref.handleref = obj->eed[idx].handle;
+          ref.absolute_ref = 0L;
+          if (dwg_resolve_handleref(&ref, obj->object))
+            {
+              Dwg_Object_APPID_CONTROL *appid = dwg->appid_control;
+              if (appid)
+                {
+                  // search absref in APPID_CONTROL apps[]
+                  for (j=0; j < appid->num_entries; j++)
+                    {
+                      if ( appid->apps[j]->absolute_ref == ref.absolute_ref )
+                        {
+                          Dwg_Object_MLEADERSTYLE *this = obj->tio.MLEADERSTYLE;
+                          this->is_new_format = 1;
+                          LOG_TRACE("EED found ACAD_MLEADERVER %lu: new format\n",
+                                    ref.absolute_ref);
+                        }
+                    }
+                }
+            }
+        }
+      obj->eed[idx].raw = dwg_decode_TF(dwg, dat, size);
       LOG_INSANE_TF(obj->eed[idx].raw, size);
-      dat->byte = sav_byte;
+    }
+  bit_read_BS(dat); // the final 0
+  obj->num_eed = num;
+
+  if (dwg->opts & DWG_OPTS_LAZY_EED)
+    {
+      obj->object->eed_deferred = 1;
+      return 0;
+    }
+  return decode_eed_data(dwg, obj);
+}
+
+/* The raw size of the EED item at raw, and in *datasize the size of its
+   Dwg_Eed_Data. Strings get a NUL, and are cut at the end of the block. */
+static long
+eed_item_size(Dwg_Data *dwg, const unsigned char *raw, long avail,
+              long *datasize)
+{
+  long size, head = 0, nul = 0;
+
+  switch (raw[0])
+    {
+    case 0:
+      if (dwg->header.version < R_2007)
+        {
+          head = 4; /* code:1 + len:1 + cp:2 */
+          size = avail > 1 ? head + raw[1] : head;
+          nul = 1;
+        }
+      else
+        {
+          head = 3; /* code:1 + len:2 */
+          size = avail > 2 ? head + 2 * (raw[1] | (raw[2] << 8)) : head;
+          nul = 2;
+        }
+      break;
+    case 2: size = 2; break;
+    case 3: case 5: case 71: size = 5; break;
+    case 4:
+      head = 2; /* code:1 + len:1 */
+      size = avail > 1 ? head + raw[1] : head;
+      nul = 1;
+      break;
+    case 10: case 11: case 12: case 13: size = 25; break;
+    case 40: case 41: case 42: size = 9; break;
+    case 70: size = 3; break;
+    default: size = 1;
+    }
+  *datasize = size + nul;
+  if (size > avail)
+    {
+      size = avail;
+      if (nul)
+        *datasize = MAX(size, head) + nul;
+    }
+  return size;
+}
+
+/* Parses the raw EED blocks of obj into one entry per item. The first
+   entry of each block keeps its size and raw data, the following ones
+   have size 0. The entries, and the data of all items are allocated at
+   once. A block with an invalid item keeps only its first entry, without
+   data. */
+static int
+decode_eed_data(Dwg_Data *dwg, Dwg_Object_Object *obj)
+{
+  Dwg_Eed *blocks = obj->eed;
+  unsigned int num_blocks = obj->num_eed;
+  unsigned int b, idx, num = 0;
+  long datasize = 0;
+  char *data;
+
+  /* count the items and their data */
+  for (b = 0; b < num_blocks; b++)
+    {
+      const unsigned char *raw = (const unsigned char *)blocks[b].raw;
+      long pos = 0, avail = blocks[b].size;
+
+      if (!raw)
+        continue;
+      do
+        {
+          long size;
+          pos += eed_item_size(dwg, &raw[pos], avail - pos, &size);
+          datasize += size;
+          num++;
+        }
+      while (pos < avail);
+    }
+  obj->eed = (Dwg_Eed*)dwg_arena_calloc(dwg, num, sizeof(Dwg_Eed));
+  /* padded, so that each item can be read as whole Dwg_Eed_Data */
+  data = (char*)dwg_arena_calloc(dwg, datasize + sizeof(Dwg_Eed_Data), 1);
+  if (!obj->eed || !data)
+    {
+      LOG_ERROR("Out of memory\n");
+      obj->eed = blocks;
+      return -1;
+    }
+
+  for (idx = 0, b = 0; b < num_blocks; b++)
+    {
+      Bit_Chain eed_dat, *dat = &eed_dat;
+      BITCODE_BS size = blocks[b].size;
+      unsigned int first = idx;
 
-      while (dat->byte < end)
+      if (!blocks[b].raw)
+        continue;
+      /* with the NUL of dwg_decode_TF, to advance to the very end */
+      dat->chain = (unsigned char *)blocks[b].raw;
+      dat->size = size + 1;
+      dat->byte = 0;
+      dat->bit = 0;
+      dat->version = dwg->header.version;
+      dat->from_version = dwg->header.from_version;
+      obj->eed[idx].size = size;
+      obj->eed[idx].raw = blocks[b].raw;
+      do
         {
+          BITCODE_RC code;
+          BITCODE_BS j, avail = size - dat->byte;
+          long itemsize, pos = dat->byte;
+          long rawsize = eed_item_size(dwg, &dat->chain[pos], avail,
+                                       &itemsize);
           int lenc;
           BITCODE_RS lens;
 
-          obj->eed[idx].data = (Dwg_Eed_Data*)calloc(size + 2, 1);
+          obj->eed[idx].handle = blocks[b].handle;
+          obj->eed[idx].data = (Dwg_Eed_Data*)data;
+          data += itemsize;
           obj->eed[idx].data->code = code = bit_read_RC(dat);
           LOG_TRACE("EED[%u] code: %d\n", idx, (int)code);
           switch (code)
             {
             case 0:
               PRE(R_2007) {
-                obj->eed[idx].data->u.eed_0.length = lenc = bit_read_RC(dat);
+                /* unsigned, as counted by eed_item_size */
+                lenc = (unsigned char)bit_read_RC(dat);
+                obj->eed[idx].data->u.eed_0.length = lenc;
                 obj->eed[idx].data->u.eed_0.codepage = bit_read_RS_LE(dat);
-                if (lenc > size-4)
+                if (lenc > avail-4)
                   {
-                    LOG_ERROR("Invalid EED string len %d, max %d", lenc, size-4);
-                    obj->num_eed = 0;
-                    free(obj->eed[idx].raw);
-                    free(obj->eed[idx].data);
-                    free(obj->eed);
-                    dat->byte = end;
-                    return 1;
+                    LOG_ERROR("Invalid EED string len %d, max %d: EED[%u] "
+                              "skipped\n", lenc, avail-4, first);
+                    idx = first;
+                    obj->eed[idx].data = NULL;
+                    rawsize = avail; // to the end of the block
+                    break;
                   }
                 /* code:1 + len:1 + cp:2 */
                 bit_read_fixed(dat, obj->eed[idx].data->u.eed_0.string, lenc);
@@ -2277,7 +2750,7 @@ dwg_decode_eed(Bit_Chain * dat, Dwg_Object_Object * obj)
               } LATER_VERSIONS {
                 obj->eed[idx].data->u.eed_0_r2007.length = lens = bit_read_RS(dat);
                 /* code:1 + len:2 NUL? */
-                for (j=0; j < MIN(lens,(size-3)/2); j++)
+                for (j=0; j < MIN(lens,(avail-3)/2); j++)
                   obj->eed[idx].data->u.eed_0_r2007.string[j] = bit_read_RS_LE(dat);
                 //obj->eed[idx].data->u.eed_0_r2007.string[j] = 0; //already calloc'ed
 #ifdef _WIN32
@@ -2298,9 +2771,10 @@ dwg_decode_eed(Bit_Chain * dat, Dwg_Object_Object * obj)
                         obj->eed[idx].data->u.eed_3.layer);
               break;
             case 4:
-              obj->eed[idx].data->u.eed_4.length = lenc = bit_read_RC(dat);
+              lenc = (unsigned char)bit_read_RC(dat);
+              obj->eed[idx].data->u.eed_4.length = lenc;
               /* code:1 + len:1 */
-              for (j=0; j < MIN(lenc,size-2); j++)
+              for (j=0; j < MIN(lenc,avail-2); j++)
                 obj->eed[idx].data->u.eed_4.data[j] = bit_read_RC(dat);
               LOG_TRACE("EED[%u] raw: %s\n", idx, obj->eed[idx].data->u.eed_4.data);
               break;
@@ -2328,47 +2802,111 @@ dwg_decode_eed(Bit_Chain * dat, Dwg_Object_Object * obj)
             default:
               LOG_WARN("Unknown EED code %d", code);
             }
-#ifdef DEBUG
-          // sanity checks
-          if (code == 0 || code == 4)
-            assert(obj->eed[idx].data->u.eed_0.length <= size-1);
-          if (code == 10) // 3 double
-            assert(size >= 1 + 3*8);
-#endif
-
+          /* a cut string ends the block, as counted */
+          dat->byte = pos + rawsize;
           idx++;
-          obj->num_eed++;
-          if (dat->byte < end-1)
-            {
-              size = (long)(end - dat->byte + 1);
-              LOG_HANDLE("EED[%u] size remaining: %ld\n", idx, (long)size);
-
-              obj->eed = (Dwg_Eed*)realloc(obj->eed, (idx+1) * sizeof(Dwg_Eed));
-              obj->eed[idx].handle = obj->eed[idx-1].handle;
-              obj->eed[idx].size = 0;
-            }
         }
-      dat->byte = end;
+      while (dat->byte < size);
     }
-  return error;
+  obj->num_eed = idx;
+  return 0;
 }
 
-/* The first common part of every entity.
+/** dwg_decode_eed_data
+ * Parses the EED items of an object decoded with DWG_OPTS_LAZY_EED.
+ * Returns 0 on success, or when there is nothing to parse.
+ */
+int
+dwg_decode_eed_data(Dwg_Object *obj)
+{
+  Dwg_Data *dwg;
 
-   The last common part is common_entity_handle_data.spec
-   called by COMMON_ENTITY_HANDLE_DATA in dwg.spec
+  if (!obj || !obj->eed_deferred || !obj->tio.unknown)
+    return 0;
+  dwg = obj->parent;
+  loglevel = dwg_loglevel(dwg->opts);
+  obj->eed_deferred = 0;
+  return decode_eed_data(dwg, obj->supertype == DWG_SUPERTYPE_ENTITY
+                         ? (Dwg_Object_Object *)obj->tio.entity
+                         : obj->tio.object);
+}
 
-   For EED check page 269, par 28 (Extended Object Data)
- */
-static int
-dwg_decode_entity(Bit_Chain* dat, Bit_Chain* hdl_dat, Bit_Chain* str_dat,
-                  Dwg_Object_Entity* ent)
+/* de-obfuscates size bytes of SAT text from src to dst */
+static void
+decode_sat_block(unsigned char *dst, const unsigned char *src,
+                 unsigned long size)
 {
-  unsigned int i;
-  BITCODE_BS size;
-  int error;
+  unsigned long i;
+  int j;
 
-  VERSIONS(R_2000, R_2010)
+  // branchless in chunks of 16, so that it vectorizes also at -O2
+  for (i = 0; i + 16 <= size; i += 16)
+    for (j = 0; j < 16; j++)
+      {
+        unsigned char c = src[i + j];
+        dst[i + j] = c <= 32 ? c : 159 - c;
+      }
+  for (; i < size; i++)
+    {
+      unsigned char c = src[i];
+      dst[i] = c <= 32 ? c : 159 - c;
+    }
+}
+
+/** dwg_decode_sat_data
+ * De-obfuscates the SAT blocks of a 3DSOLID, REGION or BODY into a new
+ * buffer, which is then raw_sat_data. The blocks in sat_data are left
+ * as read. Returns 0 on success, or when there is nothing to
+ * de-obfuscate.
+ */
+int
+dwg_decode_sat_data(Dwg_Entity_3DSOLID *_obj)
+{
+  unsigned char *sat;
+  unsigned long size = 0;
+  BITCODE_BL i;
+
+  if (!_obj || _obj->raw_sat_data || _obj->acis_empty || _obj->version != 1
+      || !_obj->sat_data || !_obj->block_size)
+    return 0;
+  for (i = 0; i < _obj->num_blocks; i++)
+    size += _obj->block_size[i];
+  // no drawing to allocate from, dwg_free frees it
+  sat = (unsigned char *)malloc(size + 1);
+  if (!sat)
+    {
+      LOG_ERROR("Out of memory");
+      return 1;
+    }
+  size = 0;
+  for (i = 0; i < _obj->num_blocks; i++)
+    {
+      decode_sat_block(sat + size, (unsigned char *)_obj->sat_data[i],
+                       _obj->block_size[i]);
+      size += _obj->block_size[i];
+    }
+  sat[size] = '\0';
+  _obj->raw_sat_data = sat;
+  return 0;
+}
+
+/* The first common part of every entity.
+
+   The last common part is common_entity_handle_data.spec
+   called by COMMON_ENTITY_HANDLE_DATA in dwg.spec
+
+   For EED check page 269, par 28 (Extended Object Data)
+ */
+static int
+dwg_decode_entity(Bit_Chain* dat, Bit_Chain* hdl_dat, Bit_Chain* str_dat,
+                  Dwg_Object_Entity* ent)
+{
+  Dwg_Data *dwg = ent->object->parent;
+  unsigned int i;
+  BITCODE_BS size;
+  int error;
+
+  VERSIONS(R_2000, R_2010)
     {
       SINCE(R_2007) {
         *str_dat = *dat;
@@ -2422,7 +2960,7 @@ dwg_decode_entity(Bit_Chain* dat, Bit_Chain* hdl_dat, Bit_Chain* str_dat,
       LOG_TRACE("picture_size: " FORMAT_BLL " \n", ent->picture_size)
       if (ent->picture_size < 210210)
         {
-          ent->picture = bit_read_TF(dat, ent->picture_size);
+          ent->picture = dwg_decode_raw(dwg, dat, (long)ent->picture_size);
         }
       else
         {
@@ -2473,6 +3011,7 @@ dwg_decode_entity(Bit_Chain* dat, Bit_Chain* hdl_dat, Bit_Chain* str_dat,
           else
             {
               flags = bit_read_RS(dat);
+              ent->color.flag = flags >> 8;
 
               if (flags & 0x8000)
                 {
@@ -2483,15 +3022,14 @@ dwg_decode_entity(Bit_Chain* dat, Bit_Chain* hdl_dat, Bit_Chain* str_dat,
                   c2 = bit_read_RC(dat);
                   c3 = bit_read_RC(dat);
                   c4 = bit_read_RC(dat);
-                  name = bit_read_TV(dat);
+                  name = dwg_decode_TV(dwg, dat);
                   ent->color.index = 0;
                   ent->color.rgb   = c1 << 24 | c2 << 16 | c3 << 8 | c4;
-                  strcpy(ent->color.name, name);
+                  ent->color.name = name;
                 }
 
-              /*if (flags & 0x4000)
-                flags = flags;   // has AcDbColor reference (handle)
-              */
+              /* 0x4000: an AcDbColor reference, its handle is read with
+                 the common entity handles */
               if (flags & 0x2000)
                 {
                   ent->color.transparency_type = bit_read_BL(dat);
@@ -2505,7 +3043,7 @@ dwg_decode_entity(Bit_Chain* dat, Bit_Chain* hdl_dat, Bit_Chain* str_dat,
         }
     }
   OTHER_VERSIONS
-    bit_read_CMC(dat, &ent->color);
+    dwg_decode_CMC(dwg, dat, &ent->color);
 
   ent->linetype_scale = bit_read_BD(dat);
 
@@ -2615,17 +3153,63 @@ dwg_decode_object(Bit_Chain* dat, Bit_Chain* hdl_dat, Bit_Chain* str_dat,
   return 0;
 }
 
+/** dwg_object_index
+ * Returns the handle, index, type and supertype of each object in
+ * dwg->object, in the same order, for scans over many objects. It is
+ * rebuilt when objects were added since. NULL if out of memory.
+ */
+const Dwg_Object_Index *
+dwg_object_index(Dwg_Data *dwg)
+{
+  long unsigned int i;
+  Dwg_Object_Index *index;
+
+  if (dwg->object_index && dwg->num_indexed_objects == dwg->num_objects)
+    return dwg->object_index;
+  index = (Dwg_Object_Index *) realloc(dwg->object_index,
+      (dwg->num_objects ? dwg->num_objects : 1) * sizeof(Dwg_Object_Index));
+  if (!index)
+    return NULL;
+  for (i = 0; i < dwg->num_objects; i++)
+    {
+      const Dwg_Object *obj = &dwg->object[i];
+      index[i].handle = obj->handle.value;
+      index[i].index = (unsigned int)i;
+      index[i].type = (unsigned short)obj->type;
+      index[i].supertype = (unsigned char)obj->supertype;
+    }
+  dwg->object_index = index;
+  dwg->num_indexed_objects = dwg->num_objects;
+  return index;
+}
+
 /**
  * Find a pointer to an object given it's id (handle)
  */
-static Dwg_Object *
+Dwg_Object *
 dwg_resolve_handle(Dwg_Data * dwg, long unsigned int absref)
 {
-  //TODO hash table? this is linear search, absref's are unsorted.
-  long unsigned int i;
+  long unsigned int i, lo = 0, hi = dwg->num_objects;
+  const Dwg_Object_Index *index = dwg_object_index(dwg);
+
+  /* dwg->object is in object map order, i.e. ascending handles, unless
+     some object failed to decode. Bisect, and search linearly if that
+     missed. */
+  while (lo < hi)
+    {
+      long unsigned int mid = lo + (hi - lo) / 2;
+      long unsigned int value = index ? index[mid].handle
+                                      : dwg->object[mid].handle.value;
+      if (value == absref)
+        return &dwg->object[mid];
+      if (value < absref)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
   for (i = 0; i < dwg->num_objects; i++)
     {
-      if (dwg->object[i].handle.value == absref)
+      if ((index ? index[i].handle : dwg->object[i].handle.value) == absref)
         {
           return &dwg->object[i];
         }
@@ -2673,7 +3257,8 @@ Dwg_Object_Ref *
 dwg_decode_handleref(Bit_Chain * dat, Dwg_Object * obj, Dwg_Data* dwg)
 {
   // Welcome to the house of evil code
-  Dwg_Object_Ref* ref = (Dwg_Object_Ref *) calloc(1, sizeof(Dwg_Object_Ref));
+  Dwg_Object_Ref* ref = (Dwg_Object_Ref *)
+    dwg_arena_calloc(dwg, 1, sizeof(Dwg_Object_Ref));
   if (!ref)
     {
       LOG_ERROR("Out of memory");
@@ -2692,7 +3277,6 @@ dwg_decode_handleref(Bit_Chain * dat, Dwg_Object * obj, Dwg_Data* dwg)
         {
           LOG_ERROR("Could not read handleref in the header variables section")
         }
-      free(ref);
       return NULL;
     }
 
@@ -2824,6 +3408,117 @@ dwg_decode_handleref_with_code(Bit_Chain * dat, Dwg_Object * obj, Dwg_Data* dwg,
   return ref;
 }
 
+/** dwg_decode_TF
+ * Reads fixed text or raw bytes into the drawing arena, NUL-terminated.
+ */
+char *
+dwg_decode_TF(Dwg_Data *dwg, Bit_Chain *dat, long length)
+{
+  char *chain;
+
+  if (length < 0)
+    length = 0;
+  chain = (char *)dwg_arena_calloc(dwg, length + 1, 1);
+  if (chain)
+    bit_read_fixed(dat, chain, (int)length);
+  return chain;
+}
+
+/** dwg_decode_raw
+ * Reads binary data, not NUL-terminated. With DWG_OPTS_ZERO_COPY it is
+ * not copied if it is byte-aligned in the input, see dwg_detach().
+ */
+char *
+dwg_decode_raw(Dwg_Data *dwg, Bit_Chain *dat, long length)
+{
+  if (length > 0 && !dat->bit && (dwg->opts & DWG_OPTS_ZERO_COPY)
+      && dat->byte + length <= dat->size
+      && dwg_input_owns(dwg, &dat->chain[dat->byte]))
+    {
+      char *raw = (char *)&dat->chain[dat->byte];
+      dat->byte += length;
+      return raw;
+    }
+  return dwg_decode_TF(dwg, dat, length);
+}
+
+/** dwg_decode_TV
+ * Reads simple text into the drawing arena, like bit_read_TV().
+ * With DWG_OPTS_INTERN short text is interned instead.
+ */
+BITCODE_TV
+dwg_decode_TV(Dwg_Data *dwg, Bit_Chain *dat)
+{
+  unsigned int length;
+
+  DWG_STATS_PRIM(TV, dat);
+  length = (bit_read_BS)(dat);
+  if (dwg->intern && length < DWG_INTERN_MAX)
+    {
+      char str[DWG_INTERN_MAX];
+
+      bit_read_fixed(dat, str, (int)length);
+      str[length] = '\0';
+      /* the length may count the NUL */
+      return (BITCODE_TV)dwg_intern_bytes(dwg->intern, str, strlen(str) + 1);
+    }
+  return dwg_decode_TF(dwg, dat, length);
+}
+
+/** dwg_decode_TU
+ * Reads UCS-2 unicode text into the drawing arena, like bit_read_TU().
+ * With DWG_OPTS_INTERN short text is interned instead.
+ */
+BITCODE_TU
+dwg_decode_TU(Dwg_Data *dwg, Bit_Chain *dat)
+{
+  unsigned int i, length;
+  BITCODE_TU chain;
+  BITCODE_RS str[DWG_INTERN_MAX / 2]; /* UCS-2 either way */
+  int interned;
+
+  DWG_STATS_PRIM(TU, dat);
+  length = (bit_read_BS)(dat);
+  interned = dwg->intern && length < DWG_INTERN_MAX / 2;
+  if (interned)
+    chain = (BITCODE_TU)str;
+  else
+    chain = (BITCODE_TU)dwg_arena_calloc(dwg, length + 1, 2);
+  if (!chain)
+    return NULL;
+  for (i = 0; i < length; i++)
+    {
+      chain[i] = (bit_read_RS)(dat); // probably without byte swapping
+    }
+  if (interned)
+    {
+      chain[length] = 0;
+      for (i = 0; str[i]; i++)
+        ;
+      return (BITCODE_TU)dwg_intern_bytes(dwg->intern, (const char *)str,
+                                          (i + 1) * 2);
+    }
+  return chain;
+}
+
+/** dwg_decode_CMC
+ * Reads a color with its names in the drawing arena, like bit_read_CMC().
+ */
+void
+dwg_decode_CMC(Dwg_Data *dwg, Bit_Chain *dat, Dwg_Color *color)
+{
+  color->index = bit_read_BS(dat);
+  if (dat->version >= R_2004)
+    {
+      color->rgb = bit_read_BL(dat);
+      color->flag = bit_read_RC(dat);
+      if (color->flag & 1)
+        color->name = dwg_decode_TV(dwg, dat);
+      if (color->flag & 2)
+        color->book_name = dwg_decode_TV(dwg, dat);
+    }
+}
+
 void
 dwg_decode_header_variables(Bit_Chain* dat, Bit_Chain* hdl_dat, Bit_Chain* str_dat,
                             Dwg_Data * dwg)
@@ -2937,120 +3632,163 @@ get_base_value_type(short gc)
 }
 
 void
-dwg_free_xdata_resbuf(Dwg_Resbuf *rbuf)
+dwg_free_xdata_resbuf(Dwg_Data *dwg, Dwg_Resbuf *rbuf)
 {
+  /* a decoded list and its strings are in the arena, a list set by the
+     caller is freed item by item */
   while (rbuf)
     {
       Dwg_Resbuf *next = rbuf->next;
       short type = get_base_value_type(rbuf->type);
       if (type == VT_STRING || type == VT_BINARY)
-        free (rbuf->value.str.u.data);
-      free(rbuf);
+        dwg_arena_free(dwg, rbuf->value.str.u.data);
+      dwg_arena_free(dwg, rbuf);
       rbuf = next;
     }
 }
 
-// TODO: unify with eed[], use an array not linked list.
-static Dwg_Resbuf*
-dwg_decode_xdata(Bit_Chain * dat, Dwg_Object_XRECORD *obj, int size)
+/* Reads one xdata item into rbuf. Its string data is copied to *str,
+   which is advanced, or skipped when str is NULL. Returns the (even)
+   number of string bytes, or -1 for an invalid group code or an item
+   beyond end_address. */
+static int
+decode_xdata_item(Bit_Chain *dat, Dwg_Resbuf *rbuf,
+                  long unsigned int end_address, char **str)
 {
-  Dwg_Resbuf *rbuf, *root = NULL, *curr = NULL;
-  unsigned char codepage;
-  long unsigned int end_address;
-  int i, length, num_xdata = 0;
-
-  static int cnt = 0;
-  cnt++;
-
-  end_address = dat->byte + (unsigned long int)size;
-
-  while (dat->byte < end_address)
-    {
-      rbuf = (Dwg_Resbuf *) calloc(1, sizeof(Dwg_Resbuf));
-      if (!rbuf)
-        {
-          LOG_ERROR("Out of memory");
-          dwg_free_xdata_resbuf(root);
-          return NULL;
-        }
-      num_xdata++;
-      rbuf->next = NULL;
-      rbuf->type = bit_read_RS(dat);
-
-      switch (get_base_value_type(rbuf->type))
-        {
-        case VT_STRING:
-          UNTIL(R_2007) {
-            length = rbuf->value.str.size = bit_read_RS(dat);
-            rbuf->value.str.codepage = bit_read_RC(dat);
-            rbuf->value.str.u.data = bit_read_TF(dat, length);
-          } LATER_VERSIONS {
-            length = rbuf->value.str.size = bit_read_RS(dat);
-            if (length > 0)
+  int i, length = 0;
+
+  if (dat->byte >= end_address)
+    return -1;
+  rbuf->type = bit_read_RS(dat);
+  switch (get_base_value_type(rbuf->type))
+    {
+    case VT_STRING:
+      length = rbuf->value.str.size = bit_read_RS(dat);
+      UNTIL(R_2007) {
+        rbuf->value.str.codepage = bit_read_RC(dat);
+        if (dat->byte + length > end_address)
+          return -1;
+        if (str)
+          {
+            rbuf->value.str.u.data = *str;
+            bit_read_fixed(dat, *str, length);
+          }
+        else
+          bit_advance_position(dat, length * 8);
+        length++;
+      } LATER_VERSIONS {
+        if (dat->byte + 2 * length > end_address)
+          return -1;
+        if (length > 0)
+          {
+            if (str)
               {
-                rbuf->value.str.u.wdata = calloc(length + 1, 2);
-                if (!rbuf->value.str.u.wdata)
-                  {
-                    LOG_ERROR("Out of memory");
-                    if (root)
-                      dwg_free_xdata_resbuf(root);
-                    else
-                      dwg_free_xdata_resbuf(rbuf);
-                    return NULL;
-                  }
+                rbuf->value.str.u.wdata = (DWGCHAR *)*str;
                 for (i = 0; i < length; i++)
                   rbuf->value.str.u.wdata[i] = bit_read_RS(dat);
-                rbuf->value.str.u.wdata[i] = '\0';
               }
+            else
+              bit_advance_position(dat, length * 16);
+            length = 2 * (length + 1);
           }
-          break;
-        case VT_REAL:
-          rbuf->value.dbl = bit_read_RD(dat);
-          break;
-        case VT_BOOL:
-        case VT_INT8:
-          rbuf->value.i8 = bit_read_RC(dat);
-          break;
-        case VT_INT16:
-          rbuf->value.i16 = bit_read_RS(dat);
-          break;
-        case VT_INT32:
-          rbuf->value.i32 = bit_read_RL(dat);
-          break;
-        case VT_POINT3D:
-          rbuf->value.pt[0] = bit_read_RD(dat);
-          rbuf->value.pt[1] = bit_read_RD(dat);
-          rbuf->value.pt[2] = bit_read_RD(dat);
-          break;
-        case VT_BINARY:
-          rbuf->value.str.size = bit_read_RC(dat);
-          rbuf->value.str.u.data = bit_read_TF(dat, rbuf->value.str.size);
-          break;
-        case VT_HANDLE:
-        case VT_OBJECTID:
-          bit_read_fixed(dat, (char*)rbuf->value.hdl, 8);
-          break;
-        case VT_INVALID:
-        default:
-          LOG_ERROR("Invalid group code in xdata: %d", rbuf->type)
-          dwg_free_xdata_resbuf(rbuf);
-          dat->byte = end_address;
-          obj->num_eed = num_xdata;
-          return root;
-        }
-
-      if (!curr)
+      }
+      break;
+    case VT_REAL:
+      rbuf->value.dbl = bit_read_RD(dat);
+      break;
+    case VT_BOOL:
+    case VT_INT8:
+      rbuf->value.i8 = bit_read_RC(dat);
+      break;
+    case VT_INT16:
+      rbuf->value.i16 = bit_read_RS(dat);
+      break;
+    case VT_INT32:
+      rbuf->value.i32 = bit_read_RL(dat);
+      break;
+    case VT_POINT3D:
+      rbuf->value.pt[0] = bit_read_RD(dat);
+      rbuf->value.pt[1] = bit_read_RD(dat);
+      rbuf->value.pt[2] = bit_read_RD(dat);
+      break;
+    case VT_BINARY:
+      length = rbuf->value.str.size = bit_read_RC(dat);
+      if (dat->byte + length > end_address)
+        return -1;
+      if (str)
         {
-          curr = root = rbuf;
+          rbuf->value.str.u.data = *str;
+          bit_read_fixed(dat, *str, length);
         }
       else
-        {
-          curr->next = rbuf;
-          curr = rbuf;
-        }
+        bit_advance_position(dat, length * 8);
+      length++;
+      break;
+    case VT_HANDLE:
+    case VT_OBJECTID:
+      bit_read_fixed(dat, (char*)rbuf->value.hdl, 8);
+      break;
+    case VT_INVALID:
+    default:
+      LOG_ERROR("Invalid group code in xdata: %d\n", rbuf->type)
+      return -1;
+    }
+  /* keep the wide strings aligned */
+  length = (length + 1) & ~1;
+  if (str)
+    *str += length;
+  return length;
+}
+
+/* The items are counted first, and then read into one array of
+   num_eed resbufs, followed by all their strings. next still links
+   the array, for callers walking it as list. */
+static Dwg_Resbuf*
+dwg_decode_xdata(Dwg_Data *dwg, Bit_Chain * dat, Dwg_Object_XRECORD *obj,
+                 int size)
+{
+  Dwg_Resbuf *root, rbuf;
+  Bit_Chain count_dat = *dat;
+  long unsigned int end_address;
+  unsigned int i, num_xdata = 0;
+  size_t strsize = 0;
+  char *str;
+  int length;
+
+  end_address = dat->byte + (unsigned long int)size;
+  if (end_address > dat->size)
+    end_address = dat->size;
+
+  while ((length = decode_xdata_item(&count_dat, &rbuf, end_address, NULL))
+         >= 0)
+    {
+      num_xdata++;
+      strsize += length;
+    }
+  obj->num_eed = num_xdata;
+  if (!num_xdata)
+    {
+      dat->byte = end_address;
+      return NULL;
+    }
+
+  root = (Dwg_Resbuf *) dwg_arena_calloc(dwg, 1, num_xdata * sizeof(Dwg_Resbuf)
+                                                 + strsize);
+  if (!root)
+    {
+      LOG_ERROR("Out of memory\n");
+      obj->num_eed = 0;
+      return NULL;
     }
-    obj->num_eed = num_xdata;
-    return root;
+  str = (char *)&root[num_xdata];
+  for (i = 0; i < num_xdata; i++)
+    {
+      decode_xdata_item(dat, &root[i], end_address, &str);
+      root[i].next = i + 1 < num_xdata ? &root[i + 1] : NULL;
+    }
+  if (count_dat.byte < end_address)
+    dat->byte = end_address;
+  return root;
 }
 
 /* OBJECTS *******************************************************************/
@@ -3066,7 +3804,7 @@ decode_preR13_entities(unsigned long start, unsigned long end,
                        unsigned long offset,
                        Bit_Chain* dat, Dwg_Data * dwg)
 {
-  int num = dwg->num_objects;
+  long unsigned int num = dwg->num_objects;
   LOG_TRACE("entities: (0x%lx-0x%lx, offset 0x%lx) TODO\n", start, end, offset)
 
   while (dat->byte < end)
@@ -3075,16 +3813,8 @@ decode_preR13_entities(unsigned long start, unsigned long end,
       Dwg_Object_Entity* ent;
       BITCODE_RS crc;
 
-      if (!num)
-        dwg->object = (Dwg_Object *) malloc(sizeof(Dwg_Object));
-      else
-        dwg->object = (Dwg_Object *) realloc(dwg->object, (num + 1)
-                                             * sizeof(Dwg_Object));
-      if (!dwg->object)
-        {
-          LOG_ERROR("Out of memory");
-          return;
-        }
+      if (reserve_objects(dwg, num + 1))
+        return;
       obj = &dwg->object[num];
       memset(obj, 0, sizeof(Dwg_Object));
       obj->index = num;
@@ -3092,7 +3822,8 @@ decode_preR13_entities(unsigned long start, unsigned long end,
       dwg->num_entities++;
       obj->parent = dwg;
       obj->supertype = DWG_SUPERTYPE_ENTITY;
-      ent = obj->tio.entity = (Dwg_Object_Entity*)calloc (1, sizeof(Dwg_Object_Entity));
+      ent = obj->tio.entity = (Dwg_Object_Entity*)
+        dwg_arena_calloc(dwg, 1, sizeof(Dwg_Object_Entity));
       obj->tio.entity->object = obj;
     
       DEBUG_HERE();
@@ -3163,6 +3894,7 @@ decode_preR13_entities(unsigned long start, unsigned long end,
             break;
         }
       crc = bit_read_RS(dat);
+      num++; // the next entity into the next object
     }
 
   dat->byte = end;
@@ -3528,49 +4260,119 @@ dwg_decode_variable_type(Dwg_Data* dwg, Bit_Chain* dat, Bit_Chain* hdl_dat, Dwg_
   return 0;
 }
 
+/* Makes room for num objects in dwg->object. It grows by half at least,
+   so it moves rarely. The structs of moved objects point back to their
+   old place until update_back_pointers.
+ */
+static int
+reserve_objects(Dwg_Data *dwg, long unsigned int num)
+{
+  long unsigned int alloced = dwg->num_alloced_objects;
+  Dwg_Object *object;
+
+  if (dwg->object && num <= alloced)
+    return 0;
+  alloced += alloced / 2;
+  if (alloced < num)
+    alloced = num < 64 ? 64 : num;
+  object = (Dwg_Object *) realloc(dwg->object, alloced * sizeof(Dwg_Object));
+  if (!object)
+    {
+      LOG_ERROR("Out of memory\n");
+      return 1;
+    }
+  dwg->object = object;
+  dwg->num_alloced_objects = alloced;
+  return 0;
+}
+
 void
 dwg_decode_add_object(Dwg_Data* dwg, Bit_Chain* dat, Bit_Chain* hdl_dat,
                       long unsigned int address)
+{
+  long unsigned int num = dwg->num_objects;
+
+  //DEBUG_HERE();
+  if (reserve_objects(dwg, num + 1))
+    return;
+  dwg->num_objects++;
+  decode_object_at(dwg, dat, hdl_dat, address, num, 0);
+}
+
+/* Decodes the object at address into the reserved dwg->object[num].
+   base is the offset of dat in its section, for a window of it.
+ */
+static void
+decode_object_at(Dwg_Data* dwg, Bit_Chain* dat, Bit_Chain* hdl_dat,
+                 long unsigned int address, long unsigned int num,
+                 long unsigned int base)
 {
   long unsigned int oldpos;
-  long unsigned int object_address, end_address;
   unsigned char previous_bit;
   Dwg_Object *obj;
-  long unsigned int num = dwg->num_objects;
+  long unsigned int num_object_refs = dwg->num_object_refs;
+  Dwg_Arena_Mark mark;
+  Dwg_Stats_Mark phase;
+
+  if (dwg->callbacks)
+    dwg_arena_mark(dwg, &mark);
 
   /* Keep the previous address
    */
   oldpos = dat->byte;
   previous_bit = dat->bit;
 
-  /* Use the indicated address for the object
-   */
-  dat->byte = address;
-  dat->bit = 0;
-
-  //DEBUG_HERE();
-  /*
-   * Reserve memory space for objects
-   */
-  if (!num)
-    dwg->object = (Dwg_Object *) malloc(sizeof(Dwg_Object));
-  else
-    dwg->object = (Dwg_Object *) realloc(dwg->object, (num + 1)
-        * sizeof(Dwg_Object));
-  if (!dwg->object)
-    {
-      LOG_ERROR("Out of memory");
-      return;
-    }
-
   LOG_INFO("==========================================\n"
            "Object number: %lu", num)
 
   obj = &dwg->object[num];
   memset(obj, 0, sizeof(Dwg_Object));
   obj->index = num;
-  dwg->num_objects++;
   obj->parent = dwg;
+  dwg_stats_begin(dwg, DWG_PHASE_OBJECTS, &phase);
+  decode_object(dwg, dat, hdl_dat, obj, address);
+  dwg_stats_end(dwg, &phase, DWG_STATS_TYPE(dwg, obj->type), obj->size);
+
+  if (base)
+    {
+      obj->address += base;
+      if (obj->hdlpos)
+        obj->hdlpos += base * 8;
+    }
+
+  /* dwg_stream: hand the object over, and release all but the tables.
+     Only the Dwg_Object with its type and handle stays as index. */
+  if (dwg->callbacks && dwg->callbacks->object
+      && dwg->callbacks->object(obj, dwg->userdata) != DWG_STREAM_KEEP
+      && !(obj->type >= DWG_TYPE_BLOCK_CONTROL
+           && obj->type <= DWG_TYPE_VP_ENT_HDR))
+    {
+      dwg_arena_release(dwg, &mark);
+      dwg->num_object_refs = num_object_refs;
+      obj->supertype = DWG_SUPERTYPE_UNKNOWN;
+      obj->tio.unknown = NULL;
+    }
+
+  /* Register the previous addresses for return
+   */
+  dat->byte = oldpos;
+  dat->bit = previous_bit;
+}
+
+/* Decodes the object at address into obj, or again into its own
+   structs when it is decode_in_place, see decode_again.
+ */
+static void
+decode_object(Dwg_Data* dwg, Bit_Chain* dat, Bit_Chain* hdl_dat,
+              Dwg_Object* obj, long unsigned int address)
+{
+  long unsigned int object_address, end_address;
+
+  /* Use the indicated address for the object
+   */
+  dat->byte = address;
+  dat->bit = 0;
+
   obj->size = bit_read_MS(dat);
   LOG_INFO(", Size: %d/0x%x", obj->size, obj->size)
   obj->address = object_address = dat->byte;
@@ -3588,6 +4390,17 @@ dwg_decode_add_object(Dwg_Data* dwg, Bit_Chain* dat, Bit_Chain* hdl_dat,
   }
   LOG_INFO(", Type: %d\n", obj->type)
 
+  /* DWG_OPTS_LAZY_*: the tables are needed to decode the rest */
+  if (dat->version >= R_2007 && !obj->tio.unknown
+      && !(obj->type >= DWG_TYPE_BLOCK_CONTROL
+           && obj->type <= DWG_TYPE_VP_ENT_HDR))
+    {
+      if (dwg->opts & DWG_OPTS_LAZY_HANDLES)
+        obj->handles_deferred = 1;
+      if (dwg->opts & DWG_OPTS_LAZY_STRINGS)
+        obj->strings_deferred = 1;
+    }
+
   /* Check the type of the object
    */
   switch (obj->type)
@@ -3889,7 +4702,8 @@ dwg_decode_add_object(Dwg_Data* dwg, Bit_Chain* dat, Bit_Chain* hdl_dat,
                 }
               object_address = dat->byte;
               obj->supertype = DWG_SUPERTYPE_UNKNOWN;
-              obj->tio.unknown = (unsigned char *)bit_read_TF(dat, obj->size);
+              obj->tio.unknown = (unsigned char *)dwg_decode_raw(dwg, dat,
+                                                                 obj->size);
               dat->byte = object_address;
             }
         }
@@ -3903,11 +4717,267 @@ dwg_decode_add_object(Dwg_Data* dwg, Bit_Chain* dat, Bit_Chain* hdl_dat,
        fprintf (stderr, "End address:\t%10lu (calculated)\n", address + 2 + obj->size);
      }
    */
+}
 
-  /* Register the previous addresses for return
-   */
-  dat->byte = oldpos;
-  dat->bit = previous_bit;
+/* Decodes obj again into its own structs, with all of its deferred
+   streams, and resolves its new references. Pointers to its structs stay
+   valid.
+ */
+static int
+decode_again(Dwg_Object *obj, const char *what)
+{
+  Dwg_Data *dwg = obj->parent;
+  Bit_Chain dat;
+  long unsigned int i, num_entities, num_object_refs;
+  BITCODE_B eed_deferred = obj->eed_deferred;
+
+  loglevel = dwg_loglevel(dwg->opts);
+  if (!dwg->objects_section || !obj->tio.unknown)
+    {
+      LOG_ERROR("No object data for the %s of object %u\n", what, obj->index)
+      return 1;
+    }
+
+  dat.chain = dwg->objects_section;
+  dat.size = dwg->objects_section_size;
+  dat.byte = 0;
+  dat.bit = 0;
+  dat.version = dwg->header.version;
+  dat.from_version = dwg->header.from_version;
+
+  LOG_INFO("==========================================\n"
+           "Object %s: %u", what, obj->index)
+  num_entities = dwg->num_entities;
+  num_object_refs = dwg->num_object_refs;
+  /* both streams at once, the structs are decoded anew */
+  obj->handles_deferred = 0;
+  obj->strings_deferred = 0;
+  decode_in_place = obj;
+  /* the map address is before the MS size, of one or two words */
+  decode_object(dwg, &dat, &dat, obj,
+                obj->address - (obj->size < 0x8000 ? 2 : 4));
+  decode_in_place = NULL;
+  dwg->num_entities = num_entities;
+  /* the EED was parsed already */
+  if (!eed_deferred)
+    dwg_decode_eed_data(obj);
+
+  for (i = num_object_refs; i < dwg->num_object_refs; i++)
+    dwg->object_ref[i]->obj =
+      dwg_resolve_handle(dwg, dwg->object_ref[i]->absolute_ref);
+  return 0;
+}
+
+/** dwg_decode_handles
+ * Reads the handle stream of an object decoded with DWG_OPTS_LAZY_HANDLES,
+ * and resolves its new references. Deferred strings are read too.
+ * Returns 0 on success, or when there is nothing to read.
+ */
+int
+dwg_decode_handles(Dwg_Object *obj)
+{
+  if (!obj || !obj->handles_deferred)
+    return 0;
+  return decode_again(obj, "handles");
+}
+
+/* the handle n + 1 in the handle stream of obj, resolved */
+static Dwg_Object *
+entity_handle(Dwg_Object *obj, long unsigned int n)
+{
+  Dwg_Data *dwg = obj->parent;
+  Dwg_Object_Ref ref;
+  Bit_Chain dat;
+
+  dat.chain = dwg->objects_section;
+  dat.size = dwg->objects_section_size;
+  dat.version = dwg->header.version;
+  dat.from_version = dwg->header.from_version;
+  bit_set_position(&dat, obj->hdlpos);
+  memset(&ref, 0, sizeof(Dwg_Object_Ref));
+  do
+    {
+      if (bit_read_H(&dat, &ref.handleref))
+        return NULL;
+    }
+  while (n--);
+  /* a null handle, as in dwg_decode_handleref() */
+  if (!ref.handleref.size || !dwg_resolve_handleref(&ref, obj))
+    return NULL;
+  return dwg_resolve_handle(dwg, ref.absolute_ref);
+}
+
+/* the handles before the layer, as in common_entity_handle_data.spec,
+   deferred since R2007 */
+static long unsigned int
+entity_layer_pos(const Dwg_Object_Entity *ent)
+{
+  long unsigned int n = ent->num_reactors;
+
+  if (ent->color.flag & 0x40)
+    n++; // color_handle
+  if (ent->entity_mode == 0)
+    n++; // subentity
+  if (!ent->xdic_missing_flag)
+    n++;
+  return n;
+}
+
+static int
+deferred_entity(const Dwg_Object *obj)
+{
+  return obj->handles_deferred && obj->supertype == DWG_SUPERTYPE_ENTITY
+         && obj->tio.entity && obj->parent->objects_section;
+}
+
+/** dwg_decode_entity_handle
+ * Reads one handle of an entity decoded with DWG_OPTS_LAZY_HANDLES, the
+ * one after its common entity handles and skip more, and resolves it.
+ * Unlike dwg_decode_handles() the entity stays as it is.
+ * Returns the object, or NULL if the handle is null or not found.
+ */
+Dwg_Object *
+dwg_decode_entity_handle(Dwg_Object *obj, unsigned int skip)
+{
+  Dwg_Object_Entity *ent = obj->tio.entity;
+  long unsigned int n;
+
+  if (!deferred_entity(obj))
+    return NULL;
+  n = skip + entity_layer_pos(ent) + 1; // layer
+  if (ent->linetype_flags == 3)
+    n++;
+  if (ent->material_flags == 3)
+    n++;
+  if (ent->shadow_flags == 3)
+    n++;
+  if (ent->plotstyle_flags == 3)
+    n++;
+  if (obj->parent->header.version >= R_2010)
+    n += ent->has_full_visualstyle + ent->has_face_visualstyle
+         + ent->has_edge_visualstyle;
+  return entity_handle(obj, n);
+}
+
+/** dwg_decode_entity_layer
+ * Reads the layer handle of an entity decoded with DWG_OPTS_LAZY_HANDLES,
+ * and resolves it. The entity stays as it is.
+ * Returns the LAYER object, or NULL if the handle is null or not found.
+ */
+Dwg_Object *
+dwg_decode_entity_layer(Dwg_Object *obj)
+{
+  if (!deferred_entity(obj))
+    return NULL;
+  return entity_handle(obj, entity_layer_pos(obj->tio.entity));
+}
+
+/** dwg_decode_strings
+ * Reads the string fields of an object decoded with DWG_OPTS_LAZY_STRINGS,
+ * and its deferred handles too.
+ * Returns 0 on success, or when there is nothing to read.
+ */
+int
+dwg_decode_strings(Dwg_Object *obj)
+{
+  if (!obj || !obj->strings_deferred)
+    return 0;
+  return decode_again(obj, "strings");
+}
+
+/** dwg_object_map_add
+ * Appends an object handle and address in handle order, to be decoded
+ * later by dwg_decode_object_map. returns 0 on success.
+ */
+int
+dwg_object_map_add(Dwg_Object_Map *map, long unsigned int handle,
+                   long unsigned int address)
+{
+  if (map->num == map->size)
+    {
+      long unsigned int size = map->size ? map->size * 2 : 1024;
+      Dwg_Object_Map_Entry *entries = (Dwg_Object_Map_Entry *)
+        realloc(map->entries, size * sizeof(Dwg_Object_Map_Entry));
+      if (!entries)
+        {
+          LOG_ERROR("Out of memory\n");
+          return -1;
+        }
+      map->entries = entries;
+      map->size = size;
+    }
+  map->entries[map->num].address = address;
+  map->entries[map->num].index = map->num;
+  map->entries[map->num].handle = handle;
+  map->num++;
+  return 0;
+}
+
+static int
+compare_map_address(const void *a, const void *b)
+{
+  const Dwg_Object_Map_Entry *ea = (const Dwg_Object_Map_Entry *)a;
+  const Dwg_Object_Map_Entry *eb = (const Dwg_Object_Map_Entry *)b;
+
+  if (ea->address != eb->address)
+    return ea->address < eb->address ? -1 : 1;
+  return ea->index < eb->index ? -1 : ea->index > eb->index;
+}
+
+/** dwg_decode_object_map
+ * DWG_OPTS_SEQUENTIAL: decodes all objects of the map in ascending
+ * file offset, each into its handle order slot in dwg->object.
+ * The map is freed. returns 0 on success, -1 if out of memory.
+ */
+int
+dwg_decode_object_map(Dwg_Data *dwg, Bit_Chain *dat, Bit_Chain *hdl_dat,
+                      Dwg_Object_Map *map)
+{
+  int error = 0;
+
+  if (map->num && reserve_object_map(dwg, map))
+    error = -1;
+  else if (map->num)
+    {
+      long unsigned int base = dwg->num_objects - map->num;
+      long unsigned int i;
+
+      for (i = 0; i < map->num; i++)
+        decode_object_at(dwg, dat, hdl_dat, map->entries[i].address,
+                         base + map->entries[i].index, 0);
+    }
+  free(map->entries);
+  memset(map, 0, sizeof(Dwg_Object_Map));
+  return error;
+}
+
+/* Appends the cleared objects of the map to dwg->object, and sorts the
+   map by address. The APPID_CONTROL goes first, as in handle order:
+   the EED of an MLEADERSTYLE needs dwg->appid_control for its format. */
+static int
+reserve_object_map(Dwg_Data *dwg, Dwg_Object_Map *map)
+{
+  long unsigned int base = dwg->num_objects;
+  Dwg_Object_Ref *appid_control = dwg->header_vars.APPID_CONTROL_OBJECT;
+  long unsigned int i;
+
+  if (reserve_objects(dwg, base + map->num))
+    return -1;
+  memset(&dwg->object[base], 0, map->num * sizeof(Dwg_Object));
+  dwg->num_objects = base + map->num;
+
+  qsort(map->entries, map->num, sizeof(Dwg_Object_Map_Entry),
+        compare_map_address);
+  for (i = 0; appid_control && i < map->num; i++)
+    if (map->entries[i].handle == appid_control->absolute_ref)
+      {
+        Dwg_Object_Map_Entry entry = map->entries[i];
+        memmove(&map->entries[1], &map->entries[0],
+                i * sizeof(Dwg_Object_Map_Entry));
+        map->entries[0] = entry;
+        break;
+      }
+  return 0;
 }
 
 #undef IS_DECODER
@@ -44,4 +44,54 @@ get_base_value_type(short gc);
 int
 dwg_decode(Bit_Chain *dat, Dwg_Data *dwg);
 
+/* strings read into the drawing arena */
+char *
+dwg_decode_TF(Dwg_Data *dwg, Bit_Chain *dat, long length);
+char *
+dwg_decode_raw(Dwg_Data *dwg, Bit_Chain *dat, long length);
+BITCODE_TV
+dwg_decode_TV(Dwg_Data *dwg, Bit_Chain *dat);
+BITCODE_TU
+dwg_decode_TU(Dwg_Data *dwg, Bit_Chain *dat);
+void
+dwg_decode_CMC(Dwg_Data *dwg, Bit_Chain *dat, Dwg_Color *color);
+
+void
+dwg_free_xdata_resbuf(Dwg_Data *dwg, Dwg_Resbuf *rbuf);
+
+/* the object of the absolute handle absref, or NULL */
+Dwg_Object *
+dwg_resolve_handle(Dwg_Data *dwg, long unsigned int absref);
+
+/* the handle after the common entity handles and skip more, of an
+   entity with deferred handles */
+Dwg_Object *
+dwg_decode_entity_handle(Dwg_Object *obj, unsigned int skip);
+
+/* the layer of an entity with deferred handles */
+Dwg_Object *
+dwg_decode_entity_layer(Dwg_Object *obj);
+
+/* The object map collected with DWG_OPTS_SEQUENTIAL */
+typedef struct _dwg_object_map_entry
+{
+  long unsigned int address;
+  long unsigned int index; /* in handle order */
+  long unsigned int handle;
+} Dwg_Object_Map_Entry;
+
+typedef struct _dwg_object_map
+{
+  Dwg_Object_Map_Entry *entries;
+  long unsigned int num;
+  long unsigned int size;
+} Dwg_Object_Map;
+
+int
+dwg_object_map_add(Dwg_Object_Map *map, long unsigned int handle,
+                   long unsigned int address);
+int
+dwg_decode_object_map(Dwg_Data *dwg, Bit_Chain *dat, Bit_Chain *hdl_dat,
+                      Dwg_Object_Map *map);
+
 #endif
@@ -18,17 +18,21 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <sys/types.h>
 #include <stdbool.h>
 #include <assert.h>
 #include "bits.h"
 #include "dec_macros.h"
+#include "decode.h"
+#include "stats.h"
+#include "intern.h"
 
-/* The logging level for the read (decode) path.  */
-static unsigned int loglevel;
+/* The logging level for the read (decode) path, per thread.  */
+static THREAD_LOCAL unsigned int loglevel;
 /* the current version per spec block */
-static unsigned int cur_ver = 0;
+static THREAD_LOCAL unsigned int cur_ver = 0;
 
 #define DWG_LOGLEVEL loglevel
 #include "logging.h"
@@ -102,9 +106,17 @@ typedef struct _r2007_page
   int64_t id;
   int64_t size;
   int64_t offset;
-  struct _r2007_page *next;
 } r2007_page;
 
+/* the pages in file order, and indexed by their id */
+typedef struct _r2007_pages
+{
+  r2007_page *pages;
+  int64_t num_pages;
+  r2007_page **by_id; /* NULL if the ids are too sparse */
+  int64_t size;       /* max. id + 1 */
+} r2007_pages;
+
 /* section page */
 typedef struct _r2007_section_page
 {
@@ -134,6 +146,13 @@ typedef struct _r2007_section
   struct _r2007_section *next;
 } r2007_section;
 
+/* the sections in file order, and indexed by their type */
+typedef struct _r2007_sections
+{
+  r2007_section *first;
+  r2007_section *by_type[SECTION_UNKNOWN + 1];
+} r2007_sections;
+
 /* exported */
 void read_r2007_init(Dwg_Data *dwg);
 int read_r2007_meta_data(Bit_Chain *dat, Bit_Chain *hdl_dat, Dwg_Data *dwg);
@@ -141,25 +160,26 @@ int read_r2007_meta_data(Bit_Chain *dat, Bit_Chain *hdl_dat, Dwg_Data *dwg);
 extern int rs_decode_block(unsigned char *blk, int fix);
 
 /* private */
-static r2007_section* get_section(r2007_section *sections_map,
+static r2007_section* get_section(r2007_sections *sections_map,
                                   Dwg_Section_Type sec_type);
-static r2007_page* get_page(r2007_page *pages_map, int64_t id);
-static void pages_destroy(r2007_page *page);
+static r2007_page* get_page(r2007_pages *pages_map, int64_t id);
+static void pages_destroy(r2007_pages *pages_map);
 static void sections_destroy(r2007_section *section);
-static r2007_section* read_sections_map(Bit_Chain* dat, int64_t size_comp,
-                                        int64_t size_uncomp,
-                                        int64_t correction);
+static int read_sections_map(Bit_Chain* dat, int64_t size_comp,
+                             int64_t size_uncomp, int64_t correction,
+                             r2007_sections *sections_map);
 static int read_data_section(Bit_Chain *sec_dat, Bit_Chain *dat,
-           r2007_section *sections_map, r2007_page *pages_map,
+           Dwg_Data *dwg, r2007_sections *sections_map, r2007_pages *pages_map,
                              Dwg_Section_Type sec_type);
 static int read_2007_section_classes(Bit_Chain* dat,
-           Dwg_Data *dwg, r2007_section *sections_map, r2007_page *pages_map);
+           Dwg_Data *dwg, r2007_sections *sections_map, r2007_pages *pages_map);
 static int read_2007_section_header(Bit_Chain* dat, Bit_Chain* hdl_dat,
-           Dwg_Data *dwg, r2007_section *sections_map, r2007_page *pages_map);
+           Dwg_Data *dwg, r2007_sections *sections_map, r2007_pages *pages_map);
 static int read_2007_section_handles(Bit_Chain* dat, Bit_Chain* hdl_dat,
-           Dwg_Data *dwg, r2007_section *sections_map, r2007_page *pages_map);
-static r2007_page* read_pages_map(Bit_Chain* dat, int64_t size_comp,
-                                  int64_t size_uncomp, int64_t correction);
+           Dwg_Data *dwg, r2007_sections *sections_map, r2007_pages *pages_map);
+static int read_pages_map(Bit_Chain* dat, int64_t size_comp,
+                          int64_t size_uncomp, int64_t correction,
+                          r2007_pages *pages_map);
 static void read_file_header(Bit_Chain* dat, r2007_file_header *file_header);
 static void read_instructions(unsigned char **src, unsigned char *opcode,
                               uint32_t *offset, uint32_t *length);
@@ -484,6 +504,7 @@ decompress_r2007(char *dst, int dst_size, char *src, int src_size)
   uint32_t length = 0;
   uint32_t offset = 0;
 
+  char *dst_start = dst;
   char *dst_end = dst + dst_size;
   char *src_end = src + src_size;
 
@@ -526,6 +547,11 @@ decompress_r2007(char *dst, int dst_size, char *src, int src_size)
 
       while (1)
         {
+          if ((dst + length) > dst_end || offset > (uint32_t)(dst - dst_start))
+            {
+              LOG_ERROR("Decompression error: offset or length overflow\n")
+              return 1;
+            }
           copy_bytes(dst, length, offset);
 
           dst += length;
@@ -586,7 +612,7 @@ static char*
 read_system_page(Bit_Chain* dat, int64_t size_comp, int64_t size_uncomp,
                  int64_t repeat_count)
 {
-  int i;
+  int error;
 
   int64_t pesize;      // Pre RS encoded size
   int64_t block_count; // Number of RS encoded blocks
@@ -608,6 +634,11 @@ read_system_page(Bit_Chain* dat, int64_t size_comp, int64_t size_uncomp,
   assert((uint64_t)repeat_count < DBG_MAX_COUNT);
   assert((uint64_t)page_size < DBG_MAX_COUNT);
 
+  if (dat->byte + page_size > dat->size)
+    {
+      LOG_ERROR("System page @%lu beyond the end of the file\n", dat->byte)
+      return NULL;
+    }
   data = (char*)malloc(size_uncomp + page_size);
   if (!data) {
     LOG_ERROR("Out of memory")
@@ -617,13 +648,26 @@ read_system_page(Bit_Chain* dat, int64_t size_comp, int64_t size_uncomp,
   rsdata = &data[size_uncomp];
   bit_read_fixed(dat, rsdata, page_size);
   pedata = decode_rs(rsdata, block_count, 239);
+  if (!pedata)
+    {
+      free(data);
+      return NULL;
+    }
 
   if (size_comp < size_uncomp)
-    decompress_r2007(data, size_uncomp, pedata, size_comp);
+    error = decompress_r2007(data, size_uncomp, pedata, size_comp);
   else
-    memcpy(data, pedata, size_uncomp);
+    {
+      memcpy(data, pedata, size_uncomp);
+      error = 0;
+    }
 
   free(pedata);
+  if (error)
+    {
+      free(data);
+      return NULL;
+    }
 
   return data;
 }
@@ -664,14 +708,16 @@ read_data_page(Bit_Chain* dat, unsigned char *decomp, int64_t page_size,
 }
 
 static int
-read_data_section(Bit_Chain *sec_dat, Bit_Chain *dat, r2007_section *sections_map,
-                  r2007_page *pages_map, Dwg_Section_Type sec_type)
+read_data_section(Bit_Chain *sec_dat, Bit_Chain *dat, Dwg_Data *dwg,
+                  r2007_sections *sections_map, r2007_pages *pages_map,
+                  Dwg_Section_Type sec_type)
 {
   r2007_section *section;
   r2007_page *page;
   int64_t max_decomp_size;
   unsigned char *decomp;
   int i;
+  Dwg_Stats_Mark mark;
 
   section = get_section(sections_map, sec_type);
   if (section == NULL) {
@@ -686,6 +732,7 @@ read_data_section(Bit_Chain *sec_dat, Bit_Chain *dat, r2007_section *sections_ma
     return 2;
   }
 
+  dwg_stats_begin(dwg, DWG_PHASE_DECOMPRESS, &mark);
   for (i = 0; i < (int)section->num_pages; i++)
     {
       r2007_section_page *section_page = section->pages[i];
@@ -693,6 +740,7 @@ read_data_section(Bit_Chain *sec_dat, Bit_Chain *dat, r2007_section *sections_ma
       if (page == NULL)
         {
           free(decomp);
+          dwg_stats_end(dwg, &mark, NULL, 0);
           LOG_ERROR("Failed to find page %d", (int)section_page->id)
           return 3;
         }
@@ -703,10 +751,13 @@ read_data_section(Bit_Chain *sec_dat, Bit_Chain *dat, r2007_section *sections_ma
           != 0)
         {
           free(decomp);
+          dwg_stats_end(dwg, &mark, NULL, 0);
           LOG_ERROR("Failed to read page")
           return 4;
         }
     }
+  dwg_stats_end(dwg, &mark, DWG_STATS_SECTION(dwg, sec_type),
+                max_decomp_size);
 
   sec_dat->bit     = 0;
   sec_dat->byte    = 0;
@@ -761,19 +812,21 @@ bfr_read_string(char **src)
   return str_base;
 }
 
-static r2007_section*
+static int
 read_sections_map(Bit_Chain* dat, int64_t size_comp,
-                  int64_t size_uncomp, int64_t correction)
+                  int64_t size_uncomp, int64_t correction,
+                  r2007_sections *sections_map)
 {
   char *data;
   r2007_section *sections = NULL, *last_section = NULL, *section;
   char *ptr, *ptr_end;
   int i, j = 0;
 
+  memset(sections_map, 0, sizeof(r2007_sections));
   data = read_system_page(dat, size_comp, size_uncomp, correction);
   if (!data) {
     LOG_ERROR("Failed to read system page")
-    return NULL;
+    return 1;
   }
 
   ptr = data;
@@ -788,7 +841,8 @@ read_sections_map(Bit_Chain* dat, int64_t size_comp,
         {
           LOG_ERROR("Out of memory");
           sections_destroy(sections); // the root
-          return NULL;
+          free(data);
+          return 2;
         }
 
       bfr_read(section, &ptr, 64);
@@ -803,14 +857,22 @@ read_sections_map(Bit_Chain* dat, int64_t size_comp,
       LOG_TRACE("  encoding:      %"PRIu64"\n", section->encoded)
       LOG_TRACE("  num pages:     %"PRIu64"\n", section->num_pages)
 
-      //debugging sanity
-      assert(section->data_size <  DBG_MAX_SIZE);
-      assert(section->max_size  <  DBG_MAX_SIZE);
-      assert(section->name_length <  DBG_MAX_SIZE);
-      assert(section->num_pages < 0x10000);
+      // a corrupt map
+      if (section->data_size >= DBG_MAX_SIZE
+          || section->max_size >= DBG_MAX_SIZE
+          || section->name_length >= DBG_MAX_SIZE
+          || section->num_pages < 0 || section->num_pages >= 0x10000)
+        {
+          LOG_ERROR("Invalid section [%d]\n", j)
+          free(section);
+          sections_destroy(sections); // the root
+          free(data);
+          return 3;
+        }
 
       section->next  = NULL;
       section->pages = NULL;
+      section->name  = NULL;
 
       if (!sections)
         {
@@ -836,9 +898,12 @@ read_sections_map(Bit_Chain* dat, int64_t size_comp,
       LOG_TRACE("\n")
 #endif
       section->type = dwg_section_type(section->name);
+      if (section->type > 0 && section->type <= SECTION_UNKNOWN
+          && !sections_map->by_type[section->type])
+        sections_map->by_type[section->type] = section;
 
-      section->pages = (r2007_section_page**) malloc(
-        (size_t)section->num_pages * sizeof(r2007_section_page*));
+      section->pages = (r2007_section_page**) calloc(
+        (size_t)section->num_pages + 1, sizeof(r2007_section_page*));
       if (!section->pages)
         {
           LOG_ERROR("Out of memory");
@@ -846,7 +911,8 @@ read_sections_map(Bit_Chain* dat, int64_t size_comp,
             sections_destroy(sections); // the root
           else
             sections_destroy(section);
-          return NULL;
+          free(data);
+          return 2;
         }
 
       for (i = 0; i < section->num_pages; i++)
@@ -860,7 +926,8 @@ read_sections_map(Bit_Chain* dat, int64_t size_comp,
                 sections_destroy(sections); // the root
               else
                 sections_destroy(section);
-              return NULL;
+              free(data);
+              return 2;
             }
 
           bfr_read(section->pages[i], &ptr, 56);
@@ -876,122 +943,127 @@ read_sections_map(Bit_Chain* dat, int64_t size_comp,
           LOG_HANDLE("   checksum:      %"PRIx64"\n",
                     section->pages[i]->checksum);
           LOG_HANDLE("   crc:           %"PRIx64"\n\n", section->pages[i]->crc);
-          //debugging sanity
-          assert(section->pages[i]->size < DBG_MAX_SIZE);
-          assert(section->pages[i]->uncomp_size < DBG_MAX_SIZE);
-          assert(section->pages[i]->comp_size < DBG_MAX_SIZE);
+          // a corrupt map, with the pages after i still NULL
+          if (ptr > ptr_end
+              || section->pages[i]->size >= DBG_MAX_SIZE
+              || section->pages[i]->uncomp_size >= DBG_MAX_SIZE
+              || section->pages[i]->comp_size >= DBG_MAX_SIZE)
+            {
+              LOG_ERROR("Invalid page [%d] of section [%d]\n", i, j - 1)
+              sections_destroy(sections); // the root
+              free(data);
+              return 3;
+            }
         }
     }
 
   free(data);
 
-  return sections;
+  sections_map->first = sections;
+  return 0;
 }
 
-static r2007_page*
+static int
 read_pages_map(Bit_Chain* dat, int64_t size_comp,
-               int64_t size_uncomp, int64_t correction)
+               int64_t size_uncomp, int64_t correction,
+               r2007_pages *pages_map)
 {
-  char *data, *ptr, *ptr_end;
-  r2007_page *pages = 0, *last_page = 0, *page;
+  char *data, *ptr;
+  r2007_page *page;
   int64_t offset = 0x480;   //dat->byte;
-  int64_t index;
+  int64_t i, max_id = 0;
 
+  memset(pages_map, 0, sizeof(r2007_pages));
   data = read_system_page(dat, size_comp, size_uncomp, correction);
   if (!data) {
     LOG_ERROR("Failed to read system page")
-    return NULL;
+    return 1;
   }
 
-  ptr = data;
-  ptr_end = data + size_uncomp;
+  /* 16 bytes per page: size and id */
+  pages_map->pages = (r2007_page*) calloc((size_t)(size_uncomp / 16) + 1,
+                                          sizeof(r2007_page));
+  if (pages_map->pages == NULL)
+    {
+      LOG_ERROR("Out of memory\n")
+      free(data);
+      return 2;
+    }
 
   LOG_TRACE("\n=== System Section (Pages Map) ===\n")
 
-  while (ptr < ptr_end)
+  for (ptr = data; ptr + 16 <= data + size_uncomp; )
     {
-      page = (r2007_page*) malloc(sizeof(r2007_page));
-      if (page == NULL)
-        {
-          LOG_ERROR("Out of memory")
-          free(data);
-          pages_destroy(pages);
-          return NULL;
-        }
-
+      page = &pages_map->pages[pages_map->num_pages++];
       page->size   = bfr_read_int64(ptr);
       page->id     = bfr_read_int64(ptr);
       page->offset = offset;
       offset += page->size;
-
-      index = page->id > 0 ? page->id : -page->id;
+      if (page->id > max_id)
+        max_id = page->id;
 
       LOG_TRACE("Page [%2"PRId64"]: ", page->id)
       LOG_TRACE("size: 0x%05"PRIx64" ", page->size)
       //LOG_TRACE("id:      0x%"PRId64" ", page->id)
       LOG_TRACE("offset: 0x6%"PRIx64" \n", page->offset)
+    }
 
-      page->next = 0;
+  free(data);
 
-      if (pages == 0)
-        pages = last_page = page;
-      else
+  /* Index the pages by id, unless the ids are too sparse.
+     Negative ids are gaps. */
+  if (max_id <= 2 * pages_map->num_pages + 1024)
+    {
+      pages_map->by_id = (r2007_page**) calloc((size_t)max_id + 1,
+                                               sizeof(r2007_page*));
+      if (pages_map->by_id)
         {
-          last_page->next = page;
-          last_page = page;
+          pages_map->size = max_id + 1;
+          for (i = pages_map->num_pages - 1; i >= 0; i--) // the first wins
+            {
+              page = &pages_map->pages[i];
+              if (page->id > 0)
+                pages_map->by_id[page->id] = page;
+            }
         }
     }
-
-  free(data);
-
-  return pages;
+  return 0;
 }
 
 /* Lookup a page in the page map. The page is identified by its id.
  */
 static r2007_page*
-get_page(r2007_page *pages_map, int64_t id)
+get_page(r2007_pages *pages_map, int64_t id)
 {
-  r2007_page *page = pages_map;
+  int64_t i;
 
-  while (page != NULL)
+  if (pages_map->by_id && id > 0)
+    return id < pages_map->size ? pages_map->by_id[id] : NULL;
+  for (i = 0; i < pages_map->num_pages; i++)
     {
-      if (page->id == id)
-        break;
-      page = page->next;
+      if (pages_map->pages[i].id == id)
+        return &pages_map->pages[i];
     }
-
-  return page;
+  return NULL;
 }
 
 static void
-pages_destroy(r2007_page *page)
+pages_destroy(r2007_pages *pages_map)
 {
-  r2007_page *next;
-
-  while (page != 0)
-    {
-      next = page->next;
-      free(page);
-      page = next;
-    }
+  free(pages_map->by_id);
+  free(pages_map->pages);
+  memset(pages_map, 0, sizeof(r2007_pages));
 }
 
 /* Lookup a section in the section map.
  * The section is identified by its numeric type.
  */
 static r2007_section*
-get_section(r2007_section *sections_map, Dwg_Section_Type sec_type)
+get_section(r2007_sections *sections_map, Dwg_Section_Type sec_type)
 {
-  r2007_section *section = sections_map;
-  while (section != NULL)
-    {
-      if (section->type == sec_type)
-        break;
-      section = section->next;
-    }
-
-  return section;
+  if (sec_type > 0 && sec_type <= SECTION_UNKNOWN)
+    return sections_map->by_type[sec_type];
+  return NULL;
 }
 
 static void
@@ -1012,6 +1084,7 @@ sections_destroy(r2007_section *section)
           free(section->pages);
         }
 
+      free(section->name);
       free(section);
       section = next;
     }
@@ -1139,7 +1212,7 @@ section_string_stream(Bit_Chain *dat, BITCODE_RL bitsize, Bit_Chain *str)
 // for string stream see p86
 static int
 read_2007_section_classes(Bit_Chain* dat, Dwg_Data *dwg,
-                          r2007_section *sections_map, r2007_page *pages_map)
+                          r2007_sections *sections_map, r2007_pages *pages_map)
 {
   BITCODE_RL size, idc;
   BITCODE_BS max_num;
@@ -1148,7 +1221,7 @@ read_2007_section_classes(Bit_Chain* dat, Dwg_Data *dwg,
   char c;
 
   sec_dat.chain = NULL;
-  error = read_data_section(&sec_dat, dat, sections_map,
+  error = read_data_section(&sec_dat, dat, dwg, sections_map,
                             pages_map, SECTION_CLASSES);
   if (error)
     {
@@ -1240,6 +1313,7 @@ read_2007_section_classes(Bit_Chain* dat, Dwg_Data *dwg,
                     dwg->dwg_class[idc].unknown_2)
 
           dwg->dwg_class[idc].dxfname = bit_convert_TU(dwg->dwg_class[idc].dxfname_u);
+          dwg_intern_class(dwg, &dwg->dwg_class[idc]);
           if (strcmp(dwg->dwg_class[idc].dxfname, "LAYOUT") == 0)
             dwg->layout_number = dwg->dwg_class[idc].number;
         }
@@ -1256,12 +1330,12 @@ read_2007_section_classes(Bit_Chain* dat, Dwg_Data *dwg,
 
 static int
 read_2007_section_header(Bit_Chain* dat, Bit_Chain* hdl_dat, Dwg_Data *dwg,
-                         r2007_section *sections_map, r2007_page *pages_map)
+                         r2007_sections *sections_map, r2007_pages *pages_map)
 {
   Bit_Chain sec_dat, str_dat;
   int error;
   LOG_TRACE("\nHeader\n-------------------\n")
-  error = read_data_section(&sec_dat, dat, sections_map,
+  error = read_data_section(&sec_dat, dat, dwg, sections_map,
                             pages_map, SECTION_HEADER);
   if (error)
     {
@@ -1305,14 +1379,16 @@ read_2007_section_header(Bit_Chain* dat, Bit_Chain* hdl_dat, Dwg_Data *dwg,
 
 static int
 read_2007_section_handles(Bit_Chain* dat, Bit_Chain* hdl, Dwg_Data *dwg,
-                          r2007_section *sections_map, r2007_page *pages_map)
+                          r2007_sections *sections_map, r2007_pages *pages_map)
 {
-  static Bit_Chain obj_dat, hdl_dat;
+  Bit_Chain obj_dat, hdl_dat;
+  Dwg_Object_Map map;
   BITCODE_RS section_size = 0;
   long unsigned int endpos;
   int error;
 
-  error = read_data_section(&obj_dat, dat, sections_map,
+  memset(&map, 0, sizeof(Dwg_Object_Map));
+  error = read_data_section(&obj_dat, dat, dwg, sections_map,
                             pages_map, SECTION_OBJECTS);
   if (error)
     {
@@ -1323,7 +1399,7 @@ read_2007_section_handles(Bit_Chain* dat, Bit_Chain* hdl, Dwg_Data *dwg,
     }
 
   LOG_TRACE("\nHandles\n-------------------\n")
-  error = read_data_section(&hdl_dat, dat, sections_map,
+  error = read_data_section(&hdl_dat, dat, dwg, sections_map,
                             pages_map, SECTION_HANDLES);
   if (error)
     {
@@ -1339,7 +1415,7 @@ read_2007_section_handles(Bit_Chain* dat, Bit_Chain* hdl, Dwg_Data *dwg,
   do
     {
       long unsigned int last_offset;
-      //long unsigned int last_handle;
+      long unsigned int last_handle;
       long unsigned int oldpos = 0;
       long unsigned int startpos = hdl_dat.byte;
 
@@ -1348,24 +1424,34 @@ read_2007_section_handles(Bit_Chain* dat, Bit_Chain* hdl, Dwg_Data *dwg,
       if (section_size > 2034)
         {
           LOG_ERROR("Object-map section size greater than 2034!");
+          free(map.entries);
           return 1;
         }
 
-      //last_handle = 0;
+      last_handle = 0;
       last_offset = 0;
       while (hdl_dat.byte - startpos < section_size)
         {
-          long handle, offset;
+          long unsigned int handle;
+          long offset;
           oldpos = hdl_dat.byte;
 
-          handle = bit_read_MC(&hdl_dat);
+          handle = bit_read_UMC(&hdl_dat);
           offset = bit_read_MC(&hdl_dat);
-          //last_handle += handle;
+          last_handle += handle;
           last_offset += offset;
           LOG_TRACE("\nNext object: %lu\t", dwg->num_objects)
-          LOG_TRACE("Handle: %li\tOffset: %ld @%lu\n", handle, offset, last_offset)
+          LOG_TRACE("Handle: %lu\tOffset: %ld @%lu\n", handle, offset, last_offset)
 
-          dwg_decode_add_object(dwg, &obj_dat, hdl, last_offset);
+          if (!(dwg->opts & DWG_OPTS_SEQUENTIAL))
+            dwg_decode_add_object(dwg, &obj_dat, hdl, last_offset);
+          else if (dwg_object_map_add(&map, last_handle, last_offset))
+            {
+              free(map.entries);
+              free(hdl_dat.chain);
+              free(obj_dat.chain);
+              return 1;
+            }
         }
 
       if (hdl_dat.byte == oldpos)
@@ -1376,11 +1462,23 @@ read_2007_section_handles(Bit_Chain* dat, Bit_Chain* hdl, Dwg_Data *dwg,
         break;
     }
   while (section_size > 2);
+  if (dwg_decode_object_map(dwg, &obj_dat, hdl, &map))
+    {
+      free(hdl_dat.chain);
+      free(obj_dat.chain);
+      return 1;
+    }
 
   LOG_INFO("\nNum objects: %lu\n", dwg->num_objects);
 
   free(hdl_dat.chain);
-  free(obj_dat.chain);
+  if (dwg->opts & (DWG_OPTS_LAZY_HANDLES | DWG_OPTS_LAZY_STRINGS))
+    {
+      dwg->objects_section = obj_dat.chain;
+      dwg->objects_section_size = obj_dat.size;
+    }
+  else
+    free(obj_dat.chain);
 
   return error;
 }
@@ -1389,27 +1487,20 @@ read_2007_section_handles(Bit_Chain* dat, Bit_Chain* hdl, Dwg_Data *dwg,
 void
 read_r2007_init(Dwg_Data *dwg)
 {
-  if (dwg->opts)
-    loglevel = dwg->opts & 0xf;
+  loglevel = dwg_loglevel(dwg->opts);
 }
 
 int
 read_r2007_meta_data(Bit_Chain *dat, Bit_Chain *hdl_dat, Dwg_Data *dwg)
 {
   r2007_file_header file_header;
-  r2007_page *pages_map, *page;
-  r2007_section *sections_map;
+  r2007_pages pages_map;
+  r2007_page *page;
+  r2007_sections sections_map;
+  Dwg_Stats_Mark phase;
   int error;
-#ifdef USE_TRACING
-  char *probe;
-#endif
 
   read_r2007_init(dwg);
-#ifdef USE_TRACING
-  probe = getenv ("LIBREDWG_TRACE");
-  if (probe)
-    loglevel = atoi (probe);
-#endif
   // @ 0x62
   read_file_header(dat, &file_header);
 
@@ -1417,36 +1508,46 @@ read_r2007_meta_data(Bit_Chain *dat, Bit_Chain *hdl_dat, Dwg_Data *dwg)
   dat->byte += 0x28;  // overread check data
   dat->byte += file_header.pages_map_offset;
 
-  pages_map = read_pages_map(dat, file_header.pages_map_size_comp,
-    file_header.pages_map_size_uncomp, file_header.pages_map_correction);
-  if (!pages_map)
+  if (read_pages_map(dat, file_header.pages_map_size_comp,
+                     file_header.pages_map_size_uncomp,
+                     file_header.pages_map_correction, &pages_map))
     return 1;
 
   // Sections Map
-  page = get_page(pages_map, file_header.sections_map_id);
+  page = get_page(&pages_map, file_header.sections_map_id);
   if (!page)
     {
       LOG_ERROR("Failed to find sections page map %d", (int)file_header.sections_map_id);
-      pages_destroy(pages_map);
+      pages_destroy(&pages_map);
       return 3;
     }
   dat->byte = page->offset;
-  sections_map = read_sections_map(dat, file_header.sections_map_size_comp,
-                                   file_header.sections_map_size_uncomp,
-                                   file_header.sections_map_correction);
+  error = read_sections_map(dat, file_header.sections_map_size_comp,
+                            file_header.sections_map_size_uncomp,
+                            file_header.sections_map_correction,
+                            &sections_map);
+  if (error)
+    {
+      LOG_ERROR("Failed to read the sections map\n")
+      pages_destroy(&pages_map);
+      return error;
+    }
 
-  error = read_2007_section_classes(dat, dwg, sections_map, pages_map);
-  error += read_2007_section_header(dat, hdl_dat, dwg, sections_map, pages_map);
-  error += read_2007_section_handles(dat, hdl_dat, dwg, sections_map, pages_map);
-  //read_2007_blocks(dat, hdl_dat, dwg, sections_map, pages_map);
+  dwg_stats_begin(dwg, DWG_PHASE_CLASSES, &phase);
+  error = read_2007_section_classes(dat, dwg, &sections_map, &pages_map);
+  dwg_stats_end(dwg, &phase, NULL, 0);
+  dwg_stats_begin(dwg, DWG_PHASE_HEADER, &phase);
+  error += read_2007_section_header(dat, hdl_dat, dwg, &sections_map, &pages_map);
+  dwg_stats_end(dwg, &phase, NULL, 0);
+  error += read_2007_section_handles(dat, hdl_dat, dwg, &sections_map, &pages_map);
+  //read_2007_blocks(dat, hdl_dat, dwg, &sections_map, &pages_map);
 
   /////////////////////////////////////////
   //	incomplete implementation
   /////////////////////////////////////////
 
-  pages_destroy(pages_map);
-  if (page)
-    sections_destroy(sections_map);
+  pages_destroy(&pages_map);
+  sections_destroy(sections_map.first);
 
   return error;
 }
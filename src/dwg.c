@@ -26,6 +26,19 @@
 #include <stdbool.h>
 #include <sys/stat.h>
 #include <assert.h>
+#if defined(HAVE_FCNTL_H) && defined(HAVE_UNISTD_H)
+# define USE_FD
+# include <fcntl.h>
+# include <unistd.h>
+# include <errno.h>
+# ifndef O_BINARY
+#  define O_BINARY 0
+# endif
+#endif
+#if defined(USE_FD) && defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+# define USE_MMAP
+# include <sys/mman.h>
+#endif
 
 #include "bits.h"
 #include "common.h"
@@ -33,17 +46,24 @@
 #include "dwg.h"
 #include "encode.h"
 #include "free.h"
+#include "arena.h"
+#include "index.h"
+#include "stats.h"
 
-/* The logging level per .o */
-static unsigned int loglevel;
+/* The logging level per .o, per thread */
+static THREAD_LOCAL unsigned int loglevel;
 #ifdef USE_TRACING
-/* This flag means we have checked the environment variable
-   LIBREDWG_TRACE and set `loglevel' appropriately.  */
-static bool env_var_checked_p;
 #define DWG_LOGLEVEL loglevel
 #endif  /* USE_TRACING */
 #include "logging.h"
 
+static int
+read_file(char *filename, const struct stat *attrib, Dwg_Data * dwg_data);
+static int
+decode_memory(const void *buf, size_t size, Dwg_Data * dwg_data);
+static int
+decode_fd(int fd, Dwg_Data * dwg_data);
+
 /*------------------------------------------------------------------------------
  * Public functions
  */
@@ -53,15 +73,24 @@ static bool env_var_checked_p;
  *
  * everything in dwg is cleared
  * and then either read from dat, or set to a default.
+ *
+ * The file is mapped read-only where mmap is available, so concurrent
+ * readers share the page cache. Otherwise it is read into memory.
+ * It is released before returning, so DWG_OPTS_ZERO_COPY copies.
+ * With DWG_OPTS_STATS dwg->stats is kept and the decode is counted.
+ * With DWG_OPTS_INTERN a dwg->intern table is kept and shared.
  */
 int
 dwg_read_file(char *filename, Dwg_Data * dwg_data)
 {
-  FILE *fp;
   struct stat attrib;
-  size_t size;
-  Bit_Chain bit_chain;
+  unsigned int opts = dwg_data->opts;
+  Dwg_Stats *stats = opts & DWG_OPTS_STATS ? dwg_data->stats : NULL;
+  Dwg_Intern *intern = opts & DWG_OPTS_INTERN ? dwg_data->intern : NULL;
+  Dwg_Stats_Mark mark;
+  int error;
 
+  loglevel = dwg_loglevel(opts);
   if (stat(filename, &attrib))
     {
       LOG_ERROR("File not found: %s\n", filename)
@@ -76,6 +105,229 @@ dwg_read_file(char *filename, Dwg_Data * dwg_data)
       LOG_ERROR("Error: %s\n", filename)
       return -1;
     }
+
+  memset(dwg_data, 0, sizeof(Dwg_Data));
+  dwg_data->opts = opts;
+  dwg_data->stats = stats;
+  dwg_data->intern = intern;
+  dwg_stats_begin(dwg_data, DWG_PHASE_READ, &mark);
+  error = read_file(filename, &attrib, dwg_data);
+  dwg_stats_end(dwg_data, &mark, NULL, 0);
+
+  if (error)
+    {
+      LOG_ERROR("Failed to decode file: %s\n", filename)
+      return -1;
+    }
+  return 0;
+}
+
+/** dwg_read_memory
+ * Decodes a DWG from a caller-owned buffer, which is only read and not
+ * copied. The buffer may be released after the call, with
+ * DWG_OPTS_ZERO_COPY only after dwg_free() or dwg_detach().
+ * returns 0 on success.
+ */
+int
+dwg_read_memory(const void *buf, size_t size, Dwg_Data * dwg_data)
+{
+  unsigned int opts = dwg_data->opts;
+  Dwg_Stats *stats = opts & DWG_OPTS_STATS ? dwg_data->stats : NULL;
+  Dwg_Intern *intern = opts & DWG_OPTS_INTERN ? dwg_data->intern : NULL;
+  Dwg_Stats_Mark mark;
+  int error;
+
+  loglevel = dwg_loglevel(opts);
+  memset(dwg_data, 0, sizeof(Dwg_Data));
+  dwg_data->opts = opts;
+  dwg_data->stats = stats;
+  dwg_data->intern = intern;
+  if (opts & DWG_OPTS_ZERO_COPY)
+    {
+      dwg_data->input = (const unsigned char *)buf;
+      dwg_data->input_size = size;
+    }
+  dwg_stats_begin(dwg_data, DWG_PHASE_READ, &mark);
+  error = decode_memory(buf, size, dwg_data);
+  dwg_stats_end(dwg_data, &mark, NULL, 0);
+  return error;
+}
+
+/** dwg_read_fd
+ * Decodes a DWG from an open file descriptor, which is not closed.
+ * A regular file is decoded from its start, mapped read-only where
+ * possible. Pipes and sockets are read until EOF. Like with
+ * dwg_read_file(), DWG_OPTS_ZERO_COPY copies.
+ * returns 0 on success.
+ */
+int
+dwg_read_fd(int fd, Dwg_Data * dwg_data)
+{
+  unsigned int opts = dwg_data->opts;
+  Dwg_Stats *stats = opts & DWG_OPTS_STATS ? dwg_data->stats : NULL;
+  Dwg_Intern *intern = opts & DWG_OPTS_INTERN ? dwg_data->intern : NULL;
+  Dwg_Stats_Mark mark;
+  int error;
+
+  loglevel = dwg_loglevel(opts);
+  memset(dwg_data, 0, sizeof(Dwg_Data));
+  dwg_data->opts = opts;
+  dwg_data->stats = stats;
+  dwg_data->intern = intern;
+  dwg_stats_begin(dwg_data, DWG_PHASE_READ, &mark);
+  error = decode_fd(fd, dwg_data);
+  dwg_stats_end(dwg_data, &mark, NULL, 0);
+  return error;
+}
+
+/** dwg_stream
+ * Decodes filename without keeping the whole drawing in memory.
+ * callbacks->object is called right after each object is decoded, and
+ * unless it returns DWG_STREAM_KEEP the object is released afterwards.
+ * Table objects and the handle of every object are always kept.
+ * Everything is freed when dwg_stream returns. Files before R13 are
+ * not streamed, the callback is not called for them.
+ * returns 0 on success.
+ */
+int
+dwg_stream(char *filename, Dwg_Stream_Callbacks *callbacks, void *userdata)
+{
+  Dwg_Data dwg;
+  struct stat attrib;
+  int error;
+
+  loglevel = dwg_loglevel(0);
+  if (stat(filename, &attrib))
+    {
+      LOG_ERROR("File not found: %s\n", filename)
+      return -1;
+    }
+  memset(&dwg, 0, sizeof(Dwg_Data));
+  dwg.callbacks = callbacks;
+  dwg.userdata = userdata;
+  error = read_file(filename, &attrib, &dwg);
+  if (error)
+    LOG_ERROR("Failed to decode file: %s\n", filename)
+  dwg_free(&dwg);
+  return error;
+}
+
+/* copy a slice of the input to the arena */
+static int
+detach_slice(Dwg_Data *dwg, void *ptr, long unsigned int size)
+{
+  unsigned char **slice = (unsigned char **)ptr;
+  unsigned char *copy;
+
+  if (!*slice || !dwg_input_owns(dwg, *slice))
+    return 0;
+  copy = (unsigned char *)dwg_arena_calloc(dwg, size + 1, 1);
+  if (!copy)
+    {
+      LOG_ERROR("Out of memory\n")
+      return 1;
+    }
+  memcpy(copy, *slice, size);
+  *slice = copy;
+  return 0;
+}
+
+/** dwg_detach
+ * Copies the data pointing into the input of DWG_OPTS_ZERO_COPY. The
+ * caller may release its buffer of dwg_read_memory() afterwards.
+ * returns 0 on success.
+ */
+int
+dwg_detach(Dwg_Data *dwg)
+{
+  long unsigned int i;
+  int error = 0;
+
+  if (!dwg->input)
+    return 0;
+  error |= detach_slice(dwg, &dwg->picture.chain, dwg->picture.size);
+  for (i = 0; i < dwg->num_objects; i++)
+    {
+      Dwg_Object *obj = &dwg->object[i];
+      Dwg_Class *klass = NULL;
+
+      if (!obj->tio.unknown)
+        continue;
+      if (obj->type >= 500 && obj->type - 500 < (long)dwg->num_classes)
+        klass = &dwg->dwg_class[obj->type - 500];
+      if (obj->supertype == DWG_SUPERTYPE_UNKNOWN && !klass)
+        {
+          error |= detach_slice(dwg, &obj->tio.unknown, obj->size);
+          continue;
+        }
+      if (obj->supertype == DWG_SUPERTYPE_ENTITY
+          || (obj->supertype == DWG_SUPERTYPE_UNKNOWN
+              && dwg_class_is_entity(klass)))
+        {
+          Dwg_Object_Entity *ent = obj->tio.entity;
+          error |= detach_slice(dwg, &ent->picture, ent->picture_size);
+          if (!ent->tio.UNKNOWN_ENT)
+            continue;
+          switch (obj->type)
+            {
+            case DWG_TYPE_OLEFRAME:
+              error |= detach_slice(dwg, &ent->tio.OLEFRAME->data,
+                                    ent->tio.OLEFRAME->data_length);
+              break;
+            case DWG_TYPE_OLE2FRAME:
+              error |= detach_slice(dwg, &ent->tio.OLE2FRAME->data,
+                                    ent->tio.OLE2FRAME->data_length);
+              break;
+            default:
+              if (obj->supertype == DWG_SUPERTYPE_UNKNOWN)
+                error |= detach_slice(dwg, &ent->tio.UNKNOWN_ENT->bytes,
+                                      ent->tio.UNKNOWN_ENT->num_bytes);
+              break;
+            }
+        }
+      else if (obj->tio.object->tio.UNKNOWN_OBJ)
+        {
+          Dwg_Object_Object *_obj = obj->tio.object;
+          if (obj->type == DWG_TYPE_BLOCK_HEADER)
+            error |= detach_slice(dwg, &_obj->tio.BLOCK_HEADER->preview_data,
+                                  _obj->tio.BLOCK_HEADER->preview_data_size);
+          else if (obj->supertype == DWG_SUPERTYPE_UNKNOWN)
+            error |= detach_slice(dwg, &_obj->tio.UNKNOWN_OBJ->bytes,
+                                  _obj->tio.UNKNOWN_OBJ->num_bytes);
+        }
+    }
+  if (error)
+    return error;
+  dwg->input = NULL;
+  dwg->input_size = 0;
+  dwg->opts &= ~DWG_OPTS_ZERO_COPY;
+  return 0;
+}
+
+/* Below, dwg_data is cleared already */
+
+static int
+read_file(char *filename, const struct stat *attrib, Dwg_Data * dwg_data)
+{
+  int error;
+#ifdef USE_FD
+  int fd;
+#else
+  FILE *fp;
+  size_t size;
+  unsigned char *buf;
+#endif
+
+#ifdef USE_FD
+  fd = open(filename, O_RDONLY | O_BINARY);
+  if (fd < 0)
+    {
+      LOG_ERROR("Could not open file: %s\n", filename)
+      return -1;
+    }
+  error = decode_fd(fd, dwg_data);
+  close(fd);
+#else
   fp = fopen(filename, "rb");
   if (!fp)
     {
@@ -85,48 +337,131 @@ dwg_read_file(char *filename, Dwg_Data * dwg_data)
 
   /* Load whole file into memory
    */
-  loglevel = dwg_data->opts;
-  memset(dwg_data, 0, sizeof(Dwg_Data));
-  dwg_data->opts = loglevel;
-  memset(&bit_chain, 0, sizeof(Bit_Chain));
-  bit_chain.size = attrib.st_size;
-  bit_chain.chain = (unsigned char *) calloc(1, bit_chain.size);
-  if (!bit_chain.chain)
+  buf = (unsigned char *) calloc(1, attrib->st_size);
+  if (!buf)
     {
       LOG_ERROR("Not enough memory.\n")
       fclose(fp);
       return -1;
     }
 
-  size = fread(bit_chain.chain, sizeof(char), bit_chain.size, fp);
-  if (size != bit_chain.size)
+  size = fread(buf, sizeof(char), attrib->st_size, fp);
+  fclose(fp);
+  if (size != (size_t)attrib->st_size)
     {
       LOG_ERROR("Could not read the entire file (%lu out of %lu): %s\n",
-          (long unsigned int) size, bit_chain.size, filename)
-      fclose(fp);
-      free(bit_chain.chain);
-      bit_chain.chain = NULL;
-      bit_chain.size = 0;
+          (long unsigned int) size, (long unsigned int) attrib->st_size,
+          filename)
+      free(buf);
       return -1;
     }
-  fclose(fp);
+  error = decode_memory(buf, size, dwg_data);
+  free(buf);
+#endif
+  return error;
+}
+
+static int
+decode_memory(const void *buf, size_t size, Dwg_Data * dwg_data)
+{
+  Bit_Chain bit_chain;
 
-  /* Decode the dwg structure */
-  if (dwg_decode(&bit_chain, dwg_data))
+  if (!buf || size < 6)
     {
-      LOG_ERROR("Failed to decode file: %s\n", filename)
-      free(bit_chain.chain);
-      bit_chain.chain = NULL;
-      bit_chain.size = 0;
+      LOG_ERROR("dwg_read_memory: input too short\n")
       return -1;
     }
+  memset(&bit_chain, 0, sizeof(Bit_Chain));
+  /* the decoder never writes to its input */
+  bit_chain.chain = (unsigned char *)buf;
+  bit_chain.size = size;
 
-  //TODO: does dwg hold any char* pointers to the bit_chain or are they all copied?
-  free(bit_chain.chain);
-  bit_chain.chain = NULL;
-  bit_chain.size = 0;
+  return dwg_decode(&bit_chain, dwg_data) ? -1 : 0;
+}
 
-  return 0;
+static int
+decode_fd(int fd, Dwg_Data * dwg_data)
+{
+#ifdef USE_FD
+  struct stat attrib;
+  unsigned char *buf = NULL;
+  size_t size = 0, alloced = 0;
+  ssize_t n;
+  int error;
+
+  if (fstat(fd, &attrib))
+    {
+      LOG_ERROR("dwg_read_fd: invalid file descriptor %d\n", fd)
+      return -1;
+    }
+  if (S_ISREG (attrib.st_mode))
+    {
+# ifdef USE_MMAP
+      if (attrib.st_size)
+        {
+          void *map = mmap(NULL, attrib.st_size, PROT_READ, MAP_PRIVATE,
+                           fd, 0);
+          if (map != MAP_FAILED)
+            {
+#  ifdef HAVE_MADVISE
+              madvise(map, attrib.st_size, MADV_SEQUENTIAL);
+              madvise(map, attrib.st_size, MADV_WILLNEED);
+#  endif
+              error = decode_memory(map, attrib.st_size, dwg_data);
+              munmap(map, attrib.st_size);
+              return error;
+            }
+          LOG_TRACE("mmap failed, reading fd %d\n", fd)
+        }
+# endif
+      if (lseek(fd, 0, SEEK_SET))
+        {
+          LOG_ERROR("dwg_read_fd: cannot seek fd %d\n", fd)
+          return -1;
+        }
+      /* one more byte to see EOF without growing */
+      alloced = attrib.st_size + 1;
+    }
+  else
+    alloced = 64 * 1024;
+
+  /* pipes, sockets or no mmap: read until EOF */
+  do
+    {
+      if (!buf || size == alloced)
+        {
+          unsigned char *tmp;
+          if (buf)
+            alloced *= 2;
+          tmp = (unsigned char *)realloc(buf, alloced);
+          if (!tmp)
+            {
+              LOG_ERROR("Not enough memory.\n")
+              free(buf);
+              return -1;
+            }
+          buf = tmp;
+        }
+      n = read(fd, buf + size, alloced - size);
+      if (n > 0)
+        size += n;
+      else if (n < 0 && errno == EINTR)
+        n = 1;
+    }
+  while (n > 0);
+  if (n < 0)
+    {
+      LOG_ERROR("dwg_read_fd: read error on fd %d\n", fd)
+      free(buf);
+      return -1;
+    }
+  error = decode_memory(buf, size, dwg_data);
+  free(buf);
+  return error;
+#else
+  LOG_ERROR("dwg_read_fd: not supported on this platform\n")
+  return -1;
+#endif
 }
 
 
@@ -214,17 +549,8 @@ dwg_bmp(Dwg_Data *dwg, BITCODE_RL *size)
   dat->bit = 0;
   dat->byte = 0;
 
-#ifdef USE_TRACING
-  /* Before starting, set the logging level, but only do so once.  */
-  if (! env_var_checked_p)
-    {
-      char *probe = getenv ("LIBREDWG_TRACE");
-      if (probe)
-        loglevel = atoi (probe);
-      env_var_checked_p = true;
-    }
-#endif  /* USE_TRACING */
-  
+  loglevel = dwg_loglevel(dwg->opts);
+
   osize = bit_read_RL(dat); /* overall size of all images */
   LOG_TRACE("overall size: " FORMAT_RL "\n", osize)
   num_pictures = bit_read_RC(dat);
@@ -269,6 +595,162 @@ dwg_bmp(Dwg_Data *dwg, BITCODE_RL *size)
     return NULL;
 }
 
+/* The image directory following the PICTURE_BEGIN sentinel:
+   RL overall size, RC num_pictures, then per picture
+   RC code (1 header, 2 BMP, 3 WMF, 6 PNG), RL absolute address, RL size.
+   Picks BMP over PNG over WMF and returns its address, or 0. */
+static BITCODE_RL
+preview_directory(Bit_Chain *dat, Dwg_Preview_Type *type, BITCODE_RL *size)
+{
+  BITCODE_RC i, num_pictures, code;
+  BITCODE_RL address, osize, found = 0;
+  int rank = 0;
+
+  if (dat->byte + 5 > dat->size)
+    return 0;
+  osize = bit_read_RL(dat);
+  LOG_TRACE("overall size: " FORMAT_RL "\n", osize)
+  num_pictures = bit_read_RC(dat);
+  LOG_INFO("num_pictures: " FORMAT_RC "\n", num_pictures)
+  for (i = 0; i < num_pictures && dat->byte + 9 <= dat->size; i++)
+    {
+      int r;
+      code = bit_read_RC(dat);
+      address = bit_read_RL(dat);
+      osize = bit_read_RL(dat);
+      LOG_TRACE("\t[%i] Code: %i, address: 0x%x, size: %u\n", i, code,
+                address, osize)
+      r = code == DWG_PREVIEW_BMP ? 3 : code == DWG_PREVIEW_PNG ? 2
+        : code == DWG_PREVIEW_WMF ? 1 : 0;
+      if (r > rank && osize)
+        {
+          rank = r;
+          found = address;
+          *type = (Dwg_Preview_Type)code;
+          *size = osize;
+        }
+    }
+  return found;
+}
+
+/** dwg_read_preview_buffer
+ * Returns a pointer into buf to the preview image of a R13+ DWG,
+ * without decoding the drawing, or NULL.
+ * Sets type to DWG_PREVIEW_BMP (a DIB without BITMAPFILEHEADER),
+ * DWG_PREVIEW_WMF or DWG_PREVIEW_PNG. The loglevel is taken from opts,
+ * as for dwg_read_file.
+ */
+unsigned char *
+dwg_read_preview_buffer(unsigned char *buf, long unsigned int bufsize,
+                        unsigned int opts, Dwg_Preview_Type *type, BITCODE_RL *size)
+{
+  Bit_Chain dat;
+  BITCODE_RL address;
+
+  loglevel = dwg_loglevel(opts);
+  *type = DWG_PREVIEW_NONE;
+  *size = 0;
+  if (bufsize < 0x19 || memcmp(buf, "AC10", 4)
+      || strncmp((char *)buf, "AC1012", 6) < 0)
+    {
+      LOG_ERROR("Not a R13+ DWG\n")
+      return NULL;
+    }
+  memset(&dat, 0, sizeof(Bit_Chain));
+  dat.chain = buf;
+  dat.size = bufsize;
+  dat.byte = 0x0d;
+  dat.byte = bit_read_RL(&dat);
+  if (!dat.byte || dat.byte + 16 > bufsize
+      || memcmp(&buf[dat.byte], dwg_sentinel(DWG_SENTINEL_PICTURE_BEGIN), 16))
+    {
+      LOG_INFO("no IMAGE DATA\n")
+      return NULL;
+    }
+  dat.byte += 16;
+  address = preview_directory(&dat, type, size);
+  if (!address || (unsigned long)address + *size > bufsize)
+    {
+      *type = DWG_PREVIEW_NONE;
+      *size = 0;
+      return NULL;
+    }
+  return &buf[address];
+}
+
+/** dwg_read_preview
+ * Reads only the preview image of a R13+ DWG file, seeking to the
+ * image directory at the file header's preview address, logging
+ * with the loglevel in opts.
+ * Returns a malloc'ed image to be freed by the caller, or NULL.
+ */
+unsigned char *
+dwg_read_preview(char *filename, unsigned int opts, Dwg_Preview_Type *type,
+                 BITCODE_RL *size)
+{
+  FILE *fp;
+  Bit_Chain dat;
+  /* sentinel, overall size, count and up to 255 entries */
+  unsigned char dir[16 + 5 + 255 * 9];
+  unsigned char *image;
+  BITCODE_RL address;
+
+  loglevel = dwg_loglevel(opts);
+  *type = DWG_PREVIEW_NONE;
+  *size = 0;
+  fp = fopen(filename, "rb");
+  if (!fp)
+    {
+      LOG_ERROR("Could not open file: %s\n", filename)
+      return NULL;
+    }
+  memset(&dat, 0, sizeof(Bit_Chain));
+  dat.chain = dir;
+  dat.size = fread(dir, 1, 0x19, fp);
+  if (dat.size < 0x19 || memcmp(dir, "AC10", 4)
+      || strncmp((char *)dir, "AC1012", 6) < 0)
+    {
+      LOG_ERROR("Not a R13+ DWG file: %s\n", filename)
+      fclose(fp);
+      return NULL;
+    }
+  dat.byte = 0x0d;
+  address = bit_read_RL(&dat);
+  if (!address || fseek(fp, address, SEEK_SET))
+    {
+      fclose(fp);
+      return NULL;
+    }
+  dat.size = fread(dir, 1, sizeof(dir), fp);
+  if (dat.size < 16
+      || memcmp(dir, dwg_sentinel(DWG_SENTINEL_PICTURE_BEGIN), 16))
+    {
+      LOG_INFO("no IMAGE DATA\n")
+      fclose(fp);
+      return NULL;
+    }
+  dat.byte = 16;
+  address = preview_directory(&dat, type, size);
+  if (!address || fseek(fp, address, SEEK_SET)
+      || !(image = (unsigned char *)malloc(*size)))
+    {
+      fclose(fp);
+      *type = DWG_PREVIEW_NONE;
+      *size = 0;
+      return NULL;
+    }
+  if (fread(image, 1, *size, fp) != *size)
+    {
+      LOG_ERROR("Could not read the preview image: %s\n", filename)
+      free(image);
+      image = NULL;
+      *type = DWG_PREVIEW_NONE;
+      *size = 0;
+    }
+  fclose(fp);
+  return image;
+}
+
 double
 dwg_model_x_min(Dwg_Data *dwg)
 {
@@ -350,13 +832,15 @@ dwg_get_layer_count(Dwg_Data *dwg)
 Dwg_Object_LAYER **
 dwg_get_layers(Dwg_Data *dwg)
 {
-  unsigned int i;
+  unsigned int i, num;
   Dwg_Object_LAYER ** layers;
   
   assert(dwg);
-  layers = (Dwg_Object_LAYER **) calloc(dwg_get_layer_count(dwg),
-                                        sizeof (Dwg_Object_LAYER*));
-  for (i=0; i < dwg_get_layer_count(dwg); i++)
+  num = dwg_get_layer_count(dwg);
+  layers = (Dwg_Object_LAYER **) calloc(num, sizeof (Dwg_Object_LAYER*));
+  if (!layers)
+    return NULL;
+  for (i=0; i < num; i++)
     {
       layers[i] = dwg->layer_control->tio.object->tio.LAYER_CONTROL->
             layers[i]->obj->tio.object->tio.LAYER;
@@ -388,26 +872,29 @@ dwg_get_entity_count(Dwg_Data *dwg)
 Dwg_Object_Entity **
 dwg_get_entities(Dwg_Data *dwg)
 {
-  long unsigned int i, ent_count = 0;
+  unsigned int i;
   Dwg_Object_Entity ** entities;
+  const Dwg_Type_Index *types;
 
   assert(dwg);
-  entities = (Dwg_Object_Entity **) calloc(dwg_get_entity_count(dwg),
+  types = dwg_type_index(dwg);
+  if (!types)
+    return NULL;
+  entities = (Dwg_Object_Entity **) calloc(types->num_entities + 1,
                                            sizeof (Dwg_Object_Entity*));
-  for (i=0; i < dwg->num_objects; i++)
-    {
-      if (dwg->object[i].supertype == DWG_SUPERTYPE_ENTITY)
-        {
-          entities[ent_count] = dwg->object[i].tio.entity;
-          ent_count++;
-        }
-    }
+  if (!entities)
+    return NULL;
+  for (i=0; i < types->num_entities; i++)
+    entities[i] = dwg->object[types->entities[i]].tio.entity;
   return entities;
 }
 
 Dwg_Object_LAYER *
 dwg_get_entity_layer(Dwg_Object_Entity * ent)
 {
+  /* NULL with DWG_OPTS_LAZY_HANDLES before dwg_decode_handles */
+  if (!ent->layer || !ent->layer->obj)
+    return NULL;
   return ent->layer->obj->tio.object->tio.LAYER;
 }
 
@@ -425,6 +912,83 @@ dwg_ref_get_object(Dwg_Object_Ref* ref)
   return ref->obj ? ref->obj : NULL;
 }
 
+/** dwg_text_utf8
+ * Writes the text field *text of obj as UTF-8 into buf, cut at size bytes
+ * and always terminated, like snprintf. The deferred strings of obj are read
+ * first, so text is the address of the field. A NULL field is the empty
+ * text. Before r2007 the text is copied as is, in the codepage of the
+ * drawing. Nothing is allocated.
+ * Returns the length of the whole text without the terminating NUL, which
+ * is >= size when it was cut, or -1 if the strings could not be read.
+ */
+int
+dwg_text_utf8(Dwg_Object *obj, char **text, char *buf, size_t size)
+{
+  BITCODE_TU wstr;
+  size_t len = 0, i;
+
+  if (!obj || !text || dwg_decode_strings(obj))
+    return -1;
+  if (buf && size)
+    *buf = '\0';
+  if (!*text)
+    return 0;
+  if (obj->parent->header.version < R_2007)
+    {
+      len = strlen(*text);
+      if (buf && size)
+        {
+          i = len < size ? len : size - 1;
+          memcpy(buf, *text, i);
+          buf[i] = '\0';
+        }
+      return (int)len;
+    }
+  for (wstr = (BITCODE_TU)*text, i = 0; wstr[i]; i++)
+    {
+      unsigned int c = wstr[i];
+      unsigned char utf8[4];
+      size_t n;
+
+      if (c < 0x80)
+        {
+          utf8[0] = c;
+          n = 1;
+        }
+      else if (c < 0x800)
+        {
+          utf8[0] = 0xc0 | (c >> 6);
+          utf8[1] = 0x80 | (c & 0x3f);
+          n = 2;
+        }
+      else if (c >= 0xd800 && c < 0xdc00
+               && wstr[i+1] >= 0xdc00 && wstr[i+1] < 0xe000)
+        {
+          c = 0x10000 + ((c - 0xd800) << 10) + (wstr[++i] - 0xdc00);
+          utf8[0] = 0xf0 | (c >> 18);
+          utf8[1] = 0x80 | ((c >> 12) & 0x3f);
+          utf8[2] = 0x80 | ((c >> 6) & 0x3f);
+          utf8[3] = 0x80 | (c & 0x3f);
+          n = 4;
+        }
+      else
+        {
+          utf8[0] = 0xe0 | (c >> 12);
+          utf8[1] = 0x80 | ((c >> 6) & 0x3f);
+          utf8[2] = 0x80 | (c & 0x3f);
+          n = 3;
+        }
+      /* no character is cut, the rest does not fit either */
+      if (buf && len + n < size)
+        {
+          memcpy(buf + len, utf8, n);
+          buf[len + n] = '\0';
+        }
+      len += n;
+    }
+  return (int)len;
+}
+
 Dwg_Object*
 get_first_owned_object(Dwg_Object* hdr_obj, Dwg_Object_BLOCK_HEADER* hdr)
 {
@@ -526,3 +1090,22 @@ dwg_section_type(DWGCHAR *wname)
   }
   return SECTION_UNKNOWN;
 }
+
+/** dwg_alloc
+ * Zeroed memory owned by the drawing, released by dwg_free.
+ */
+void *
+dwg_alloc(Dwg_Data *dwg, size_t size)
+{
+  return dwg_arena_calloc(dwg, 1, size);
+}
+
+/** dwg_realloc
+ * Resizes memory of a decoded field or from dwg_alloc. The old contents
+ * are copied if it cannot grow in place, new memory is zeroed.
+ */
+void *
+dwg_realloc(Dwg_Data *dwg, void *ptr, size_t oldsize, size_t size)
+{
+  return dwg_arena_realloc(dwg, ptr, oldsize, size);
+}
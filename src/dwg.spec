@@ -1403,11 +1403,9 @@ void decode_3dsolid(Bit_Chain* dat, Bit_Chain* hdl_dat, Dwg_Object* obj, Dwg_Ent
 {
   Dwg_Data* dwg = obj->parent;
   int vcount, rcount, rcount2;
-  int i=0;
-  unsigned long j;
-  int index;
-  int total_size = 0;
-  int num_blocks = 0;
+  unsigned long i;
+  unsigned long total_size = 0;
+  unsigned long num_blocks = 0;
 
   FIELD_B (acis_empty, 0);
   if (!FIELD_VALUE(acis_empty))
@@ -1416,38 +1414,47 @@ void decode_3dsolid(Bit_Chain* dat, Bit_Chain* hdl_dat, Dwg_Object* obj, Dwg_Ent
       FIELD_BS (version, 70);
       if (FIELD_VALUE(version) == 1)
         {
+          Bit_Chain scan = *dat;
+          BITCODE_BL size;
+          BITCODE_RC *buf;
+
+          // count the blocks first, to read them into one buffer
           do
             {
-              FIELD_VALUE(sat_data) = (BITCODE_RC**)
-                realloc(FIELD_VALUE(sat_data), (i+1) * sizeof (BITCODE_RC*));
-              FIELD_VALUE(block_size) = (BITCODE_BL*)
-                realloc(FIELD_VALUE(block_size), (i+1) * sizeof (BITCODE_BL));
-              FIELD_BL (block_size[i], 0);
-              FIELD_TF (sat_data[i], FIELD_VALUE(block_size[i]), 0);
-              total_size += FIELD_VALUE (block_size[i]);
-            } while(FIELD_VALUE (block_size[i++]));
-
-          // de-obfuscate SAT data
-          FIELD_VALUE(raw_sat_data) = malloc (total_size+1);
-          num_blocks = i-1;
-          FIELD_VALUE(num_blocks) = num_blocks;
-          index = 0;
-          for (i=0; i<num_blocks; i++)
+              size = bit_read_BL(&scan);
+              if (size > scan.size - scan.byte)
+                size = scan.size - scan.byte;
+              total_size += size;
+              num_blocks++;
+              bit_advance_position(&scan, size * 8);
+            } while (size && scan.byte < scan.size - 1);
+
+          FIELD_VALUE(num_blocks) = num_blocks - 1;
+          FIELD_VALUE(block_size) = (BITCODE_BL*)
+            dwg_arena_calloc(dwg, num_blocks, sizeof (BITCODE_BL));
+          FIELD_VALUE(sat_data) = (BITCODE_RC**)
+            dwg_arena_calloc(dwg, num_blocks, sizeof (BITCODE_RC*));
+          buf = (BITCODE_RC*)dwg_arena_calloc(dwg, total_size + 1, 1);
+          if (!FIELD_VALUE(block_size) || !FIELD_VALUE(sat_data) || !buf)
             {
-              for (j=0; j<FIELD_VALUE (block_size[i]); j++)
-                {
-                  if (FIELD_VALUE(sat_data[i][j] <= 32))
-                    {
-                      FIELD_VALUE(raw_sat_data)[index++] = FIELD_VALUE (sat_data[i][j]);
-                    }
-                  else
-                    {
-                      FIELD_VALUE(raw_sat_data)[index++] = 159 - FIELD_VALUE (sat_data[i][j]);
-                    }
-                }
+              LOG_ERROR("Out of memory\n");
+              FIELD_VALUE(num_blocks) = 0;
+              return;
+            }
+          // the obfuscated SAT text, see dwg_decode_sat_data()
+          for (i = 0; i < num_blocks; i++)
+            {
+              FIELD_BL (block_size[i], 0);
+              if (FIELD_VALUE(block_size[i]) > total_size)
+                FIELD_VALUE(block_size[i]) = total_size;
+              FIELD_VALUE(sat_data[i]) = buf;
+              bit_read_fixed(dat, (char*)buf, FIELD_VALUE(block_size[i]));
+              buf += FIELD_VALUE(block_size[i]);
+              total_size -= FIELD_VALUE(block_size[i]);
             }
-          FIELD_VALUE(raw_sat_data)[index] = '\0';
-          LOG_TRACE("Raw SAT data:\n%s\n", FIELD_VALUE (raw_sat_data)); // DXF 1 + 3 if >255
+          LOG_TRACE("SAT data: " FORMAT_BL " blocks, %lu bytes\n",
+                    FIELD_VALUE(num_blocks),
+                    (unsigned long)(buf - FIELD_VALUE(sat_data[0])));
         }
       else //if (FIELD_VALUE(version)==2)
         {
@@ -1542,17 +1549,18 @@ void free_3dsolid(Dwg_Object* obj, Dwg_Entity_3DSOLID* _obj);
 
 void free_3dsolid(Dwg_Object* obj, Dwg_Entity_3DSOLID* _obj)
 {
-  unsigned int i;
+  Dwg_Data* dwg = obj->parent;
   int vcount;
   if (FIELD_VALUE(version) == 1)
     {
-      for (i=0; i < FIELD_VALUE (num_blocks); i++)
+      // all blocks are one buffer
+      if (FIELD_VALUE(sat_data))
         {
-          FIELD_TF (sat_data[i], block_size[i], 0);
+          FIELD_TV (sat_data[0], 0);
         }
-      free(_obj->sat_data);
-      free(_obj->block_size);
-      free(_obj->raw_sat_data);
+      FIELD_TV (sat_data, 0);
+      FIELD_TV (raw_sat_data, 0);
+      FIELD_TV (block_size, 0);
     }
 }
 #undef FREE_3DSOLID
@@ -1697,7 +1705,7 @@ DWG_ENTITY(OLEFRAME)
   }
 
   FIELD_BL (data_length, 0);
-  FIELD_TF (data, FIELD_VALUE(data_length), 0);
+  FIELD_BINARY (data, FIELD_VALUE(data_length), 0);
 
   COMMON_ENTITY_HANDLE_DATA;
 
@@ -1983,7 +1991,7 @@ DWG_OBJECT(BLOCK_HEADER)
         }
       else
         {
-          FIELD_TF (preview_data, FIELD_VALUE(preview_data_size), 310);
+          FIELD_BINARY (preview_data, FIELD_VALUE(preview_data_size), 310);
         }
     }
 
@@ -3317,7 +3325,7 @@ DWG_ENTITY(OLE2FRAME)
   }
 
   FIELD_BL (data_length, 0);
-  FIELD_TF (data, FIELD_VALUE(data_length), 0);
+  FIELD_BINARY (data, FIELD_VALUE(data_length), 0);
 
   SINCE(R_2000) {
     FIELD_RC (unknown, 0);
@@ -4379,14 +4387,21 @@ DWG_OBJECT(XRECORD)
 
   DECODER
     {
+      // doubled: the refs are allocated after it, it never grows in place
+      int max_objid_handles = 0;
       for (vcount=0;
            hdl_dat->byte < obj->tio.object->datpos + (obj->tio.object->bitsize/8);
            vcount++)
         {
-          FIELD_VALUE(objid_handles) = vcount
-            ? realloc(FIELD_VALUE(objid_handles),
-                                   (vcount+1) * sizeof(Dwg_Object_Ref))
-            : malloc(sizeof(Dwg_Object_Ref));
+          if (vcount == max_objid_handles)
+            {
+              int max = max_objid_handles ? 2 * max_objid_handles : 8;
+              FIELD_VALUE(objid_handles) = (BITCODE_H*)
+                dwg_realloc(obj->parent, FIELD_VALUE(objid_handles),
+                            max_objid_handles * sizeof(BITCODE_H),
+                            max * sizeof(BITCODE_H));
+              max_objid_handles = max;
+            }
           FIELD_HANDLE_N (objid_handles[vcount], vcount, ANYCODE, 0);
           if (!FIELD_VALUE(objid_handles[vcount]))
             break;
@@ -4779,7 +4794,7 @@ DWG_ENTITY(UNKNOWN_ENT)
   FIELD_VALUE(num_bytes) = obj->bitsize / 8;
   FIELD_VALUE(num_bits)  = obj->bitsize % 8;
 
-  FIELD_TF (bytes, FIELD_VALUE(num_bytes), 0);
+  FIELD_BINARY (bytes, FIELD_VALUE(num_bytes), 0);
   FIELD_VECTOR (bits, B, num_bits, 0);
   //COMMON_ENTITY_HANDLE_DATA; // including this
 
@@ -4791,7 +4806,7 @@ DWG_OBJECT(UNKNOWN_OBJ)
   FIELD_VALUE(num_bytes) = obj->bitsize / 8;
   FIELD_VALUE(num_bits)  = obj->bitsize % 8;
 
-  FIELD_TF (bytes, FIELD_VALUE(num_bytes), 0);
+  FIELD_BINARY (bytes, FIELD_VALUE(num_bytes), 0);
   FIELD_VECTOR (bits, B, num_bits, 0);
 
 DWG_OBJECT_END
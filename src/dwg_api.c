@@ -30,6 +30,7 @@
 #include "dwg.h"
 #include "logging.h"
 #include "bits.h"
+#include "arena.h"
 #include "dwg_api.h"
 
 /*******************************************************************
@@ -1467,6 +1468,7 @@ dwg_ent_text_set_text(dwg_ent_text *text, char * text_value, int *error)
   if (text != 0)
     {
       *error = 0;
+      dwg_arena_adopt(text, text->text_value, text_value);
       text->text_value = text_value;
     }
   else
@@ -1819,6 +1821,7 @@ dwg_ent_attrib_set_text(dwg_ent_attrib *attrib, char * text_value, int *error)
   if (attrib != 0)
     {
       *error = 0;
+      dwg_arena_adopt(attrib, attrib->text_value, text_value);
       attrib->text_value = text_value;
     }
   else
@@ -2175,6 +2178,7 @@ dwg_ent_attdef_set_text(dwg_ent_attdef *attdef, char * default_value,
   if (attdef != 0)
     {
       *error = 0;
+      dwg_arena_adopt(attdef, attdef->default_value, default_value);
       attdef->default_value = default_value;
     }
   else
@@ -2995,6 +2999,7 @@ dwg_ent_block_set_name(dwg_ent_block *block, char * name, int *error)
   if (block != 0)
     {
       *error = 0;
+      dwg_arena_adopt(block, block->name, name);
       block->name = name;
     }
   else
@@ -4936,6 +4941,7 @@ dwg_obj_mlinestyle_set_name(dwg_obj_mlinestyle *mlinestyle, char * name,
   if (mlinestyle != 0)
     {
       *error = 0;
+      dwg_arena_adopt(mlinestyle, mlinestyle->name, name);
       mlinestyle->name = name;
     }
   else
@@ -4979,6 +4985,7 @@ dwg_obj_mlinestyle_set_desc(dwg_obj_mlinestyle *mlinestyle, char * desc,
   if (mlinestyle != 0)
     {
       *error = 0;
+      dwg_arena_adopt(mlinestyle, mlinestyle->desc, desc);
       mlinestyle->desc = desc;
     }
   else
@@ -5241,6 +5248,7 @@ dwg_obj_appid_set_entry_name(dwg_obj_appid *appid, char * entry_name,
   if (appid != 0)
     {
       *error = 0;
+      dwg_arena_adopt(appid, appid->entry_name, entry_name);
       appid->entry_name = entry_name;
     }
   else
@@ -5721,6 +5729,7 @@ dwg_ent_dim_set_user_text(dwg_ent_dim *dim, char * text,
   if (dim != 0)
     {
       *error = 0;
+      dwg_arena_adopt(dim, dim->user_text, text);
       dim->user_text = text;
     }
   else
@@ -8041,6 +8050,7 @@ dwg_ent_mtext_set_text(dwg_ent_mtext *mtext, char * text, int *error)
   if (mtext != 0)
     {
       *error = 0;
+      dwg_arena_adopt(mtext, mtext->text, text);
       mtext->text = text;
     }
   else
@@ -8861,6 +8871,7 @@ dwg_ent_tolerance_set_text_string(dwg_ent_tolerance *tol, char * string,
   if (tol != 0)
     {
       *error = 0;
+      dwg_arena_adopt(tol, tol->text_string, string);
       tol->text_string = string;
     }
   else
@@ -9360,6 +9371,7 @@ dwg_ent_ole2frame_set_data(dwg_ent_ole2frame *frame, char * data, int *error)
   if (frame != 0)
     {
       *error = 0;
+      dwg_arena_adopt(frame, frame->data, data);
       frame->data = data;
     }
   else
@@ -9495,6 +9507,7 @@ dwg_obj_proxy_set_data(dwg_obj_proxy *proxy, char* data,
   if (proxy != 0)
     {
       *error = 0;
+      dwg_arena_adopt(proxy, proxy->data, data);
       proxy->data = data;
     }
   else
@@ -9654,6 +9667,7 @@ dwg_obj_xrecord_set_num_eed(dwg_obj_xrecord *xrecord,
     }
 }
 
+/// Returns the first xdata item. The items are chained by next.
 Dwg_Resbuf*
 dwg_obj_xrecord_get_xdata(dwg_obj_xrecord *xrecord, int *error)
 {
@@ -9670,6 +9684,8 @@ dwg_obj_xrecord_get_xdata(dwg_obj_xrecord *xrecord, int *error)
     }
 }
 
+/// Sets the xdata items, a list chained by next. dwg_free frees each
+/// malloc'ed item and its malloc'ed string.
 void
 dwg_obj_xrecord_set_xdata(dwg_obj_xrecord *xrecord, Dwg_Resbuf* xdata,
                        int *error)
@@ -10508,6 +10524,7 @@ dwg_ent_viewport_set_style_sheet(dwg_ent_viewport *vp, char * sheet,
   if (vp != 0)
     {
       *error = 0;
+      dwg_arena_adopt(vp, vp->style_sheet, sheet);
       vp->style_sheet = sheet;
     }
   else
@@ -13393,6 +13410,23 @@ dwg_ent_3dsolid_get_acis_data(dwg_ent_3dsolid *_3dsolid, int *error)
     }
 }
 
+/// Returns the de-obfuscated SAT data, decoded on the first call
+char *
+dwg_ent_3dsolid_get_raw_sat_data(dwg_ent_3dsolid *_3dsolid, int *error)
+{
+  if (_3dsolid != 0)
+    {
+      *error = dwg_decode_sat_data(_3dsolid);
+      return (char *)_3dsolid->raw_sat_data;
+    }
+  else
+    {
+      *error = 1;
+      LOG_ERROR("%s: empty arg", __FUNCTION__)
+      return NULL;
+    }
+}
+
 /// Sets acis data
 void
 dwg_ent_3dsolid_set_acis_data(dwg_ent_3dsolid *_3dsolid,
@@ -13401,6 +13435,7 @@ dwg_ent_3dsolid_set_acis_data(dwg_ent_3dsolid *_3dsolid,
   if (_3dsolid != 0)
     {
       *error = 0;
+      dwg_arena_adopt(_3dsolid, _3dsolid->acis_data, data);
       _3dsolid->acis_data = data;
     }
   else
@@ -13840,6 +13875,23 @@ dwg_ent_region_get_acis_data(dwg_ent_region *region, int *error)
     }
 }
 
+/// Returns the de-obfuscated SAT data, decoded on the first call
+char *
+dwg_ent_region_get_raw_sat_data(dwg_ent_region *region, int *error)
+{
+  if (region != 0)
+    {
+      *error = dwg_decode_sat_data(region);
+      return (char *)region->raw_sat_data;
+    }
+  else
+    {
+      *error = 1;
+      LOG_ERROR("%s: empty arg", __FUNCTION__)
+      return NULL;
+    }
+}
+
 /// Sets acis data
 void
 dwg_ent_region_set_acis_data(dwg_ent_region *region, char * data,
@@ -13848,6 +13900,7 @@ dwg_ent_region_set_acis_data(dwg_ent_region *region, char * data,
   if (region != 0)
     {
       *error = 0;
+      dwg_arena_adopt(region, region->acis_data, data);
       region->acis_data = data;
     }
   else
@@ -14283,6 +14336,23 @@ dwg_ent_body_get_acis_data(dwg_ent_body *body, int *error)
     }
 }
 
+/// Returns the de-obfuscated SAT data, decoded on the first call
+char *
+dwg_ent_body_get_raw_sat_data(dwg_ent_body *body, int *error)
+{
+  if (body != 0)
+    {
+      *error = dwg_decode_sat_data(body);
+      return (char *)body->raw_sat_data;
+    }
+  else
+    {
+      *error = 1;
+      LOG_ERROR("%s: empty arg", __FUNCTION__)
+      return NULL;
+    }
+}
+
 /// Sets acis data of body
 void
 dwg_ent_body_set_acis_data(dwg_ent_body *body, char * data, int *error)
@@ -14290,6 +14360,7 @@ dwg_ent_body_set_acis_data(dwg_ent_body *body, char * data, int *error)
   if (body != 0)
     {
       *error = 0;
+      dwg_arena_adopt(body, body->acis_data, data);
       body->acis_data = data;
     }
   else
@@ -17090,28 +17161,96 @@ dwg_ent_get_bitsize(dwg_obj_ent *obj, int *error)
 unsigned int
 dwg_obj_get_num_eed(dwg_obj_obj *obj, int *error)
 {
-  *error = 0;
+  /* DWG_OPTS_LAZY_EED: the blocks are split into their items now */
+  *error = dwg_decode_eed_data(obj->object);
   return obj->num_eed;
 }
+dwg_entity_eed *
+dwg_obj_get_eed(dwg_obj_obj *obj, int index, int *error)
+{
+  *error = dwg_decode_eed_data(obj->object);
+  return (index >= 0 && (unsigned int)index < obj->num_eed)
+    ? &obj->eed[index] : NULL;
+}
+dwg_entity_eed_data *
+dwg_obj_get_eed_data(dwg_obj_obj *obj, int index, int *error)
+{
+  *error = dwg_decode_eed_data(obj->object);
+  return (index >= 0 && (unsigned int)index < obj->num_eed)
+    ? obj->eed[index].data : NULL;
+}
 unsigned int
 dwg_ent_get_num_eed(dwg_obj_ent *ent, int *error)
 {
-  *error = 0;
+  *error = dwg_decode_eed_data(ent->object);
   return ent->num_eed;
 }
 dwg_entity_eed *
 dwg_ent_get_eed(dwg_obj_ent *ent, unsigned int index, int *error)
 {
-  *error = 0;
+  *error = dwg_decode_eed_data(ent->object);
   return (index < ent->num_eed) ? &ent->eed[index] : NULL;
 }
 dwg_entity_eed_data *
 dwg_ent_get_eed_data(dwg_obj_ent *ent, unsigned int index, int *error)
 {
-  *error = 0;
+  *error = dwg_decode_eed_data(ent->object);
   return (index < ent->num_eed) ? ent->eed[index].data : NULL;
 }
 
+/* The next EED block from *index on, for appid or all. Only the first
+   item of a block has its size, and its APPID handle is absolute. */
+static dwg_entity_eed *
+eed_next_appid(Dwg_Eed *eed, unsigned int num_eed, dwg_object *appid,
+               unsigned int *index)
+{
+  unsigned int i;
+
+  for (i = *index; i < num_eed; i++)
+    {
+      if (eed[i].size
+          && (!appid || eed[i].handle.value == appid->handle.value))
+        {
+          *index = i + 1;
+          return &eed[i];
+        }
+    }
+  *index = i;
+  return NULL;
+}
+
+/// Returns the next EED block of an entity for an APPID, unparsed
+/** Usage : unsigned int i = 0;
+            while ((eed = dwg_ent_get_eed_appid(ent, appid, &i, &error)))
+              use eed->raw, eed->size;
+\param 1 dwg_obj_ent
+\param 2 dwg_object, the APPID or NULL for all
+\param 3 unsigned int*, the EED index to start at, advanced past the block
+\param 4 int
+*/
+dwg_entity_eed *
+dwg_ent_get_eed_appid(dwg_obj_ent *ent, dwg_object *appid,
+                      unsigned int *index, int *error)
+{
+  *error = 0;
+  return eed_next_appid(ent->eed, ent->num_eed, appid, index);
+}
+
+/// Returns the next EED block of an object for an APPID, unparsed
+/** Usage : see dwg_ent_get_eed_appid
+\param 1 dwg_obj_obj
+\param 2 dwg_object, the APPID or NULL for all
+\param 3 unsigned int*, the EED index to start at, advanced past the block
+\param 4 int
+*/
+dwg_entity_eed *
+dwg_obj_get_eed_appid(dwg_obj_obj *obj, dwg_object *appid,
+                      unsigned int *index, int *error)
+{
+  *error = 0;
+  return eed_next_appid(obj->eed, obj->num_eed, appid, index);
+}
+
 /// Returns dwg_object index
 /** Usage : int index = dwg_obj_object_get_index(obj, &error);
 \param 1 dwg_object
@@ -36,16 +36,10 @@
 #include "encode.h"
 #include "decode.h"
 
-/* The logging level for the write (encode) path.  */
-static unsigned int loglevel;
+/* The logging level for the write (encode) path, per thread.  */
+static THREAD_LOCAL unsigned int loglevel;
 /* the current version per spec block */
-static unsigned int cur_ver = 0;
-
-#ifdef USE_TRACING
-/* This flag means we have checked the environment variable
-   LIBREDWG_TRACE and set `loglevel' appropriately.  */
-static bool env_var_checked_p;
-#endif  /* USE_TRACING */
+static THREAD_LOCAL unsigned int cur_ver = 0;
 #define DWG_LOGLEVEL loglevel
 
 #include "logging.h"
@@ -99,6 +93,7 @@ obj_string_stream(Bit_Chain *dat, BITCODE_RL bitsize, Bit_Chain *str);
   { bit_write_TF(dat, _obj->name, len); \
     FIELD_G_TRACE(name, TF, dxf); }
 #define FIELD_TFF(name,len,dxf) FIELD_TF(name,len,dxf)
+#define FIELD_BINARY(name,len,dxf) FIELD_TF(name,len,dxf)
 #define FIELD_TU(name,dxf) \
   { bit_write_TU(dat, (BITCODE_TU)_obj->name);  \
     LOG_TRACE_TU(#name, (BITCODE_TU)_obj->name,dxf); }
@@ -350,6 +345,8 @@ dwg_encode_entity(Dwg_Object* obj, Bit_Chain* dat, Bit_Chain* hdl_dat, Bit_Chain
 static int
 dwg_encode_object(Dwg_Object* obj, Bit_Chain* dat, Bit_Chain* hdl_dat, Bit_Chain* str_dat);
 static void
+dwg_encode_eed(Bit_Chain* dat, Dwg_Object_Object* obj);
+static void
 dwg_encode_common_entity_handle_data(Bit_Chain* dat, Bit_Chain* hdl_dat, Dwg_Object* obj);
 static void
 dwg_encode_header_variables(Bit_Chain* dat, Bit_Chain* hdl_dat, Bit_Chain* str_dat,
@@ -396,18 +393,7 @@ dwg_encode(Dwg_Data* dwg, Bit_Chain* dat)
   Object_Map pvzmap;
   Bit_Chain *hdl_dat;
 
-  if (dwg->opts)
-    loglevel = dwg->opts & 0xf;
-#ifdef USE_TRACING
-  /* Before starting, set the logging level, but only do so once.  */
-  if (! env_var_checked_p)
-    {
-      char *probe = getenv ("LIBREDWG_TRACE");
-      if (probe)
-        loglevel = atoi (probe);
-      env_var_checked_p = true;
-    }
-#endif  /* USE_TRACING */
+  loglevel = dwg_loglevel(dwg->opts);
 
   bit_chain_alloc(dat);
   hdl_dat = dat;
@@ -1639,6 +1625,28 @@ dwg_encode_add_object(Dwg_Object* obj, Bit_Chain* dat,
   dat->bit = previous_bit;
 }
 
+/* For objects and entities: the EED blocks, from their raw data.
+   Only the first item of each block has its size and raw data, also
+   with DWG_OPTS_LAZY_EED.
+ */
+static void
+dwg_encode_eed(Bit_Chain* dat, Dwg_Object_Object* obj)
+{
+  unsigned int i;
+
+  for (i = 0; i < obj->num_eed; i++)
+    {
+      BITCODE_BS size = obj->eed[i].size;
+      if (!size) // the following items of a block
+        continue;
+      bit_write_BS(dat, size);
+      LOG_TRACE("EED[%u] size: " FORMAT_BS "\n", i, size);
+      bit_write_H(dat, &(obj->eed[i].handle));
+      bit_write_TF(dat, obj->eed[i].raw, size);
+    }
+  bit_write_BS(dat, 0);
+}
+
 /* The first common part of every entity.
 
    The last common part is common_entity_handle_data.spec
@@ -1660,20 +1668,7 @@ dwg_encode_entity(Dwg_Object* obj, Bit_Chain* hdl_dat, Bit_Chain* str_dat,
     }
   bit_write_H(dat, &(obj->handle));
 
-  for (i = 0; i < ent->num_eed; i++)
-    {
-      BITCODE_BS size;
-      size = ent->eed[i].size;
-      bit_write_BS(dat, size);
-      LOG_TRACE("EED[%u] size: " FORMAT_BS "\n", i, size);
-      if (size) // not all eed's have a new handle
-        {
-          bit_write_H(dat, &(ent->eed[i].handle));
-          LOG_TRACE("EED[%u] code: %d\n", i, (int)ent->eed[i].data->code);
-          bit_write_TF(dat, ent->eed[i].raw, size);
-        }
-    }
-  bit_write_BS(dat, 0);
+  dwg_encode_eed(dat, (Dwg_Object_Object *)ent);
 
   bit_write_B(dat, ent->picture_exists);
   if (ent->picture_exists)
@@ -1828,29 +1823,7 @@ dwg_encode_object(Dwg_Object* obj, Bit_Chain* hdl_dat, Bit_Chain* str_dat,
 
   bit_write_H(dat, &ord->object->handle);
 
-  num_eed = ord->num_eed;
-  if (!num_eed) {
-    bit_write_BS(dat, 0);
-  } else {
-    bit_write_BS(dat, ord->eed[0].size);
-    for (i = 0; i < num_eed; i++)
-      {
-        BITCODE_BS j;
-        LOG_TRACE("EED[%u] size: " FORMAT_BS "\n", i, ord->eed[i].size)
-        bit_write_H(dat, &(ord->eed[i].handle));
-        LOG_TRACE("EED[%u] code: " FORMAT_RC "\n", i, ord->eed[i].data->code)
-        bit_write_TF(dat, ord->eed[i].raw, ord->eed[i].size);
-        /*
-        bit_write_RC(dat, ord->eed[i].data->code);
-        for (j=1; j < ord->eed[i].size-1; j++)
-          bit_write_RC(dat, ord->eed[i].raw[j]);
-        */
-        if (i+1 < num_eed)
-          bit_write_BS(dat, ord->eed[i+1].size);
-        else
-          bit_write_BS(dat, 0);
-      }
-  }
+  dwg_encode_eed(dat, ord);
 
   VERSIONS(R_13,R_14)
     {
@@ -1879,14 +1852,14 @@ dwg_encode_header_variables(Bit_Chain* dat, Bit_Chain* hdl_dat, Bit_Chain* str_d
 static void
 dwg_encode_xdata(Bit_Chain* dat, Dwg_Object_XRECORD *obj, int size)
 {
-  Dwg_Resbuf *tmp, *rbuf = obj->xdata;
+  Dwg_Resbuf *rbuf;
   short type;
   int i;
 
-  while (rbuf)
+  for (rbuf = obj->xdata; rbuf; rbuf = rbuf->next)
     {
-      tmp = rbuf->next;
       type = get_base_value_type(rbuf->type);
+      bit_write_RS(dat, rbuf->type);
       switch (type)
         {
         case VT_STRING:
@@ -1932,7 +1905,6 @@ dwg_encode_xdata(Bit_Chain* dat, Dwg_Object_XRECORD *obj, int size)
           LOG_ERROR("Invalid group code in xdata: %d", rbuf->type)
           break;
         }
-      rbuf = tmp;
     }
 }
 
@@ -26,20 +26,18 @@
 #include "dwg.h"
 #include "decode.h"
 #include "free.h"
+#include "arena.h"
+#include "index.h"
+#include "spatial.h"
+#include "stats.h"
 
-static unsigned int loglevel;
-#ifdef USE_TRACING
-static int env_var_checked_p;
-#endif
+/* The logging level for the free path, per thread.  */
+static THREAD_LOCAL unsigned int loglevel;
 #define DWG_LOGLEVEL loglevel
 #include "logging.h"
 
 /* the current version per spec block */
-static unsigned int cur_ver = 0;
-static Bit_Chain pdat = {NULL,0,0,0,0,0};
-static Bit_Chain *dat = &pdat;
-
-extern void dwg_free_xdata_resbuf(Dwg_Resbuf *rbuf);
+static THREAD_LOCAL unsigned int cur_ver = 0;
 
 /*--------------------------------------------------------------------------------
  * MACROS
@@ -72,14 +70,16 @@ extern void dwg_free_xdata_resbuf(Dwg_Resbuf *rbuf);
 #define FIELD_RLL(name,dxf) FIELD(name, RLL)
 #define FIELD_MC(name,dxf) FIELD(name, MC)
 #define FIELD_MS(name,dxf) FIELD(name, MS)
+/* decoded fields live in the arena, fields set later may be malloc'ed */
 #define FIELD_TV(name,dxf) \
   if (FIELD_VALUE(name))\
     {\
-      free (FIELD_VALUE(name)); \
+      dwg_arena_free (dwg, FIELD_VALUE(name)); \
       FIELD_VALUE(name) = NULL; \
     }
 #define FIELD_TU(name,dxf)  FIELD_TV(name,dxf)
 #define FIELD_TF(name,len,dxf) FIELD_TV(name,dxf)
+#define FIELD_BINARY(name,len,dxf) FIELD_TF(name,len,dxf)
 #define FIELD_TFF(name,len,dxf) {}
 #define FIELD_T FIELD_TV /*TODO: implement version dependant string fields */
 #define FIELD_BT(name,dxf) FIELD(name, BT);
@@ -125,7 +125,7 @@ extern void dwg_free_xdata_resbuf(Dwg_Resbuf *rbuf);
 
 #define FIELD_INSERT_COUNT(insert_count, type, dxf)
 #define FIELD_XDATA(name, size) \
-  dwg_free_xdata(_obj, _obj->size)
+  dwg_free_xdata(dwg, _obj, _obj->size)
 
 #define REACTORS(code) \
   for (vcount=0; vcount < (long)obj->tio.object->num_reactors; vcount++) \
@@ -183,7 +183,7 @@ extern void dwg_free_xdata_resbuf(Dwg_Resbuf *rbuf);
 
 #define COMMON_ENTITY_HANDLE_DATA \
   SINCE(R_13) {\
-    dwg_free_common_entity_handle_data(obj); \
+    dwg_free_common_entity_handle_data(dat, obj); \
   }
 #define SECTION_STRING_STREAM
 #define START_STRING_STREAM
@@ -197,16 +197,18 @@ dwg_free_ ##token (Dwg_Object * obj)\
   int vcount, rcount, rcount2, rcount3, rcount4;\
   Dwg_Entity_##token *ent, *_obj;\
   Dwg_Object_Entity *_ent;\
+  Dwg_Data* dwg = obj->parent;\
+  Bit_Chain _dat = { NULL, 0, 0, 0, dwg->header.version, dwg->header.version };\
+  Bit_Chain *dat = &_dat;\
   Bit_Chain *hdl_dat = dat;\
   Bit_Chain* str_dat = dat;\
-  Dwg_Data* dwg = obj->parent;\
   LOG_HANDLE("Free entity " #token "\n")\
   _ent = obj->tio.entity;\
   _obj = ent = _ent->tio.token;
 
 #define DWG_ENTITY_END \
-    free(_obj); obj->tio.entity->tio.UNKNOWN_ENT = NULL; \
-    free(obj->tio.entity); obj->tio.object = NULL;\
+    dwg_arena_free(dwg, _obj); obj->tio.entity->tio.UNKNOWN_ENT = NULL; \
+    dwg_arena_free(dwg, obj->tio.entity); obj->tio.object = NULL;\
 }
 
 #define DWG_OBJECT(token) \
@@ -216,6 +218,8 @@ dwg_free_ ##token (Dwg_Object * obj) \
   int vcount, rcount, rcount2, rcount3, rcount4; \
   Dwg_Data* dwg = obj->parent;                   \
   Dwg_Object_##token *_obj;                      \
+  Bit_Chain _dat = { NULL, 0, 0, 0, dwg->header.version, dwg->header.version }; \
+  Bit_Chain *dat = &_dat;                        \
   Bit_Chain *hdl_dat = dat;                      \
   Bit_Chain* str_dat = dat;                      \
   LOG_HANDLE("Free object " #token " %p\n", obj) \
@@ -223,8 +227,10 @@ dwg_free_ ##token (Dwg_Object * obj) \
 
 #define DWG_OBJECT_END                                  \
   dwg_free_eed(obj);                                    \
-  free(_obj); obj->tio.object->tio.UNKNOWN_OBJ = NULL;  \
-  free(obj->tio.object); obj->tio.object = NULL;        \
+  dwg_arena_free(dwg, _obj);                            \
+  obj->tio.object->tio.UNKNOWN_OBJ = NULL;              \
+  dwg_arena_free(dwg, obj->tio.object);                 \
+  obj->tio.object = NULL;                               \
   obj->parent = NULL;                                   \
   /* free(obj); obj = NULL; */                          \
 }
@@ -237,6 +243,9 @@ dwg_free_handleref(Dwg_Object_Ref *ref, Dwg_Data * dwg)
     free(ref);
     return;
   }
+  /* decoded refs stay valid in object_ref[] until dwg_free */
+  if (dwg_arena_owns(dwg, ref))
+    return;
   for (i=0; i < dwg->num_object_refs; i++)
     {
       if (dwg->object_ref[i] == ref)
@@ -248,7 +257,7 @@ dwg_free_handleref(Dwg_Object_Ref *ref, Dwg_Data * dwg)
 }
 
 static void
-dwg_free_common_entity_handle_data(Dwg_Object* obj)
+dwg_free_common_entity_handle_data(Bit_Chain *dat, Dwg_Object* obj)
 {
 
   Dwg_Data *dwg = obj->parent;
@@ -264,39 +273,42 @@ dwg_free_common_entity_handle_data(Dwg_Object* obj)
 }
 
 static void
-dwg_free_xdata(Dwg_Object_XRECORD *obj, int size)
+dwg_free_xdata(Dwg_Data *dwg, Dwg_Object_XRECORD *obj, int size)
 {
-  dwg_free_xdata_resbuf(obj->xdata);
+  dwg_free_xdata_resbuf(dwg, obj->xdata);
+  obj->xdata = NULL;
+  obj->num_eed = 0;
 }
 
 static void
 dwg_free_eed(Dwg_Object* obj)
 {
+  Dwg_Data *dwg = obj->parent;
   unsigned int i;
   if (obj->supertype == DWG_SUPERTYPE_OBJECT) {
     Dwg_Object_Object* _obj = obj->tio.object;
     for (i=0; i < _obj->num_eed; i++) {
       if (_obj->eed[i].size && _obj->eed[i].raw)
-        free (_obj->eed[i].raw);
+        dwg_arena_free (dwg, _obj->eed[i].raw);
       _obj->eed[i].raw = NULL;
       if (_obj->eed[i].data)
-        free (_obj->eed[i].data);
+        dwg_arena_free (dwg, _obj->eed[i].data);
       _obj->eed[i].data = NULL;
     }
-    free(_obj->eed);
+    dwg_arena_free(dwg, _obj->eed);
     _obj->eed = NULL;
   }
   else if (obj->supertype == DWG_SUPERTYPE_ENTITY) {
     Dwg_Object_Entity* _obj = obj->tio.entity;
     for (i=0; i < _obj->num_eed; i++) {
       if (_obj->eed[i].size && _obj->eed[i].raw)
-        free (_obj->eed[i].raw);
+        dwg_arena_free (dwg, _obj->eed[i].raw);
       _obj->eed[i].raw = NULL;
       if (_obj->eed[i].data)
-        free (_obj->eed[i].data);
+        dwg_arena_free (dwg, _obj->eed[i].data);
       _obj->eed[i].data = NULL;
     }
-    free(_obj->eed);
+    dwg_arena_free(dwg, _obj->eed);
     _obj->eed = NULL;
   }
 }
@@ -523,14 +535,12 @@ dwg_free_object(Dwg_Object *obj)
   long unsigned int j;
   Dwg_Data *dwg;
 
-  if (obj && obj->parent) {
+  if (obj && obj->parent)
     dwg = obj->parent;
-    dat->version = dwg->header.version;
-  } else
+  else
     return;
   if (obj->type == DWG_TYPE_FREED)
     return;
-  dat->from_version = dat->version;
   switch (obj->type)
     {
     case DWG_TYPE_TEXT:
@@ -799,36 +809,35 @@ dwg_free_object(Dwg_Object *obj)
             }
           else // not a class
             {
-              free(obj->tio.unknown);
+              dwg_arena_free(dwg, obj->tio.unknown);
             }
         }
     }
   obj->type = DWG_TYPE_FREED;
 }
 
+/** dwg_free
+ * With a decoded drawing all objects live in the arena, and are released
+ * at once without walking them. Only the heap parts are freed one by one,
+ * and the heap memory which the setters put into the objects.
+ */
 void
 dwg_free(Dwg_Data * dwg)
 {
   unsigned int i;
   if (dwg)
     {
-      if (dwg->opts)
-        loglevel = dwg->opts & 0xf;
-#ifdef USE_TRACING
-      /* Before starting, set the logging level, but only do so once.  */
-      if (! env_var_checked_p)
-        {
-          char *probe = getenv ("LIBREDWG_TRACE");
-          if (probe)
-            loglevel = atoi (probe);
-          env_var_checked_p = 1;
-        }
-#endif  /* USE_TRACING */
+      Dwg_Arena *arena = (Dwg_Arena *)dwg->arena;
+      int walk = !(arena && arena->decoded);
+      Dwg_Stats_Mark mark;
+
+      loglevel = dwg_loglevel(dwg->opts);
       LOG_INFO("dwg_free\n")
+      dwg_stats_begin(dwg, DWG_PHASE_FREE, &mark);
       /*if (dwg->bit_chain && dwg->bit_chain->size)
         free (dwg->bit_chain->chain);*/
-#define FREE_IF(ptr) { if (ptr) free(ptr); }
-      for (i=0; i < dwg->num_objects; ++i)
+#define FREE_IF(ptr) { if (ptr) dwg_arena_free(dwg, ptr); }
+      for (i=0; walk && i < dwg->num_objects; ++i)
         {
           if (dwg->object[i].type != DWG_TYPE_BLOCK_CONTROL)
             dwg_free_object(&dwg->object[i]);
@@ -837,11 +846,16 @@ dwg_free(Dwg_Data * dwg)
       {
         Dwg_Header_Variables* _obj = &dwg->header_vars;
         Dwg_Object* obj = NULL;
+        Bit_Chain _dat = { NULL, 0, 0, 0, dwg->header.version,
+                           dwg->header.version };
+        Bit_Chain *dat = &_dat;
 
         #include "header_variables.spec"
       }
-      if (dwg->picture.size && dwg->picture.chain)
-        free(dwg->picture.chain);
+      dwg_arena_free(dwg, dwg->picture.chain);
+      if (dwg->objects_section)
+        free(dwg->objects_section);
+      dwg->objects_section = NULL;
       if (dwg->num_classes)
         {
           for (i=0; i < dwg->num_classes; ++i)
@@ -858,17 +872,38 @@ dwg_free(Dwg_Data * dwg)
         FREE_IF(dwg->header.section_info);
       for (i=0; i < dwg->second_header.num_handlers; i++)
         FREE_IF(dwg->second_header.handlers[i].data);
-      for (i=0; i < dwg->num_objects; ++i)
+      for (i=0; walk && i < dwg->num_objects; ++i)
         {
           if (dwg->object[i].type == DWG_TYPE_BLOCK_CONTROL)
             dwg_free_object(&dwg->object[i]);
         }
-      for (i=0; i < dwg->num_object_refs; ++i)
+      for (i=0; walk && i < dwg->num_object_refs; ++i)
         FREE_IF(dwg->object_ref[i]);
       FREE_IF(dwg->object_ref);
       FREE_IF(dwg->object);
+      if (dwg->object_index)
+        free(dwg->object_index);
+      dwg->object_ref = NULL;
+      dwg->object = NULL;
+      dwg->num_alloced_objects = 0;
+      dwg->object_index = NULL;
+      dwg->num_indexed_objects = 0;
+      dwg_free_owner_index(dwg);
+      dwg_free_type_index(dwg);
+      dwg_free_layer_index(dwg);
+      dwg_free_spatial_index(dwg);
+      dwg_index_lock_free(dwg);
+      dwg_arena_destroy(dwg);
+      dwg->input = NULL;
+      dwg->input_size = 0;
+      if (dwg->intern_owned)
+        dwg_intern_free(dwg->intern);
+      dwg->intern = NULL;
+      dwg->intern_owned = 0;
+      dwg_stats_end(dwg, &mark, NULL, 0);
 #undef FREE_IF
     }
+  dwg_log_flush();
 }
 
 #undef IS_FREE
@@ -130,7 +130,7 @@
   dat->byte = 0x31b;
   FIELD_RS (CECOLOR_idx, 62);
   DECODER {
-    _obj->CELTYPE = calloc(1, sizeof(Dwg_Object_Ref));
+    _obj->CELTYPE = dwg_arena_calloc(dwg, 1, sizeof(Dwg_Object_Ref));
     _obj->CELTYPE->absolute_ref = bit_read_RS(dat); // 6, ff for BYLAYER, fe for BYBLOCK
     LOG_TRACE("CELTYPE: %lu [long 6]\n", _obj->CELTYPE->absolute_ref)
   }
@@ -200,7 +200,7 @@
 
   dat->byte = 0x4ee;
   DECODER {
-    _obj->HANDSEED = calloc(1, sizeof(Dwg_Object_Ref));
+    _obj->HANDSEED = dwg_arena_calloc(dwg, 1, sizeof(Dwg_Object_Ref));
     _obj->HANDSEED->absolute_ref = bit_read_RS(dat);
     LOG_TRACE("HANDSEED: %lu [long 5]\n", _obj->HANDSEED->absolute_ref)
   }
@@ -0,0 +1,946 @@
+/*****************************************************************************/
+/*  LibreDWG - free implementation of the DWG file format                    */
+/*                                                                           */
+/*  Copyright (C) 2018 Free Software Foundation, Inc.                        */
+/*                                                                           */
+/*  This library is free software, licensed under the terms of the GNU       */
+/*  General Public License as published by the Free Software Foundation,     */
+/*  either version 3 of the License, or (at your option) any later version.  */
+/*  You should have received a copy of the GNU General Public License        */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.    */
+/*****************************************************************************/
+
+/*
+ * index.c: indices over the decoded objects, built after decoding.
+ *
+ * The owner index maps every entity to the BLOCK_HEADER owning it, or
+ * to its INSERT or POLYLINE for attributes, vertices and SEQENDs, and
+ * lists the owned objects of each owner. It is built from the owner
+ * handles for all versions, and from the entity lists of the
+ * BLOCK_HEADERs since R2004, which are also there when the handles of
+ * the entities are not decoded yet. Its iterators do not change the
+ * drawing, so several threads may walk the same block.
+ *
+ * The type index lists the objects of each type, of the whole drawing
+ * and of each block, as views without allocation.
+ *
+ * The owner index is built by dwg_decode(), the others on first use,
+ * under one lock for all drawings, and published when complete. Once
+ * built they are only read, by any number of threads.
+ *
+ * The layer index finds a LAYER by its name, and lists the entities on
+ * each layer, grouped by block. It is built from the layer handles of
+ * the entities, as the LAYER_INDEX object is optional and often out of
+ * date.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include "common.h"
+#include "index.h"
+#include "decode.h"
+
+#ifdef HAVE_PTHREAD_H
+/* of the drawings which were not decoded */
+static pthread_mutex_t index_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK_OF(dwg) \
+  ((dwg)->index_lock ? (pthread_mutex_t *)(dwg)->index_lock : &index_lock)
+#endif
+
+/* The lock of one drawing, so that unrelated drawings are decoded and
+   indexed in parallel. Created by the decoder before dwg is shared. */
+void
+dwg_index_lock_new(Dwg_Data *dwg)
+{
+  dwg->index_lock = NULL;
+#ifdef HAVE_PTHREAD_H
+  {
+    pthread_mutex_t *lock = (pthread_mutex_t *)malloc(sizeof(*lock));
+    if (lock && pthread_mutex_init(lock, NULL) == 0)
+      dwg->index_lock = lock;
+    else
+      free(lock);
+  }
+#endif
+}
+
+void
+dwg_index_lock_free(Dwg_Data *dwg)
+{
+#ifdef HAVE_PTHREAD_H
+  if (dwg->index_lock)
+    {
+      pthread_mutex_destroy((pthread_mutex_t *)dwg->index_lock);
+      free(dwg->index_lock);
+    }
+#endif
+  dwg->index_lock = NULL;
+}
+
+/* held while an index of dwg is built on first use */
+void
+dwg_index_lock(Dwg_Data *dwg)
+{
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(LOCK_OF(dwg));
+#endif
+}
+
+void
+dwg_index_unlock(Dwg_Data *dwg)
+{
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(LOCK_OF(dwg));
+#endif
+}
+
+/* the object of ref, or its handle looked up in the object index */
+static unsigned int
+ref_index(Dwg_Data *dwg, const Dwg_Object_Index *index,
+          const Dwg_Object_Ref *ref)
+{
+  long unsigned int lo = 0, hi = dwg->num_objects;
+
+  if (!ref)
+    return DWG_NO_OWNER;
+  if (ref->obj && ref->obj >= dwg->object
+      && ref->obj < dwg->object + dwg->num_objects)
+    return (unsigned int)(ref->obj - dwg->object);
+  if (!index || !ref->absolute_ref)
+    return DWG_NO_OWNER;
+  while (lo < hi)
+    {
+      long unsigned int mid = lo + (hi - lo) / 2;
+      if (index[mid].handle == ref->absolute_ref)
+        return (unsigned int)mid;
+      if (index[mid].handle < ref->absolute_ref)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return DWG_NO_OWNER;
+}
+
+static int
+is_subentity(unsigned int type)
+{
+  return type == DWG_TYPE_ATTRIB || type == DWG_TYPE_SEQEND
+         || type == DWG_TYPE_VERTEX_2D || type == DWG_TYPE_VERTEX_3D
+         || type == DWG_TYPE_VERTEX_MESH || type == DWG_TYPE_VERTEX_PFACE
+         || type == DWG_TYPE_VERTEX_PFACE_FACE;
+}
+
+/* Blocks own entities, other entities only their attributes, vertices
+   and SEQEND. So the owners are at most two levels deep. */
+static int
+valid_owner(const Dwg_Data *dwg, unsigned int i, unsigned int owner)
+{
+  const Dwg_Object *obj;
+
+  if (owner == DWG_NO_OWNER || owner == i)
+    return 0;
+  obj = &dwg->object[owner];
+  if (obj->type == DWG_TYPE_BLOCK_HEADER)
+    return 1;
+  return obj->supertype == DWG_SUPERTYPE_ENTITY
+         && is_subentity(dwg->object[i].type) && !is_subentity(obj->type);
+}
+
+/* the model or paper space BLOCK_HEADER of entity_mode 2 or 1 */
+static unsigned int
+space_index(Dwg_Data *dwg, const Dwg_Object_Index *index, int paper)
+{
+  Dwg_Object_Ref *ref = paper ? dwg->header_vars.BLOCK_RECORD_PSPACE
+                              : dwg->header_vars.BLOCK_RECORD_MSPACE;
+  long unsigned int i;
+
+  if (ref)
+    return ref_index(dwg, index, ref);
+  for (i = 0; i < dwg->num_objects; i++)
+    if (dwg->object[i].type == DWG_TYPE_BLOCK_CONTROL
+        && dwg->object[i].tio.object)
+      {
+        Dwg_Object_BLOCK_CONTROL *ctrl
+            = dwg->object[i].tio.object->tio.BLOCK_CONTROL;
+        return ref_index(dwg, index,
+                         paper ? ctrl->paper_space : ctrl->model_space);
+      }
+  return DWG_NO_OWNER;
+}
+
+static void
+owner_index_free(Dwg_Owner_Index *owners)
+{
+  if (!owners)
+    return;
+  free(owners->owner);
+  free(owners->start);
+  free(owners->owned);
+  free(owners);
+}
+
+/* dwg_owner_index() under the lock */
+static int
+owner_index_build(Dwg_Data *dwg)
+{
+  const Dwg_Object_Index *index;
+  Dwg_Owner_Index *owners;
+  unsigned int mspace, pspace;
+  long unsigned int i, num = dwg->num_objects;
+
+  dwg_free_owner_index(dwg);
+  dwg_free_type_index(dwg);
+  dwg_free_layer_index(dwg);
+  if (dwg->header.version < R_13)
+    return 1;
+  index = dwg_object_index(dwg);
+  owners = (Dwg_Owner_Index *)calloc(1, sizeof(Dwg_Owner_Index));
+  if (!index || !owners)
+    {
+      free(owners);
+      return -1;
+    }
+  owners->owner = (unsigned int *)malloc((num ? num : 1) * sizeof(unsigned int));
+  owners->start = (unsigned int *)calloc(num + 1, sizeof(unsigned int));
+  owners->owned = (unsigned int *)malloc((num ? num : 1) * sizeof(unsigned int));
+  if (!owners->owner || !owners->start || !owners->owned)
+    {
+      owner_index_free(owners);
+      return -1;
+    }
+  memset(owners->owner, 0xff, num * sizeof(unsigned int));
+
+  /* R2004+: the entities listed by each block */
+  for (i = 0; i < num; i++)
+    {
+      Dwg_Object_BLOCK_HEADER *hdr;
+      BITCODE_BL j;
+
+      if (dwg->object[i].type != DWG_TYPE_BLOCK_HEADER
+          || !dwg->object[i].tio.object)
+        continue;
+      hdr = dwg->object[i].tio.object->tio.BLOCK_HEADER;
+      if (dwg->header.version < R_2004 || !hdr->entities)
+        continue;
+      for (j = 0; j < hdr->owned_object_count; j++)
+        {
+          unsigned int k = ref_index(dwg, index, hdr->entities[j]);
+          if (k != DWG_NO_OWNER && owners->owner[k] == DWG_NO_OWNER)
+            owners->owner[k] = (unsigned int)i;
+        }
+    }
+  /* the owner handle, or the model or paper space */
+  mspace = space_index(dwg, index, 0);
+  pspace = space_index(dwg, index, 1);
+  for (i = 0; i < num; i++)
+    {
+      const Dwg_Object *obj = &dwg->object[i];
+      unsigned int owner;
+
+      /* listed, maybe not decoded */
+      if (obj->type == DWG_TYPE_BLOCK || obj->type == DWG_TYPE_ENDBLK
+          || obj->supertype == DWG_SUPERTYPE_OBJECT)
+        {
+          owners->owner[i] = DWG_NO_OWNER;
+          continue;
+        }
+      if (owners->owner[i] != DWG_NO_OWNER
+          || obj->supertype != DWG_SUPERTYPE_ENTITY || !obj->tio.entity)
+        continue;
+      switch (obj->tio.entity->entity_mode)
+        {
+        case 0:
+          owner = ref_index(dwg, index, obj->tio.entity->subentity);
+          break;
+        case 1:
+          owner = pspace;
+          break;
+        case 2:
+          owner = mspace;
+          break;
+        default:
+          owner = DWG_NO_OWNER;
+        }
+      if (valid_owner(dwg, (unsigned int)i, owner))
+        owners->owner[i] = owner;
+    }
+
+  /* count, sum up and fill in ascending order */
+  for (i = 0; i < num; i++)
+    if (owners->owner[i] != DWG_NO_OWNER)
+      owners->start[owners->owner[i] + 1]++;
+  for (i = 0; i < num; i++)
+    owners->start[i + 1] += owners->start[i];
+  for (i = 0; i < num; i++)
+    if (owners->owner[i] != DWG_NO_OWNER)
+      owners->owned[owners->start[owners->owner[i]]++] = (unsigned int)i;
+  /* each start moved to the next one */
+  for (i = num; i > 0; i--)
+    owners->start[i] = owners->start[i - 1];
+  owners->start[0] = 0;
+  owners->num_objects = num;
+  DWG_INDEX_STORE(dwg->owner_index, owners);
+  return 0;
+}
+
+/** dwg_owner_index
+ * Builds the index of which BLOCK_HEADER owns which entities, used by
+ * dwg_first_owned(). dwg_decode() builds
+ * it; call it again after adding objects. Not before R13.
+ * returns 0 on success.
+ */
+int
+dwg_owner_index(Dwg_Data *dwg)
+{
+  int error;
+
+  dwg_index_lock(dwg);
+  error = owner_index_build(dwg);
+  dwg_index_unlock(dwg);
+  return error;
+}
+
+const Dwg_Owner_Index *
+dwg_owner_index_get(const Dwg_Data *dwg)
+{
+  const Dwg_Owner_Index *owners
+      = (const Dwg_Owner_Index *)DWG_INDEX_LOAD(dwg->owner_index);
+
+  return owners && owners->num_objects == dwg->num_objects ? owners : NULL;
+}
+
+const Dwg_Owner_Index *
+dwg_owner_index_locked(Dwg_Data *dwg)
+{
+  const Dwg_Owner_Index *owners = dwg_owner_index_get(dwg);
+
+  /* none before R13 */
+  if (!owners && owner_index_build(dwg) == 0)
+    owners = dwg_owner_index_get(dwg);
+  return owners;
+}
+
+void
+dwg_free_owner_index(Dwg_Data *dwg)
+{
+  owner_index_free((Dwg_Owner_Index *)dwg->owner_index);
+  DWG_INDEX_STORE(dwg->owner_index, NULL);
+}
+
+/* Depth first: the first object owned by cur, else the next one owned
+   by its owner, up to top. */
+static Dwg_Object *
+owned_next(const Dwg_Data *dwg, const Dwg_Owner_Index *owners,
+           unsigned int top, unsigned int cur)
+{
+  if (owners->start[cur] < owners->start[cur + 1])
+    return &dwg->object[owners->owned[owners->start[cur]]];
+  while (cur != top)
+    {
+      unsigned int owner = owners->owner[cur];
+      unsigned int lo, hi;
+
+      if (owner == DWG_NO_OWNER)
+        return NULL;
+      lo = owners->start[owner];
+      hi = owners->start[owner + 1];
+      while (lo < hi)
+        {
+          unsigned int mid = lo + (hi - lo) / 2;
+          if (owners->owned[mid] < cur)
+            lo = mid + 1;
+          else
+            hi = mid;
+        }
+      if (lo + 1 < owners->start[owner + 1])
+        return &dwg->object[owners->owned[lo + 1]];
+      cur = owner;
+    }
+  return NULL;
+}
+
+/** dwg_first_owned
+ * Starts iter over the entities owned by a BLOCK_HEADER, each followed
+ * by its attributes or vertices and SEQEND, or over those of an INSERT
+ * or POLYLINE. Neither owner nor its drawing is changed.
+ * Returns the first one, NULL if none or without owner index.
+ */
+Dwg_Object *
+dwg_first_owned(const Dwg_Object *owner, Dwg_Owned_Iterator *iter)
+{
+  const Dwg_Owner_Index *owners;
+
+  iter->owner = owner;
+  iter->current = NULL;
+  if (!owner || !owner->parent
+      || !(owners = dwg_owner_index_get(owner->parent))
+      || owner->index >= owners->num_objects)
+    return NULL;
+  iter->current = owned_next(owner->parent, owners, owner->index,
+                             owner->index);
+  return (Dwg_Object *)iter->current;
+}
+
+/** dwg_next_owned
+ * Returns the next object of iter, NULL at its end.
+ */
+Dwg_Object *
+dwg_next_owned(Dwg_Owned_Iterator *iter)
+{
+  const Dwg_Owner_Index *owners;
+
+  if (!iter->current
+      || !(owners = dwg_owner_index_get(iter->owner->parent)))
+    return NULL;
+  iter->current = owned_next(iter->owner->parent, owners, iter->owner->index,
+                             iter->current->index);
+  return (Dwg_Object *)iter->current;
+}
+
+/* the BLOCK_HEADER of an entity, or of the entity owning it */
+static unsigned int
+block_of(const Dwg_Data *dwg, const Dwg_Owner_Index *owners, unsigned int i)
+{
+  unsigned int owner = owners ? owners->owner[i] : DWG_NO_OWNER;
+
+  if (owner != DWG_NO_OWNER
+      && dwg->object[owner].type != DWG_TYPE_BLOCK_HEADER)
+    owner = owners->owner[owner];
+  if (owner != DWG_NO_OWNER
+      && dwg->object[owner].type != DWG_TYPE_BLOCK_HEADER)
+    owner = DWG_NO_OWNER;
+  return owner;
+}
+
+static void
+type_index_free(Dwg_Type_Index *types)
+{
+  if (!types)
+    return;
+  free(types->start);
+  free(types->objects);
+  free(types->entities);
+  free(types->block_start);
+  free(types->block_objects);
+  free(types);
+}
+
+static Dwg_Type_Index *
+type_index_new(Dwg_Data *dwg, const Dwg_Owner_Index *owners)
+{
+  Dwg_Type_Index *types;
+  long unsigned int i, num = dwg->num_objects;
+  unsigned int t;
+
+  types = (Dwg_Type_Index *)calloc(1, sizeof(Dwg_Type_Index));
+  if (!types)
+    return NULL;
+  for (i = 0; i < num; i++)
+    if (dwg->object[i].type >= types->num_types)
+      types->num_types = dwg->object[i].type + 1;
+  types->start = (unsigned int *)calloc(types->num_types + 1,
+                                        sizeof(unsigned int));
+  types->objects = (unsigned int *)malloc((num ? num : 1)
+                                          * sizeof(unsigned int));
+  types->entities = (unsigned int *)malloc((num ? num : 1)
+                                           * sizeof(unsigned int));
+  types->block_start = (unsigned int *)calloc(num + 1, sizeof(unsigned int));
+  types->block_objects = (unsigned int *)malloc((num ? num : 1)
+                                                * sizeof(unsigned int));
+  if (!types->start || !types->objects || !types->entities
+      || !types->block_start || !types->block_objects)
+    {
+      type_index_free(types);
+      return NULL;
+    }
+
+  /* by type, stable */
+  for (i = 0; i < num; i++)
+    types->start[dwg->object[i].type + 1]++;
+  for (t = 0; t < types->num_types; t++)
+    types->start[t + 1] += types->start[t];
+  for (i = 0; i < num; i++)
+    {
+      types->objects[types->start[dwg->object[i].type]++] = (unsigned int)i;
+      if (dwg->object[i].supertype == DWG_SUPERTYPE_ENTITY)
+        types->entities[types->num_entities++] = (unsigned int)i;
+    }
+  for (t = types->num_types; t > 0; t--)
+    types->start[t] = types->start[t - 1];
+  types->start[0] = 0;
+
+  /* by block, stable over the objects by type */
+  for (i = 0; i < num; i++)
+    {
+      unsigned int block = block_of(dwg, owners, (unsigned int)i);
+      if (block != DWG_NO_OWNER)
+        types->block_start[block + 1]++;
+    }
+  for (i = 0; i < num; i++)
+    types->block_start[i + 1] += types->block_start[i];
+  for (i = 0; i < num; i++)
+    {
+      unsigned int j = types->objects[i];
+      unsigned int block = block_of(dwg, owners, j);
+      if (block != DWG_NO_OWNER)
+        types->block_objects[types->block_start[block]++] = j;
+    }
+  for (i = num; i > 0; i--)
+    types->block_start[i] = types->block_start[i - 1];
+  types->block_start[0] = 0;
+  types->num_objects = num;
+  DWG_INDEX_STORE(dwg->type_index, types);
+  return types;
+}
+
+const Dwg_Type_Index *
+dwg_type_index_get(const Dwg_Data *dwg)
+{
+  const Dwg_Type_Index *types
+      = (const Dwg_Type_Index *)DWG_INDEX_LOAD(dwg->type_index);
+
+  return types && types->num_objects == dwg->num_objects ? types : NULL;
+}
+
+const Dwg_Type_Index *
+dwg_type_index_locked(Dwg_Data *dwg)
+{
+  const Dwg_Type_Index *types = (const Dwg_Type_Index *)dwg->type_index;
+
+  /* built by another thread meanwhile */
+  if (types && types->num_objects == dwg->num_objects)
+    return types;
+  dwg_free_type_index(dwg);
+  /* without blocks before R13 */
+  return type_index_new(dwg, dwg_owner_index_locked(dwg));
+}
+
+const Dwg_Type_Index *
+dwg_type_index(Dwg_Data *dwg)
+{
+  const Dwg_Type_Index *types = dwg_type_index_get(dwg);
+
+  if (types)
+    return types;
+  dwg_index_lock(dwg);
+  types = dwg_type_index_locked(dwg);
+  dwg_index_unlock(dwg);
+  return types;
+}
+
+void
+dwg_free_type_index(Dwg_Data *dwg)
+{
+  type_index_free((Dwg_Type_Index *)dwg->type_index);
+  DWG_INDEX_STORE(dwg->type_index, NULL);
+}
+
+/** dwg_objects_of_type
+ * The indices into dwg->object of all objects of type in ascending
+ * order, variable types of classes included. Sets *num to their number.
+ * The array belongs to the drawing and stays valid until objects are
+ * added or dwg_free. Its first call builds the index for all types.
+ * NULL if there are none.
+ */
+const unsigned int *
+dwg_objects_of_type(Dwg_Data *dwg, unsigned int type, unsigned int *num)
+{
+  const Dwg_Type_Index *types = dwg_type_index(dwg);
+
+  *num = 0;
+  if (!types || type >= types->num_types
+      || types->start[type] == types->start[type + 1])
+    return NULL;
+  *num = types->start[type + 1] - types->start[type];
+  return &types->objects[types->start[type]];
+}
+
+/** dwg_block_objects_of_type
+ * Like dwg_objects_of_type(), for the entities of the BLOCK_HEADER
+ * block with their attributes, vertices and SEQENDs.
+ */
+const unsigned int *
+dwg_block_objects_of_type(Dwg_Object *block, unsigned int type,
+                          unsigned int *num)
+{
+  const Dwg_Type_Index *types;
+  unsigned int lo, hi, first;
+
+  *num = 0;
+  if (!block || !block->parent
+      || !(types = dwg_type_index(block->parent))
+      || block->index >= types->num_objects)
+    return NULL;
+  /* the range of type in the block */
+  lo = types->block_start[block->index];
+  hi = types->block_start[block->index + 1];
+  while (lo < hi)
+    {
+      unsigned int mid = lo + (hi - lo) / 2;
+      if (block->parent->object[types->block_objects[mid]].type < type)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  first = lo;
+  hi = types->block_start[block->index + 1];
+  while (lo < hi)
+    {
+      unsigned int mid = lo + (hi - lo) / 2;
+      if (block->parent->object[types->block_objects[mid]].type <= type)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  if (lo == first)
+    return NULL;
+  *num = lo - first;
+  return &types->block_objects[first];
+}
+
+/* FNV-1a of name, ASCII letters in upper case as layer names are
+   case-insensitive */
+static unsigned int
+name_hash(const char *name)
+{
+  unsigned int hash = 2166136261U;
+
+  for (; *name; name++)
+    {
+      unsigned char c = (unsigned char)*name;
+      hash ^= c >= 'a' && c <= 'z' ? c - 32 : c;
+      hash *= 16777619U;
+    }
+  return hash;
+}
+
+static int
+name_equal(const char *a, const char *b)
+{
+  for (; *a && *b; a++, b++)
+    {
+      unsigned char ca = (unsigned char)*a, cb = (unsigned char)*b;
+      if (ca != cb
+          && (ca >= 'a' && ca <= 'z' ? ca - 32 : ca)
+                 != (cb >= 'a' && cb <= 'z' ? cb - 32 : cb))
+        return 0;
+    }
+  return *a == *b;
+}
+
+/* the layer at object index i, or num_layers */
+static unsigned int
+layer_of(const Dwg_Layer_Index *layers, unsigned int i)
+{
+  unsigned int lo = 0, hi = layers->num_layers;
+
+  while (lo < hi)
+    {
+      unsigned int mid = lo + (hi - lo) / 2;
+      if (layers->layers[mid] < i)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo < layers->num_layers && layers->layers[lo] == i
+             ? lo
+             : layers->num_layers;
+}
+
+/* the UTF-8 names of the layers into one text, hashed into buckets */
+static int
+layer_names(Dwg_Data *dwg, Dwg_Layer_Index *layers)
+{
+  size_t size = 0, alloced = 0;
+  unsigned int l;
+
+  for (l = 0; l < layers->num_layers; l++)
+    {
+      Dwg_Object *obj = &dwg->object[layers->layers[l]];
+      char **entry_name = obj->tio.object
+                          ? &obj->tio.object->tio.LAYER->entry_name : NULL;
+      int len = entry_name ? dwg_text_utf8(obj, entry_name, NULL, 0) : -1;
+
+      if (len < 0) // unreadable, empty
+        len = 0;
+      if (size + len + 1 > alloced)
+        {
+          char *text = (char *)realloc(layers->text, (size + len + 1) * 2);
+          if (!text)
+            return -1;
+          layers->text = text;
+          alloced = (size + len + 1) * 2;
+        }
+      layers->text[size] = '\0';
+      if (entry_name)
+        dwg_text_utf8(obj, entry_name, layers->text + size, len + 1);
+      layers->name_at[l] = (unsigned int)size;
+      size += len + 1;
+    }
+
+  /* at most half full */
+  layers->num_buckets = 16;
+  while (layers->num_buckets < layers->num_layers * 2)
+    layers->num_buckets *= 2;
+  layers->buckets = (unsigned int *)calloc(layers->num_buckets,
+                                           sizeof(unsigned int));
+  if (!layers->buckets)
+    return -1;
+  for (l = 0; l < layers->num_layers; l++)
+    {
+      unsigned int b = name_hash(layers->text + layers->name_at[l])
+                       & (layers->num_buckets - 1);
+      while (layers->buckets[b])
+        b = (b + 1) & (layers->num_buckets - 1);
+      layers->buckets[b] = l + 1;
+    }
+  return 0;
+}
+
+static void
+layer_index_free(Dwg_Layer_Index *layers)
+{
+  if (!layers)
+    return;
+  free(layers->layers);
+  free(layers->name_at);
+  free(layers->text);
+  free(layers->buckets);
+  free(layers->start);
+  free(layers->entities);
+  free(layers);
+}
+
+static Dwg_Layer_Index *
+layer_index_new(Dwg_Data *dwg, const Dwg_Type_Index *types,
+                const Dwg_Owner_Index *owners)
+{
+  const Dwg_Object_Index *index = dwg_object_index(dwg);
+  Dwg_Layer_Index *layers;
+  const unsigned int *objects = NULL;
+  unsigned int *layer = NULL, *by_block = NULL, *order = NULL;
+  long unsigned int i, num = dwg->num_objects;
+  unsigned int l, n = 0;
+
+  if (DWG_TYPE_LAYER < types->num_types)
+    {
+      objects = &types->objects[types->start[DWG_TYPE_LAYER]];
+      n = types->start[DWG_TYPE_LAYER + 1] - types->start[DWG_TYPE_LAYER];
+    }
+  layers = (Dwg_Layer_Index *)calloc(1, sizeof(Dwg_Layer_Index));
+  if (!layers)
+    return NULL;
+  layers->num_layers = n;
+  layers->layers = (unsigned int *)malloc((n ? n : 1) * sizeof(unsigned int));
+  layers->name_at = (unsigned int *)malloc((n ? n : 1)
+                                           * sizeof(unsigned int));
+  layers->start = (unsigned int *)calloc(n + 1, sizeof(unsigned int));
+  layers->entities = (unsigned int *)malloc((num ? num : 1)
+                                            * sizeof(unsigned int));
+  layer = (unsigned int *)malloc((num ? num : 1) * sizeof(unsigned int));
+  by_block = (unsigned int *)calloc(num + 2, sizeof(unsigned int));
+  order = (unsigned int *)malloc((num ? num : 1) * sizeof(unsigned int));
+  if (!layers->layers || !layers->name_at || !layers->start
+      || !layers->entities || !layer || !by_block || !order)
+    goto oom;
+  if (n)
+    memcpy(layers->layers, objects, n * sizeof(unsigned int));
+  if (layer_names(dwg, layers))
+    goto oom;
+
+  /* the layer of each entity, num_layers if none. With deferred handles
+     only the layer handle is read, and the entity stays deferred. */
+  for (i = 0; i < num; i++)
+    {
+      Dwg_Object *obj = &dwg->object[i];
+
+      layer[i] = n;
+      if (obj->supertype != DWG_SUPERTYPE_ENTITY || !obj->tio.entity)
+        continue;
+      if (obj->handles_deferred)
+        {
+          Dwg_Object *layer_obj = dwg_decode_entity_layer(obj);
+          l = layer_obj ? (unsigned int)(layer_obj - dwg->object)
+                        : DWG_NO_OWNER;
+        }
+      else
+        l = ref_index(dwg, index, obj->tio.entity->layer);
+      if (l != DWG_NO_OWNER)
+        layer[i] = layer_of(layers, l);
+    }
+
+  /* by block, entities without block last, then stable by layer */
+  for (i = 0; i < num; i++)
+    if (layer[i] < n)
+      {
+        unsigned int block = block_of(dwg, owners, (unsigned int)i);
+        by_block[(block == DWG_NO_OWNER ? num : block) + 1]++;
+        layers->start[layer[i] + 1]++;
+      }
+  for (i = 0; i <= num; i++)
+    by_block[i + 1] += by_block[i];
+  for (l = 0; l < n; l++)
+    layers->start[l + 1] += layers->start[l];
+  for (i = 0; i < num; i++)
+    if (layer[i] < n)
+      {
+        unsigned int block = block_of(dwg, owners, (unsigned int)i);
+        order[by_block[block == DWG_NO_OWNER ? num : block]++]
+            = (unsigned int)i;
+      }
+  for (i = 0; i < layers->start[n]; i++)
+    layers->entities[layers->start[layer[order[i]]]++] = order[i];
+  for (l = n; l > 0; l--)
+    layers->start[l] = layers->start[l - 1];
+  layers->start[0] = 0;
+  free(layer);
+  free(by_block);
+  free(order);
+  layers->num_objects = num;
+  DWG_INDEX_STORE(dwg->layer_index, layers);
+  return layers;
+
+ oom:
+  free(layer);
+  free(by_block);
+  free(order);
+  layer_index_free(layers);
+  return NULL;
+}
+
+/* dwg_layer_index() under the lock */
+static const Dwg_Layer_Index *
+layer_index_locked(Dwg_Data *dwg)
+{
+  const Dwg_Layer_Index *layers = (const Dwg_Layer_Index *)dwg->layer_index;
+  const Dwg_Type_Index *types;
+
+  /* built by another thread meanwhile */
+  if (layers && layers->num_objects == dwg->num_objects)
+    return layers;
+  dwg_free_layer_index(dwg);
+  /* builds the owner index too */
+  if (!(types = dwg_type_index_locked(dwg)))
+    return NULL;
+  return layer_index_new(dwg, types, dwg_owner_index_get(dwg));
+}
+
+const Dwg_Layer_Index *
+dwg_layer_index(Dwg_Data *dwg)
+{
+  const Dwg_Layer_Index *layers
+      = (const Dwg_Layer_Index *)DWG_INDEX_LOAD(dwg->layer_index);
+
+  if (layers && layers->num_objects == dwg->num_objects)
+    return layers;
+  dwg_index_lock(dwg);
+  layers = layer_index_locked(dwg);
+  dwg_index_unlock(dwg);
+  return layers;
+}
+
+void
+dwg_free_layer_index(Dwg_Data *dwg)
+{
+  layer_index_free((Dwg_Layer_Index *)dwg->layer_index);
+  DWG_INDEX_STORE(dwg->layer_index, NULL);
+}
+
+/** dwg_find_layer
+ * The LAYER object named name, in UTF-8, compared case-insensitive
+ * for ASCII letters. Its first call builds the layer index, which
+ * decodes deferred layer names.
+ * NULL if there is none.
+ */
+Dwg_Object *
+dwg_find_layer(Dwg_Data *dwg, const char *name)
+{
+  const Dwg_Layer_Index *layers;
+  unsigned int b;
+
+  if (!dwg || !name || !(layers = dwg_layer_index(dwg))
+      || !layers->num_layers)
+    return NULL;
+  b = name_hash(name) & (layers->num_buckets - 1);
+  while (layers->buckets[b])
+    {
+      unsigned int l = layers->buckets[b] - 1;
+      if (name_equal(layers->text + layers->name_at[l], name))
+        return &dwg->object[layers->layers[l]];
+      b = (b + 1) & (layers->num_buckets - 1);
+    }
+  return NULL;
+}
+
+/** dwg_layer_entities
+ * The indices into dwg->object of the entities on layer, grouped by
+ * their BLOCK_HEADER and in ascending order within it, entities
+ * without block last. Sets *num to their number. The array belongs to
+ * the drawing and stays valid until objects are added or dwg_free.
+ * NULL if there are none.
+ */
+const unsigned int *
+dwg_layer_entities(Dwg_Object *layer, unsigned int *num)
+{
+  const Dwg_Layer_Index *layers;
+  unsigned int l;
+
+  *num = 0;
+  if (!layer || !layer->parent || layer->type != DWG_TYPE_LAYER
+      || !(layers = dwg_layer_index(layer->parent)))
+    return NULL;
+  l = layer_of(layers, layer->index);
+  if (l == layers->num_layers || layers->start[l] == layers->start[l + 1])
+    return NULL;
+  *num = layers->start[l + 1] - layers->start[l];
+  return &layers->entities[layers->start[l]];
+}
+
+/** dwg_block_layer_entities
+ * Like dwg_layer_entities(), for the entities of the BLOCK_HEADER
+ * block only, with their attributes, vertices and SEQENDs.
+ */
+const unsigned int *
+dwg_block_layer_entities(Dwg_Object *block, Dwg_Object *layer,
+                         unsigned int *num)
+{
+  const unsigned int *entities;
+  const Dwg_Owner_Index *owners;
+  unsigned int lo, hi, first, n;
+
+  *num = 0;
+  if (!block || block->type != DWG_TYPE_BLOCK_HEADER
+      || !(entities = dwg_layer_entities(layer, &n))
+      || !(owners = dwg_owner_index_get(block->parent)))
+    return NULL;
+  /* the range of block in the entities of layer */
+  lo = 0;
+  hi = n;
+  while (lo < hi)
+    {
+      unsigned int mid = lo + (hi - lo) / 2;
+      if (block_of(block->parent, owners, entities[mid]) < block->index)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  first = lo;
+  hi = n;
+  while (lo < hi)
+    {
+      unsigned int mid = lo + (hi - lo) / 2;
+      if (block_of(block->parent, owners, entities[mid]) <= block->index)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  if (lo == first)
+    return NULL;
+  *num = lo - first;
+  return &entities[first];
+}
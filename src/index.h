@@ -0,0 +1,129 @@
+/*****************************************************************************/
+/*  LibreDWG - free implementation of the DWG file format                    */
+/*                                                                           */
+/*  Copyright (C) 2018 Free Software Foundation, Inc.                        */
+/*                                                                           */
+/*  This library is free software, licensed under the terms of the GNU       */
+/*  General Public License as published by the Free Software Foundation,     */
+/*  either version 3 of the License, or (at your option) any later version.  */
+/*  You should have received a copy of the GNU General Public License        */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.    */
+/*****************************************************************************/
+
+/*
+ * index.h: indices over the decoded objects, built after decoding
+ */
+
+#ifndef INDEX_H
+#define INDEX_H
+
+#include "dwg.h"
+
+#define DWG_NO_OWNER ((unsigned int)-1)
+
+/* Which entities each BLOCK_HEADER or complex entity owns. All arrays
+   are by object index, owned[start[i] .. start[i+1]) are the objects
+   owned by object i in ascending order. */
+typedef struct _dwg_owner_index
+{
+  long unsigned int num_objects; /* when built */
+  unsigned int *owner;           /* DWG_NO_OWNER if none */
+  unsigned int *start;           /* num_objects + 1 */
+  unsigned int *owned;
+} Dwg_Owner_Index;
+
+/* The objects of each type in ascending order, of all types together,
+   and of each BLOCK_HEADER with the attributes, vertices and SEQENDs of
+   its entities, by type and in ascending order. Built on first use. */
+typedef struct _dwg_type_index
+{
+  long unsigned int num_objects; /* when built */
+  unsigned int num_types;        /* the largest type + 1 */
+  unsigned int *start;           /* by type, num_types + 1 */
+  unsigned int *objects;
+  unsigned int num_entities;
+  unsigned int *entities;
+  unsigned int *block_start;     /* by object index, num_objects + 1 */
+  unsigned int *block_objects;
+} Dwg_Type_Index;
+
+/* The entities of each LAYER, sorted by their BLOCK_HEADER and in
+   ascending order, entities without block last, and the LAYERs by
+   name. Layers are in ascending order, their names in UTF-8 at
+   text + name_at[layer]. Built on first use. */
+typedef struct _dwg_layer_index
+{
+  long unsigned int num_objects; /* when built */
+  unsigned int num_layers;
+  unsigned int *layers;          /* object index of each layer */
+  unsigned int *name_at;
+  char *text;
+  unsigned int num_buckets;      /* a power of 2 */
+  unsigned int *buckets;         /* layer + 1, 0 if empty */
+  unsigned int *start;           /* by layer, num_layers + 1 */
+  unsigned int *entities;
+} Dwg_Layer_Index;
+
+/* The indices built on first use are built under dwg_index_lock(), a
+   lock of each drawing, and published when complete. So a query which
+   finds one up to date needs no lock. They are built again only after
+   objects were added, which must not run concurrently with queries. */
+#ifdef __GNUC__
+# define DWG_INDEX_LOAD(field) __atomic_load_n(&(field), __ATOMIC_ACQUIRE)
+# define DWG_INDEX_STORE(field, index) \
+  __atomic_store_n(&(field), (void *)(index), __ATOMIC_RELEASE)
+#else
+# define DWG_INDEX_LOAD(field) (field)
+# define DWG_INDEX_STORE(field, index) ((field) = (void *)(index))
+#endif
+
+void
+dwg_index_lock_new(Dwg_Data *dwg);
+
+void
+dwg_index_lock_free(Dwg_Data *dwg);
+
+void
+dwg_index_lock(Dwg_Data *dwg);
+
+void
+dwg_index_unlock(Dwg_Data *dwg);
+
+/* the owner index of dwg if it is up to date, else NULL */
+const Dwg_Owner_Index *
+dwg_owner_index_get(const Dwg_Data *dwg);
+
+/* the owner index of dwg, built if missing or out of date. The caller
+   holds dwg_index_lock(). NULL before R13 or if out of memory. */
+const Dwg_Owner_Index *
+dwg_owner_index_locked(Dwg_Data *dwg);
+
+void
+dwg_free_owner_index(Dwg_Data *dwg);
+
+/* the type index of dwg, built under dwg_index_lock() if missing or
+   out of date. Without blocks before R13. NULL if out of memory. */
+const Dwg_Type_Index *
+dwg_type_index(Dwg_Data *dwg);
+
+/* the type index of dwg if it is up to date, else NULL */
+const Dwg_Type_Index *
+dwg_type_index_get(const Dwg_Data *dwg);
+
+/* dwg_type_index(), the caller holding dwg_index_lock() */
+const Dwg_Type_Index *
+dwg_type_index_locked(Dwg_Data *dwg);
+
+void
+dwg_free_type_index(Dwg_Data *dwg);
+
+/* the layer index of dwg, built under dwg_index_lock() if missing or out
+   of date. Decodes the deferred strings of the layers. NULL if out of
+   memory. */
+const Dwg_Layer_Index *
+dwg_layer_index(Dwg_Data *dwg);
+
+void
+dwg_free_layer_index(Dwg_Data *dwg);
+
+#endif
@@ -0,0 +1,237 @@
+/*****************************************************************************/
+/*  LibreDWG - free implementation of the DWG file format                    */
+/*                                                                           */
+/*  Copyright (C) 2018 Free Software Foundation, Inc.                        */
+/*                                                                           */
+/*  This library is free software, licensed under the terms of the GNU       */
+/*  General Public License as published by the Free Software Foundation,     */
+/*  either version 3 of the License, or (at your option) any later version.  */
+/*  You should have received a copy of the GNU General Public License        */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.    */
+/*****************************************************************************/
+
+/*
+ * intern.c: deduplicated strings for DWG_OPTS_INTERN.
+ *
+ * Every distinct string is stored once, in blocks which are only freed
+ * with the table. An open addressing hash finds the stored copy, so
+ * equal names of one drawing, or of a batch sharing the table, are the
+ * same pointer.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include "intern.h"
+
+#define INTERN_MIN_BLOCK (16 * 1024)
+#define INTERN_MIN_ENTRIES 256
+#define ALIGNED(n) (((n) + 1) & ~(size_t)1) /* for UCS-2 text */
+
+typedef struct _dwg_intern_block
+{
+  struct _dwg_intern_block *next;
+  size_t size;
+  size_t used;
+} Dwg_Intern_Block;
+
+typedef struct _dwg_intern_entry
+{
+  const char *str; /* NULL: free */
+  size_t size;
+  unsigned int hash;
+} Dwg_Intern_Entry;
+
+struct _dwg_intern
+{
+  Dwg_Intern_Entry *entries;
+  unsigned int num_entries; /* a power of 2 */
+  unsigned int num_used;
+  Dwg_Intern_Block *head;
+};
+
+#define BLOCK_DATA(b) ((char *)(b) + sizeof(Dwg_Intern_Block))
+
+/** dwg_intern_new
+ * An empty table of strings, to be shared by a batch of drawings with
+ * DWG_OPTS_INTERN. Not thread-safe: use one table per thread.
+ * NULL when out of memory.
+ */
+Dwg_Intern *
+dwg_intern_new(void)
+{
+  Dwg_Intern *intern = (Dwg_Intern *)calloc(1, sizeof(Dwg_Intern));
+
+  if (!intern)
+    return NULL;
+  intern->entries = (Dwg_Intern_Entry *)calloc(INTERN_MIN_ENTRIES,
+                                               sizeof(Dwg_Intern_Entry));
+  if (!intern->entries)
+    {
+      free(intern);
+      return NULL;
+    }
+  intern->num_entries = INTERN_MIN_ENTRIES;
+  return intern;
+}
+
+/** dwg_intern_free
+ * Frees the table and all its strings, after the last drawing using
+ * them was freed.
+ */
+void
+dwg_intern_free(Dwg_Intern *intern)
+{
+  Dwg_Intern_Block *block, *next;
+
+  if (!intern)
+    return;
+  for (block = intern->head; block; block = next)
+    {
+      next = block->next;
+      free(block);
+    }
+  free(intern->entries);
+  free(intern);
+}
+
+/* FNV-1a */
+static unsigned int
+intern_hash(const char *data, size_t size)
+{
+  unsigned int hash = 2166136261U;
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    {
+      hash ^= (unsigned char)data[i];
+      hash *= 16777619U;
+    }
+  return hash;
+}
+
+static int
+intern_grow(Dwg_Intern *intern)
+{
+  unsigned int i, num = intern->num_entries * 2;
+  Dwg_Intern_Entry *entries
+      = (Dwg_Intern_Entry *)calloc(num, sizeof(Dwg_Intern_Entry));
+
+  if (!entries)
+    return 1;
+  for (i = 0; i < intern->num_entries; i++)
+    {
+      const Dwg_Intern_Entry *entry = &intern->entries[i];
+      unsigned int j = entry->hash & (num - 1);
+
+      if (!entry->str)
+        continue;
+      while (entries[j].str)
+        j = (j + 1) & (num - 1);
+      entries[j] = *entry;
+    }
+  free(intern->entries);
+  intern->entries = entries;
+  intern->num_entries = num;
+  return 0;
+}
+
+static char *
+intern_store(Dwg_Intern *intern, const char *data, size_t size)
+{
+  Dwg_Intern_Block *block = intern->head;
+  char *str;
+
+  if (!block || block->used + ALIGNED(size) > block->size)
+    {
+      size_t bsize = block ? block->size * 2 : INTERN_MIN_BLOCK;
+
+      if (bsize < size)
+        bsize = ALIGNED(size);
+      block = (Dwg_Intern_Block *)malloc(sizeof(Dwg_Intern_Block) + bsize);
+      if (!block)
+        return NULL;
+      block->size = bsize;
+      block->used = 0;
+      block->next = intern->head;
+      intern->head = block;
+    }
+  str = BLOCK_DATA(block) + block->used;
+  memcpy(str, data, size);
+  block->used += ALIGNED(size);
+  return str;
+}
+
+const char *
+dwg_intern_bytes(Dwg_Intern *intern, const char *data, size_t size)
+{
+  unsigned int hash = intern_hash(data, size);
+  unsigned int i;
+  Dwg_Intern_Entry *entry;
+  const char *str;
+
+  /* at most half full */
+  if ((intern->num_used + 1) * 2 > intern->num_entries && intern_grow(intern))
+    return NULL;
+  i = hash & (intern->num_entries - 1);
+  while ((entry = &intern->entries[i])->str)
+    {
+      if (entry->hash == hash && entry->size == size
+          && !memcmp(entry->str, data, size))
+        return entry->str;
+      i = (i + 1) & (intern->num_entries - 1);
+    }
+  str = intern_store(intern, data, size);
+  if (!str)
+    return NULL;
+  entry->str = str;
+  entry->size = size;
+  entry->hash = hash;
+  intern->num_used++;
+  return str;
+}
+
+/** dwg_intern
+ * The interned copy of the NUL-terminated str, which must not be
+ * changed. Compare it by pointer with interned text fields.
+ * NULL when out of memory.
+ */
+const char *
+dwg_intern(Dwg_Intern *intern, const char *str)
+{
+  if (!intern || !str)
+    return NULL;
+  return dwg_intern_bytes(intern, str, strlen(str) + 1);
+}
+
+void
+dwg_intern_class(Dwg_Data *dwg, Dwg_Class *klass)
+{
+  const char *dxfname;
+
+  if (!dwg->intern || !klass->dxfname)
+    return;
+  dxfname = dwg_intern(dwg->intern, klass->dxfname);
+  if (dxfname && dxfname != klass->dxfname)
+    {
+      free(klass->dxfname);
+      klass->dxfname = (char *)dxfname;
+    }
+}
+
+int
+dwg_intern_owns(const Dwg_Data *dwg, const void *ptr)
+{
+  const Dwg_Intern_Block *block;
+
+  if (!dwg->intern || !ptr)
+    return 0;
+  for (block = dwg->intern->head; block; block = block->next)
+    {
+      if ((const char *)ptr >= BLOCK_DATA(block)
+          && (const char *)ptr < BLOCK_DATA(block) + block->size)
+        return 1;
+    }
+  return 0;
+}
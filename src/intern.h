@@ -0,0 +1,39 @@
+/*****************************************************************************/
+/*  LibreDWG - free implementation of the DWG file format                    */
+/*                                                                           */
+/*  Copyright (C) 2018 Free Software Foundation, Inc.                        */
+/*                                                                           */
+/*  This library is free software, licensed under the terms of the GNU       */
+/*  General Public License as published by the Free Software Foundation,     */
+/*  either version 3 of the License, or (at your option) any later version.  */
+/*  You should have received a copy of the GNU General Public License        */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.    */
+/*****************************************************************************/
+
+/*
+ * intern.h: deduplicated strings for DWG_OPTS_INTERN
+ */
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include "dwg.h"
+
+/* longer strings are not interned, but copied to the arena */
+#define DWG_INTERN_MAX 256
+
+/* The stored copy of size bytes of data, including its terminator,
+   which may be a NUL or, for UCS-2 text, two NULs. NULL when out of
+   memory. */
+const char *
+dwg_intern_bytes(Dwg_Intern *intern, const char *data, size_t size);
+
+/* Replaces the heap copy of klass->dxfname by the interned one. */
+void
+dwg_intern_class(Dwg_Data *dwg, Dwg_Class *klass);
+
+int
+dwg_intern_owns(const Dwg_Data *dwg, const void *ptr);
+
+#endif
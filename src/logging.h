@@ -43,26 +43,38 @@
 #ifndef DWG_LOGLEVEL
 # define DWG_LOGLEVEL DWG_LOGLEVEL_ERROR
 #endif
+/* Messages above this level are compiled out, see --with-max-loglevel */
+#ifndef DWG_LOGLEVEL_MAX
+# define DWG_LOGLEVEL_MAX DWG_LOGLEVEL_ALL
+#endif
+
+/* Appends to the log of the current thread, which is passed to the log
+   sink line by line. See dwg_set_log_sink() */
+#ifdef __GNUC__
+__attribute__ ((format (printf, 2, 3)))
+#endif
+void dwg_log(int level, const char *fmt, ...);
 
-#define HANDLER fprintf
-#define OUTPUT stderr
+#define LOG_ENABLED(level) \
+          (DWG_LOGLEVEL_##level <= DWG_LOGLEVEL_MAX && \
+           DWG_LOGLEVEL >= DWG_LOGLEVEL_##level)
 
 #define LOG(level, args...) \
-          if (DWG_LOGLEVEL >= DWG_LOGLEVEL_##level) { \
-            HANDLER(OUTPUT, args); \
+          if (LOG_ENABLED(level)) { \
+            dwg_log(DWG_LOGLEVEL_##level, args); \
           }
 
 #define LOG_ERROR(args...) \
-          if (DWG_LOGLEVEL >= DWG_LOGLEVEL_ERROR) { \
-              HANDLER(OUTPUT, "ERROR: "); \
+          if (LOG_ENABLED(ERROR)) { \
+              dwg_log(DWG_LOGLEVEL_ERROR, "ERROR: "); \
               LOG(ERROR, args) \
-              HANDLER(OUTPUT, "\n");          \
+              dwg_log(DWG_LOGLEVEL_ERROR, "\n"); \
           }
 #define LOG_WARN(args...) \
-          if (DWG_LOGLEVEL >= DWG_LOGLEVEL_ERROR) { \
-              HANDLER(OUTPUT, "Warning: "); \
+          if (LOG_ENABLED(ERROR)) { \
+              dwg_log(DWG_LOGLEVEL_ERROR, "Warning: "); \
               LOG(ERROR, args) \
-              HANDLER(OUTPUT, "\n"); \
+              dwg_log(DWG_LOGLEVEL_ERROR, "\n"); \
           }
 
 #define LOG_INFO(args...) LOG(INFO, args)
@@ -87,11 +99,11 @@
    LOG_TEXT_UNICODE(TRACE, (BITCODE_TU)wstr) \
    LOG_TRACE("\" [TU %d]\n", dxf)
 # define LOG_TEXT_UNICODE(level, wstr) \
-	if (DWG_LOGLEVEL >= DWG_LOGLEVEL_##level && wstr) { \
+	if (LOG_ENABLED(level) && wstr) { \
             BITCODE_TU ws = wstr; \
             uint16_t _c; \
             while ((_c = *ws++)) { \
-              HANDLER(OUTPUT, "%c", (char)(_c & 0xff)); \
+              dwg_log(DWG_LOGLEVEL_##level, "%c", (char)(_c & 0xff)); \
             } \
         }
 #endif
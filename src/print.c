@@ -26,12 +26,13 @@
 #include "bits.h"
 #include "dwg.h"
 #include "print.h"
+#include "decode.h"
 
 #define DWG_LOGLEVEL DWG_LOGLEVEL_TRACE
 #include "logging.h"
 
 /* the current version per spec block */
-static unsigned int cur_ver = 0;
+static THREAD_LOCAL unsigned int cur_ver = 0;
 
 extern void
 obj_string_stream(Bit_Chain *dat, BITCODE_RL bitsize, Bit_Chain *str);
@@ -88,6 +89,7 @@ obj_string_stream(Bit_Chain *dat, BITCODE_RL bitsize, Bit_Chain *str);
 #define FIELD_MC(name,dxf) FIELD(name, MC, dxf);
 #define FIELD_MS(name,dxf) FIELD(name, MS, dxf);
 #define FIELD_TF(name,len,dxf) FIELD_G_TRACE(name, TF, dxf)
+#define FIELD_BINARY(name,len,dxf) FIELD_TF(name,len,dxf)
 #define FIELD_TFF(name,len,dxf) FIELD_TF(name,len,dxf)
 #define FIELD_TV(name,dxf) FIELD(name, TV, dxf);
 #define FIELD_TU(name,dxf) LOG_TRACE_TU(#name, (BITCODE_TU)_obj->name, dxf)
@@ -171,7 +173,8 @@ obj_string_stream(Bit_Chain *dat, BITCODE_RL bitsize, Bit_Chain *str);
 #define FIELD_INSERT_COUNT(insert_count, type, dxf) \
   FIELD_G_TRACE(insert_count, type, dxf)
 
-#define FIELD_XDATA(name, size)
+#define FIELD_XDATA(name, size) \
+  dwg_print_xdata(dat, _obj)
 
 #define REACTORS(code)\
   for (vcount=0; vcount < (int)obj->tio.object->num_reactors; vcount++)\
@@ -258,6 +261,63 @@ dwg_print_ ##token (Bit_Chain * dat, Dwg_Object * obj) \
 
 #define DWG_OBJECT_END }
 
+static void
+dwg_print_xdata(Bit_Chain *dat, Dwg_Object_XRECORD *obj)
+{
+  Dwg_Resbuf *rbuf;
+  unsigned int i;
+
+  for (rbuf = obj->xdata, i = 0; rbuf; rbuf = rbuf->next, i++)
+    {
+      switch (get_base_value_type(rbuf->type))
+        {
+        case VT_STRING:
+          UNTIL(R_2007) {
+            LOG_TRACE("xdata[%u]: \"%s\" [TV %d]\n", i,
+                      rbuf->value.str.u.data, rbuf->type)
+          } LATER_VERSIONS {
+            LOG_TRACE_TU_I("xdata", i, rbuf->value.str.u.wdata, rbuf->type)
+          }
+          break;
+        case VT_REAL:
+          LOG_TRACE("xdata[%u]: %f [RD %d]\n", i, rbuf->value.dbl, rbuf->type)
+          break;
+        case VT_BOOL:
+        case VT_INT8:
+          LOG_TRACE("xdata[%u]: %d [RC %d]\n", i, (int)rbuf->value.i8,
+                    rbuf->type)
+          break;
+        case VT_INT16:
+          LOG_TRACE("xdata[%u]: %d [RS %d]\n", i, (int)rbuf->value.i16,
+                    rbuf->type)
+          break;
+        case VT_INT32:
+          LOG_TRACE("xdata[%u]: %d [RL %d]\n", i, rbuf->value.i32, rbuf->type)
+          break;
+        case VT_POINT3D:
+          LOG_TRACE("xdata[%u]: (%f, %f, %f) [3RD %d]\n", i,
+                    rbuf->value.pt[0], rbuf->value.pt[1], rbuf->value.pt[2],
+                    rbuf->type)
+          break;
+        case VT_BINARY:
+          LOG_TRACE("xdata[%u]: %d bytes [TF %d]\n", i,
+                    (int)rbuf->value.str.size, rbuf->type)
+          break;
+        case VT_HANDLE:
+        case VT_OBJECTID:
+          LOG_TRACE("xdata[%u]: %02X%02X%02X%02X%02X%02X%02X%02X [H %d]\n", i,
+                    rbuf->value.hdl[7], rbuf->value.hdl[6], rbuf->value.hdl[5],
+                    rbuf->value.hdl[4], rbuf->value.hdl[3], rbuf->value.hdl[2],
+                    rbuf->value.hdl[1], rbuf->value.hdl[0], rbuf->type)
+          break;
+        case VT_INVALID:
+        default:
+          LOG_TRACE("xdata[%u]: invalid group code %d\n", i, rbuf->type)
+          break;
+        }
+    }
+}
+
 #include "dwg.spec"
 
 /* returns 1 if object could be printd and 0 otherwise
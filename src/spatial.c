@@ -0,0 +1,1347 @@
+/*****************************************************************************/
+/*  LibreDWG - free implementation of the DWG file format                    */
+/*                                                                           */
+/*  Copyright (C) 2018 Free Software Foundation, Inc.                        */
+/*                                                                           */
+/*  This library is free software, licensed under the terms of the GNU       */
+/*  General Public License as published by the Free Software Foundation,     */
+/*  either version 3 of the License, or (at your option) any later version.  */
+/*  You should have received a copy of the GNU General Public License        */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.    */
+/*****************************************************************************/
+
+/*
+ * spatial.c: packed R-trees over the entity extents of each block.
+ *
+ * The extents are rectangles in the XY plane of the WCS, or of the
+ * block for the entities of a block. They are exact for lines, points
+ * and the vertices of polylines, and cover arcs, bulges, blocks and
+ * text by an estimate. Entities without a finite extent, such as rays,
+ * or not computed here, such as hatches and solids, are not in the
+ * trees.
+ *
+ * Each tree is bulk-loaded by Sort-Tile-Recursive: the entries of a
+ * level are sorted into vertical slices by x, each slice by y, and
+ * packed into full nodes, up to a single root. It is built once under
+ * the lock of the other indices, and only read afterwards; a query
+ * builds it again when the stamp of the drawing changed: objects were
+ * added, HANDSEED, TDUPDATE or the SPATIAL_INDEX object changed.
+ * Entities changed in place need dwg_spatial_index().
+ *
+ * dwg_spatial_write() saves the trees in the byte order of the host,
+ * with the number of objects, HANDSEED, TDUPDATE and the timestamps of
+ * the SPATIAL_INDEX object of the drawing, which dwg_spatial_read()
+ * checks before loading them.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "common.h"
+#include "decode.h"
+#include "index.h"
+#include "spatial.h"
+
+static THREAD_LOCAL unsigned int loglevel;
+
+#define DWG_LOGLEVEL loglevel
+#include "logging.h"
+
+#define SPATIAL_MAGIC "DWGSIDX1"
+/* levels of a tree, enough for any unsigned int number of items */
+#define SPATIAL_MAX_DEPTH 16
+
+/* the model or object coordinate system of a 2D entity */
+typedef struct _spatial_ocs
+{
+  int wcs; /* the default extrusion */
+  BITCODE_3BD ax;
+  BITCODE_3BD ay;
+  BITCODE_3BD az;
+} Spatial_Ocs;
+
+typedef struct _spatial_build
+{
+  Dwg_Data *dwg;
+  const Dwg_Owner_Index *owners;
+  Dwg_Spatial_Index *spatial;
+  unsigned char *state; /* by tree: 0 to do, 1 building, 2 done, or NULL */
+  int error;
+} Spatial_Build;
+
+static int
+entity_bbox(Spatial_Build *b, Dwg_Object *obj, Dwg_BBox *box);
+
+static void
+box_empty(Dwg_BBox *box)
+{
+  box->xmin = box->ymin = HUGE_VAL;
+  box->xmax = box->ymax = -HUGE_VAL;
+}
+
+static void
+box_add(Dwg_BBox *box, double x, double y)
+{
+  if (x < box->xmin)
+    box->xmin = x;
+  if (x > box->xmax)
+    box->xmax = x;
+  if (y < box->ymin)
+    box->ymin = y;
+  if (y > box->ymax)
+    box->ymax = y;
+}
+
+static void
+box_union(Dwg_BBox *box, const Dwg_BBox *other)
+{
+  box_add(box, other->xmin, other->ymin);
+  box_add(box, other->xmax, other->ymax);
+}
+
+/* finite and not empty, NaN coordinates are not */
+static int
+box_valid(const Dwg_BBox *box)
+{
+  return box->xmin <= box->xmax && box->ymin <= box->ymax
+         && box->xmin > -HUGE_VAL && box->xmax < HUGE_VAL
+         && box->ymin > -HUGE_VAL && box->ymax < HUGE_VAL;
+}
+
+static int
+box_overlaps(const Dwg_BBox *a, const Dwg_BBox *b)
+{
+  return a->xmin <= b->xmax && b->xmin <= a->xmax && a->ymin <= b->ymax
+         && b->ymin <= a->ymax;
+}
+
+/* the arbitrary axis algorithm */
+static void
+ocs_init(Spatial_Ocs *ocs, const BITCODE_3BD *extrusion)
+{
+  double len;
+
+  ocs->wcs = 1;
+  if (!extrusion)
+    return;
+  len = sqrt(extrusion->x * extrusion->x + extrusion->y * extrusion->y
+             + extrusion->z * extrusion->z);
+  if (!(len > 0.0)
+      || (extrusion->x == 0.0 && extrusion->y == 0.0 && extrusion->z > 0.0))
+    return;
+  ocs->wcs = 0;
+  ocs->az.x = extrusion->x / len;
+  ocs->az.y = extrusion->y / len;
+  ocs->az.z = extrusion->z / len;
+  if (fabs(ocs->az.x) < 1.0 / 64 && fabs(ocs->az.y) < 1.0 / 64)
+    {
+      ocs->ax.x = ocs->az.z; /* WY x N */
+      ocs->ax.y = 0.0;
+      ocs->ax.z = -ocs->az.x;
+    }
+  else
+    {
+      ocs->ax.x = -ocs->az.y; /* WZ x N */
+      ocs->ax.y = ocs->az.x;
+      ocs->ax.z = 0.0;
+    }
+  len = sqrt(ocs->ax.x * ocs->ax.x + ocs->ax.y * ocs->ax.y
+             + ocs->ax.z * ocs->ax.z);
+  ocs->ax.x /= len;
+  ocs->ax.y /= len;
+  ocs->ax.z /= len;
+  ocs->ay.x = ocs->az.y * ocs->ax.z - ocs->az.z * ocs->ax.y;
+  ocs->ay.y = ocs->az.z * ocs->ax.x - ocs->az.x * ocs->ax.z;
+  ocs->ay.z = ocs->az.x * ocs->ax.y - ocs->az.y * ocs->ax.x;
+}
+
+static void
+box_add_ocs(Dwg_BBox *box, const Spatial_Ocs *ocs, double x, double y,
+            double z)
+{
+  if (ocs->wcs)
+    box_add(box, x, y);
+  else
+    box_add(box, x * ocs->ax.x + y * ocs->ay.x + z * ocs->az.x,
+            x * ocs->ax.y + y * ocs->ay.y + z * ocs->az.y);
+}
+
+/* the corners of the OCS rectangle obox at elevation z */
+static void
+box_union_ocs(Dwg_BBox *box, const Spatial_Ocs *ocs, const Dwg_BBox *obox,
+              double z)
+{
+  if (!box_valid(obox))
+    return;
+  box_add_ocs(box, ocs, obox->xmin, obox->ymin, z);
+  box_add_ocs(box, ocs, obox->xmax, obox->ymin, z);
+  box_add_ocs(box, ocs, obox->xmin, obox->ymax, z);
+  box_add_ocs(box, ocs, obox->xmax, obox->ymax, z);
+}
+
+/* an arc from a0 counter-clockwise to a1, both ends and the quadrant
+   points in between */
+static void
+arc_box(Dwg_BBox *box, double x, double y, double r, double a0, double a1)
+{
+  double sweep = fmod(a1 - a0, 2 * M_PI);
+  int k, end;
+
+  if (!(r >= 0.0) || !(fabs(a0) < 1e6) || !(fabs(a1) < 1e6))
+    return;
+  if (sweep <= 0.0)
+    sweep += 2 * M_PI;
+  box_add(box, x + r * cos(a0), y + r * sin(a0));
+  box_add(box, x + r * cos(a0 + sweep), y + r * sin(a0 + sweep));
+  k = (int)ceil(a0 / (M_PI / 2));
+  end = (int)floor((a0 + sweep) / (M_PI / 2));
+  for (; k <= end; k++)
+    switch (k & 3)
+      {
+      case 0:
+        box_add(box, x + r, y);
+        break;
+      case 1:
+        box_add(box, x, y + r);
+        break;
+      case 2:
+        box_add(box, x - r, y);
+        break;
+      default:
+        box_add(box, x, y - r);
+      }
+}
+
+/* the segment to the next vertex, with an arc within the circle
+   around its middle through both ends, or through its bulge */
+static void
+bulge_box(Dwg_BBox *box, double x0, double y0, double x1, double y1,
+          double bulge)
+{
+  double r;
+
+  box_add(box, x0, y0);
+  box_add(box, x1, y1);
+  if (bulge == 0.0)
+    return;
+  r = sqrt((x1 - x0) * (x1 - x0) + (y1 - y0) * (y1 - y0)) / 2;
+  if (fabs(bulge) > 1.0)
+    r *= fabs(bulge);
+  box_add(box, (x0 + x1) / 2 - r, (y0 + y1) / 2 - r);
+  box_add(box, (x0 + x1) / 2 + r, (y0 + y1) / 2 + r);
+}
+
+static void
+box_widen(Dwg_BBox *box, double width)
+{
+  if (!box_valid(box) || !(width > 0.0))
+    return;
+  box->xmin -= width / 2;
+  box->ymin -= width / 2;
+  box->xmax += width / 2;
+  box->ymax += width / 2;
+}
+
+/* the number of characters of a text field */
+static size_t
+text_length(const Dwg_Data *dwg, const char *text)
+{
+  size_t len = 0;
+
+  if (!text)
+    return 0;
+  if (dwg->header.version < R_2007)
+    return strlen(text);
+  while (((const BITCODE_RS *)text)[len])
+    len++;
+  return len;
+}
+
+/* TEXT, ATTRIB and ATTDEF, as wide as height times their length. An
+   aligned one is around its alignment point. */
+#define TEXT_BOX(token, value)                                               \
+  {                                                                          \
+    Dwg_Entity_##token *_obj = ent->tio.token;                               \
+    double h = _obj->height, w, c = cos(_obj->rotation),                     \
+           s = sin(_obj->rotation);                                          \
+    Dwg_BBox obox;                                                           \
+                                                                             \
+    if (dwg_decode_strings(obj))                                             \
+      return 1;                                                              \
+    w = h * text_length(dwg, _obj->value)                                    \
+        * (_obj->width_factor > 0.0 ? _obj->width_factor : 1.0);             \
+    box_empty(&obox);                                                        \
+    if (_obj->horiz_alignment || _obj->vert_alignment)                       \
+      {                                                                      \
+        w += h;                                                              \
+        box_add(&obox, _obj->alignment_pt.x - w, _obj->alignment_pt.y - w); \
+        box_add(&obox, _obj->alignment_pt.x + w, _obj->alignment_pt.y + w); \
+      }                                                                      \
+    else                                                                     \
+      {                                                                      \
+        box_add(&obox, _obj->insertion_pt.x, _obj->insertion_pt.y);          \
+        box_add(&obox, _obj->insertion_pt.x + w * c,                         \
+                _obj->insertion_pt.y + w * s);                               \
+        box_add(&obox, _obj->insertion_pt.x - h * s,                         \
+                _obj->insertion_pt.y + h * c);                               \
+        box_add(&obox, _obj->insertion_pt.x + w * c - h * s,                 \
+                _obj->insertion_pt.y + w * s + h * c);                       \
+      }                                                                      \
+    ocs_init(&ocs, &_obj->extrusion);                                        \
+    box_union_ocs(box, &ocs, &obox, _obj->elevation);                        \
+  }
+
+/* the four corners of SOLID and TRACE */
+#define CORNERS_BOX(token)                                                   \
+  {                                                                          \
+    Dwg_Entity_##token *_obj = ent->tio.token;                               \
+    Dwg_BBox obox;                                                           \
+                                                                             \
+    box_empty(&obox);                                                        \
+    box_add(&obox, _obj->corner1.x, _obj->corner1.y);                        \
+    box_add(&obox, _obj->corner2.x, _obj->corner2.y);                        \
+    box_add(&obox, _obj->corner3.x, _obj->corner3.y);                        \
+    box_add(&obox, _obj->corner4.x, _obj->corner4.y);                        \
+    ocs_init(&ocs, &_obj->extrusion);                                        \
+    box_union_ocs(box, &ocs, &obox, _obj->elevation);                        \
+  }
+
+/* the tree of the block at object index i */
+static Dwg_Spatial_Tree *
+tree_of(const Dwg_Spatial_Index *spatial, unsigned int i)
+{
+  unsigned int lo = 0, hi = spatial->num_trees;
+
+  while (lo < hi)
+    {
+      unsigned int mid = lo + (hi - lo) / 2;
+      if (spatial->trees[mid].block < i)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo < spatial->num_trees && spatial->trees[lo].block == i
+             ? &spatial->trees[lo]
+             : NULL;
+}
+
+static void
+build_tree(Spatial_Build *b, Dwg_Spatial_Tree *tree);
+
+/* The object of the handle ref of the entity obj. With deferred handles
+   only this one is read, the one after the common entity handles and
+   skip more. */
+static Dwg_Object *
+handle_object(Dwg_Object *obj, const Dwg_Object_Ref *ref, unsigned int skip)
+{
+  if (obj->handles_deferred)
+    return dwg_decode_entity_handle(obj, skip);
+  if (!ref || (!ref->obj && !ref->absolute_ref))
+    return NULL;
+  return ref->obj ? ref->obj : dwg_resolve_handle(obj->parent,
+                                                  ref->absolute_ref);
+}
+
+/* the extent of the entities of the block hdr, from the root of its
+   tree */
+static Dwg_Object *
+block_box(Spatial_Build *b, Dwg_Object *hdr, Dwg_BBox *box)
+{
+  Dwg_Spatial_Tree *tree;
+
+  if (!hdr || hdr->index >= b->dwg->num_objects
+      || !(tree = tree_of(b->spatial, hdr->index)))
+    return NULL;
+  if (b->state)
+    {
+      unsigned char *state = &b->state[tree - b->spatial->trees];
+      if (*state == 1) /* inserts itself */
+        return NULL;
+      if (*state == 0)
+        build_tree(b, tree);
+    }
+  if (!tree->num_nodes)
+    return NULL;
+  *box = tree->nodes[tree->num_nodes - 1].box;
+  return hdr;
+}
+
+/* an INSERT or MINSERT, the corners of its block and of its corner
+   cells, scaled, rotated and moved */
+static int
+insert_box(Spatial_Build *b, Dwg_Object *block,
+           const BITCODE_3BD *ins_pt, const BITCODE_3BD *scale,
+           double rotation, const BITCODE_3BD *extrusion, unsigned int cols,
+           unsigned int rows, double col_spacing, double row_spacing,
+           Dwg_BBox *box)
+{
+  Dwg_BBox inner;
+  Dwg_Object *hdr = block_box(b, block, &inner);
+  const BITCODE_3BD *base;
+  Spatial_Ocs ocs;
+  double c = cos(rotation), s = sin(rotation);
+  int corner;
+
+  if (!hdr || !hdr->tio.object)
+    return 1;
+  base = &hdr->tio.object->tio.BLOCK_HEADER->base_pt;
+  ocs_init(&ocs, extrusion);
+  for (corner = 0; corner < 16; corner++)
+    {
+      double x = (((corner & 1) ? inner.xmax : inner.xmin) - base->x)
+                 * scale->x;
+      double y = (((corner & 2) ? inner.ymax : inner.ymin) - base->y)
+                 * scale->y;
+      if ((corner & 4) && cols > 1)
+        x += (cols - 1) * col_spacing;
+      if ((corner & 8) && rows > 1)
+        y += (rows - 1) * row_spacing;
+      box_add_ocs(box, &ocs, ins_pt->x + x * c - y * s,
+                  ins_pt->y + x * s + y * c, ins_pt->z);
+    }
+  return 0;
+}
+
+/* the objects owned by obj: vertices, attributes and SEQEND */
+static void
+owned_range(const Spatial_Build *b, const Dwg_Object *obj,
+            unsigned int *first, unsigned int *end)
+{
+  *first = *end = 0;
+  if (b->owners && obj->index < b->owners->num_objects)
+    {
+      *first = b->owners->start[obj->index];
+      *end = b->owners->start[obj->index + 1];
+    }
+}
+
+/* the extent of obj in the XY plane of the WCS, 0 if known */
+static int
+entity_bbox(Spatial_Build *b, Dwg_Object *obj, Dwg_BBox *box)
+{
+  Dwg_Data *dwg = obj->parent;
+  Dwg_Object_Entity *ent = obj->tio.entity;
+  Spatial_Ocs ocs;
+  unsigned int i, end;
+
+  box_empty(box);
+  if (obj->supertype != DWG_SUPERTYPE_ENTITY || !ent || !ent->tio.LINE)
+    return 1;
+  switch (obj->type)
+    {
+    case DWG_TYPE_LINE:
+      {
+        Dwg_Entity_LINE *_obj = ent->tio.LINE;
+        box_add(box, _obj->start.x, _obj->start.y);
+        box_add(box, _obj->end.x, _obj->end.y);
+      }
+      break;
+    case DWG_TYPE_POINT:
+      box_add(box, ent->tio.POINT->x, ent->tio.POINT->y);
+      break;
+    case DWG_TYPE_CIRCLE:
+      {
+        Dwg_Entity_CIRCLE *_obj = ent->tio.CIRCLE;
+        Dwg_BBox obox;
+        box_empty(&obox);
+        box_add(&obox, _obj->center.x - _obj->radius,
+                _obj->center.y - _obj->radius);
+        box_add(&obox, _obj->center.x + _obj->radius,
+                _obj->center.y + _obj->radius);
+        ocs_init(&ocs, &_obj->extrusion);
+        box_union_ocs(box, &ocs, &obox, _obj->center.z);
+      }
+      break;
+    case DWG_TYPE_ARC:
+      {
+        Dwg_Entity_ARC *_obj = ent->tio.ARC;
+        Dwg_BBox obox;
+        box_empty(&obox);
+        arc_box(&obox, _obj->center.x, _obj->center.y, _obj->radius,
+                _obj->start_angle, _obj->end_angle);
+        ocs_init(&ocs, &_obj->extrusion);
+        box_union_ocs(box, &ocs, &obox, _obj->center.z);
+      }
+      break;
+    case DWG_TYPE_ELLIPSE:
+      {
+        Dwg_Entity_ELLIPSE *_obj = ent->tio.ELLIPSE;
+        const BITCODE_3BD *n = &_obj->extrusion, *m = &_obj->sm_axis;
+        double len = sqrt(n->x * n->x + n->y * n->y + n->z * n->z);
+        double minx, miny, hx, hy;
+        if (!(len > 0.0))
+          return 1;
+        /* the minor axis is ratio * (N x M) */
+        minx = _obj->axis_ratio * (n->y * m->z - n->z * m->y) / len;
+        miny = _obj->axis_ratio * (n->z * m->x - n->x * m->z) / len;
+        hx = sqrt(m->x * m->x + minx * minx);
+        hy = sqrt(m->y * m->y + miny * miny);
+        box_add(box, _obj->center.x - hx, _obj->center.y - hy);
+        box_add(box, _obj->center.x + hx, _obj->center.y + hy);
+      }
+      break;
+    case DWG_TYPE_TEXT:
+      TEXT_BOX(TEXT, text_value)
+      break;
+    case DWG_TYPE_ATTRIB:
+      TEXT_BOX(ATTRIB, text_value)
+      break;
+    case DWG_TYPE_ATTDEF:
+      TEXT_BOX(ATTDEF, default_value)
+      break;
+    case DWG_TYPE_MTEXT:
+      {
+        Dwg_Entity_MTEXT *_obj = ent->tio.MTEXT;
+        const BITCODE_3BD *n = &_obj->extrusion, *x = &_obj->x_axis_dir;
+        double w = _obj->extents_width > 0.0 ? _obj->extents_width
+                                               : _obj->rect_width;
+        double h = _obj->extents_height > 0.0 ? _obj->extents_height
+                                                : _obj->text_height;
+        double len = sqrt(x->x * x->x + x->y * x->y + x->z * x->z);
+        double ux, uy, vx, vy, x0, y1;
+        int corner, att = _obj->attachment >= 1 && _obj->attachment <= 9
+                              ? _obj->attachment - 1
+                              : 0;
+        if (!(len > 0.0))
+          return 1;
+        /* the x axis, and N x X as y axis */
+        ux = x->x / len;
+        uy = x->y / len;
+        vx = (n->y * x->z - n->z * x->y) / len;
+        vy = (n->z * x->x - n->x * x->z) / len;
+        /* left, center or right, and top, middle or bottom */
+        x0 = -(att % 3) * w / 2;
+        y1 = (att / 3) * h / 2;
+        for (corner = 0; corner < 4; corner++)
+          {
+            double cx = x0 + ((corner & 1) ? w : 0.0);
+            double cy = y1 - ((corner & 2) ? h : 0.0);
+            box_add(box, _obj->insertion_pt.x + cx * ux + cy * vx,
+                    _obj->insertion_pt.y + cx * uy + cy * vy);
+          }
+      }
+      break;
+    case DWG_TYPE_SOLID:
+      CORNERS_BOX(SOLID)
+      break;
+    case DWG_TYPE_TRACE:
+      CORNERS_BOX(TRACE)
+      break;
+    case DWG_TYPE__3DFACE:
+      {
+        Dwg_Entity__3DFACE *_obj = ent->tio._3DFACE;
+        box_add(box, _obj->corner1.x, _obj->corner1.y);
+        box_add(box, _obj->corner2.x, _obj->corner2.y);
+        box_add(box, _obj->corner3.x, _obj->corner3.y);
+        box_add(box, _obj->corner4.x, _obj->corner4.y);
+      }
+      break;
+    case DWG_TYPE_LWPLINE:
+      {
+        Dwg_Entity_LWPLINE *_obj = ent->tio.LWPLINE;
+        Dwg_BBox obox;
+        BITCODE_BL j;
+        box_empty(&obox);
+        if (!_obj->points)
+          return 1;
+        for (j = 0; j < _obj->num_points; j++)
+          {
+            const BITCODE_2RD *p = &_obj->points[j];
+            const BITCODE_2RD *q = &_obj->points[(j + 1) % _obj->num_points];
+            double bulge = _obj->bulges && j < _obj->num_bulges
+                               ? _obj->bulges[j]
+                               : 0.0;
+            bulge_box(&obox, p->x, p->y, q->x, q->y, bulge);
+          }
+        box_widen(&obox, _obj->const_width);
+        for (j = 0; _obj->widths && j < _obj->num_widths; j++)
+          {
+            box_widen(&obox, _obj->widths[j].start);
+            box_widen(&obox, _obj->widths[j].end);
+          }
+        ocs_init(&ocs, &_obj->normal);
+        box_union_ocs(box, &ocs, &obox, _obj->elevation);
+      }
+      break;
+    case DWG_TYPE_POLYLINE_2D:
+      {
+        Dwg_Entity_POLYLINE_2D *_obj = ent->tio.POLYLINE_2D;
+        Dwg_Entity_VERTEX_2D *prev = NULL, *first = NULL;
+        Dwg_BBox obox;
+        double width = 0.0;
+        box_empty(&obox);
+        owned_range(b, obj, &i, &end);
+        for (; i < end; i++)
+          {
+            Dwg_Object *o = &dwg->object[b->owners->owned[i]];
+            Dwg_Entity_VERTEX_2D *v;
+            if (o->type != DWG_TYPE_VERTEX_2D || !o->tio.entity)
+              continue;
+            v = o->tio.entity->tio.VERTEX_2D;
+            if (prev)
+              bulge_box(&obox, prev->point.x, prev->point.y, v->point.x,
+                        v->point.y, prev->bulge);
+            else
+              first = v;
+            box_add(&obox, v->point.x, v->point.y);
+            if (v->start_width > width)
+              width = v->start_width;
+            if (v->end_width > width)
+              width = v->end_width;
+            prev = v;
+          }
+        /* closed */
+        if (prev && first && (_obj->flag & 1))
+          bulge_box(&obox, prev->point.x, prev->point.y, first->point.x,
+                    first->point.y, prev->bulge);
+        if (width < _obj->start_width)
+          width = _obj->start_width;
+        if (width < _obj->end_width)
+          width = _obj->end_width;
+        box_widen(&obox, width);
+        ocs_init(&ocs, &_obj->extrusion);
+        box_union_ocs(box, &ocs, &obox, _obj->elevation);
+      }
+      break;
+    case DWG_TYPE_POLYLINE_3D:
+    case DWG_TYPE_POLYLINE_MESH:
+    case DWG_TYPE_POLYLINE_PFACE:
+      owned_range(b, obj, &i, &end);
+      for (; i < end; i++)
+        {
+          Dwg_Object *o = &dwg->object[b->owners->owned[i]];
+          if ((o->type == DWG_TYPE_VERTEX_3D || o->type == DWG_TYPE_VERTEX_MESH
+               || o->type == DWG_TYPE_VERTEX_PFACE)
+              && o->tio.entity)
+            box_add(box, o->tio.entity->tio.VERTEX_3D->point.x,
+                    o->tio.entity->tio.VERTEX_3D->point.y);
+        }
+      break;
+    case DWG_TYPE_VERTEX_2D:
+    case DWG_TYPE_VERTEX_3D:
+    case DWG_TYPE_VERTEX_MESH:
+    case DWG_TYPE_VERTEX_PFACE:
+      box_add(box, ent->tio.VERTEX_3D->point.x, ent->tio.VERTEX_3D->point.y);
+      break;
+    case DWG_TYPE_INSERT:
+    case DWG_TYPE_MINSERT:
+      {
+        int known;
+        /* block_header is the first handle of both */
+        if (obj->type == DWG_TYPE_INSERT)
+          {
+            Dwg_Entity_INSERT *_obj = ent->tio.INSERT;
+            known = !insert_box(b, handle_object(obj, _obj->block_header, 0),
+                                &_obj->ins_pt, &_obj->scale, _obj->rotation,
+                                &_obj->extrusion, 1, 1, 0.0, 0.0, box);
+          }
+        else
+          {
+            Dwg_Entity_MINSERT *_obj = ent->tio.MINSERT;
+            known = !insert_box(b, handle_object(obj, _obj->block_header, 0),
+                                &_obj->ins_pt, &_obj->scale, _obj->rotation,
+                                &_obj->extrusion, _obj->numcols,
+                                _obj->numrows, _obj->col_spacing,
+                                _obj->row_spacing, box);
+          }
+        /* and its attributes */
+        owned_range(b, obj, &i, &end);
+        for (; i < end; i++)
+          {
+            Dwg_BBox attrib;
+            if (!entity_bbox(b, &dwg->object[b->owners->owned[i]], &attrib))
+              {
+                box_union(box, &attrib);
+                known = 1;
+              }
+          }
+        if (!known)
+          return 1;
+      }
+      break;
+    case DWG_TYPE_DIMENSION_ORDINATE:
+    case DWG_TYPE_DIMENSION_LINEAR:
+    case DWG_TYPE_DIMENSION_ALIGNED:
+    case DWG_TYPE_DIMENSION_ANG3PT:
+    case DWG_TYPE_DIMENSION_ANG2LN:
+    case DWG_TYPE_DIMENSION_RADIUS:
+    case DWG_TYPE_DIMENSION_DIAMETER:
+      {
+        Dwg_Object_Ref *block = NULL;
+        Dwg_BBox inner;
+        switch (obj->type)
+          {
+#define DIMENSION_BLOCK(token)                                               \
+  case DWG_TYPE_DIMENSION_##token:                                           \
+    block = ent->tio.DIMENSION_##token->block;                               \
+    break;
+            DIMENSION_BLOCK(ORDINATE)
+            DIMENSION_BLOCK(LINEAR)
+            DIMENSION_BLOCK(ALIGNED)
+            DIMENSION_BLOCK(ANG3PT)
+            DIMENSION_BLOCK(ANG2LN)
+            DIMENSION_BLOCK(RADIUS)
+            DIMENSION_BLOCK(DIAMETER)
+#undef DIMENSION_BLOCK
+          default:
+            break;
+          }
+        /* its anonymous block is drawn in the WCS, the handle after
+           dimstyle until R2007 */
+        if (dwg->header.version > R_2007
+            || !block_box(b, handle_object(obj, block, 1), &inner))
+          return 1;
+        box_union(box, &inner);
+      }
+      break;
+    case DWG_TYPE_SPLINE:
+      {
+        Dwg_Entity_SPLINE *_obj = ent->tio.SPLINE;
+        BITCODE_BL j;
+        /* within the hull of its control points */
+        if (_obj->ctrl_pts && _obj->num_ctrl_pts)
+          for (j = 0; j < _obj->num_ctrl_pts; j++)
+            box_add(box, _obj->ctrl_pts[j].x, _obj->ctrl_pts[j].y);
+        else
+          for (j = 0; _obj->fit_pts && j < _obj->num_fit_pts; j++)
+            box_add(box, _obj->fit_pts[j].x, _obj->fit_pts[j].y);
+      }
+      break;
+    case DWG_TYPE_LEADER:
+      {
+        Dwg_Entity_LEADER *_obj = ent->tio.LEADER;
+        BITCODE_BL j;
+        for (j = 0; _obj->points && j < _obj->numpts; j++)
+          box_add(box, _obj->points[j].x, _obj->points[j].y);
+      }
+      break;
+    case DWG_TYPE_VIEWPORT:
+      {
+        Dwg_Entity_VIEWPORT *_obj = ent->tio.VIEWPORT;
+        box_add(box, _obj->center.x - _obj->width / 2,
+                _obj->center.y - _obj->height / 2);
+        box_add(box, _obj->center.x + _obj->width / 2,
+                _obj->center.y + _obj->height / 2);
+      }
+      break;
+    default:
+      return 1;
+    }
+  return !box_valid(box);
+}
+
+static int
+compare_x(const void *a, const void *b)
+{
+  const Dwg_BBox *ba = (const Dwg_BBox *)a, *bb = (const Dwg_BBox *)b;
+  double ca = ba->xmin + ba->xmax, cb = bb->xmin + bb->xmax;
+
+  return ca < cb ? -1 : ca > cb;
+}
+
+static int
+compare_y(const void *a, const void *b)
+{
+  const Dwg_BBox *ba = (const Dwg_BBox *)a, *bb = (const Dwg_BBox *)b;
+  double ca = ba->ymin + ba->ymax, cb = bb->ymin + bb->ymax;
+
+  return ca < cb ? -1 : ca > cb;
+}
+
+/* STR: sorts n entries of size bytes, each beginning with its box, by
+   x into vertical slices of whole nodes, and each slice by y */
+static void
+str_sort(void *entries, unsigned int n, size_t size)
+{
+  unsigned int parents = (n + DWG_SPATIAL_NODE - 1) / DWG_SPATIAL_NODE;
+  unsigned int slices = (unsigned int)ceil(sqrt((double)parents));
+  unsigned int per_slice, i;
+
+  if (n <= DWG_SPATIAL_NODE)
+    return;
+  per_slice = slices * DWG_SPATIAL_NODE;
+  qsort(entries, n, size, compare_x);
+  for (i = 0; i < n; i += per_slice)
+    qsort((char *)entries + i * size, n - i < per_slice ? n - i : per_slice,
+          size, compare_y);
+}
+
+static void
+build_tree(Spatial_Build *b, Dwg_Spatial_Tree *tree)
+{
+  const Dwg_Owner_Index *owners = b->owners;
+  unsigned int k = (unsigned int)(tree - b->spatial->trees);
+  unsigned int first = owners->start[tree->block];
+  unsigned int end = owners->start[tree->block + 1];
+  unsigned int i, n = 0, num, level, num_level;
+
+  b->state[k] = 1;
+  tree->items = (Dwg_Spatial_Item *)malloc(
+      (end > first ? end - first : 1) * sizeof(Dwg_Spatial_Item));
+  if (!tree->items)
+    {
+      b->error = 1;
+      b->state[k] = 2;
+      return;
+    }
+  for (i = first; i < end; i++)
+    {
+      Dwg_Object *obj = &b->dwg->object[owners->owned[i]];
+      if (!entity_bbox(b, obj, &tree->items[n].box))
+        tree->items[n++].index = obj->index;
+    }
+  tree->num_items = n;
+  if (!n)
+    {
+      b->state[k] = 2;
+      return;
+    }
+  str_sort(tree->items, n, sizeof(Dwg_Spatial_Item));
+
+  /* the leaves and each level above, up to the root */
+  tree->num_leaves = (n + DWG_SPATIAL_NODE - 1) / DWG_SPATIAL_NODE;
+  for (num = level = tree->num_leaves; level > 1;)
+    {
+      level = (level + DWG_SPATIAL_NODE - 1) / DWG_SPATIAL_NODE;
+      num += level;
+    }
+  tree->nodes = (Dwg_Spatial_Node *)malloc(num * sizeof(Dwg_Spatial_Node));
+  if (!tree->nodes)
+    {
+      b->error = 1;
+      b->state[k] = 2;
+      return;
+    }
+  for (i = 0; i < tree->num_leaves; i++)
+    {
+      Dwg_Spatial_Node *node = &tree->nodes[i];
+      unsigned int j;
+      node->first = i * DWG_SPATIAL_NODE;
+      node->num = n - node->first < DWG_SPATIAL_NODE ? n - node->first
+                                                     : DWG_SPATIAL_NODE;
+      node->box = tree->items[node->first].box;
+      for (j = 1; j < node->num; j++)
+        box_union(&node->box, &tree->items[node->first + j].box);
+    }
+  tree->num_nodes = tree->num_leaves;
+  for (level = 0, num_level = tree->num_leaves; num_level > 1;)
+    {
+      unsigned int parents
+          = (num_level + DWG_SPATIAL_NODE - 1) / DWG_SPATIAL_NODE;
+      str_sort(&tree->nodes[level], num_level, sizeof(Dwg_Spatial_Node));
+      for (i = 0; i < parents; i++)
+        {
+          Dwg_Spatial_Node *node = &tree->nodes[tree->num_nodes + i];
+          unsigned int j;
+          node->first = level + i * DWG_SPATIAL_NODE;
+          node->num = num_level - i * DWG_SPATIAL_NODE < DWG_SPATIAL_NODE
+                          ? num_level - i * DWG_SPATIAL_NODE
+                          : DWG_SPATIAL_NODE;
+          node->box = tree->nodes[node->first].box;
+          for (j = 1; j < node->num; j++)
+            box_union(&node->box, &tree->nodes[node->first + j].box);
+        }
+      level = tree->num_nodes;
+      tree->num_nodes += parents;
+      num_level = parents;
+    }
+  b->state[k] = 2;
+}
+
+/* the class number of SPATIAL_INDEX objects, 0 if none */
+static unsigned int
+spatial_index_type(const Dwg_Data *dwg)
+{
+  unsigned int i;
+
+  for (i = 0; i < dwg->num_classes; i++)
+    if (dwg->dwg_class[i].dxfname
+        && !strcmp(dwg->dwg_class[i].dxfname, "SPATIAL_INDEX"))
+      return dwg->dwg_class[i].number;
+  return 0;
+}
+
+/* the SPATIAL_INDEX object of the drawing, or NULL */
+static const Dwg_Object *
+spatial_index_object(const Dwg_Data *dwg, const Dwg_Type_Index *types)
+{
+  unsigned int type = spatial_index_type(dwg);
+
+  if (!type || !types || type >= types->num_types
+      || types->start[type] == types->start[type + 1])
+    return NULL;
+  return &dwg->object[types->objects[types->start[type]]];
+}
+
+static void
+spatial_stamp(const Dwg_Data *dwg, const Dwg_Object *object,
+              Dwg_Spatial_Stamp *stamp)
+{
+  memset(stamp, 0, sizeof(Dwg_Spatial_Stamp));
+  stamp->num_objects = dwg->num_objects;
+  if (dwg->header_vars.HANDSEED)
+    stamp->handseed = dwg->header_vars.HANDSEED->absolute_ref;
+  stamp->days = dwg->header_vars.TDUPDATE.days;
+  stamp->ms = dwg->header_vars.TDUPDATE.ms;
+  /* AutoCAD updates them with its own spatial index */
+  if (object && object->tio.object)
+    {
+      Dwg_Object_SPATIAL_INDEX *_obj = object->tio.object->tio.SPATIAL_INDEX;
+      stamp->timestamp = _obj->timestamp1;
+      stamp->timestamp2 = _obj->timestamp2;
+    }
+}
+
+/* whether spatial was built or loaded for dwg as it is */
+static int
+spatial_current(const Dwg_Data *dwg, const Dwg_Spatial_Index *spatial)
+{
+  Dwg_Spatial_Stamp stamp;
+
+  if (spatial->stamp.num_objects != dwg->num_objects)
+    return 0;
+  spatial_stamp(dwg,
+                spatial->object < dwg->num_objects
+                    ? &dwg->object[spatial->object]
+                    : NULL,
+                &stamp);
+  /* stamp padding is zeroed on both sides */
+  return !memcmp(&stamp, &spatial->stamp, sizeof(Dwg_Spatial_Stamp));
+}
+
+static void
+spatial_free(Dwg_Spatial_Index *spatial)
+{
+  unsigned int k;
+
+  if (!spatial)
+    return;
+  for (k = 0; k < spatial->num_trees; k++)
+    {
+      free(spatial->trees[k].items);
+      free(spatial->trees[k].nodes);
+    }
+  free(spatial->trees);
+  free(spatial);
+}
+
+/* an empty index with a tree for each BLOCK_HEADER, not yet published */
+static Dwg_Spatial_Index *
+spatial_new(Dwg_Data *dwg, const Dwg_Type_Index *types,
+            const Dwg_Owner_Index *owners)
+{
+  Dwg_Spatial_Index *spatial;
+  const Dwg_Object *object = spatial_index_object(dwg, types);
+  unsigned int k, first = 0, num = 0;
+
+  if (owners && types && DWG_TYPE_BLOCK_HEADER < types->num_types)
+    {
+      first = types->start[DWG_TYPE_BLOCK_HEADER];
+      num = types->start[DWG_TYPE_BLOCK_HEADER + 1] - first;
+    }
+  spatial = (Dwg_Spatial_Index *)calloc(1, sizeof(Dwg_Spatial_Index));
+  if (!spatial)
+    return NULL;
+  spatial->trees
+      = (Dwg_Spatial_Tree *)calloc(num ? num : 1, sizeof(Dwg_Spatial_Tree));
+  if (!spatial->trees)
+    {
+      free(spatial);
+      return NULL;
+    }
+  spatial->num_trees = num;
+  for (k = 0; k < num; k++)
+    spatial->trees[k].block = types->objects[first + k];
+  spatial_stamp(dwg, object, &spatial->stamp);
+  spatial->object = object ? object->index : dwg->num_objects;
+  return spatial;
+}
+
+/* replaces the index of dwg by spatial, under the lock */
+static void
+spatial_publish(Dwg_Data *dwg, Dwg_Spatial_Index *spatial)
+{
+  dwg_free_spatial_index(dwg);
+  DWG_INDEX_STORE(dwg->spatial_index, spatial);
+}
+
+/* dwg_spatial_index() under the lock */
+static int
+spatial_build(Dwg_Data *dwg)
+{
+  const Dwg_Type_Index *types = dwg_type_index_locked(dwg);
+  Spatial_Build b;
+  unsigned int k;
+
+  memset(&b, 0, sizeof(Spatial_Build));
+  b.dwg = dwg;
+  /* none before R13, then without blocks */
+  b.owners = dwg_owner_index_locked(dwg);
+  b.spatial = spatial_new(dwg, types, b.owners);
+  if (!b.spatial)
+    return -1;
+  b.state = (unsigned char *)calloc(b.spatial->num_trees + 1, 1);
+  if (!b.state)
+    {
+      spatial_free(b.spatial);
+      return -1;
+    }
+  for (k = 0; k < b.spatial->num_trees; k++)
+    if (!b.state[k])
+      build_tree(&b, &b.spatial->trees[k]);
+  free(b.state);
+  if (b.error)
+    {
+      spatial_free(b.spatial);
+      return -1;
+    }
+  spatial_publish(dwg, b.spatial);
+  return 0;
+}
+
+/** dwg_spatial_index
+ * Builds a packed R-tree over the extents of the entities of each
+ * BLOCK_HEADER, by Sort-Tile-Recursive. dwg_decode() builds it with
+ * DWG_OPTS_SPATIAL, else the first query. Call it again after changing
+ * entities. Without blocks before R13.
+ * returns 0 on success.
+ */
+int
+dwg_spatial_index(Dwg_Data *dwg)
+{
+  int error;
+
+  dwg_index_lock(dwg);
+  error = spatial_build(dwg);
+  dwg_index_unlock(dwg);
+  return error;
+}
+
+/* the spatial index of dwg, built if missing or out of date */
+static const Dwg_Spatial_Index *
+spatial_get(Dwg_Data *dwg)
+{
+  const Dwg_Spatial_Index *spatial
+      = (const Dwg_Spatial_Index *)DWG_INDEX_LOAD(dwg->spatial_index);
+
+  if (spatial && spatial_current(dwg, spatial))
+    return spatial;
+  dwg_index_lock(dwg);
+  spatial = (const Dwg_Spatial_Index *)dwg->spatial_index;
+  /* built by another thread meanwhile */
+  if (!spatial || !spatial_current(dwg, spatial))
+    spatial = spatial_build(dwg)
+                  ? NULL
+                  : (const Dwg_Spatial_Index *)dwg->spatial_index;
+  dwg_index_unlock(dwg);
+  return spatial;
+}
+
+void
+dwg_free_spatial_index(Dwg_Data *dwg)
+{
+  spatial_free((Dwg_Spatial_Index *)dwg->spatial_index);
+  DWG_INDEX_STORE(dwg->spatial_index, NULL);
+}
+
+/** dwg_entity_bbox
+ * Sets bbox to the extent of the entity obj in the XY plane, of the
+ * WCS or of its block, as in the spatial index, which is built for
+ * the extents of inserted blocks.
+ * returns 0 on success, 1 if it is not known.
+ */
+int
+dwg_entity_bbox(Dwg_Object *obj, Dwg_BBox *bbox)
+{
+  Spatial_Build b;
+
+  box_empty(bbox);
+  if (!obj || !obj->parent)
+    return 1;
+  memset(&b, 0, sizeof(Spatial_Build));
+  b.dwg = obj->parent;
+  b.spatial = (Dwg_Spatial_Index *)spatial_get(obj->parent);
+  b.owners = dwg_owner_index_get(obj->parent);
+  if (!b.spatial)
+    return 1;
+  return entity_bbox(&b, obj, bbox);
+}
+
+/** dwg_spatial_query
+ * Finds the entities of the BLOCK_HEADER block whose extent intersects
+ * window, and stores up to max of their indices into dwg->object into
+ * objects, in no particular order. objects may be NULL to count them.
+ * Returns their number, which may be larger than max.
+ */
+long unsigned int
+dwg_spatial_query(Dwg_Object *block, const Dwg_BBox *window,
+                  unsigned int *objects, long unsigned int max)
+{
+  const Dwg_Spatial_Index *spatial;
+  const Dwg_Spatial_Tree *tree;
+  unsigned int stack[SPATIAL_MAX_DEPTH * DWG_SPATIAL_NODE];
+  unsigned int sp = 0;
+  long unsigned int num = 0;
+
+  if (!block || !block->parent || !window
+      || !(spatial = spatial_get(block->parent))
+      || !(tree = tree_of(spatial, block->index)) || !tree->num_nodes)
+    return 0;
+  stack[sp++] = tree->num_nodes - 1;
+  while (sp)
+    {
+      unsigned int i = stack[--sp], j;
+      const Dwg_Spatial_Node *node = &tree->nodes[i];
+
+      if (!box_overlaps(&node->box, window))
+        continue;
+      if (i < tree->num_leaves)
+        {
+          for (j = 0; j < node->num; j++)
+            {
+              const Dwg_Spatial_Item *item = &tree->items[node->first + j];
+              if (!box_overlaps(&item->box, window))
+                continue;
+              if (objects && num < max)
+                objects[num] = item->index;
+              num++;
+            }
+        }
+      else
+        for (j = 0; j < node->num; j++)
+          stack[sp++] = node->first + j;
+    }
+  return num;
+}
+
+/* the header of a saved index */
+typedef struct _spatial_file_header
+{
+  char magic[8];
+  unsigned int byte_order;
+  unsigned int item_size;
+  unsigned int node_size;
+  unsigned int node_entries;
+  Dwg_Spatial_Stamp stamp;
+  unsigned int num_trees;
+} Spatial_File_Header;
+
+static void
+spatial_header(Spatial_File_Header *header, const Dwg_Spatial_Index *spatial)
+{
+  memset(header, 0, sizeof(Spatial_File_Header));
+  memcpy(header->magic, SPATIAL_MAGIC, 8);
+  header->byte_order = 0x01020304;
+  header->item_size = sizeof(Dwg_Spatial_Item);
+  header->node_size = sizeof(Dwg_Spatial_Node);
+  header->node_entries = DWG_SPATIAL_NODE;
+  header->stamp = spatial->stamp;
+  header->num_trees = spatial->num_trees;
+}
+
+/** dwg_spatial_write
+ * Saves the spatial index of dwg, built if needed, into filename, to
+ * be loaded by dwg_spatial_read() with the same drawing.
+ * returns 0 on success.
+ */
+int
+dwg_spatial_write(Dwg_Data *dwg, const char *filename)
+{
+  const Dwg_Spatial_Index *spatial;
+  Spatial_File_Header header;
+  FILE *fh;
+  unsigned int k;
+  int error = 0;
+
+  loglevel = dwg->opts & 0xf;
+  if (!(spatial = spatial_get(dwg)))
+    return -1;
+  fh = fopen(filename, "wb");
+  if (!fh)
+    {
+      LOG_ERROR("Failed to create the file: %s\n", filename)
+      return -1;
+    }
+  spatial_header(&header, spatial);
+  if (fwrite(&header, sizeof(header), 1, fh) != 1)
+    error = 1;
+  for (k = 0; k < spatial->num_trees && !error; k++)
+    {
+      const Dwg_Spatial_Tree *tree = &spatial->trees[k];
+      unsigned int sizes[4];
+
+      sizes[0] = tree->block;
+      sizes[1] = tree->num_items;
+      sizes[2] = tree->num_leaves;
+      sizes[3] = tree->num_nodes;
+      if (fwrite(sizes, sizeof(sizes), 1, fh) != 1
+          || fwrite(tree->items, sizeof(Dwg_Spatial_Item), tree->num_items,
+                    fh) != tree->num_items
+          || fwrite(tree->nodes, sizeof(Dwg_Spatial_Node), tree->num_nodes,
+                    fh) != tree->num_nodes)
+        error = 1;
+    }
+  if (fclose(fh))
+    error = 1;
+  if (error)
+    {
+      LOG_ERROR("Failed to write the file: %s\n", filename)
+      return -1;
+    }
+  return 0;
+}
+
+/* the tree refers to objects of dwg only, and each node to entries
+   below it, at most SPATIAL_MAX_DEPTH levels deep */
+static int
+tree_valid(const Dwg_Data *dwg, const Dwg_Spatial_Tree *tree)
+{
+  unsigned char *depth;
+  unsigned int i;
+  int valid = 1;
+
+  if (tree->block >= dwg->num_objects
+      || dwg->object[tree->block].type != DWG_TYPE_BLOCK_HEADER
+      || tree->num_leaves > tree->num_nodes
+      || (tree->num_items == 0) != (tree->num_nodes == 0)
+      || (tree->num_nodes && !tree->num_leaves))
+    return 0;
+  for (i = 0; i < tree->num_items; i++)
+    if (tree->items[i].index >= dwg->num_objects)
+      return 0;
+  depth = (unsigned char *)calloc(tree->num_nodes + 1, 1);
+  if (!depth)
+    return 0;
+  for (i = 0; i < tree->num_nodes && valid; i++)
+    {
+      const Dwg_Spatial_Node *node = &tree->nodes[i];
+      unsigned int j;
+
+      if (node->num > DWG_SPATIAL_NODE)
+        valid = 0;
+      else if (i < tree->num_leaves)
+        valid = node->first <= tree->num_items
+                && node->num <= tree->num_items - node->first;
+      else if (node->first > i || node->num > i - node->first)
+        valid = 0;
+      else
+        for (j = 0; j < node->num; j++)
+          if (depth[node->first + j] >= depth[i])
+            {
+              depth[i] = depth[node->first + j] + 1;
+              if (depth[i] >= SPATIAL_MAX_DEPTH)
+                valid = 0;
+            }
+    }
+  free(depth);
+  return valid;
+}
+
+/* dwg_spatial_read() under the lock */
+static int
+spatial_load(Dwg_Data *dwg, FILE *fh, const char *filename)
+{
+  const Dwg_Type_Index *types = dwg_type_index_locked(dwg);
+  Dwg_Spatial_Index *spatial;
+  Spatial_File_Header header, expected;
+  Dwg_Spatial_Stamp stamp;
+  unsigned int k;
+  int error = 0;
+
+  spatial_stamp(dwg, spatial_index_object(dwg, types), &stamp);
+  memset(&expected, 0, sizeof(expected));
+  if (fread(&header, sizeof(header), 1, fh) != 1)
+    error = 1;
+  else
+    {
+      Dwg_Spatial_Index current;
+      current.stamp = stamp;
+      current.num_trees = header.num_trees;
+      spatial_header(&expected, &current);
+      /* stamp padding is zeroed on both sides */
+      if (memcmp(&header, &expected, sizeof(header)))
+        error = 1;
+    }
+  if (error)
+    {
+      LOG_INFO("Spatial index %s is not for this drawing\n", filename)
+      return 1;
+    }
+
+  spatial = spatial_new(dwg, types, dwg_owner_index_locked(dwg));
+  if (!spatial)
+    return -1;
+  for (k = 0; k < header.num_trees && !error; k++)
+    {
+      Dwg_Spatial_Tree *tree;
+      unsigned int sizes[4];
+
+      if (fread(sizes, sizeof(sizes), 1, fh) != 1
+          || !(tree = tree_of(spatial, sizes[0])) || tree->items)
+        {
+          error = 1;
+          break;
+        }
+      tree->num_items = sizes[1];
+      tree->num_leaves = sizes[2];
+      tree->num_nodes = sizes[3];
+      if (tree->num_items > dwg->num_objects
+          || tree->num_nodes > tree->num_items)
+        {
+          error = 1;
+          break;
+        }
+      tree->items = (Dwg_Spatial_Item *)malloc(
+          (tree->num_items ? tree->num_items : 1) * sizeof(Dwg_Spatial_Item));
+      tree->nodes = (Dwg_Spatial_Node *)malloc(
+          (tree->num_nodes ? tree->num_nodes : 1) * sizeof(Dwg_Spatial_Node));
+      if (!tree->items || !tree->nodes
+          || fread(tree->items, sizeof(Dwg_Spatial_Item), tree->num_items, fh)
+                 != tree->num_items
+          || fread(tree->nodes, sizeof(Dwg_Spatial_Node), tree->num_nodes, fh)
+                 != tree->num_nodes
+          || !tree_valid(dwg, tree))
+        error = 1;
+    }
+  /* one tree for each block */
+  if (!error && header.num_trees != spatial->num_trees)
+    error = 1;
+  if (error)
+    {
+      LOG_ERROR("Invalid spatial index %s\n", filename)
+      spatial_free(spatial);
+      return -1;
+    }
+  spatial_publish(dwg, spatial);
+  return 0;
+}
+
+/** dwg_spatial_read
+ * Loads the spatial index of dwg from filename, as saved by
+ * dwg_spatial_write() for this drawing. Fails when the drawing or its
+ * own SPATIAL_INDEX changed since, and then the first query builds the
+ * index again.
+ * returns 0 on success.
+ */
+int
+dwg_spatial_read(Dwg_Data *dwg, const char *filename)
+{
+  FILE *fh;
+  int error;
+
+  loglevel = dwg->opts & 0xf;
+  fh = fopen(filename, "rb");
+  if (!fh)
+    {
+      LOG_ERROR("File not found: %s\n", filename)
+      return -1;
+    }
+  dwg_index_lock(dwg);
+  error = spatial_load(dwg, fh, filename);
+  dwg_index_unlock(dwg);
+  fclose(fh);
+  return error;
+}
@@ -0,0 +1,73 @@
+/*****************************************************************************/
+/*  LibreDWG - free implementation of the DWG file format                    */
+/*                                                                           */
+/*  Copyright (C) 2018 Free Software Foundation, Inc.                        */
+/*                                                                           */
+/*  This library is free software, licensed under the terms of the GNU       */
+/*  General Public License as published by the Free Software Foundation,     */
+/*  either version 3 of the License, or (at your option) any later version.  */
+/*  You should have received a copy of the GNU General Public License        */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.    */
+/*****************************************************************************/
+
+/*
+ * spatial.h: packed R-trees over the entity extents of each block
+ */
+
+#ifndef SPATIAL_H
+#define SPATIAL_H
+
+#include "dwg.h"
+
+/* entries per node */
+#define DWG_SPATIAL_NODE 16
+
+typedef struct _dwg_spatial_item
+{
+  Dwg_BBox box;
+  unsigned int index; /* into dwg->object */
+} Dwg_Spatial_Item;
+
+typedef struct _dwg_spatial_node
+{
+  Dwg_BBox box;
+  unsigned int first; /* of its items for a leaf, else of its nodes */
+  unsigned int num;
+} Dwg_Spatial_Node;
+
+/* The entities of one BLOCK_HEADER with a known extent. The leaves
+   are the first num_leaves nodes, the root is the last one. */
+typedef struct _dwg_spatial_tree
+{
+  unsigned int block; /* object index of the BLOCK_HEADER */
+  unsigned int num_items;
+  unsigned int num_leaves;
+  unsigned int num_nodes;
+  Dwg_Spatial_Item *items;
+  Dwg_Spatial_Node *nodes;
+} Dwg_Spatial_Tree;
+
+/* what a saved index must match to be loaded again */
+typedef struct _dwg_spatial_stamp
+{
+  long unsigned int num_objects;
+  long unsigned int handseed;
+  BITCODE_BL days;      /* TDUPDATE */
+  BITCODE_BL ms;
+  BITCODE_BL timestamp; /* of the SPATIAL_INDEX object, if any */
+  BITCODE_BL timestamp2;
+} Dwg_Spatial_Stamp;
+
+/* The trees of all blocks, by block. Built on first use. */
+typedef struct _dwg_spatial_index
+{
+  Dwg_Spatial_Stamp stamp;
+  long unsigned int object; /* of the timestamps, else num_objects */
+  unsigned int num_trees;
+  Dwg_Spatial_Tree *trees;
+} Dwg_Spatial_Index;
+
+void
+dwg_free_spatial_index(Dwg_Data *dwg);
+
+#endif
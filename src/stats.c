@@ -0,0 +1,378 @@
+/*****************************************************************************/
+/*  LibreDWG - free implementation of the DWG file format                    */
+/*                                                                           */
+/*  Copyright (C) 2018 Free Software Foundation, Inc.                        */
+/*                                                                           */
+/*  This library is free software, licensed under the terms of the GNU       */
+/*  General Public License as published by the Free Software Foundation,     */
+/*  either version 3 of the License, or (at your option) any later version.  */
+/*  You should have received a copy of the GNU General Public License        */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.    */
+/*****************************************************************************/
+
+/*
+ * stats.c: decode statistics, collected into dwg->stats if set
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#if defined(LIBREDWG_STATS) && (defined(__x86_64__) || defined(__i386__)) \
+  && defined(__GNUC__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+#include "dwg.h"
+#include "stats.h"
+
+static void
+stats_now(Dwg_Stats_Time *t)
+{
+#ifdef HAVE_CLOCK_GETTIME
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  t->wall = ts.tv_sec + ts.tv_nsec * 1e-9;
+# ifdef CLOCK_THREAD_CPUTIME_ID
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+# else
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+# endif
+  t->cpu = ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+  t->wall = (double)time(NULL);
+  t->cpu = (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* Charges the time since the last switch to the running phase, and
+   runs phase then, none if -1. Returns the phase which was running. */
+static int
+stats_switch(Dwg_Stats *stats, int phase)
+{
+  Dwg_Stats_Time now;
+  int prev = stats->running - 1;
+
+  stats_now(&now);
+  if (prev >= 0)
+    {
+      stats->phase[prev].wall += now.wall - stats->since.wall;
+      stats->phase[prev].cpu += now.cpu - stats->since.cpu;
+    }
+  stats->since = now;
+  stats->running = phase + 1;
+  return prev;
+}
+
+void
+dwg_stats_begin(Dwg_Data *dwg, Dwg_Stats_Phase phase, Dwg_Stats_Mark *mark)
+{
+  mark->phase = -1;
+  if (!dwg->stats)
+    return;
+  mark->prev = stats_switch(dwg->stats, phase);
+  mark->phase = phase;
+  mark->before = dwg->stats->phase[phase];
+}
+
+void
+dwg_stats_end(Dwg_Data *dwg, const Dwg_Stats_Mark *mark,
+              Dwg_Stats_Count *count, long unsigned int bytes)
+{
+  Dwg_Stats *stats = dwg->stats;
+
+  if (!stats || mark->phase < 0)
+    return;
+  stats_switch(stats, mark->prev);
+  if (count)
+    {
+      count->count++;
+      count->bytes += bytes;
+      count->time.wall += stats->phase[mark->phase].wall - mark->before.wall;
+      count->time.cpu += stats->phase[mark->phase].cpu - mark->before.cpu;
+    }
+}
+
+#define TYPE_NAME(t) \
+    case DWG_TYPE_##t: \
+      return #t;
+
+/** dwg_type_name
+ * Returns the name of an object type, for the types above 500 the DXF
+ * name of its class in dwg. NULL if unknown.
+ */
+const char *
+dwg_type_name(const Dwg_Data *dwg, unsigned int type)
+{
+  if (type >= 500)
+    {
+      if (dwg && type - 500 < dwg->num_classes)
+        return dwg->dwg_class[type - 500].dxfname;
+      return NULL;
+    }
+  switch (type)
+    {
+    TYPE_NAME(TEXT)
+    TYPE_NAME(ATTRIB)
+    TYPE_NAME(ATTDEF)
+    TYPE_NAME(BLOCK)
+    TYPE_NAME(ENDBLK)
+    TYPE_NAME(SEQEND)
+    TYPE_NAME(INSERT)
+    TYPE_NAME(MINSERT)
+    TYPE_NAME(VERTEX_2D)
+    TYPE_NAME(VERTEX_3D)
+    TYPE_NAME(VERTEX_MESH)
+    TYPE_NAME(VERTEX_PFACE)
+    TYPE_NAME(VERTEX_PFACE_FACE)
+    TYPE_NAME(POLYLINE_2D)
+    TYPE_NAME(POLYLINE_3D)
+    TYPE_NAME(ARC)
+    TYPE_NAME(CIRCLE)
+    TYPE_NAME(LINE)
+    TYPE_NAME(DIMENSION_ORDINATE)
+    TYPE_NAME(DIMENSION_LINEAR)
+    TYPE_NAME(DIMENSION_ALIGNED)
+    TYPE_NAME(DIMENSION_ANG3PT)
+    TYPE_NAME(DIMENSION_ANG2LN)
+    TYPE_NAME(DIMENSION_RADIUS)
+    TYPE_NAME(DIMENSION_DIAMETER)
+    TYPE_NAME(POINT)
+    case DWG_TYPE__3DFACE:
+      return "3DFACE";
+    TYPE_NAME(POLYLINE_PFACE)
+    TYPE_NAME(POLYLINE_MESH)
+    TYPE_NAME(SOLID)
+    TYPE_NAME(TRACE)
+    TYPE_NAME(SHAPE)
+    TYPE_NAME(VIEWPORT)
+    TYPE_NAME(ELLIPSE)
+    TYPE_NAME(SPLINE)
+    TYPE_NAME(REGION)
+    TYPE_NAME(3DSOLID)
+    TYPE_NAME(BODY)
+    TYPE_NAME(RAY)
+    TYPE_NAME(XLINE)
+    TYPE_NAME(DICTIONARY)
+    TYPE_NAME(OLEFRAME)
+    TYPE_NAME(MTEXT)
+    TYPE_NAME(LEADER)
+    TYPE_NAME(TOLERANCE)
+    TYPE_NAME(MLINE)
+    TYPE_NAME(BLOCK_CONTROL)
+    TYPE_NAME(BLOCK_HEADER)
+    TYPE_NAME(LAYER_CONTROL)
+    TYPE_NAME(LAYER)
+    TYPE_NAME(SHAPEFILE_CONTROL)
+    TYPE_NAME(SHAPEFILE)
+    TYPE_NAME(LTYPE_CONTROL)
+    TYPE_NAME(LTYPE)
+    TYPE_NAME(VIEW_CONTROL)
+    TYPE_NAME(VIEW)
+    TYPE_NAME(UCS_CONTROL)
+    TYPE_NAME(UCS)
+    TYPE_NAME(VPORT_CONTROL)
+    TYPE_NAME(VPORT)
+    TYPE_NAME(APPID_CONTROL)
+    TYPE_NAME(APPID)
+    TYPE_NAME(DIMSTYLE_CONTROL)
+    TYPE_NAME(DIMSTYLE)
+    TYPE_NAME(VP_ENT_HDR_CONTROL)
+    TYPE_NAME(VP_ENT_HDR)
+    TYPE_NAME(GROUP)
+    TYPE_NAME(MLINESTYLE)
+    TYPE_NAME(OLE2FRAME)
+    TYPE_NAME(DUMMY)
+    TYPE_NAME(LONG_TRANSACTION)
+    TYPE_NAME(LWPLINE)
+    TYPE_NAME(HATCH)
+    TYPE_NAME(XRECORD)
+    TYPE_NAME(PLACEHOLDER)
+    TYPE_NAME(VBA_PROJECT)
+    TYPE_NAME(LAYOUT)
+    TYPE_NAME(PROXY_ENTITY)
+    TYPE_NAME(PROXY_OBJECT)
+    default:
+      return NULL;
+    }
+}
+
+#ifdef LIBREDWG_STATS
+
+long unsigned int dwg_stats_prims[DWG_NUM_PRIMS][2];
+
+static const char *prim_names[DWG_NUM_PRIMS] = {
+  "B", "BB", "3B", "BS", "BL", "BLL", "BD", "DD", "BT", "BE",
+  "RC", "RS", "RL", "RLL", "RD", "MC", "MS", "H", "TV", "TU"
+};
+
+static Dwg_Stats_Func *funcs;
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t funcs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t report_once = PTHREAD_ONCE_INIT;
+#else
+static int report_added;
+#endif
+
+unsigned long long
+dwg_stats_ticks(void)
+{
+#ifdef HAVE_RDTSC
+  return __rdtsc();
+#else
+  Dwg_Stats_Time t;
+  stats_now(&t);
+  return (unsigned long long)(t.wall * 1e9);
+#endif
+}
+
+/* added is set once func is linked, and read without the lock */
+#ifdef __GNUC__
+# define FUNC_ADDED(func) __atomic_load_n(&(func)->added, __ATOMIC_ACQUIRE)
+# define FUNC_SET_ADDED(func) \
+  __atomic_store_n(&(func)->added, 1, __ATOMIC_RELEASE)
+#else
+# define FUNC_ADDED(func) ((func)->added)
+# define FUNC_SET_ADDED(func) ((func)->added = 1)
+#endif
+
+void
+dwg_stats_func(Dwg_Stats_Func *func, long bits, unsigned long long ticks)
+{
+  if (!FUNC_ADDED(func))
+    {
+#ifdef HAVE_PTHREAD_H
+      pthread_mutex_lock(&funcs_lock);
+#endif
+      if (!func->added)
+        {
+          func->next = funcs;
+          funcs = func;
+          FUNC_SET_ADDED(func);
+        }
+#ifdef HAVE_PTHREAD_H
+      pthread_mutex_unlock(&funcs_lock);
+#endif
+    }
+  DWG_STATS_ADD(func->calls, 1);
+  if (bits > 0)
+    DWG_STATS_ADD(func->bits, (long unsigned int)bits);
+  DWG_STATS_ADD(func->ticks, ticks);
+}
+
+static int
+compare_prims(const void *a, const void *b)
+{
+  const long unsigned int *pa = dwg_stats_prims[*(const int *)a];
+  const long unsigned int *pb = dwg_stats_prims[*(const int *)b];
+  long unsigned int na = pa[0] + pa[1], nb = pb[0] + pb[1];
+
+  return na < nb ? 1 : na > nb ? -1 : 0;
+}
+
+static int
+compare_funcs(const void *a, const void *b)
+{
+  const Dwg_Stats_Func *fa = *(Dwg_Stats_Func *const *)a;
+  const Dwg_Stats_Func *fb = *(Dwg_Stats_Func *const *)b;
+
+  return fa->ticks < fb->ticks ? 1 : fa->ticks > fb->ticks ? -1 : 0;
+}
+
+/* a bar of up to 40 #, for 100% */
+static void
+print_bar(double part)
+{
+  int n = (int)(part * 40 + 0.5);
+  while (n-- > 0)
+    fputc('#', stderr);
+  fputc('\n', stderr);
+}
+
+static void
+stats_report(void)
+{
+  int order[DWG_NUM_PRIMS];
+  long unsigned int total = 0, num_funcs = 0;
+  unsigned long long ticks = 0;
+  Dwg_Stats_Func *func, **sorted;
+  int i;
+
+  for (i = 0; i < DWG_NUM_PRIMS; i++)
+    {
+      order[i] = i;
+      total += dwg_stats_prims[i][0] + dwg_stats_prims[i][1];
+    }
+  qsort(order, DWG_NUM_PRIMS, sizeof(int), compare_prims);
+  fprintf(stderr, "\nLibreDWG primitive reads: %lu\n"
+          "%-4s %12s %12s %6s\n", total, "kind", "aligned", "unaligned",
+          "%");
+  for (i = 0; total && i < DWG_NUM_PRIMS; i++)
+    {
+      long unsigned int *n = dwg_stats_prims[order[i]];
+      double part = (double)(n[0] + n[1]) / total;
+      if (!n[0] && !n[1])
+        break;
+      fprintf(stderr, "%-4s %12lu %12lu %6.2f ", prim_names[order[i]], n[0],
+              n[1], part * 100);
+      print_bar(part);
+    }
+
+  for (func = funcs; func; func = func->next)
+    {
+      num_funcs++;
+      ticks += func->ticks;
+    }
+  sorted = (Dwg_Stats_Func **)malloc(num_funcs * sizeof(Dwg_Stats_Func *));
+  if (!sorted)
+    return;
+  for (i = 0, func = funcs; func; func = func->next)
+    sorted[i++] = func;
+  qsort(sorted, num_funcs, sizeof(Dwg_Stats_Func *), compare_funcs);
+  fprintf(stderr, "\nLibreDWG decode functions, in %s\n"
+          "%-32s %10s %12s %14s %10s %8s %6s\n",
+#ifdef HAVE_RDTSC
+          "TSC cycles",
+#else
+          "ns",
+#endif
+          "type", "calls", "bytes", "ticks", "/call", "/byte", "%");
+  for (i = 0; i < (int)num_funcs; i++)
+    {
+      double part = ticks ? (double)sorted[i]->ticks / ticks : 0.0;
+      long unsigned int bytes = sorted[i]->bits / 8;
+      fprintf(stderr, "%-32s %10lu %12lu %14llu %10.0f %8.1f %6.2f ",
+              sorted[i]->name, sorted[i]->calls, bytes, sorted[i]->ticks,
+              (double)sorted[i]->ticks / sorted[i]->calls,
+              bytes ? (double)sorted[i]->ticks / bytes : 0.0, part * 100);
+      print_bar(part);
+    }
+  free(sorted);
+}
+
+static void
+add_report(void)
+{
+  atexit(stats_report);
+}
+
+void
+dwg_stats_atexit(void)
+{
+#ifdef HAVE_PTHREAD_H
+  pthread_once(&report_once, add_report);
+#else
+  if (!report_added)
+    {
+      add_report();
+      report_added = 1;
+    }
+#endif
+}
+
+#endif /* LIBREDWG_STATS */
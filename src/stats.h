@@ -0,0 +1,102 @@
+/*****************************************************************************/
+/*  LibreDWG - free implementation of the DWG file format                    */
+/*                                                                           */
+/*  Copyright (C) 2018 Free Software Foundation, Inc.                        */
+/*                                                                           */
+/*  This library is free software, licensed under the terms of the GNU       */
+/*  General Public License as published by the Free Software Foundation,     */
+/*  either version 3 of the License, or (at your option) any later version.  */
+/*  You should have received a copy of the GNU General Public License        */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.    */
+/*****************************************************************************/
+
+/*
+ * stats.h: decode statistics, collected into dwg->stats if set
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "dwg.h"
+
+/* the phase which was running before dwg_stats_begin */
+typedef struct _dwg_stats_mark
+{
+  int prev;
+  int phase;
+  Dwg_Stats_Time before;
+} Dwg_Stats_Mark;
+
+/* Charges the time until now to the running phase, and starts phase. */
+void
+dwg_stats_begin(Dwg_Data *dwg, Dwg_Stats_Phase phase, Dwg_Stats_Mark *mark);
+
+/* Ends the phase of mark and continues the previous one. The time of
+   the phase since mark, and bytes, are added to count if not NULL. */
+void
+dwg_stats_end(Dwg_Data *dwg, const Dwg_Stats_Mark *mark,
+              Dwg_Stats_Count *count, long unsigned int bytes);
+
+/* The counts of a section or object type, NULL without stats */
+#define DWG_STATS_SECTION(dwg, t) \
+  ((dwg)->stats ? &(dwg)->stats->section[(t) < DWG_STATS_SECTIONS \
+                                         ? (t) : DWG_STATS_SECTIONS - 1] \
+                : NULL)
+#define DWG_STATS_TYPE(dwg, t) \
+  ((dwg)->stats ? &(dwg)->stats->type[(t) < DWG_STATS_TYPES \
+                                      ? (t) : DWG_STATS_TYPES - 1] \
+                : NULL)
+
+#ifdef LIBREDWG_STATS
+/* --enable-stats: every primitive read outside of bits.c is counted by
+   its kind and alignment, and every dwg_decode_<TYPE> function by its
+   calls, bits and ticks. The report goes to stderr at exit. */
+typedef enum DWG_STATS_PRIM
+{
+  DWG_PRIM_B, DWG_PRIM_BB, DWG_PRIM_3B, DWG_PRIM_BS, DWG_PRIM_BL,
+  DWG_PRIM_BLL, DWG_PRIM_BD, DWG_PRIM_DD, DWG_PRIM_BT, DWG_PRIM_BE,
+  DWG_PRIM_RC, DWG_PRIM_RS, DWG_PRIM_RL, DWG_PRIM_RLL, DWG_PRIM_RD,
+  DWG_PRIM_MC, DWG_PRIM_MS, DWG_PRIM_H, DWG_PRIM_TV, DWG_PRIM_TU,
+  DWG_NUM_PRIMS
+} Dwg_Stats_Prim;
+
+/* by kind, unaligned */
+extern long unsigned int dwg_stats_prims[DWG_NUM_PRIMS][2];
+
+#ifdef __GNUC__
+# define DWG_STATS_ADD(var, n) \
+  __atomic_fetch_add(&(var), (n), __ATOMIC_RELAXED)
+#else
+# define DWG_STATS_ADD(var, n) ((var) += (n))
+#endif
+
+#define DWG_STATS_PRIM(kind, dat) \
+  DWG_STATS_ADD(dwg_stats_prims[DWG_PRIM_##kind][(dat)->bit != 0], 1)
+
+typedef struct _dwg_stats_func
+{
+  const char *name;
+  long unsigned int calls;
+  long unsigned int bits;
+  unsigned long long ticks;
+  int added;
+  struct _dwg_stats_func *next;
+} Dwg_Stats_Func;
+
+/* TSC cycles on x86, else nanoseconds */
+unsigned long long
+dwg_stats_ticks(void);
+
+/* Adds one call of func, which is listed in the report then. */
+void
+dwg_stats_func(Dwg_Stats_Func *func, long bits, unsigned long long ticks);
+
+/* Prints the report at exit, once. */
+void
+dwg_stats_atexit(void);
+
+#else
+# define DWG_STATS_PRIM(kind, dat) ((void)0)
+#endif
+
+#endif
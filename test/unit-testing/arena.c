@@ -0,0 +1,95 @@
+/* Decode DWG files, set caller-allocated and arena strings into their
+   TEXT and MTEXT entities, and free them. The decoded fields are in the
+   arena, the malloc'ed ones are not, and dwg_free frees the latter but
+   not those replaced again: run with "make check-valgrind" or
+   -fsanitize=address to catch a leak or a double free. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwg.h"
+#include "dwg_api.h"
+#include "arena.h"
+#include "fixture.c"
+
+static const char *files[] = {
+  "example_2000.dwg",
+  "2004/Leader_2004.dwg",
+  "2007/Leader_2007.dwg",
+};
+
+static char *
+heap_string(const char *s)
+{
+  char *copy = malloc(strlen(s) + 1);
+  strcpy(copy, s);
+  return copy;
+}
+
+static int
+check(const char *path, Dwg_Data *dwg)
+{
+  long unsigned int i, texts = 0;
+  int local = 0;
+  char *heap = heap_string("heap");
+  int failed = 0, error;
+
+  /* neither the stack nor the heap is in the arena */
+  if (dwg_arena_owns(dwg, &local) || dwg_arena_owns(dwg, heap)
+      || !dwg_arena_owns(dwg, dwg_alloc(dwg, 1)))
+    failed = 1;
+  free(heap);
+  for (i = 0; !failed && i < dwg->num_objects; i++)
+    {
+      Dwg_Object *obj = &dwg->object[i];
+      char *text;
+
+      if (!obj->tio.entity || (obj->type != DWG_TYPE_TEXT
+                               && obj->type != DWG_TYPE_MTEXT))
+        continue;
+      text = obj->type == DWG_TYPE_TEXT
+        ? obj->tio.entity->tio.TEXT->text_value
+        : obj->tio.entity->tio.MTEXT->text;
+      if (text && !dwg_arena_owns(dwg, text))
+        failed = 1;
+      /* every other one from the heap, to be freed by dwg_free */
+      if (texts++ & 1)
+        {
+          text = (char *)dwg_alloc(dwg, 6);
+          strcpy(text, "arena");
+        }
+      else
+        {
+          /* a replaced one is the caller's again */
+          char *replaced = heap_string("replaced");
+          if (obj->type == DWG_TYPE_TEXT)
+            dwg_ent_text_set_text(obj->tio.entity->tio.TEXT, replaced,
+                                  &error);
+          else
+            dwg_ent_mtext_set_text(obj->tio.entity->tio.MTEXT, replaced,
+                                   &error);
+          text = heap_string("caller");
+          if (obj->type == DWG_TYPE_TEXT)
+            dwg_ent_text_set_text(obj->tio.entity->tio.TEXT, text, &error);
+          else
+            dwg_ent_mtext_set_text(obj->tio.entity->tio.MTEXT, text, &error);
+          free(replaced);
+        }
+      if (obj->type == DWG_TYPE_TEXT)
+        dwg_ent_text_set_text(obj->tio.entity->tio.TEXT, text, &error);
+      else
+        dwg_ent_mtext_set_text(obj->tio.entity->tio.MTEXT, text, &error);
+      if (error || (dwg_arena_owns(dwg, text) != (int)((texts - 1) & 1)))
+        failed = 1;
+    }
+  if (!texts)
+    failed = 1;
+  return test_result(failed, "%s: %lu texts set", path, texts);
+}
+
+int
+main(int argc, char *argv[])
+{
+  return test_files(files, NUM_FILES(files), 0, check) ? 1 : 0;
+}
@@ -0,0 +1,145 @@
+/* The fixture of the tests which decode the DWG files of test/test-data:
+   the path of each file, the loop over them, and the "ok" or "not ok"
+   line of each check. Included by them, like common.c. */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwg.h"
+
+#define NUM_FILES(files) (int)(sizeof(files) / sizeof(files[0]))
+
+char *
+test_path(const char *file);
+
+#ifdef __GNUC__
+__attribute__ ((format (printf, 2, 3)))
+#endif
+int
+test_result(int failed, const char *fmt, ...);
+
+int
+test_read(const char *path, Dwg_Data *dwg, unsigned int opts);
+
+int
+test_paths(const char **files, int num_files,
+           int (*check)(const char *path));
+
+int
+test_files(const char **files, int num_files, unsigned int opts,
+           int (*check)(const char *path, Dwg_Data *dwg));
+
+int
+test_file_pairs(const char **files, int num_files, unsigned int opts,
+                unsigned int other_opts,
+                int (*check)(const char *path, Dwg_Data *dwg,
+                             Dwg_Data *other));
+
+/// The malloc'ed path of file in $TESTDATA, or else in ../test-data
+char *
+test_path(const char *file)
+{
+  const char *datadir = getenv("TESTDATA");
+  char *path;
+
+  if (!datadir)
+    datadir = "../test-data";
+  path = malloc(strlen(datadir) + strlen(file) + 2);
+  sprintf(path, "%s/%s", datadir, file);
+  return path;
+}
+
+/// Prints "ok: " or "not ok: " and the message. Returns 1 if failed.
+int
+test_result(int failed, const char *fmt, ...)
+{
+  va_list ap;
+
+  printf("%s: ", failed ? "not ok" : "ok");
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  printf("\n");
+  return failed ? 1 : 0;
+}
+
+/// Reads path with opts into the cleared dwg. Returns 1 if that failed.
+int
+test_read(const char *path, Dwg_Data *dwg, unsigned int opts)
+{
+  memset(dwg, 0, sizeof(Dwg_Data));
+  dwg->opts = opts;
+  if (dwg_read_file((char *)path, dwg))
+    return test_result(1, "dwg_read_file %s", path);
+  return 0;
+}
+
+/// Calls check with the path of each file. Returns the failures.
+int
+test_paths(const char **files, int num_files,
+           int (*check)(const char *path))
+{
+  int failures = 0;
+  int i;
+
+  for (i = 0; i < num_files; i++)
+    {
+      char *path = test_path(files[i]);
+      failures += check(path);
+      free(path);
+    }
+  return failures;
+}
+
+/// Reads each file with opts and calls check on it. Returns the failures.
+int
+test_files(const char **files, int num_files, unsigned int opts,
+           int (*check)(const char *path, Dwg_Data *dwg))
+{
+  int failures = 0;
+  int i;
+
+  for (i = 0; i < num_files; i++)
+    {
+      Dwg_Data dwg;
+      char *path = test_path(files[i]);
+
+      if (test_read(path, &dwg, opts))
+        failures++;
+      else
+        failures += check(path, &dwg);
+      dwg_free(&dwg);
+      free(path);
+    }
+  return failures;
+}
+
+/// Reads each file once with opts and once with other_opts, and calls
+/// check on both. Returns the failures.
+int
+test_file_pairs(const char **files, int num_files, unsigned int opts,
+                unsigned int other_opts,
+                int (*check)(const char *path, Dwg_Data *dwg,
+                             Dwg_Data *other))
+{
+  int failures = 0;
+  int i;
+
+  for (i = 0; i < num_files; i++)
+    {
+      Dwg_Data dwg, other;
+      char *path = test_path(files[i]);
+
+      memset(&other, 0, sizeof(Dwg_Data));
+      if (test_read(path, &dwg, opts) || test_read(path, &other, other_opts))
+        failures++;
+      else
+        failures += check(path, &dwg, &other);
+      dwg_free(&dwg);
+      dwg_free(&other);
+      free(path);
+    }
+  return failures;
+}
@@ -0,0 +1,120 @@
+/* Decode DWG files twice with DWG_OPTS_INTERN and a shared table, and
+   check that their layer names and class DXF names are the same
+   pointers, which outlive the first drawing, and that an interned
+   string set into an object stays in the table. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwg.h"
+#include "dwg_api.h"
+#include "common.h"
+#include "fixture.c"
+
+static const char *files[] = {
+  "example_2000.dwg",
+  "2004/Leader_2004.dwg",
+  "2007/Leader_2007.dwg",
+};
+
+static int
+read_interned(const char *path, Dwg_Data *dwg, Dwg_Intern *intern)
+{
+  memset(dwg, 0, sizeof(Dwg_Data));
+  dwg->opts = DWG_OPTS_INTERN;
+  dwg->intern = intern;
+  if (dwg_read_file((char *)path, dwg) || dwg->intern != intern
+      || dwg->intern_owned)
+    return test_result(1, "dwg_read_file %s", path);
+  return 0;
+}
+
+static int
+check(const char *path)
+{
+  Dwg_Intern *intern = dwg_intern_new();
+  Dwg_Data a, b;
+  long unsigned int i, layers = 0;
+  const char *layer0 = NULL;
+  int failed = 0;
+
+  if (read_interned(path, &a, intern))
+    {
+      dwg_free(&a);
+      dwg_intern_free(intern);
+      return 1;
+    }
+  if (read_interned(path, &b, intern) || a.num_objects != b.num_objects
+      || a.num_classes != b.num_classes)
+    failed = 1;
+  for (i = 0; !failed && i < a.num_classes; i++)
+    if (a.dwg_class[i].dxfname != b.dwg_class[i].dxfname)
+      failed = 1;
+  for (i = 0; !failed && i < a.num_objects; i++)
+    {
+      if (a.object[i].type != DWG_TYPE_LAYER || !a.object[i].tio.object)
+        continue;
+      layers++;
+      if (!a.object[i].tio.object->tio.LAYER->entry_name
+          || a.object[i].tio.object->tio.LAYER->entry_name
+                 != b.object[i].tio.object->tio.LAYER->entry_name)
+        failed = 1;
+      else if (a.header.version < R_2007
+               && !strcmp(a.object[i].tio.object->tio.LAYER->entry_name, "0"))
+        layer0 = a.object[i].tio.object->tio.LAYER->entry_name;
+    }
+  if (!layers || (a.header.version < R_2007 && layer0 != dwg_intern(intern, "0")))
+    failed = 1;
+  dwg_free(&a);
+  /* still there */
+  for (i = 0; !failed && i < b.num_classes; i++)
+    if (!b.dwg_class[i].dxfname || !*b.dwg_class[i].dxfname)
+      failed = 1;
+  if (layer0 && strcmp(layer0, "0"))
+    failed = 1;
+  for (i = 0; !failed && i < b.num_objects; i++)
+    if (b.object[i].type == DWG_TYPE_APPID && b.object[i].tio.object)
+      {
+        int error;
+        dwg_obj_appid_set_entry_name(b.object[i].tio.object->tio.APPID,
+                                     (char *)dwg_intern(intern, "0"),
+                                     &error);
+        break;
+      }
+  dwg_free(&b);
+  dwg_intern_free(intern);
+  return test_result(failed, "%s: %lu layers", path, layers);
+}
+
+/* without a table the drawing has its own, without the bit none */
+static int
+check_owned(const char *path)
+{
+  Dwg_Data dwg;
+  int failed = 0;
+
+  memset(&dwg, 0, sizeof(Dwg_Data));
+  dwg.opts = DWG_OPTS_INTERN;
+  if (dwg_read_file((char *)path, &dwg) || !dwg.intern || !dwg.intern_owned)
+    failed = 1;
+  dwg_free(&dwg);
+  if (dwg.intern)
+    failed = 1;
+
+  memset(&dwg, 0, sizeof(Dwg_Data));
+  dwg.intern = (Dwg_Intern *)&dwg;
+  if (dwg_read_file((char *)path, &dwg) || dwg.intern)
+    failed = 1;
+  dwg_free(&dwg);
+  return test_result(failed, "%s: own table", path);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int failures = test_paths(files, NUM_FILES(files), check);
+
+  failures += test_paths(files, NUM_FILES(files), check_owned);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,157 @@
+/* Decode DWG files and check that every LAYER is found by its name in
+   any case, and that the layer index lists the entities of each layer,
+   of the drawing and of the model space, as a scan finds them, also
+   when the handles and strings are deferred, which building the index
+   leaves deferred. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwg.h"
+#include "fixture.c"
+
+static const char *files[] = {
+  "example_2000.dwg",
+  "r14/Leader_r14.dwg",
+  "2004/Leader_2004.dwg",
+  "2007/Leader_2007.dwg",
+};
+
+static Dwg_Object *
+layer_of(Dwg_Object *obj)
+{
+  Dwg_Object_Entity *ent = obj->tio.entity;
+
+  if (obj->supertype != DWG_SUPERTYPE_ENTITY || !ent
+      || dwg_decode_handles(obj) || !ent->layer)
+    return NULL;
+  return ent->layer->obj;
+}
+
+static int
+check_names(Dwg_Data *dwg, Dwg_Object *layer)
+{
+  char name[256], other[256];
+  int len = dwg_text_utf8(layer, &layer->tio.object->tio.LAYER->entry_name,
+                          name, sizeof(name));
+  size_t i;
+
+  if (len < 0 || len >= (int)sizeof(other))
+    return 1;
+  for (i = 0; name[i]; i++)
+    {
+      char c = name[i];
+      other[i] = c >= 'a' && c <= 'z'   ? c - 32
+                 : c >= 'A' && c <= 'Z' ? c + 32
+                                        : c;
+    }
+  other[i] = '\0';
+  return dwg_find_layer(dwg, name) != layer
+         || dwg_find_layer(dwg, other) != layer;
+}
+
+/* the entities of layer, owned by block if not NULL, in ascending
+   order */
+static int
+check_entities(Dwg_Object *layer, Dwg_Object *block, const char *owned)
+{
+  Dwg_Data *dwg = layer->parent;
+  const unsigned int *entities;
+  unsigned int num, j = 0;
+  long unsigned int i;
+
+  entities = block ? dwg_block_layer_entities(block, layer, &num)
+                   : dwg_layer_entities(layer, &num);
+  for (i = 0; i < dwg->num_objects; i++)
+    if (layer_of(&dwg->object[i]) == layer && (!owned || owned[i]))
+      {
+        if (block && (j >= num || entities[j] != i))
+          return 1;
+        j++;
+      }
+  if (j != num)
+    return 1;
+  /* all of the drawing, grouped by block */
+  for (j = 0; !block && j < num; j++)
+    if (layer_of(&dwg->object[entities[j]]) != layer)
+      return 1;
+  return 0;
+}
+
+static long unsigned int
+num_deferred(const Dwg_Data *dwg)
+{
+  long unsigned int i, num = 0;
+
+  for (i = 0; i < dwg->num_objects; i++)
+    num += dwg->object[i].handles_deferred;
+  return num;
+}
+
+static int
+check(const char *path, Dwg_Data *dwg)
+{
+  Dwg_Object_Ref *mspace = dwg->header_vars.BLOCK_RECORD_MSPACE;
+  char *owned = calloc(dwg->num_objects, 1);
+  Dwg_Owned_Iterator iter;
+  Dwg_Object *obj;
+  long unsigned int i, num_layers = 0, num_entities = 0;
+  long unsigned int deferred = num_deferred(dwg);
+
+  if (!mspace || !mspace->obj || !dwg_find_layer(dwg, "0")
+      || dwg_find_layer(dwg, "no such layer")
+      || num_deferred(dwg) != deferred)
+    {
+      printf("not ok: %s: dwg_find_layer\n", path);
+      free(owned);
+      return 1;
+    }
+  for (obj = dwg_first_owned(mspace->obj, &iter); obj;
+       obj = dwg_next_owned(&iter))
+    owned[obj->index] = 1;
+  for (i = 0; i < dwg->num_objects; i++)
+    {
+      Dwg_Object *layer = &dwg->object[i];
+      unsigned int num;
+      if (layer->type != DWG_TYPE_LAYER || !layer->tio.object)
+        continue;
+      num_layers++;
+      if (dwg_layer_entities(layer, &num))
+        num_entities += num;
+      if (check_names(dwg, layer))
+        {
+          printf("not ok: %s: layer %lu by name\n", path, i);
+          free(owned);
+          return 1;
+        }
+      if (check_entities(layer, NULL, NULL)
+          || check_entities(layer, mspace->obj, owned))
+        {
+          printf("not ok: %s: entities of layer %lu\n", path, i);
+          free(owned);
+          return 1;
+        }
+    }
+  free(owned);
+  /* every version has the layer handles */
+  if (!num_entities)
+    {
+      printf("not ok: %s: no entities on %lu layers\n", path, num_layers);
+      return 1;
+    }
+  printf("ok: %s: %lu layers, %lu entities\n", path, num_layers,
+         num_entities);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int failures = test_files(files, NUM_FILES(files), 0, check);
+
+  /* again with deferred handles and strings */
+  failures += test_files(files, NUM_FILES(files),
+                         DWG_OPTS_LAZY_HANDLES | DWG_OPTS_LAZY_STRINGS, check);
+  return failures ? 1 : 0;
+}
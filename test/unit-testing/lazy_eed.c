@@ -0,0 +1,235 @@
+/* Decode DWG files with DWG_OPTS_LAZY_EED, iterate over the raw EED blocks
+   by APPID, parse them on demand, and compare them with an eager decode.
+   An invalid string length must skip its block only. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwg.h"
+#include "common.h"
+#include "fixture.c"
+#include "dwg_api.h"
+
+static const char *files[] = {
+  "example_2000.dwg",
+  "2000/Text.dwg",
+  "2004/Leader_2004.dwg",
+  "2007/Leader_2007.dwg",
+  "r14/Leader_r14.dwg",
+};
+
+/* both are parsed */
+static int
+compare_eed(Dwg_Eed *a, Dwg_Eed *b, unsigned int num_eed)
+{
+  unsigned int i;
+
+  for (i = 0; i < num_eed; i++)
+    {
+      if (a[i].size != b[i].size
+          || a[i].handle.value != b[i].handle.value
+          || (a[i].size && memcmp(a[i].raw, b[i].raw, a[i].size))
+          || !a[i].data || !b[i].data
+          || a[i].data->code != b[i].data->code)
+        return 1;
+      switch (a[i].data->code)
+        {
+        case 70:
+          if (a[i].data->u.eed_70.rs != b[i].data->u.eed_70.rs)
+            return 1;
+          break;
+        case 40: case 41: case 42:
+          if (a[i].data->u.eed_40.real != b[i].data->u.eed_40.real)
+            return 1;
+          break;
+        default:
+          break;
+        }
+    }
+  return 0;
+}
+
+/* the entries of both block by block, but block bad of b without data */
+static int
+compare_blocks(Dwg_Object_Object *ea, Dwg_Object_Object *eb, unsigned int bad)
+{
+  unsigned int ia = 0, ib = 0, block;
+
+  for (block = 0; ia < ea->num_eed; block++)
+    {
+      unsigned int na = 1, nb = 1;
+
+      if (ib >= eb->num_eed)
+        return 1;
+      while (ia + na < ea->num_eed && !ea->eed[ia + na].size)
+        na++;
+      while (ib + nb < eb->num_eed && !eb->eed[ib + nb].size)
+        nb++;
+      if (block == bad ? nb != 1 || eb->eed[ib].data
+                           || eb->eed[ib].size != ea->eed[ia].size
+                       : na != nb
+                           || compare_eed(&ea->eed[ia], &eb->eed[ib], na))
+        return 1;
+      ia += na;
+      ib += nb;
+    }
+  return ib != eb->num_eed;
+}
+
+/* Before r2007, give the string at the start of an EED block of a deferred
+   object with more blocks an invalid length, and parse it. Returns the
+   index of the object, 0 if there is none, or -1 if it failed. */
+static long
+check_invalid_string(Dwg_Data *a, Dwg_Data *b)
+{
+  long unsigned int i;
+
+  if (b->header.version >= R_2007)
+    return 0;
+  for (i = 0; i < b->num_objects; i++)
+    {
+      Dwg_Object *ob = &b->object[i];
+      Dwg_Object_Object *ea, *eb;
+      unsigned int j, block, num_eed;
+      int error;
+
+      if (!ob->eed_deferred || ob->tio.object->num_eed < 2)
+        continue;
+      ea = (Dwg_Object_Object *)a->object[i].tio.object;
+      eb = (Dwg_Object_Object *)ob->tio.object;
+      for (j = 0, block = 0; j < ea->num_eed; j++)
+        {
+          unsigned char *raw = (unsigned char *)ea->eed[j].raw;
+          if (!ea->eed[j].size)
+            continue;
+          if (raw[0] == 0 && ea->eed[j].size >= 4 && ea->eed[j].size < 259)
+            break;
+          block++;
+        }
+      if (j == ea->num_eed)
+        continue;
+      ((unsigned char *)eb->eed[block].raw)[1] = 0xff;
+      num_eed = ob->supertype == DWG_SUPERTYPE_ENTITY
+        ? dwg_ent_get_num_eed(ob->tio.entity, &error)
+        : dwg_obj_get_num_eed(ob->tio.object, &error);
+      if (num_eed != eb->num_eed || error || compare_blocks(ea, eb, block))
+        return -1;
+      return (long)i;
+    }
+  return 0;
+}
+
+static int
+compare(const char *path, Dwg_Data *a, Dwg_Data *b)
+{
+  long unsigned int i, deferred = 0, blocks = 0, appid_blocks = 0;
+  long invalid;
+  Dwg_Object *appid = NULL;
+
+  if (a->num_objects != b->num_objects)
+    {
+      printf("not ok: %s: %lu objects, expected %lu\n", path,
+             b->num_objects, a->num_objects);
+      return 1;
+    }
+  invalid = check_invalid_string(a, b);
+  if (invalid < 0)
+    {
+      printf("not ok: %s: invalid EED string\n", path);
+      return 1;
+    }
+  if (invalid)
+    printf("ok: %s: object[%ld] invalid EED string skipped\n", path,
+           invalid);
+  /* the APPID of the first EED, mostly ACAD */
+  for (i = 0; i < a->num_objects && !appid; i++)
+    {
+      Dwg_Object_Object *oa = (Dwg_Object_Object *)a->object[i].tio.object;
+      if (a->object[i].supertype != DWG_SUPERTYPE_UNKNOWN && oa
+          && oa->num_eed)
+        {
+          long unsigned int j;
+          for (j = 0; j < b->num_objects; j++)
+            if (b->object[j].handle.value == oa->eed[0].handle.value)
+              appid = &b->object[j];
+        }
+    }
+
+  for (i = 0; i < a->num_objects; i++)
+    {
+      Dwg_Object *oa = &a->object[i];
+      Dwg_Object *ob = &b->object[i];
+      Dwg_Object_Object *ea, *eb;
+      Dwg_Eed *eed;
+      unsigned int j, n = 0, num_blocks = 0, num_appid = 0, num_eed;
+      int error;
+
+      if (!ob->eed_deferred)
+        continue;
+      deferred++;
+      /* entities and objects start alike */
+      ea = (Dwg_Object_Object *)oa->tio.object;
+      eb = (Dwg_Object_Object *)ob->tio.object;
+      for (j = 0; j < ea->num_eed; j++)
+        if (ea->eed[j].size)
+          {
+            num_blocks++;
+            if (appid && ea->eed[j].handle.value == appid->handle.value)
+              num_appid++;
+          }
+      /* the unparsed blocks */
+      j = 0;
+      while ((eed = ob->supertype == DWG_SUPERTYPE_ENTITY
+              ? dwg_ent_get_eed_appid(ob->tio.entity, NULL, &j, &error)
+              : dwg_obj_get_eed_appid(ob->tio.object, NULL, &j, &error)))
+        n++;
+      if (n != num_blocks || eb->num_eed != num_blocks)
+        {
+          printf("not ok: %s: object[%lu] %u EED blocks, expected %u\n",
+                 path, i, n, num_blocks);
+          return 1;
+        }
+      for (j = 0, n = 0;
+           (eed = ob->supertype == DWG_SUPERTYPE_ENTITY
+            ? dwg_ent_get_eed_appid(ob->tio.entity, appid, &j, &error)
+            : dwg_obj_get_eed_appid(ob->tio.object, appid, &j, &error));
+           n++)
+        if (eed->data)
+          return 1;
+      if (n != num_appid)
+        {
+          printf("not ok: %s: object[%lu] %u EED blocks for APPID, "
+                 "expected %u\n", path, i, n, num_appid);
+          return 1;
+        }
+      blocks += num_blocks;
+      appid_blocks += num_appid;
+      /* parsed on first use */
+      num_eed = ob->supertype == DWG_SUPERTYPE_ENTITY
+        ? dwg_ent_get_num_eed(ob->tio.entity, &error)
+        : dwg_obj_get_num_eed(ob->tio.object, &error);
+      if (num_eed != ea->num_eed || error || ob->eed_deferred
+          || compare_eed(ea->eed, eb->eed, ea->num_eed))
+        {
+          printf("not ok: %s: object[%lu] EED differs\n", path, i);
+          return 1;
+        }
+    }
+  if (!deferred || !appid_blocks)
+    {
+      printf("not ok: %s: no EED deferred\n", path);
+      return 1;
+    }
+  printf("ok: %s: %lu EED blocks of %lu objects, %lu for APPID %lu\n",
+         path, blocks, deferred, appid_blocks, appid->handle.value);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int failures = test_file_pairs(files, NUM_FILES(files), 0,
+                                 DWG_OPTS_LAZY_EED, compare);
+  return failures ? 1 : 0;
+}
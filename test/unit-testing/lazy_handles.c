@@ -0,0 +1,190 @@
+/* Decode R2007 DWG files with DWG_OPTS_LAZY_HANDLES, read the handles of
+   each object on demand, and compare them with an eager decode. Resolving
+   a reference to an object must not read its handles, nor reading one
+   entity handle alone. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwg.h"
+#include "dwg_api.h"
+#include "decode.h"
+#include "fixture.c"
+
+static const char *files[] = {
+  "2007/Arc.dwg",
+  "2007/Leader_2007.dwg",
+  "2007/Line.dwg",
+  "2007/Multiline.dwg",
+  "2007/Text.dwg",
+};
+
+static long
+ref_index(Dwg_Object_Ref *ref)
+{
+  if (!ref)
+    return -2;
+  return ref->obj ? (long)ref->obj->index : -1;
+}
+
+static int
+compare_refs(Dwg_Object_Ref *a, Dwg_Object_Ref *b)
+{
+  return ref_index(a) != ref_index(b)
+    || (a && a->absolute_ref != b->absolute_ref);
+}
+
+/* the handle after the common entity handles and skip more, read alone
+   from ob, against the eager ref of oa */
+static int
+compare_handle(Dwg_Object *ob, unsigned int skip, Dwg_Object_Ref *ref)
+{
+  Dwg_Data *dwg = ob->parent;
+  long unsigned int num_object_refs = dwg->num_object_refs;
+  Dwg_Object *obj = dwg_decode_entity_handle(ob, skip);
+  long expected = ref_index(ref);
+
+  return (obj ? (long)obj->index : -1) != (expected == -2 ? -1 : expected)
+         || !ob->handles_deferred || dwg->num_object_refs != num_object_refs;
+}
+
+/* the handles of LEADER and MLINE read alone */
+static int
+compare_handles(Dwg_Object *oa, Dwg_Object *ob)
+{
+  if (oa->type == DWG_TYPE_LEADER)
+    {
+      Dwg_Entity_LEADER *la = oa->tio.entity->tio.LEADER;
+      return compare_handle(ob, 0, la->associated_annotation)
+             || compare_handle(ob, 1, la->dimstyle);
+    }
+  if (oa->type == DWG_TYPE_MLINE)
+    return compare_handle(ob, 0, oa->tio.entity->tio.MLINE->mlinestyle);
+  return 0;
+}
+
+/* The handles after dwg_decode_handles, and the data before */
+static int
+compare_object(Dwg_Object *oa, Dwg_Object *ob)
+{
+  unsigned int j;
+
+  if (oa->supertype == DWG_SUPERTYPE_ENTITY)
+    {
+      Dwg_Object_Entity *ea = oa->tio.entity;
+      Dwg_Object_Entity *eb = ob->tio.entity;
+
+      if (ea->entity_mode != eb->entity_mode
+          || ea->num_reactors != eb->num_reactors
+          || eb->subentity || eb->xdicobjhandle
+          || dwg_decode_handles(ob)
+          || compare_refs(ea->subentity, eb->subentity)
+          || compare_refs(ea->xdicobjhandle, eb->xdicobjhandle)
+          || compare_refs(ea->color_handle, eb->color_handle)
+          || compare_refs(ea->plotstyle, eb->plotstyle))
+        return 1;
+      for (j = 0; j < ea->num_reactors; j++)
+        if (compare_refs(ea->reactors[j], eb->reactors[j]))
+          return 1;
+    }
+  else if (oa->type == DWG_TYPE_DICTIONARY)
+    {
+      Dwg_Object_DICTIONARY *da = oa->tio.object->tio.DICTIONARY;
+      Dwg_Object_DICTIONARY *db = ob->tio.object->tio.DICTIONARY;
+
+      if (da->numitems != db->numitems || db->parenthandle
+          || dwg_decode_handles(ob)
+          || compare_refs(da->parenthandle, db->parenthandle))
+        return 1;
+      for (j = 0; j < da->numitems; j++)
+        if (compare_refs(da->itemhandles[j], db->itemhandles[j]))
+          return 1;
+    }
+  else if (dwg_decode_handles(ob))
+    return 1;
+  return ob->handles_deferred;
+}
+
+/* the references to deferred objects, which stay deferred */
+static long unsigned int
+resolve_refs(Dwg_Data *dwg)
+{
+  long unsigned int i, num = 0;
+  int error;
+
+  for (i = 0; i < dwg->num_object_refs; i++)
+    {
+      Dwg_Object_Ref *ref = dwg->object_ref[i];
+
+      if (!ref->obj || !ref->obj->handles_deferred)
+        continue;
+      if (dwg_ref_get_object(ref) != ref->obj
+          || dwg_obj_reference_get_object(ref, &error) != ref->obj || error
+          || !ref->obj->handles_deferred)
+        return 0;
+      if (ref->obj->supertype == DWG_SUPERTYPE_ENTITY
+          && dwg_get_entity_layer(ref->obj->tio.entity))
+        return 0;
+      num++;
+    }
+  return num;
+}
+
+static int
+compare(const char *path, Dwg_Data *a, Dwg_Data *b)
+{
+  long unsigned int i, deferred = 0, single = 0;
+
+  if (a->num_objects != b->num_objects)
+    {
+      printf("not ok: %s: %lu objects, expected %lu\n", path,
+             b->num_objects, a->num_objects);
+      return 1;
+    }
+  if (b->num_object_refs >= a->num_object_refs)
+    {
+      printf("not ok: %s: %lu refs before use, eager %lu\n", path,
+             b->num_object_refs, a->num_object_refs);
+      return 1;
+    }
+  if (!resolve_refs(b))
+    {
+      printf("not ok: %s: references to deferred objects\n", path);
+      return 1;
+    }
+  for (i = 0; i < a->num_objects; i++)
+    {
+      Dwg_Object *oa = &a->object[i];
+      Dwg_Object *ob = &b->object[i];
+
+      if (!ob->handles_deferred)
+        continue;
+      deferred++;
+      if (oa->type == DWG_TYPE_LEADER || oa->type == DWG_TYPE_MLINE)
+        single++;
+      if (oa->type != ob->type || compare_handles(oa, ob)
+          || compare_object(oa, ob))
+        {
+          printf("not ok: %s: object[%lu] type %u differs\n", path, i,
+                 ob->type);
+          return 1;
+        }
+    }
+  if (!deferred)
+    {
+      printf("not ok: %s: no handles deferred\n", path);
+      return 1;
+    }
+  printf("ok: %s: %lu of %lu objects deferred, %lu handles read alone\n",
+         path, deferred, b->num_objects, single);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int failures = test_file_pairs(files, NUM_FILES(files), 0,
+                                 DWG_OPTS_LAZY_HANDLES, compare);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,110 @@
+/* Decode R2007 DWG files with DWG_OPTS_LAZY_STRINGS, read the strings of
+   each object on demand, and compare them with an eager decode, also as
+   UTF-8. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwg.h"
+#include "fixture.c"
+
+static const char *files[] = {
+  "2007/Arc.dwg",
+  "2007/Leader_2007.dwg",
+  "2007/Multiline.dwg",
+  "2007/Text.dwg",
+};
+
+/* compare as UTF-8, once into a buffer and once cut. The text of ob is
+   still deferred, dwg_text_utf8 reads it. */
+static int
+compare_text(Dwg_Object *oa, char **ta, Dwg_Object *ob, char **tb)
+{
+  char bufa[256], bufb[256], cut[4];
+  int la = dwg_text_utf8(oa, ta, bufa, sizeof(bufa));
+  int lb = dwg_text_utf8(ob, tb, bufb, sizeof(bufb));
+  int lc = dwg_text_utf8(ob, tb, cut, sizeof(cut));
+
+  return la < 0 || la != lb || lb != lc || !*ta != !*tb
+         || ob->strings_deferred || strcmp(bufa, bufb)
+         || strncmp(cut, bufb, strlen(cut))
+         || (lb < (int)sizeof(cut) && strcmp(cut, bufb));
+}
+
+/* The strings after dwg_text_utf8, and the data before */
+static int
+compare_object(Dwg_Object *oa, Dwg_Object *ob)
+{
+  switch (ob->type)
+    {
+    case DWG_TYPE_TEXT:
+      {
+        Dwg_Entity_TEXT *ta = oa->tio.entity->tio.TEXT;
+        Dwg_Entity_TEXT *tb = ob->tio.entity->tio.TEXT;
+        return ta->height != tb->height || tb->text_value
+          || compare_text(oa, &ta->text_value, ob, &tb->text_value);
+      }
+    case DWG_TYPE_MTEXT:
+      {
+        Dwg_Entity_MTEXT *ta = oa->tio.entity->tio.MTEXT;
+        Dwg_Entity_MTEXT *tb = ob->tio.entity->tio.MTEXT;
+        return ta->text_height != tb->text_height || tb->text
+          || compare_text(oa, &ta->text, ob, &tb->text);
+      }
+    case DWG_TYPE_MLINESTYLE:
+      {
+        Dwg_Object_MLINESTYLE *ma = oa->tio.object->tio.MLINESTYLE;
+        Dwg_Object_MLINESTYLE *mb = ob->tio.object->tio.MLINESTYLE;
+        return ma->flag != mb->flag || mb->name || mb->desc
+          || compare_text(oa, &ma->name, ob, &mb->name)
+          || compare_text(oa, &ma->desc, ob, &mb->desc);
+      }
+    default:
+      return dwg_decode_strings(ob) || ob->strings_deferred;
+    }
+}
+
+static int
+compare(const char *path, Dwg_Data *a, Dwg_Data *b)
+{
+  long unsigned int i, deferred = 0;
+
+  if (a->num_objects != b->num_objects)
+    {
+      printf("not ok: %s: %lu objects, expected %lu\n", path,
+             b->num_objects, a->num_objects);
+      return 1;
+    }
+  for (i = 0; i < a->num_objects; i++)
+    {
+      Dwg_Object *oa = &a->object[i];
+      Dwg_Object *ob = &b->object[i];
+
+      if (!ob->strings_deferred)
+        continue;
+      deferred++;
+      if (oa->type != ob->type || compare_object(oa, ob))
+        {
+          printf("not ok: %s: object[%lu] type %u differs\n", path, i,
+                 ob->type);
+          return 1;
+        }
+    }
+  if (!deferred)
+    {
+      printf("not ok: %s: no strings deferred\n", path);
+      return 1;
+    }
+  printf("ok: %s: %lu of %lu objects deferred\n", path, deferred,
+         b->num_objects);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int failures = test_file_pairs(files, NUM_FILES(files), 0,
+                                 DWG_OPTS_LAZY_STRINGS, compare);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,95 @@
+/* Decode DWG files with a log sink, and check that it receives whole
+   lines only, with the level of their most severe part. */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwg.h"
+#include "logging.h"
+#include "fixture.c"
+
+static const char *files[] = {
+  "example_2000.dwg",
+  "2004/Leader_2004.dwg",
+};
+
+struct sink_state
+{
+  long unsigned int lines;
+  long unsigned int bad;
+  int min_level;
+};
+
+static void
+sink(int level, const char *msg, size_t len, void *userdata)
+{
+  struct sink_state *state = (struct sink_state *)userdata;
+
+  if (!len || strlen(msg) != len || msg[len - 1] != '\n')
+    state->bad++;
+  if (level < state->min_level)
+    state->min_level = level;
+  state->lines++;
+}
+
+/* partial lines are kept until their end, or dwg_log_flush */
+static int
+check_lines(void)
+{
+  struct sink_state state = { 0, 0, DWG_LOGLEVEL_ALL };
+  char *longmsg = malloc(3000);
+  int failures = 0;
+
+  dwg_set_log_sink(sink, &state);
+  dwg_log(DWG_LOGLEVEL_TRACE, "a");
+  dwg_log(DWG_LOGLEVEL_ERROR, "b");
+  if (state.lines)
+    failures++;
+  dwg_log(DWG_LOGLEVEL_TRACE, "c\nd");
+  if (state.lines != 1 || state.bad || state.min_level != DWG_LOGLEVEL_ERROR)
+    failures++;
+  /* longer than the buffer: the pending "d" first, then the cut message */
+  memset(longmsg, 'x', 2999);
+  longmsg[2998] = '\n';
+  longmsg[2999] = '\0';
+  state.min_level = DWG_LOGLEVEL_ALL;
+  dwg_log(DWG_LOGLEVEL_INFO, "%s", longmsg);
+  if (state.lines != 3 || state.min_level != DWG_LOGLEVEL_INFO)
+    failures++;
+  dwg_log(DWG_LOGLEVEL_INFO, "e");
+  dwg_log_flush();
+  if (state.lines != 4)
+    failures++;
+  dwg_set_log_sink(NULL, NULL);
+  free(longmsg);
+  return test_result(failures, "partial and long lines");
+}
+
+static int
+check(const char *path)
+{
+  struct sink_state state = { 0, 0, DWG_LOGLEVEL_ALL };
+  Dwg_Data dwg;
+  int failures;
+
+  dwg_set_log_sink(sink, &state);
+  failures = test_read(path, &dwg, DWG_LOGLEVEL_TRACE);
+  dwg_free(&dwg);
+  dwg_set_log_sink(NULL, NULL);
+  return failures
+         + test_result(state.bad || (DWG_LOGLEVEL_MAX >= DWG_LOGLEVEL_TRACE
+                                     && !state.lines),
+                       "%s: %lu lines, %lu not whole", path, state.lines,
+                       state.bad);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int failures = check_lines();
+
+  failures += test_paths(files, NUM_FILES(files), check);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,73 @@
+/* Decode DWG files and check that dwg_object_index() mirrors dwg->object,
+   and that every decoded struct points back to its object after the
+   array grew in chunks. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwg.h"
+#include "fixture.c"
+
+static const char *files[] = {
+  "example_2000.dwg",
+  "2000/Leader_2000.dwg",
+  "2004/Leader_2004.dwg",
+  "2007/Leader_2007.dwg",
+  "r14/Leader_r14.dwg",
+};
+
+static int
+check(const char *path, Dwg_Data *dwg)
+{
+  const Dwg_Object_Index *index = dwg_object_index(dwg);
+  Dwg_Object_Entity **entities;
+  long unsigned int i, num_entities = 0;
+
+  if (!index || dwg->num_alloced_objects < dwg->num_objects
+      || dwg_object_index(dwg) != index)
+    {
+      printf("not ok: %s: no index\n", path);
+      return 1;
+    }
+  for (i = 0; i < dwg->num_objects; i++)
+    {
+      Dwg_Object *obj = &dwg->object[i];
+      if (index[i].handle != obj->handle.value || index[i].index != i
+          || index[i].type != obj->type
+          || index[i].supertype != obj->supertype)
+        {
+          printf("not ok: %s: index of object %lu\n", path, i);
+          return 1;
+        }
+      if (obj->supertype == DWG_SUPERTYPE_ENTITY)
+        num_entities++;
+      if ((obj->supertype == DWG_SUPERTYPE_ENTITY
+           && obj->tio.entity && obj->tio.entity->object != obj)
+          || (obj->supertype == DWG_SUPERTYPE_OBJECT
+              && obj->tio.object && obj->tio.object->object != obj))
+        {
+          printf("not ok: %s: object %lu points elsewhere\n", path, i);
+          return 1;
+        }
+    }
+  entities = dwg_get_entities(dwg);
+  for (i = 0; entities && i < num_entities; i++)
+    if (!entities[i] || entities[i]->object->supertype != DWG_SUPERTYPE_ENTITY)
+      break;
+  free(entities);
+  if (i != num_entities)
+    {
+      printf("not ok: %s: dwg_get_entities\n", path);
+      return 1;
+    }
+  printf("ok: %s: %lu objects, %lu entities\n", path, dwg->num_objects,
+         num_entities);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  return test_files(files, NUM_FILES(files), 0, check) ? 1 : 0;
+}
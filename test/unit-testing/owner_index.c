@@ -0,0 +1,148 @@
+/* Decode DWG files and check that the owner index of the model space
+   holds the same entities as it lists or their owner handles, each
+   followed by its own, and that two iterators over it do not disturb
+   each other. The legacy get_first_owned_object() keeps its order. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwg.h"
+#include "fixture.c"
+#include "common.h"
+
+static const char *files[] = {
+  "example_2000.dwg",
+  "r14/Leader_r14.dwg",
+  "2000/Leader_2000.dwg",
+  "2004/Leader_2004.dwg",
+  "2007/Leader_2007.dwg",
+};
+
+/* the entities of the block, as listed by it, or before R2004 as
+   owned by their entity mode or owner handle */
+static long unsigned int
+mark_listed(Dwg_Data *dwg, Dwg_Object *hdr_obj, char *listed)
+{
+  Dwg_Object_BLOCK_HEADER *hdr = hdr_obj->tio.object->tio.BLOCK_HEADER;
+  long unsigned int i, num = 0;
+
+  if (dwg->header.version >= R_2004)
+    {
+      for (i = 0; i < hdr->owned_object_count; i++)
+        if (hdr->entities[i] && hdr->entities[i]->obj)
+          {
+            listed[hdr->entities[i]->obj->index] = 1;
+            num++;
+          }
+      return num;
+    }
+  for (i = 0; i < dwg->num_objects; i++)
+    {
+      Dwg_Object *obj = &dwg->object[i];
+      Dwg_Object_Entity *ent = obj->tio.entity;
+
+      if (obj->supertype != DWG_SUPERTYPE_ENTITY || !ent
+          || obj->type == DWG_TYPE_BLOCK || obj->type == DWG_TYPE_ENDBLK)
+        continue;
+      if (ent->entity_mode == 2
+          || (ent->entity_mode == 0 && ent->subentity
+              && ent->subentity->absolute_ref == hdr_obj->handle.value))
+        {
+          listed[i] = 1;
+          num++;
+        }
+    }
+  return num;
+}
+
+/* by the entity links before R2004, else in the order of the list */
+static int
+check_legacy(Dwg_Object *hdr_obj)
+{
+  Dwg_Object_BLOCK_HEADER *hdr = hdr_obj->tio.object->tio.BLOCK_HEADER;
+  Dwg_Object *obj = get_first_owned_object(hdr_obj, hdr);
+  BITCODE_BL i;
+
+  if (hdr_obj->parent->header.version < R_2004)
+    return !hdr->first_entity || obj != hdr->first_entity->obj;
+  for (i = 0; i < hdr->owned_object_count; i++)
+    {
+      if (!hdr->entities[i] || obj != hdr->entities[i]->obj)
+        return 1;
+      obj = get_next_owned_object(hdr_obj, obj, hdr);
+    }
+  return obj != NULL;
+}
+
+static int
+check(const char *path, Dwg_Data *dwg)
+{
+  Dwg_Object *mspace = dwg->header_vars.BLOCK_RECORD_MSPACE
+                           ? dwg->header_vars.BLOCK_RECORD_MSPACE->obj
+                           : NULL;
+  Dwg_Object_BLOCK_HEADER *hdr;
+  Dwg_Owned_Iterator a, b;
+  Dwg_Object *obj, *obj2, *last = NULL;
+  char *listed;
+  long unsigned int num_listed, num = 0, num_sub = 0;
+  BITCODE_BL iterator;
+
+  if (!mspace || mspace->type != DWG_TYPE_BLOCK_HEADER)
+    {
+      printf("not ok: %s: no model space\n", path);
+      return 1;
+    }
+  hdr = mspace->tio.object->tio.BLOCK_HEADER;
+  iterator = hdr->__iterator;
+  listed = calloc(dwg->num_objects, 1);
+  num_listed = mark_listed(dwg, mspace, listed);
+
+  obj = dwg_first_owned(mspace, &a);
+  obj2 = dwg_first_owned(mspace, &b);
+  while (obj)
+    {
+      if (obj != obj2)
+        break;
+      if (listed[obj->index] == 1)
+        {
+          listed[obj->index] = 2;
+          last = obj;
+          num++;
+        }
+      /* else an attribute, vertex or SEQEND of the last one */
+      else if (last && obj->supertype == DWG_SUPERTYPE_ENTITY
+               && obj->tio.entity->subentity
+               && obj->tio.entity->subentity->absolute_ref
+                      == last->handle.value)
+        num_sub++;
+      else
+        break;
+      obj = dwg_next_owned(&a);
+      /* b behind a */
+      if (obj)
+        obj2 = dwg_next_owned(&b);
+    }
+  free(listed);
+  if (obj || num != num_listed || !num || hdr->__iterator != iterator
+      || dwg_next_owned(&b) || dwg_next_owned(&a))
+    {
+      printf("not ok: %s: %lu of %lu model space entities\n", path, num,
+             num_listed);
+      return 1;
+    }
+  if (check_legacy(mspace))
+    {
+      printf("not ok: %s: get_next_owned_object order\n", path);
+      return 1;
+    }
+  printf("ok: %s: %lu model space entities, %lu owned by them\n", path,
+         num, num_sub);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  return test_files(files, NUM_FILES(files), 0, check) ? 1 : 0;
+}
@@ -0,0 +1,101 @@
+/* Decode the same DWG file with dwg_read_file, dwg_read_memory and
+   dwg_read_fd, from a regular file and from a pipe, and compare. */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+# include <fcntl.h>
+#endif
+
+#include "dwg.h"
+#include "fixture.c"
+
+static int failures;
+
+static void
+check(const char *what, int error, Dwg_Data *dwg, long unsigned int expected)
+{
+  failures += test_result(error || dwg->num_objects != expected,
+                          "%s: error %d, %lu objects, expected %lu", what,
+                          error, dwg->num_objects, expected);
+  if (!error)
+    dwg_free(dwg);
+}
+
+int
+main(int argc, char *argv[])
+{
+  const char *input = getenv("INPUT");
+  Dwg_Data dwg;
+  long unsigned int num_objects;
+  struct stat attrib;
+  unsigned char *buf;
+  FILE *fp;
+  int error;
+
+  if (!input)
+    input = "example_2000.dwg";
+  if (test_read(input, &dwg, 0))
+    return 1;
+  num_objects = dwg.num_objects;
+  dwg_free(&dwg);
+
+  stat(input, &attrib);
+  buf = malloc(attrib.st_size);
+  fp = fopen(input, "rb");
+  if (!buf || !fp || fread(buf, 1, attrib.st_size, fp) != (size_t)attrib.st_size)
+    return test_result(1, "reading %s", input);
+  fclose(fp);
+
+  memset(&dwg, 0, sizeof(Dwg_Data));
+  error = dwg_read_memory(buf, attrib.st_size, &dwg);
+  check("dwg_read_memory", error, &dwg, num_objects);
+
+  memset(&dwg, 0, sizeof(Dwg_Data));
+  error = dwg_read_memory(buf, 3, &dwg);
+  failures += test_result(!error, "dwg_read_memory of a truncated buffer");
+
+#ifdef HAVE_UNISTD_H
+  {
+    int fds[2];
+    int fd = open(input, O_RDONLY);
+
+    memset(&dwg, 0, sizeof(Dwg_Data));
+    error = dwg_read_fd(fd, &dwg);
+    check("dwg_read_fd file", error, &dwg, num_objects);
+    close(fd);
+
+    /* a pipe cannot be mapped, it is read until EOF */
+    if (!pipe(fds))
+      {
+        pid_t pid = fork();
+        if (pid == 0)
+          {
+            ssize_t off = 0;
+            close(fds[0]);
+            while (off < attrib.st_size)
+              {
+                ssize_t n = write(fds[1], buf + off, attrib.st_size - off);
+                if (n <= 0)
+                  break;
+                off += n;
+              }
+            close(fds[1]);
+            _exit(0);
+          }
+        close(fds[1]);
+        memset(&dwg, 0, sizeof(Dwg_Data));
+        error = dwg_read_fd(fds[0], &dwg);
+        check("dwg_read_fd pipe", error, &dwg, num_objects);
+        close(fds[0]);
+      }
+  }
+#endif
+
+  free(buf);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,110 @@
+/* Decode DWG files and check that the SAT blocks of each 3DSOLID, REGION
+   and BODY are one buffer, which is only de-obfuscated into a new one by
+   the first call of its raw_sat_data getter, and left as read. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwg.h"
+#include "fixture.c"
+#include "dwg_api.h"
+
+static const char *files[] = {
+  "example_2000.dwg",
+};
+
+/* the getter of the type of obj */
+static char *
+get_raw_sat_data(Dwg_Object *obj, int *error)
+{
+  Dwg_Entity_3DSOLID *_obj = obj->tio.entity->tio._3DSOLID;
+
+  if (obj->type == DWG_TYPE_REGION)
+    return dwg_ent_region_get_raw_sat_data(_obj, error);
+  if (obj->type == DWG_TYPE_BODY)
+    return dwg_ent_body_get_raw_sat_data(_obj, error);
+  return dwg_ent_3dsolid_get_raw_sat_data(_obj, error);
+}
+
+static int
+check_sat(Dwg_Object *obj)
+{
+  Dwg_Entity_3DSOLID *_obj = obj->tio.entity->tio._3DSOLID;
+  unsigned char *sat, *expected, *blocks;
+  char *acis_data;
+  unsigned long size = 0, i;
+  BITCODE_BL j;
+  int error, failed = 0;
+
+  if (_obj->acis_empty || _obj->version != 1)
+    return 0;
+  if (_obj->raw_sat_data || !_obj->sat_data || !_obj->num_blocks)
+    return 1;
+  for (j = 0; j < _obj->num_blocks; j++)
+    {
+      if (_obj->sat_data[j] != _obj->sat_data[0] + size)
+        return 1;
+      size += _obj->block_size[j];
+    }
+  /* the de-obfuscation of one byte at a time, as before */
+  expected = malloc(size + 1);
+  blocks = malloc(size);
+  memcpy(blocks, _obj->sat_data[0], size);
+  for (i = 0; i < size; i++)
+    {
+      unsigned char c = blocks[i];
+      expected[i] = c <= 32 ? c : 159 - c;
+    }
+  expected[size] = '\0';
+  /* acis_data is not decoded SAT data */
+  acis_data = dwg_ent_3dsolid_get_acis_data(_obj, &error);
+  if (error || acis_data != (char *)_obj->acis_data || _obj->raw_sat_data)
+    failed = 1;
+  sat = (unsigned char *)get_raw_sat_data(obj, &error);
+  if (failed || error || !sat || sat == (unsigned char *)_obj->sat_data[0]
+      || sat != _obj->raw_sat_data || memcmp(sat, expected, size + 1)
+      || memcmp(_obj->sat_data[0], blocks, size))
+    failed = 1;
+  /* the second call keeps it */
+  else if ((unsigned char *)get_raw_sat_data(obj, &error) != sat
+           || memcmp(sat, expected, size + 1))
+    failed = 1;
+  free(expected);
+  free(blocks);
+  return failed;
+}
+
+static int
+check(const char *path, Dwg_Data *dwg)
+{
+  long unsigned int i, solids = 0;
+
+  for (i = 0; i < dwg->num_objects; i++)
+    {
+      Dwg_Object *obj = &dwg->object[i];
+      if ((obj->type != DWG_TYPE_3DSOLID && obj->type != DWG_TYPE_REGION
+           && obj->type != DWG_TYPE_BODY)
+          || !obj->tio.entity)
+        continue;
+      if (check_sat(obj))
+        {
+          printf("not ok: %s: SAT data of %lu\n", path, obj->handle.value);
+          return 1;
+        }
+      solids++;
+    }
+  if (!solids)
+    {
+      printf("not ok: %s: no SAT data\n", path);
+      return 1;
+    }
+  printf("ok: %s: %lu SAT entities\n", path, solids);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  return test_files(files, NUM_FILES(files), 0, check) ? 1 : 0;
+}
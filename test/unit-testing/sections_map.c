@@ -0,0 +1,93 @@
+/* Decode R2007 DWG files from memory with their sections map page
+   overwritten, which must fail instead of going on with a bogus map,
+   with their last pages cut off, and intact. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "dwg.h"
+#include "fixture.c"
+
+/* the file offset and size of the sections map page, page 19 of both */
+static const struct
+{
+  const char *file;
+  long unsigned int offset;
+  long unsigned int size;
+} files[] = {
+  { "2007/Arc.dwg", 64640, 4864 },
+  { "2007/Line.dwg", 64128, 4864 },
+};
+
+static const unsigned char fills[] = { 0x00, 0x55, 0xff };
+
+static int
+read_buffer(const unsigned char *buf, size_t size)
+{
+  Dwg_Data dwg;
+  int error;
+
+  memset(&dwg, 0, sizeof(Dwg_Data));
+  error = dwg_read_memory(buf, size, &dwg);
+  dwg_free(&dwg);
+  return error;
+}
+
+static int
+check(const char *path, long unsigned int offset, long unsigned int size)
+{
+  struct stat attrib;
+  unsigned char *buf, *copy;
+  FILE *fp;
+  int failures = 0;
+  unsigned int i;
+
+  if (stat(path, &attrib) || (long unsigned int)attrib.st_size < offset + size)
+    return test_result(1, "%s: size", path);
+  buf = malloc(attrib.st_size);
+  copy = malloc(attrib.st_size);
+  fp = fopen(path, "rb");
+  if (!buf || !copy || !fp
+      || fread(buf, 1, attrib.st_size, fp) != (size_t)attrib.st_size)
+    {
+      if (fp)
+        fclose(fp);
+      free(buf);
+      free(copy);
+      return test_result(1, "reading %s", path);
+    }
+  fclose(fp);
+
+  failures += test_result(read_buffer(buf, attrib.st_size) != 0,
+                          "%s: intact", path);
+  for (i = 0; i < sizeof(fills); i++)
+    {
+      memcpy(copy, buf, attrib.st_size);
+      memset(copy + offset, fills[i], size);
+      failures += test_result(read_buffer(copy, attrib.st_size) == 0,
+                              "%s: sections map filled with 0x%02X", path,
+                              fills[i]);
+    }
+  failures += test_result(read_buffer(buf, offset + size / 2) == 0,
+                          "%s: cut in the sections map", path);
+  free(buf);
+  free(copy);
+  return failures;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int failures = 0;
+  int i;
+
+  for (i = 0; i < NUM_FILES(files); i++)
+    {
+      char *path = test_path(files[i].file);
+      failures += check(path, files[i].offset, files[i].size);
+      free(path);
+    }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,76 @@
+/* Decode DWG files in object map order and with DWG_OPTS_SEQUENTIAL in
+   file offset order, and compare the objects at each index. The EED of
+   an MLEADERSTYLE depends on the APPID_CONTROL decoded before it, so
+   compare their fields too. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwg.h"
+#include "fixture.c"
+
+static const char *files[] = {
+  "example_2000.dwg",
+  "sample_2000.dwg",
+  "2000/Leader_2000.dwg",
+  "2004/Arc.dwg",
+  "2004/Leader_2004.dwg",
+  "2004/Multiline.dwg",
+  "2007/Arc.dwg",
+  "r14/Leader_r14.dwg",
+};
+
+static int
+same_mleaderstyle(Dwg_Object *oa, Dwg_Object *ob)
+{
+  Dwg_Object_MLEADERSTYLE *a, *b;
+
+  if (!oa->dxfname || strcmp(oa->dxfname, "MLEADERSTYLE"))
+    return 1;
+  if (!oa->tio.object || !ob->tio.object)
+    return oa->tio.object == ob->tio.object;
+  a = oa->tio.object->tio.MLEADERSTYLE;
+  b = ob->tio.object->tio.MLEADERSTYLE;
+  return a->is_new_format == b->is_new_format
+         && a->text_always_left == b->text_always_left
+         && a->scale == b->scale;
+}
+
+static int
+compare(const char *path, Dwg_Data *a, Dwg_Data *b)
+{
+  long unsigned int i;
+
+  if (a->num_objects != b->num_objects)
+    {
+      printf("not ok: %s: %lu objects, expected %lu\n", path,
+             b->num_objects, a->num_objects);
+      return 1;
+    }
+  for (i = 0; i < a->num_objects; i++)
+    {
+      Dwg_Object *oa = &a->object[i];
+      Dwg_Object *ob = &b->object[i];
+      if (oa->type != ob->type || oa->address != ob->address
+          || oa->handle.value != ob->handle.value
+          || oa->supertype != ob->supertype || ob->index != i
+          || !same_mleaderstyle(oa, ob))
+        {
+          printf("not ok: %s: object[%lu] type %u, handle %lX, "
+                 "expected type %u, handle %lX\n", path, i, ob->type,
+                 ob->handle.value, oa->type, oa->handle.value);
+          return 1;
+        }
+    }
+  printf("ok: %s\n", path);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int failures = test_file_pairs(files, NUM_FILES(files), 0,
+                                 DWG_OPTS_SEQUENTIAL, compare);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,94 @@
+/* Decode DWG files and check that the payloads of each object type lie
+   next to each other in decode order, in a few chunks per type. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwg.h"
+#include "fixture.c"
+
+static const char *files[] = {
+  "example_2000.dwg",
+  "2000/Leader_2000.dwg",
+  "2004/Leader_2004.dwg",
+  "2007/Leader_2007.dwg",
+};
+
+static void *
+payload(const Dwg_Object *obj)
+{
+  if (obj->supertype == DWG_SUPERTYPE_ENTITY && obj->tio.entity)
+    return obj->tio.entity->tio.UNKNOWN_ENT;
+  if (obj->supertype == DWG_SUPERTYPE_OBJECT && obj->tio.object)
+    return obj->tio.object->tio.UNKNOWN_OBJ;
+  return NULL;
+}
+
+/* the chunks double in size: n payloads need at most log2(n) + 1 */
+static int
+max_chunks(long unsigned int n)
+{
+  int chunks = 1;
+
+  while (n >>= 1)
+    chunks++;
+  return chunks;
+}
+
+static int
+check(const char *path, Dwg_Data *dwg)
+{
+  long unsigned int i, j, num_types = 0, num_adjacent = 0;
+  char *seen = calloc(dwg->num_objects, 1);
+
+  for (i = 0; i < dwg->num_objects; i++)
+    {
+      const Dwg_Object *obj = &dwg->object[i];
+      const char *prev, *cur;
+      long unsigned int n = 1, size = 0;
+      int chunks = 1;
+
+      if (seen[i] || !(prev = payload(obj)))
+        continue;
+      seen[i] = 1;
+      num_types++;
+      for (j = i + 1; j < dwg->num_objects; j++)
+        {
+          const Dwg_Object *next = &dwg->object[j];
+          if (next->type != obj->type || !(cur = payload(next)))
+            continue;
+          seen[j] = 1;
+          n++;
+          if (!size)
+            size = cur - prev;
+          if (cur - prev == (long)size)
+            num_adjacent++;
+          else
+            chunks++;
+          prev = cur;
+        }
+      if (chunks > max_chunks(n))
+        {
+          printf("not ok: %s: type %u: %lu payloads in %d chunks\n", path,
+                 obj->type, n, chunks);
+          free(seen);
+          return 1;
+        }
+    }
+  free(seen);
+  if (!num_adjacent)
+    {
+      printf("not ok: %s: no adjacent payloads\n", path);
+      return 1;
+    }
+  printf("ok: %s: %lu types, %lu adjacent payloads\n", path, num_types,
+         num_adjacent);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  return test_files(files, NUM_FILES(files), 0, check) ? 1 : 0;
+}
@@ -0,0 +1,281 @@
+/* Decode DWG files and check that the spatial index of the model space
+   finds the same entities as a scan over their extents, for windows of
+   all sizes, and again after saving and loading it. With deferred
+   handles it finds the same and leaves them deferred, and it is built
+   again when the stamp of the drawing changed. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwg.h"
+#include "spatial.h"
+#include "fixture.c"
+
+static const char *files[] = {
+  "example_2000.dwg",
+  "r14/Leader_r14.dwg",
+  "2004/Leader_2004.dwg",
+  "2007/Leader_2007.dwg",
+};
+
+#define SIDX_FILE "spatial.sidx"
+
+static int
+is_subentity(const Dwg_Object *obj)
+{
+  return obj->type == DWG_TYPE_ATTRIB || obj->type == DWG_TYPE_SEQEND
+         || obj->type == DWG_TYPE_VERTEX_2D || obj->type == DWG_TYPE_VERTEX_3D
+         || obj->type == DWG_TYPE_VERTEX_MESH
+         || obj->type == DWG_TYPE_VERTEX_PFACE
+         || obj->type == DWG_TYPE_VERTEX_PFACE_FACE;
+}
+
+static int
+overlaps(const Dwg_BBox *a, const Dwg_BBox *b)
+{
+  return a->xmin <= b->xmax && b->xmin <= a->xmax && a->ymin <= b->ymax
+         && b->ymin <= a->ymax;
+}
+
+static int
+compare_index(const void *a, const void *b)
+{
+  unsigned int ia = *(const unsigned int *)a, ib = *(const unsigned int *)b;
+  return ia < ib ? -1 : ia > ib;
+}
+
+/* the entities of block in window, by a scan and by a query */
+static int
+check_window(Dwg_Object *block, const Dwg_BBox *window)
+{
+  Dwg_Data *dwg = block->parent;
+  unsigned int *found = calloc(dwg->num_objects + 1, sizeof(unsigned int));
+  Dwg_Owned_Iterator iter;
+  Dwg_Object *obj;
+  long unsigned int num, expected = 0, i;
+  int failed = 0;
+
+  for (obj = dwg_first_owned(block, &iter); obj; obj = dwg_next_owned(&iter))
+    {
+      Dwg_BBox box;
+      if (!is_subentity(obj) && !dwg_entity_bbox(obj, &box)
+          && overlaps(&box, window))
+        expected++;
+    }
+  num = dwg_spatial_query(block, window, found, dwg->num_objects);
+  if (num != expected || dwg_spatial_query(block, window, NULL, 0) != num)
+    failed = 1;
+  qsort(found, num, sizeof(unsigned int), compare_index);
+  for (i = 0; i < num && !failed; i++)
+    {
+      Dwg_BBox box;
+      obj = &dwg->object[found[i]];
+      if ((i && found[i] == found[i - 1]) || dwg_entity_bbox(obj, &box)
+          || !overlaps(&box, window))
+        failed = 1;
+    }
+  free(found);
+  return failed;
+}
+
+/* the whole block, each quarter of it, and a point at each entity */
+static int
+check_block(Dwg_Object *block, long unsigned int *num_entities)
+{
+  Dwg_Owned_Iterator iter;
+  Dwg_Object *obj;
+  Dwg_BBox all = { 1e300, 1e300, -1e300, -1e300 };
+  int q;
+
+  *num_entities = 0;
+  for (obj = dwg_first_owned(block, &iter); obj; obj = dwg_next_owned(&iter))
+    {
+      Dwg_BBox box, point;
+      if (is_subentity(obj) || dwg_entity_bbox(obj, &box))
+        continue;
+      (*num_entities)++;
+      if (box.xmin < all.xmin)
+        all.xmin = box.xmin;
+      if (box.ymin < all.ymin)
+        all.ymin = box.ymin;
+      if (box.xmax > all.xmax)
+        all.xmax = box.xmax;
+      if (box.ymax > all.ymax)
+        all.ymax = box.ymax;
+      point.xmin = point.xmax = (box.xmin + box.xmax) / 2;
+      point.ymin = point.ymax = (box.ymin + box.ymax) / 2;
+      if (check_window(block, &point))
+        return 1;
+    }
+  if (!*num_entities
+      || dwg_spatial_query(block, &all, NULL, 0) != *num_entities)
+    return 1;
+  for (q = 0; q < 4; q++)
+    {
+      Dwg_BBox quarter = all;
+      double mx = (all.xmin + all.xmax) / 2, my = (all.ymin + all.ymax) / 2;
+      if (q & 1)
+        quarter.xmin = mx;
+      else
+        quarter.xmax = mx;
+      if (q & 2)
+        quarter.ymin = my;
+      else
+        quarter.ymax = my;
+      if (check_window(block, &quarter))
+        return 1;
+    }
+  return 0;
+}
+
+/* a LINE covers exactly its ends */
+static int
+check_lines(Dwg_Data *dwg)
+{
+  long unsigned int i;
+
+  for (i = 0; i < dwg->num_objects; i++)
+    {
+      Dwg_Object *obj = &dwg->object[i];
+      Dwg_Entity_LINE *line;
+      Dwg_BBox box;
+
+      if (obj->type != DWG_TYPE_LINE || !obj->tio.entity)
+        continue;
+      line = obj->tio.entity->tio.LINE;
+      if (dwg_entity_bbox(obj, &box)
+          || box.xmin != (line->start.x < line->end.x ? line->start.x
+                                                      : line->end.x)
+          || box.ymax != (line->start.y > line->end.y ? line->start.y
+                                                      : line->end.y))
+        return 1;
+    }
+  return 0;
+}
+
+static int
+check(const char *path, Dwg_Data *dwg)
+{
+  Dwg_Object_Ref *mspace = dwg->header_vars.BLOCK_RECORD_MSPACE;
+  long unsigned int num_entities;
+
+  if (!mspace || !mspace->obj || check_lines(dwg))
+    {
+      printf("not ok: %s: extents\n", path);
+      return 1;
+    }
+  if (check_block(mspace->obj, &num_entities))
+    {
+      printf("not ok: %s: model space windows\n", path);
+      return 1;
+    }
+  printf("ok: %s: %lu model space entities\n", path, num_entities);
+  return 0;
+}
+
+static long unsigned int
+num_deferred(const Dwg_Data *dwg)
+{
+  long unsigned int i, num = 0;
+
+  for (i = 0; i < dwg->num_objects; i++)
+    num += dwg->object[i].handles_deferred;
+  return num;
+}
+
+/* the same extents, eager and with deferred handles, which stay so */
+static int
+check_lazy(const char *path, Dwg_Data *dwg, Dwg_Data *lazy)
+{
+  Dwg_Object_Ref *mspace = lazy->header_vars.BLOCK_RECORD_MSPACE;
+  Dwg_BBox all = { -1e300, -1e300, 1e300, 1e300 };
+  long unsigned int i, deferred = num_deferred(lazy);
+  int failed = !mspace || !mspace->obj || dwg->num_objects != lazy->num_objects;
+
+  if (!failed
+      && dwg_spatial_query(mspace->obj, &all, NULL, 0)
+             != dwg_spatial_query(&dwg->object[mspace->obj->index], &all,
+                                  NULL, 0))
+    failed = 1;
+  for (i = 0; !failed && i < lazy->num_objects; i++)
+    {
+      Dwg_BBox a, b;
+      int ea = dwg_entity_bbox(&dwg->object[i], &a);
+      int eb = dwg_entity_bbox(&lazy->object[i], &b);
+      if (ea != eb || (!ea && memcmp(&a, &b, sizeof(Dwg_BBox))))
+        failed = 1;
+    }
+  if (num_deferred(lazy) != deferred)
+    failed = 1;
+  return test_result(failed, "%s: %lu deferred, the same extents", path,
+                     deferred);
+}
+
+/* a new TDUPDATE, as when saved again, builds it again */
+static int
+check_stamp(const char *path, Dwg_Data *dwg)
+{
+  Dwg_Object_Ref *mspace = dwg->header_vars.BLOCK_RECORD_MSPACE;
+  Dwg_BBox all = { -1e300, -1e300, 1e300, 1e300 };
+  const Dwg_Spatial_Index *spatial;
+  int failed;
+
+  failed = !mspace || !mspace->obj
+           || !dwg_spatial_query(mspace->obj, &all, NULL, 0)
+           || !(spatial = (const Dwg_Spatial_Index *)dwg->spatial_index)
+           || spatial->stamp.days != dwg->header_vars.TDUPDATE.days;
+  dwg->header_vars.TDUPDATE.days++;
+  if (!failed
+      && (!dwg_spatial_query(mspace->obj, &all, NULL, 0)
+          || !(spatial = (const Dwg_Spatial_Index *)dwg->spatial_index)
+          || spatial->stamp.days != dwg->header_vars.TDUPDATE.days))
+    failed = 1;
+  return test_result(failed, "%s: built again for a new TDUPDATE", path);
+}
+
+/* saved and loaded by the same drawing only */
+static int
+check_file(const char *path, const char *other)
+{
+  Dwg_Data dwg;
+  int failures = 0;
+
+  memset(&dwg, 0, sizeof(Dwg_Data));
+  dwg.opts = DWG_OPTS_SPATIAL;
+  if (dwg_read_file((char *)path, &dwg) || !dwg.spatial_index
+      || dwg_spatial_write(&dwg, SIDX_FILE))
+    failures++;
+  dwg_free(&dwg);
+
+  memset(&dwg, 0, sizeof(Dwg_Data));
+  if (!failures && (dwg_read_file((char *)path, &dwg)
+                    || dwg_spatial_read(&dwg, SIDX_FILE) || !dwg.spatial_index
+                    || check(path, &dwg)))
+    failures++;
+  dwg_free(&dwg);
+
+  memset(&dwg, 0, sizeof(Dwg_Data));
+  if (!failures && (dwg_read_file((char *)other, &dwg)
+                    || !dwg_spatial_read(&dwg, SIDX_FILE) || dwg.spatial_index))
+    failures++;
+  dwg_free(&dwg);
+  remove(SIDX_FILE);
+  return test_result(failures, "%s saved and loaded", path);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int failures = test_files(files, NUM_FILES(files), 0, check);
+  char *path = test_path(files[0]);
+  char *other = test_path(files[2]);
+
+  failures += check_file(path, other);
+  failures += test_file_pairs(files, NUM_FILES(files), 0,
+                              DWG_OPTS_LAZY_HANDLES, check_lazy);
+  failures += test_files(files, NUM_FILES(files), 0, check_stamp);
+  free(path);
+  free(other);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,115 @@
+/* Decode DWG files with DWG_OPTS_STATS, and check that every object is
+   counted by its type, and that the counts add up over two drawings. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwg.h"
+#include "common.h"
+#include "fixture.c"
+
+static const char *files[] = {
+  "example_2000.dwg",
+  "2004/Leader_2004.dwg",
+  "2007/Leader_2007.dwg",
+};
+
+static long unsigned int
+num_counted(const Dwg_Stats *stats)
+{
+  long unsigned int num = 0;
+  int i;
+
+  for (i = 0; i < DWG_STATS_TYPES; i++)
+    num += stats->type[i].count;
+  return num;
+}
+
+static int
+check(const char *path, Dwg_Stats *stats, int opts)
+{
+  Dwg_Data dwg;
+  long unsigned int num_objects, num_refs;
+  Dwg_Stats before = *stats;
+  int i;
+
+  memset(&dwg, 0, sizeof(Dwg_Data));
+  dwg.opts = opts | DWG_OPTS_STATS;
+  dwg.stats = stats;
+  if (dwg_read_file((char *)path, &dwg) || dwg.stats != stats)
+    {
+      printf("not ok: dwg_read_file %s\n", path);
+      dwg_free(&dwg);
+      return 1;
+    }
+  num_objects = dwg.num_objects;
+  num_refs = dwg.num_object_refs;
+  for (i = 0; i < DWG_STATS_TYPES; i++)
+    if (stats->type[i].count != before.type[i].count
+        && !dwg_type_name(&dwg, i))
+      {
+        printf("not ok: %s: no name for type %d\n", path, i);
+        dwg_free(&dwg);
+        return 1;
+      }
+  dwg_free(&dwg);
+
+  if (num_counted(stats) - num_counted(&before) != num_objects
+      || stats->refs - before.refs != num_refs
+      || stats->allocations <= before.allocations
+      || stats->phase[DWG_PHASE_OBJECTS].cpu
+         < before.phase[DWG_PHASE_OBJECTS].cpu
+      || stats->running)
+    {
+      printf("not ok: %s: %lu of %lu objects counted\n", path,
+             num_counted(stats) - num_counted(&before), num_objects);
+      return 1;
+    }
+  if (dwg.header.version >= R_2004
+      && stats->section[SECTION_OBJECTS].count
+         == before.section[SECTION_OBJECTS].count)
+    {
+      printf("not ok: %s: objects section not counted\n", path);
+      return 1;
+    }
+  printf("ok: %s: %lu objects%s\n", path, num_objects,
+         opts & DWG_OPTS_SEQUENTIAL ? ", sequential" : "");
+  return 0;
+}
+
+/* the same counts, in object map and in file offset order */
+static int
+check_file(const char *path)
+{
+  Dwg_Stats stats;
+
+  memset(&stats, 0, sizeof(Dwg_Stats));
+  return check(path, &stats, 0) + check(path, &stats, DWG_OPTS_SEQUENTIAL);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int failures = 0;
+  Dwg_Stats stats;
+  Dwg_Data dwg;
+  char *path;
+
+  failures += test_result(strcmp(dwg_type_name(NULL, DWG_TYPE_LINE), "LINE")
+                          || strcmp(dwg_type_name(NULL, DWG_TYPE__3DFACE),
+                                    "3DFACE")
+                          || dwg_type_name(NULL, 500),
+                          "dwg_type_name");
+  failures += test_paths(files, NUM_FILES(files), check_file);
+
+  /* without DWG_OPTS_STATS the pointer is not used */
+  path = test_path(files[0]);
+  memset(&dwg, 0, sizeof(Dwg_Data));
+  dwg.stats = &stats;
+  failures += test_result(dwg_read_file(path, &dwg) || dwg.stats,
+                          "stats without DWG_OPTS_STATS");
+  dwg_free(&dwg);
+  free(path);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,74 @@
+/* Decode DWG files with dwg_stream, and compare the objects handed to
+   the callback with those of dwg_read_file. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwg.h"
+#include "fixture.c"
+
+static const char *files[] = {
+  "example_2000.dwg",
+  "2000/Leader_2000.dwg",
+  "2004/Multiline.dwg",
+  "2007/Arc.dwg",
+  "r14/Leader_r14.dwg",
+};
+
+struct counts
+{
+  long unsigned int objects;
+  long unsigned int entities;
+  long unsigned int handles; /* sum of all handles */
+};
+
+static int
+count(Dwg_Object *obj, void *userdata)
+{
+  struct counts *c = (struct counts *)userdata;
+
+  c->objects++;
+  if (obj->supertype == DWG_SUPERTYPE_ENTITY)
+    c->entities++;
+  c->handles += obj->handle.value;
+  /* keep every other object */
+  return (c->objects & 1) ? DWG_STREAM_KEEP : DWG_STREAM_FREE;
+}
+
+static int
+check(const char *path)
+{
+  Dwg_Stream_Callbacks callbacks = { count };
+  Dwg_Data dwg;
+  struct counts expected, got;
+  long unsigned int j;
+
+  memset(&expected, 0, sizeof(expected));
+  memset(&got, 0, sizeof(got));
+  if (test_read(path, &dwg, 0))
+    {
+      dwg_free(&dwg);
+      return 1;
+    }
+  for (j = 0; j < dwg.num_objects; j++)
+    {
+      expected.objects++;
+      if (dwg.object[j].supertype == DWG_SUPERTYPE_ENTITY)
+        expected.entities++;
+      expected.handles += dwg.object[j].handle.value;
+    }
+  dwg_free(&dwg);
+
+  return test_result(dwg_stream((char *)path, &callbacks, &got)
+                         || memcmp(&got, &expected, sizeof(got)),
+                     "dwg_stream %s: %lu objects, %lu entities, "
+                     "expected %lu, %lu", path, got.objects, got.entities,
+                     expected.objects, expected.entities);
+}
+
+int
+main(int argc, char *argv[])
+{
+  return test_paths(files, NUM_FILES(files), check) ? 1 : 0;
+}
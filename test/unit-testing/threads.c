@@ -0,0 +1,207 @@
+/* Decode the same DWG files concurrently from several threads, and compare
+   a digest of the objects of each result with a sequential decode. Then
+   query the indices of one drawing from several threads at once, the
+   first query building them. Build with -fsanitize=thread to check the
+   decoder for data races. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "dwg.h"
+#include "fixture.c"
+
+#define NUM_THREADS 4
+#define NUM_ROUNDS 3
+
+static const char *files[] = {
+  "example_2000.dwg",
+  "sample_2000.dwg",
+  "2000/Line.dwg",
+  "2000/Leader_2000.dwg",
+  "2000/Text.dwg",
+  "2004/Arc.dwg",
+  "2004/Leader_2004.dwg",
+  "2004/Multiline.dwg",
+  "2007/Arc.dwg",
+  "2007/Leader_2007.dwg",
+  "r14/Leader_r14.dwg",
+};
+static char *paths[NUM_FILES(files)];
+static long unsigned int digests[NUM_FILES(files)];
+
+static long unsigned int
+mix(long unsigned int digest, long unsigned int value)
+{
+  return (digest ^ value) * 16777619UL;
+}
+
+/* A digest of the decoded objects, or 0 if the file was not decoded */
+static long unsigned int
+decode(const char *path)
+{
+  Dwg_Data dwg;
+  long unsigned int digest = 2166136261UL;
+  long unsigned int i;
+
+  memset(&dwg, 0, sizeof(Dwg_Data));
+  if (dwg_read_file((char *)path, &dwg))
+    return 0;
+  digest = mix(digest, dwg.num_objects);
+  for (i = 0; i < dwg.num_objects; i++)
+    {
+      Dwg_Object *obj = &dwg.object[i];
+
+      digest = mix(digest, obj->type);
+      digest = mix(digest, obj->supertype);
+      digest = mix(digest, obj->handle.value);
+      digest = mix(digest, obj->address);
+      digest = mix(digest, obj->size);
+      digest = mix(digest, obj->bitsize);
+      if (obj->supertype == DWG_SUPERTYPE_ENTITY && obj->tio.entity)
+        {
+          Dwg_Object_Entity *ent = obj->tio.entity;
+          digest = mix(digest, ent->num_eed);
+          digest = mix(digest, ent->num_reactors);
+          digest = mix(digest, ent->entity_mode);
+          digest = mix(digest, ent->color.index);
+        }
+      else if (obj->supertype == DWG_SUPERTYPE_OBJECT && obj->tio.object)
+        {
+          digest = mix(digest, obj->tio.object->num_eed);
+          digest = mix(digest, obj->tio.object->num_reactors);
+        }
+    }
+  dwg_free(&dwg);
+  return digest ? digest : 1;
+}
+
+static void *
+worker(void *arg)
+{
+  long id = (long)arg;
+  long failures = 0;
+  int i, r;
+
+  for (r = 0; r < NUM_ROUNDS; r++)
+    for (i = 0; i < NUM_FILES(files); i++)
+      {
+        /* each thread starts at another file */
+        int f = (i + (int)id) % NUM_FILES(files);
+        long unsigned int digest = decode(paths[f]);
+        if (digest != digests[f])
+          {
+            printf("thread %ld: %s: digest %lX, expected %lX\n", id,
+                   paths[f], digest, digests[f]);
+            failures++;
+          }
+      }
+  return (void *)failures;
+}
+
+static Dwg_Data shared;
+
+struct query
+{
+  const unsigned int *lines;
+  unsigned int num;
+  Dwg_Object *layer;
+  long unsigned int num_found;
+};
+
+/* the first query of the shared drawing, racing the other threads */
+static void *
+query(void *arg)
+{
+  struct query *q = (struct query *)arg;
+  Dwg_Object_Ref *mspace = shared.header_vars.BLOCK_RECORD_MSPACE;
+  Dwg_BBox all = { -1e300, -1e300, 1e300, 1e300 };
+
+  q->lines = dwg_objects_of_type(&shared, DWG_TYPE_LINE, &q->num);
+  q->layer = dwg_find_layer(&shared, "0");
+  q->num_found = mspace && mspace->obj
+                     ? dwg_spatial_query(mspace->obj, &all, NULL, 0)
+                     : 0;
+  return NULL;
+}
+
+/* The LINEs, the layer "0" and the model space entities of path,
+   queried at once by all threads, which must find the same, and as many
+   LINEs as a sequential query */
+static long
+shared_queries(const char *path)
+{
+  pthread_t threads[NUM_THREADS];
+  struct query queries[NUM_THREADS];
+  Dwg_Data dwg;
+  unsigned int num = 0;
+  long failures = 0;
+  int i;
+
+  memset(&dwg, 0, sizeof(Dwg_Data));
+  if (dwg_read_file((char *)path, &dwg))
+    failures++;
+  else
+    dwg_objects_of_type(&dwg, DWG_TYPE_LINE, &num);
+  dwg_free(&dwg);
+  memset(&shared, 0, sizeof(Dwg_Data));
+  if (failures || dwg_read_file((char *)path, &shared) || shared.type_index)
+    {
+      dwg_free(&shared);
+      return 1;
+    }
+  for (i = 0; i < NUM_THREADS; i++)
+    if (pthread_create(&threads[i], NULL, query, &queries[i]))
+      {
+        printf("pthread_create failed\n");
+        exit(1);
+      }
+  for (i = 0; i < NUM_THREADS; i++)
+    pthread_join(threads[i], NULL);
+  for (i = 0; i < NUM_THREADS; i++)
+    if (queries[i].lines != queries[0].lines || queries[i].num != num
+        || !queries[i].layer || queries[i].layer != queries[0].layer
+        || queries[i].num_found != queries[0].num_found)
+      failures++;
+  dwg_free(&shared);
+  return failures;
+}
+
+int
+main(int argc, char *argv[])
+{
+  pthread_t threads[NUM_THREADS];
+  long failures = 0;
+  int i;
+
+  for (i = 0; i < NUM_FILES(files); i++)
+    {
+      paths[i] = test_path(files[i]);
+      digests[i] = decode(paths[i]);
+      if (!digests[i])
+        failures += test_result(1, "%s: sequential decode", paths[i]);
+    }
+  for (i = 0; i < NUM_THREADS; i++)
+    if (pthread_create(&threads[i], NULL, worker, (void *)(long)i))
+      {
+        printf("pthread_create failed\n");
+        return 1;
+      }
+  for (i = 0; i < NUM_THREADS; i++)
+    {
+      void *ret;
+      pthread_join(threads[i], &ret);
+      failures += (long)ret;
+    }
+  failures = test_result(failures != 0, "%d threads x %d files x %d rounds: "
+                         "%ld failures", NUM_THREADS, NUM_FILES(files),
+                         NUM_ROUNDS, failures);
+  for (i = 0; i < NUM_FILES(files); i++)
+    failures += test_result(shared_queries(paths[i]) != 0,
+                            "%s: %d threads building the indices",
+                            paths[i], NUM_THREADS);
+  for (i = 0; i < NUM_FILES(files); i++)
+    free(paths[i]);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,130 @@
+/* Decode DWG files and check that the type index lists the objects of
+   each type, of the drawing and of the model space, as a scan finds
+   them, and that dwg_get_LINE() returns them. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwg.h"
+#include "fixture.c"
+#include "dwg_api.h"
+
+static const char *files[] = {
+  "example_2000.dwg",
+  "r14/Leader_r14.dwg",
+  "2004/Leader_2004.dwg",
+  "2007/Leader_2007.dwg",
+};
+
+static int
+check_drawing(Dwg_Data *dwg)
+{
+  long unsigned int i, total = 0;
+  unsigned int type, num, j;
+
+  for (type = 0; type < 1024; type++)
+    {
+      const unsigned int *objects = dwg_objects_of_type(dwg, type, &num);
+      total += num;
+      for (i = 0, j = 0; i < dwg->num_objects; i++)
+        if (dwg->object[i].type == type)
+          {
+            if (j >= num || objects[j] != i)
+              return 1;
+            j++;
+          }
+      if (j != num)
+        return 1;
+      if (num && dwg_objects_of_type(dwg, type, &j) != objects)
+        return 1;
+    }
+  return total != dwg->num_objects;
+}
+
+static int
+check_block(Dwg_Object *block)
+{
+  Dwg_Data *dwg = block->parent;
+  char *owned = calloc(dwg->num_objects, 1);
+  Dwg_Owned_Iterator iter;
+  Dwg_Object *obj;
+  unsigned int type, num, j;
+  long unsigned int i, total = 0, num_owned = 0;
+  int failed = 0;
+
+  for (obj = dwg_first_owned(block, &iter); obj; obj = dwg_next_owned(&iter))
+    {
+      owned[obj->index] = 1;
+      num_owned++;
+    }
+  for (type = 0; type < 1024 && !failed; type++)
+    {
+      const unsigned int *objects
+          = dwg_block_objects_of_type(block, type, &num);
+      total += num;
+      for (i = 0, j = 0; i < dwg->num_objects; i++)
+        if (owned[i] && dwg->object[i].type == type)
+          {
+            if (j >= num || objects[j] != i)
+              failed = 1;
+            j++;
+          }
+      if (j != num)
+        failed = 1;
+    }
+  free(owned);
+  return failed || total != num_owned || !num_owned;
+}
+
+static int
+check(const char *path, Dwg_Data *dwg)
+{
+  Dwg_Object_Ref *mspace = dwg->header_vars.BLOCK_RECORD_MSPACE;
+  Dwg_Entity_LINE **lines;
+  Dwg_Object_Entity **entities;
+  const unsigned int *objects;
+  unsigned int num_lines, num_entities, i;
+
+  if (check_drawing(dwg))
+    {
+      printf("not ok: %s: objects of type\n", path);
+      return 1;
+    }
+  if (!mspace || !mspace->obj || check_block(mspace->obj))
+    {
+      printf("not ok: %s: model space objects of type\n", path);
+      return 1;
+    }
+  objects = dwg_block_objects_of_type(mspace->obj, DWG_TYPE_LINE, &num_lines);
+  lines = dwg_get_LINE(mspace);
+  for (i = 0; lines && lines[i] && i < num_lines; i++)
+    if (lines[i] != dwg->object[objects[i]].tio.entity->tio.LINE)
+      break;
+  free(lines);
+  if (i != num_lines)
+    {
+      printf("not ok: %s: %u of %u LINEs\n", path, i, num_lines);
+      return 1;
+    }
+  for (i = 0, num_entities = 0; i < dwg->num_objects; i++)
+    if (dwg->object[i].supertype == DWG_SUPERTYPE_ENTITY)
+      num_entities++;
+  entities = dwg_get_entities(dwg);
+  for (i = 0; entities && entities[i]; i++)
+    ;
+  free(entities);
+  if (i != num_entities)
+    {
+      printf("not ok: %s: %u of %u entities\n", path, i, num_entities);
+      return 1;
+    }
+  printf("ok: %s: %u model space LINEs\n", path, num_lines);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  return test_files(files, NUM_FILES(files), 0, check) ? 1 : 0;
+}
@@ -0,0 +1,128 @@
+/* Decode DWG files and check that the xdata of each XRECORD is one
+   contiguous resbuf array, followed by the string data of its items.
+   Then set a malloc'ed list into one, for dwg_free to free: run with
+   "make check-valgrind" or -fsanitize=address to catch a leak. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwg.h"
+#include "fixture.c"
+#include "dwg_api.h"
+
+static const char *files[] = {
+  "example_2000.dwg",
+  "2000/Leader_2000.dwg",
+  "2004/Leader_2004.dwg",
+  "2007/Leader_2007.dwg",
+};
+
+/* the common string and binary group codes */
+static int
+is_string(short type)
+{
+  return (type >= 1 && type <= 4) || (type >= 6 && type <= 9)
+    || (type >= 300 && type <= 319) || (type >= 1000 && type <= 1009);
+}
+
+static int
+check_xrecord(Dwg_Object *obj)
+{
+  int error;
+  dwg_obj_xrecord *xrecord = dwg_object_to_XRECORD(obj);
+  unsigned int i, num = dwg_obj_xrecord_get_num_eed(xrecord, &error);
+  Dwg_Resbuf *xdata = dwg_obj_xrecord_get_xdata(xrecord, &error);
+  const char *str;
+
+  if (!num)
+    return xdata != NULL;
+  if (!xdata)
+    return 1;
+  str = (const char *)&xdata[num];
+  for (i = 0; i < num; i++)
+    {
+      if (xdata[i].next != (i + 1 < num ? &xdata[i + 1] : NULL))
+        return 1;
+      if (is_string(xdata[i].type) && xdata[i].value.str.u.data)
+        {
+          /* the strings follow the array in item order */
+          if (xdata[i].value.str.u.data < str)
+            return 1;
+          str = xdata[i].value.str.u.data;
+        }
+    }
+  return 0;
+}
+
+static Dwg_Resbuf *
+new_item(short type, Dwg_Resbuf *next)
+{
+  Dwg_Resbuf *rbuf = calloc(1, sizeof(Dwg_Resbuf));
+  rbuf->type = type;
+  rbuf->next = next;
+  return rbuf;
+}
+
+/* a caller-built list of a string, a real and an int16 */
+static int
+set_list(Dwg_Object *obj)
+{
+  int error;
+  dwg_obj_xrecord *xrecord = dwg_object_to_XRECORD(obj);
+  Dwg_Resbuf *rbuf, *list = new_item(1, new_item(40, new_item(70, NULL)));
+  unsigned int num = 0;
+
+  list->value.str.size = 5;
+  list->value.str.u.data = malloc(6);
+  strcpy(list->value.str.u.data, "list");
+  list->next->value.dbl = 1.5;
+  list->next->next->value.i16 = 7;
+  dwg_obj_xrecord_set_xdata(xrecord, list, &error);
+  if (error)
+    return 1;
+  for (rbuf = dwg_obj_xrecord_get_xdata(xrecord, &error); rbuf;
+       rbuf = rbuf->next)
+    num++;
+  return num != 3;
+}
+
+static int
+check(const char *path, Dwg_Data *dwg)
+{
+  Dwg_Object *last = NULL;
+  long unsigned int i, xrecords = 0, items = 0;
+
+  for (i = 0; i < dwg->num_objects; i++)
+    {
+      Dwg_Object *obj = &dwg->object[i];
+      if (obj->type != DWG_TYPE_XRECORD || !obj->tio.object)
+        continue;
+      if (check_xrecord(obj))
+        {
+          printf("not ok: %s: XRECORD %lu xdata\n", path, obj->handle.value);
+          return 1;
+        }
+      xrecords++;
+      items += obj->tio.object->tio.XRECORD->num_eed;
+      last = obj;
+    }
+  if (!items)
+    {
+      printf("not ok: %s: no xdata\n", path);
+      return 1;
+    }
+  if (set_list(last))
+    {
+      printf("not ok: %s: xdata list\n", path);
+      return 1;
+    }
+  printf("ok: %s: %lu xdata items in %lu XRECORDs\n", path, items, xrecords);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  return test_files(files, NUM_FILES(files), 0, check) ? 1 : 0;
+}
@@ -0,0 +1,228 @@
+/* Decode DWG files from memory with DWG_OPTS_ZERO_COPY, compare their
+   binary payloads with a normal decode, check that some of them are
+   slices of the input, and that dwg_detach() leaves nothing pointing
+   into the released input. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwg.h"
+#include "bits.h"
+#include "decode.h"
+#include "fixture.c"
+
+static const char *files[] = {
+  "example_2000.dwg",
+  "2000/Leader_2000.dwg",
+  "2004/Leader_2004.dwg",
+  "r14/Leader_r14.dwg",
+};
+
+static const unsigned char *input;
+static long unsigned int input_size;
+static long unsigned int num_slices;
+
+static int
+is_slice(const void *ptr)
+{
+  return (const unsigned char *)ptr >= input
+         && (const unsigned char *)ptr < input + input_size;
+}
+
+/* a and b are equal and b does not point into the input */
+static int
+compare_payload(const void *a, const void *b, long unsigned int size,
+                int detached)
+{
+  if (!a || !b)
+    return a != b;
+  if (is_slice(b))
+    {
+      if (detached)
+        return 1;
+      num_slices++;
+    }
+  return memcmp(a, b, size) != 0;
+}
+
+static int
+compare_object(Dwg_Data *dwg, Dwg_Object *a, Dwg_Object *b, int detached)
+{
+  unsigned int j;
+
+  if (a->type != b->type || a->supertype != b->supertype)
+    return 1;
+  if (!a->tio.unknown || !b->tio.unknown)
+    return a->tio.unknown != b->tio.unknown;
+  if (a->supertype == DWG_SUPERTYPE_ENTITY)
+    {
+      Dwg_Object_Entity *ea = a->tio.entity, *eb = b->tio.entity;
+      if (ea->picture_size != eb->picture_size
+          || compare_payload(ea->picture, eb->picture, ea->picture_size,
+                             detached))
+        return 1;
+      switch (a->type)
+        {
+        case DWG_TYPE_OLE2FRAME:
+          return compare_payload(ea->tio.OLE2FRAME->data,
+                                 eb->tio.OLE2FRAME->data,
+                                 ea->tio.OLE2FRAME->data_length, detached);
+        case DWG_TYPE_REGION:
+        case DWG_TYPE_3DSOLID:
+        case DWG_TYPE_BODY:
+          if (ea->tio._3DSOLID->num_blocks != eb->tio._3DSOLID->num_blocks)
+            return 1;
+          for (j = 0; j < ea->tio._3DSOLID->num_blocks; j++)
+            if (compare_payload(ea->tio._3DSOLID->sat_data[j],
+                                eb->tio._3DSOLID->sat_data[j],
+                                ea->tio._3DSOLID->block_size[j], detached))
+              return 1;
+          break;
+        default:
+          break;
+        }
+    }
+  else if (a->supertype == DWG_SUPERTYPE_UNKNOWN && a->type >= 500
+           && a->type - 500 < (long)dwg->num_classes)
+    {
+      /* only the raw unknown objects without class are compared */
+      return 0;
+    }
+  else if (a->supertype == DWG_SUPERTYPE_UNKNOWN)
+    return compare_payload(a->tio.unknown, b->tio.unknown, a->size,
+                           detached);
+  return 0;
+}
+
+static int
+compare(const char *path, Dwg_Data *a, Dwg_Data *b, int detached)
+{
+  long unsigned int i;
+
+  if (a->picture.size != b->picture.size
+      || compare_payload(a->picture.chain, b->picture.chain, a->picture.size,
+                         detached))
+    return test_result(1, "%s: preview differs%s", path,
+                       detached ? " after dwg_detach" : "");
+  if (a->num_objects != b->num_objects)
+    return test_result(1, "%s: %lu objects, expected %lu", path,
+                       b->num_objects, a->num_objects);
+  for (i = 0; i < a->num_objects; i++)
+    if (compare_object(a, &a->object[i], &b->object[i], detached))
+      return test_result(1, "%s: object %lu differs%s", path, i,
+                         detached ? " after dwg_detach" : "");
+  return 0;
+}
+
+/* only byte-aligned data in the input is a slice */
+static int
+check_decode_raw(void)
+{
+  unsigned char buf[16] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+  Dwg_Data dwg;
+  Bit_Chain dat;
+  char *raw, *copy;
+  int failures = 0;
+
+  memset(&dwg, 0, sizeof(Dwg_Data));
+  memset(&dat, 0, sizeof(Bit_Chain));
+  dwg.opts = DWG_OPTS_ZERO_COPY;
+  dwg.input = dat.chain = buf;
+  dwg.input_size = dat.size = sizeof(buf);
+  dat.byte = 2;
+  raw = dwg_decode_raw(&dwg, &dat, 4);
+  if (raw != (char *)&buf[2] || dat.byte != 6)
+    failures++;
+  dat.bit = 4;
+  copy = dwg_decode_raw(&dwg, &dat, 2);
+  if (copy == (char *)&buf[6] || (unsigned char)copy[0] != 0x70
+      || dat.byte != 8)
+    failures++;
+  dat.bit = 0;
+  dwg.opts = 0;
+  copy = dwg_decode_raw(&dwg, &dat, 2);
+  if (copy == (char *)&buf[8] || memcmp(copy, &buf[8], 2))
+    failures++;
+  dwg.input = NULL;
+  dwg_free(&dwg);
+  return test_result(failures, "dwg_decode_raw");
+}
+
+static unsigned char *
+read_input(const char *path, long unsigned int *size)
+{
+  FILE *fp = fopen(path, "rb");
+  unsigned char *buf;
+  long len;
+
+  if (!fp)
+    return NULL;
+  fseek(fp, 0, SEEK_END);
+  len = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  buf = malloc(len);
+  if (buf && fread(buf, 1, len, fp) != (size_t)len)
+    {
+      free(buf);
+      buf = NULL;
+    }
+  fclose(fp);
+  *size = len;
+  return buf;
+}
+
+static int
+check(const char *path)
+{
+  Dwg_Data dwg, zc;
+  unsigned char *buf;
+  int failures = 0;
+
+  memset(&dwg, 0, sizeof(Dwg_Data));
+  memset(&zc, 0, sizeof(Dwg_Data));
+  zc.opts = DWG_OPTS_ZERO_COPY;
+  buf = read_input(path, &input_size);
+  input = buf;
+  num_slices = 0;
+  if (!buf || dwg_read_file((char *)path, &dwg)
+      || dwg_read_memory(buf, input_size, &zc))
+    failures += test_result(1, "decode %s", path);
+  else if (compare(path, &dwg, &zc, 0))
+    failures++;
+  /* the preview before R2004 starts on a byte */
+  else if (!num_slices && zc.header.version < R_2004)
+    failures += test_result(1, "%s: nothing sliced", path);
+  else if (dwg_detach(&zc) || zc.input || (zc.opts & DWG_OPTS_ZERO_COPY))
+    failures += test_result(1, "%s: dwg_detach", path);
+  else
+    {
+      long unsigned int sliced = num_slices;
+      /* the input may be released now */
+      memset(buf, 0xff, input_size);
+      if (compare(path, &dwg, &zc, 1))
+        failures++;
+      else
+        test_result(0, "%s: %lu slices", path, sliced);
+    }
+  dwg_free(&dwg);
+  dwg_free(&zc);
+  free(buf);
+
+  /* the file is released before dwg_read_file returns */
+  memset(&zc, 0, sizeof(Dwg_Data));
+  zc.opts = DWG_OPTS_ZERO_COPY;
+  if (dwg_read_file((char *)path, &zc) || zc.input)
+    failures += test_result(1, "dwg_read_file %s kept its input", path);
+  dwg_free(&zc);
+  return failures;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int failures = check_decode_raw();
+
+  failures += test_paths(files, NUM_FILES(files), check);
+  return failures ? 1 : 0;
+}